@@ -38,10 +38,13 @@ else
     LDD=ldd
 fi
 
-TEMP=`getopt -o v: --long headers:,libs:,cc:,cxx:,with-glog,with-thrift,with-mesalink,nodebugsymbols -n 'config_brpc' -- "$@"`
+TEMP=`getopt -o v: --long headers:,libs:,cc:,cxx:,with-glog,with-thrift,with-mesalink,with-io-uring,with-lz4,with-zstd,nodebugsymbols -n 'config_brpc' -- "$@"`
 WITH_GLOG=0
 WITH_THRIFT=0
 WITH_MESALINK=0
+WITH_IO_URING=0
+WITH_LZ4=0
+WITH_ZSTD=0
 DEBUGSYMBOLS=-g
 
 if [ $? != 0 ] ; then >&2 $ECHO "Terminating..."; exit 1 ; fi
@@ -65,6 +68,9 @@ while true; do
         --with-glog ) WITH_GLOG=1; shift 1 ;;
         --with-thrift) WITH_THRIFT=1; shift 1 ;;
         --with-mesalink) WITH_MESALINK=1; shift 1 ;;
+        --with-io-uring) WITH_IO_URING=1; shift 1 ;;
+        --with-lz4) WITH_LZ4=1; shift 1 ;;
+        --with-zstd) WITH_ZSTD=1; shift 1 ;;
         --nodebugsymbols ) DEBUGSYMBOLS=; shift 1 ;;
         -- ) shift; break ;;
         * ) break ;;
@@ -174,6 +180,16 @@ if [ $WITH_MESALINK != 0 ]; then
     OPENSSL_HDR="$OPENSSL_HDR\n$MESALINK_HDR"
 fi
 
+if [ $WITH_LZ4 != 0 ]; then
+    LZ4_HDR=$(find_dir_of_header_or_die lz4frame.h)
+    LZ4_LIB=$(find_dir_of_lib_or_die lz4)
+fi
+
+if [ $WITH_ZSTD != 0 ]; then
+    ZSTD_HDR=$(find_dir_of_header_or_die zstd.h)
+    ZSTD_LIB=$(find_dir_of_lib_or_die zstd)
+fi
+
 STATIC_LINKINGS=
 DYNAMIC_LINKINGS="-lpthread -lssl -lcrypto -ldl -lz"
 
@@ -181,6 +197,14 @@ if [ $WITH_MESALINK != 0 ]; then
     DYNAMIC_LINKINGS="$DYNAMIC_LINKINGS -lmesalink"
 fi
 
+if [ $WITH_LZ4 != 0 ]; then
+    DYNAMIC_LINKINGS="$DYNAMIC_LINKINGS -llz4"
+fi
+
+if [ $WITH_ZSTD != 0 ]; then
+    DYNAMIC_LINKINGS="$DYNAMIC_LINKINGS -lzstd"
+fi
+
 if [ "$SYSTEM" = "Linux" ]; then
     DYNAMIC_LINKINGS="$DYNAMIC_LINKINGS -lrt"
 fi
@@ -261,8 +285,8 @@ fi
 PROTOBUF_HDR=$(find_dir_of_header_or_die google/protobuf/message.h)
 LEVELDB_HDR=$(find_dir_of_header_or_die leveldb/db.h)
 
-HDRS=$($ECHO "$GFLAGS_HDR\n$PROTOBUF_HDR\n$LEVELDB_HDR\n$OPENSSL_HDR" | sort | uniq)
-LIBS=$($ECHO "$GFLAGS_LIB\n$PROTOBUF_LIB\n$LEVELDB_LIB\n$OPENSSL_LIB\n$SNAPPY_LIB" | sort | uniq)
+HDRS=$($ECHO "$GFLAGS_HDR\n$PROTOBUF_HDR\n$LEVELDB_HDR\n$OPENSSL_HDR\n$LZ4_HDR\n$ZSTD_HDR" | sort | uniq)
+LIBS=$($ECHO "$GFLAGS_LIB\n$PROTOBUF_LIB\n$LEVELDB_LIB\n$OPENSSL_LIB\n$SNAPPY_LIB\n$LZ4_LIB\n$ZSTD_LIB" | sort | uniq)
 
 absent_in_the_list() {
     TMP=`$ECHO "$1\n$2" | sort | uniq`
@@ -356,6 +380,22 @@ if [ $WITH_MESALINK != 0 ]; then
     CPPFLAGS="${CPPFLAGS} -DUSE_MESALINK"
 fi
 
+if [ $WITH_IO_URING != 0 ]; then
+    if [ "$SYSTEM" = "Darwin" ]; then
+        >&2 $ECHO "io_uring is only available on Linux"
+        exit 1
+    fi
+    CPPFLAGS="${CPPFLAGS} -DBRPC_WITH_IO_URING"
+fi
+
+if [ $WITH_LZ4 != 0 ]; then
+    CPPFLAGS="${CPPFLAGS} -DBRPC_WITH_LZ4"
+fi
+
+if [ $WITH_ZSTD != 0 ]; then
+    CPPFLAGS="${CPPFLAGS} -DBRPC_WITH_ZSTD"
+fi
+
 append_to_output "CPPFLAGS=${CPPFLAGS}"
 append_to_output "# without the flag, linux+arm64 may crash due to folding on TLS.
 ifeq (\$(CC),gcc)
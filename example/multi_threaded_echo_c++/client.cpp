@@ -143,7 +143,8 @@ int main(int argc, char* argv[]) {
     while (!brpc::IsAskedToQuit()) {
         sleep(1);
         LOG(INFO) << "Sending EchoRequest at qps=" << g_latency_recorder.qps(1)
-                  << " latency=" << g_latency_recorder.latency(1);
+                  << " latency=" << g_latency_recorder.latency(1)
+                  << " latency_99=" << g_latency_recorder.latency_percentile(0.99);
     }
 
     LOG(INFO) << "EchoClient is going to quit";
@@ -22,6 +22,7 @@
 #include "butil/fd_utility.h"               // make_close_on_exec
 #include "butil/time.h"                     // gettimeofday_us
 #include "brpc/acceptor.h"
+#include <algorithm>                        // std::find
 
 
 namespace brpc {
@@ -35,9 +36,11 @@ Acceptor::Acceptor(bthread_keytable_pool_t* pool)
     , _idle_timeout_sec(-1)
     , _close_idle_tid(INVALID_BTHREAD)
     , _listened_fd(-1)
-    , _acception_id(0)
+    , _nacception(0)
     , _empty_cond(&_map_mutex)
-    , _ssl_ctx(NULL) {
+    , _ssl_ctx(NULL)
+    , _use_zerocopy(false)
+    , _bthread_tag(BTHREAD_TAG_DEFAULT) {
 }
 
 Acceptor::~Acceptor() {
@@ -51,44 +54,109 @@ int Acceptor::StartAccept(int listened_fd, int idle_timeout_sec,
         LOG(FATAL) << "Invalid listened_fd=" << listened_fd;
         return -1;
     }
-    
-    BAIDU_SCOPED_LOCK(_map_mutex);
-    if (_status == UNINITIALIZED) {
-        if (Initialize() != 0) {
-            LOG(FATAL) << "Fail to initialize Acceptor";
-            return -1;
+    return StartAcceptInternal(std::vector<int>(1, listened_fd), false,
+                               idle_timeout_sec, ssl_ctx);
+}
+
+int Acceptor::StartAccept(const std::vector<int>& listened_fds,
+                          int idle_timeout_sec,
+                          const std::shared_ptr<SocketSSLContext>& ssl_ctx) {
+    bool valid = !listened_fds.empty();
+    for (size_t i = 0; i < listened_fds.size(); ++i) {
+        if (listened_fds[i] < 0) {
+            LOG(FATAL) << "Invalid listened_fd=" << listened_fds[i];
+            valid = false;
         }
-        _status = READY;
     }
-    if (_status != READY) {
-        LOG(FATAL) << "Acceptor hasn't stopped yet: status=" << status();
+    if (!valid) {
+        for (size_t i = 0; i < listened_fds.size(); ++i) {
+            if (listened_fds[i] >= 0) {
+                close(listened_fds[i]);
+            }
+        }
         return -1;
     }
-    if (idle_timeout_sec > 0) {
-        if (bthread_start_background(&_close_idle_tid, NULL,
-                                     CloseIdleConnections, this) != 0) {
-            LOG(FATAL) << "Fail to start bthread";
-            return -1;
+    return StartAcceptInternal(listened_fds, true, idle_timeout_sec, ssl_ctx);
+}
+
+int Acceptor::StartAcceptInternal(
+    const std::vector<int>& listened_fds, bool by_dispatcher,
+    int idle_timeout_sec, const std::shared_ptr<SocketSSLContext>& ssl_ctx) {
+    // listened_fds[0, nowned) are owned by created Sockets. The rest are
+    // closed on failure if `by_dispatcher' is true, otherwise they're still
+    // owned by the caller.
+    size_t nowned = 0;
+    std::vector<SocketId> created_ids;
+    {
+        BAIDU_SCOPED_LOCK(_map_mutex);
+        if (_status == UNINITIALIZED) {
+            if (Initialize() != 0) {
+                LOG(FATAL) << "Fail to initialize Acceptor";
+                goto FAIL;
+            }
+            _status = READY;
+        }
+        if (_status != READY) {
+            LOG(FATAL) << "Acceptor hasn't stopped yet: status=" << status();
+            goto FAIL;
+        }
+        if (idle_timeout_sec > 0) {
+            if (bthread_start_background(&_close_idle_tid, NULL,
+                                         CloseIdleConnections, this) != 0) {
+                LOG(FATAL) << "Fail to start bthread";
+                goto FAIL;
+            }
+        }
+        _idle_timeout_sec = idle_timeout_sec;
+        _ssl_ctx = ssl_ctx;
+
+        // Creation of _acception_ids is inside lock so that OnNewConnections
+        // (which may run immediately) should see sane fields set below.
+        for (; nowned < listened_fds.size(); ++nowned) {
+            SocketOptions options;
+            options.fd = listened_fds[nowned];
+            options.user = this;
+            options.on_edge_triggered_events = OnNewConnections;
+            options.bthread_tag = _bthread_tag;
+            if (by_dispatcher) {
+                // Inherited by accepted connections.
+                options.dispatcher_index = (int)nowned;
+            }
+            SocketId id;
+            if (Socket::Create(options, &id) != 0) {
+                // Close-idle-socket thread will be stopped inside destructor
+                LOG(FATAL) << "Fail to create acception socket for fd="
+                           << listened_fds[nowned];
+                break;
+            }
+            created_ids.push_back(id);
+        }
+        _acception_ids = created_ids;
+        _nacception = created_ids.size();
+        _listened_fd = listened_fds[0];
+        if (nowned == listened_fds.size()) {
+            _status = RUNNING;
+            return 0;
+        }
+        if (!created_ids.empty()) {
+            // Join() waits for created Sockets to be recycled.
+            _status = STOPPING;
+        } else {
+            _listened_fd = -1;
         }
     }
-    _idle_timeout_sec = idle_timeout_sec;
-    _ssl_ctx = ssl_ctx;
-    
-    // Creation of _acception_id is inside lock so that OnNewConnections
-    // (which may run immediately) should see sane fields set below.
-    SocketOptions options;
-    options.fd = listened_fd;
-    options.user = this;
-    options.on_edge_triggered_events = OnNewConnections;
-    if (Socket::Create(options, &_acception_id) != 0) {
-        // Close-idle-socket thread will be stopped inside destructor
-        LOG(FATAL) << "Fail to create _acception_id";
-        return -1;
+    // SetFailed outside the lock since BeforeRecycle may be called inside.
+    for (size_t i = 0; i < created_ids.size(); ++i) {
+        Socket::SetFailed(created_ids[i]);
     }
-    
-    _listened_fd = listened_fd;
-    _status = RUNNING;
-    return 0;
+
+FAIL:
+    if (by_dispatcher) {
+        for (size_t i = nowned; i < listened_fds.size(); ++i) {
+            close(listened_fds[i]);
+        }
+    }
+    return -1;
 }
 
 void* Acceptor::CloseIdleConnections(void* arg) {
@@ -121,8 +189,10 @@ void Acceptor::StopAccept(int /*closewait_ms*/) {
         _status = STOPPING;
     }
 
-    // Don't set _acception_id to 0 because BeforeRecycle needs it.
-    Socket::SetFailed(_acception_id);
+    // Don't clear _acception_ids because BeforeRecycle needs it.
+    for (size_t i = 0; i < _acception_ids.size(); ++i) {
+        Socket::SetFailed(_acception_ids[i]);
+    }
 
     // SetFailed all existing connections. Connections added after this piece
     // of code will be SetFailed directly in OnNewConnectionsUntilEAGAIN
@@ -274,6 +344,10 @@ void Acceptor::OnNewConnectionsUntilEAGAIN(Socket* acception) {
         options.user = acception->user();
         options.on_edge_triggered_events = InputMessenger::OnNewMessages;
         options.initial_ssl_ctx = am->_ssl_ctx;
+        options.use_zerocopy = am->_use_zerocopy;
+        options.bthread_tag = am->_bthread_tag;
+        // Stay in the EventDispatcher of the listened fd.
+        options.dispatcher_index = acception->_dispatcher_index;
         if (Socket::Create(options, &socket_id) != 0) {
             LOG(ERROR) << "Fail to create Socket";
             continue;
@@ -325,12 +399,15 @@ void Acceptor::OnNewConnections(Socket* acception) {
 
 void Acceptor::BeforeRecycle(Socket* sock) {
     BAIDU_SCOPED_LOCK(_map_mutex);
-    if (sock->id() == _acception_id) {
-        // Set _listened_fd to -1 when acception socket has been recycled
-        // so that we are ensured no more events will arrive (and `Join'
-        // will return to its caller)
-        _listened_fd = -1;
-        _empty_cond.Broadcast();
+    if (std::find(_acception_ids.begin(), _acception_ids.end(), sock->id())
+        != _acception_ids.end()) {
+        // Set _listened_fd to -1 when all acception sockets have been
+        // recycled so that we are ensured no more events will arrive (and
+        // `Join' will return to its caller)
+        if (--_nacception == 0) {
+            _listened_fd = -1;
+            _empty_cond.Broadcast();
+        }
         return;
     }
     // If a Socket could not be addressed shortly after its creation, it
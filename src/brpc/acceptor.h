@@ -56,6 +56,16 @@ public:
     int StartAccept(int listened_fd, int idle_timeout_sec,
                     const std::shared_ptr<SocketSSLContext>& ssl_ctx);
 
+    // [thread-safe] Same as above, but accept connections from all
+    // `listened_fds', which are SO_REUSEPORT sockets bound to one address.
+    // Connections accepted from the i-th fd are handled by the i-th
+    // EventDispatcher. Ownership of the fds is transferred to `Acceptor'
+    // even if this function fails.
+    // Return 0 on success, -1 otherwise.
+    int StartAccept(const std::vector<int>& listened_fds,
+                    int idle_timeout_sec,
+                    const std::shared_ptr<SocketSSLContext>& ssl_ctx);
+
     // [thread-safe] Stop accepting connections.
     // `closewait_ms' is not used anymore.
     void StopAccept(int /*closewait_ms*/);
@@ -63,9 +73,13 @@ public:
     // Wait until all existing Sockets(defined in socket.h) are recycled.
     void Join();
 
-    // The parameter to StartAccept. Negative when acceptor is stopped.
+    // The parameter to StartAccept(the first one if there're multiple).
+    // Negative when acceptor is stopped.
     int listened_fd() const { return _listened_fd; }
 
+    // Number of fds accepting connections.
+    size_t listened_fd_count() const { return _acception_ids.size(); }
+
     // Get number of existing connections.
     size_t ConnectionCount() const;
 
@@ -77,6 +91,14 @@ public:
 
     Status status() const { return _status; }
 
+    // Accepted connections send with MSG_ZEROCOPY if this is true.
+    // Must be called before StartAccept.
+    void set_use_zerocopy(bool use_zerocopy) { _use_zerocopy = use_zerocopy; }
+
+    // Accept connections and process their messages in the worker pool
+    // `tag'. Must be called before StartAccept.
+    void set_bthread_tag(bthread_tag_t tag) { _bthread_tag = tag; }
+
 private:
     // Accept connections.
     static void OnNewConnectionsUntilEAGAIN(Socket* m);
@@ -87,6 +109,12 @@ private:
     // Initialize internal structure. 
     int Initialize();
 
+    // Implement StartAccept(). The i-th fd is bound to the i-th
+    // EventDispatcher if `by_dispatcher' is true.
+    int StartAcceptInternal(const std::vector<int>& listened_fds,
+                            bool by_dispatcher, int idle_timeout_sec,
+                            const std::shared_ptr<SocketSSLContext>& ssl_ctx);
+
     // Remove the accepted socket `sock' from inside
     void BeforeRecycle(Socket* sock) override;
 
@@ -96,8 +124,10 @@ private:
     bthread_t _close_idle_tid;
 
     int _listened_fd;
-    // The Socket tso accept connections.
-    SocketId _acception_id;
+    // The Sockets to accept connections, one for each listened fd.
+    std::vector<SocketId> _acception_ids;
+    // Number of Sockets in _acception_ids not recycled yet.
+    size_t _nacception;
 
     butil::Mutex _map_mutex;
     butil::ConditionVariable _empty_cond;
@@ -106,6 +136,10 @@ private:
     SocketMap _socket_map;
 
     std::shared_ptr<SocketSSLContext> _ssl_ctx;
+
+    bool _use_zerocopy;
+
+    bthread_tag_t _bthread_tag;
 };
 
 } // namespace brpc
@@ -28,7 +28,7 @@
 namespace brpc {
 
 // Convert a case-insensitive string to corresponding ConnectionType
-// Possible options are: short, pooled, single
+// Possible options are: short, pooled, single, multi
 // Returns: CONNECTION_TYPE_UNKNOWN on error.
 ConnectionType StringToConnectionType(const butil::StringPiece& type,
                                       bool print_log_on_unknown);
@@ -24,6 +24,8 @@
 
 namespace bthread {
 void print_task(std::ostream& os, bthread_t tid);
+void print_stack_usages(std::ostream& os);
+void print_workers(std::ostream& os);
 }
 
 
@@ -40,7 +42,12 @@ void BthreadsService::default_method(::google::protobuf::RpcController* cntl_bas
     const std::string& constraint = cntl->http_request().unresolved_path();
     
     if (constraint.empty()) {
-        os << "Use /bthreads/<bthread_id>";
+        os << "Use /bthreads/<bthread_id>, /bthreads/stack_usage or "
+            "/bthreads/workers";
+    } else if (constraint == "stack_usage") {
+        ::bthread::print_stack_usages(os);
+    } else if (constraint == "workers") {
+        ::bthread::print_workers(os);
     } else {
         char* endptr = NULL;
         bthread_t tid = strtoull(constraint.c_str(), &endptr, 10);
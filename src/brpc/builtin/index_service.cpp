@@ -157,6 +157,8 @@ void IndexService::default_method(::google::protobuf::RpcController* controller,
        << Path("/vlog", html_addr) << " : List all VLOG callsites" << NL
        << Path("/sockets", html_addr) << " : Check status of a Socket" << NL
        << Path("/bthreads", html_addr) << " : Check status of a bthread" << NL
+       << Path("/bthreads/stack_usage", html_addr) << " : Peak stack usages of bthreads" << NL
+       << Path("/bthreads/workers", html_addr) << " : Steals, wakeups and runqueue latencies of bthread workers" << NL
        << Path("/ids", html_addr) << " : Check status of a bthread_id" << NL
        << Path("/protobufs", html_addr) << " : List all protobuf services and messages" << NL
        << Path("/list", html_addr) << " : json signature of methods" << NL
@@ -52,6 +52,8 @@ ChannelOptions::ChannelOptions()
     , auth(NULL)
     , retry_policy(NULL)
     , ns_filter(NULL)
+    , use_zerocopy(false)
+    , batch_window_us(0)
 {}
 
 ChannelSSLOptions* ChannelOptions::mutable_ssl_options() {
@@ -64,7 +66,8 @@ ChannelSSLOptions* ChannelOptions::mutable_ssl_options() {
 static ChannelSignature ComputeChannelSignature(const ChannelOptions& opt) {
     if (opt.auth == NULL &&
         !opt.has_ssl_options() &&
-        opt.connection_group.empty()) {
+        opt.connection_group.empty() &&
+        !opt.use_zerocopy) {
         // Returning zeroized result by default is more intuitive for users.
         return ChannelSignature();
     }
@@ -84,6 +87,9 @@ static ChannelSignature ComputeChannelSignature(const ChannelOptions& opt) {
             buf.append("|auth=");
             buf.append((char*)&opt.auth, sizeof(opt.auth));
         }
+        if (opt.use_zerocopy) {
+            buf.append("|zerocopy");
+        }
         if (opt.has_ssl_options()) {
             const ChannelSSLOptions& ssl = opt.ssl_options();
             buf.push_back('|');
@@ -172,7 +178,11 @@ int Channel::InitChannelOptions(const ChannelOptions* options) {
                        << _options.protocol.name();
         }
     } else {
-        if (!(_options.connection_type & protocol->supported_connection_type)) {
+        // Multiplexed connections are the same as single ones to protocols.
+        const ConnectionType type =
+            (_options.connection_type == CONNECTION_TYPE_MULTI ?
+             CONNECTION_TYPE_SINGLE : (ConnectionType)_options.connection_type);
+        if (!(type & protocol->supported_connection_type)) {
             LOG(ERROR) << protocol->name << " does not support connection_type="
                        << ConnectionTypeToString(_options.connection_type);
             return -1;
@@ -186,6 +196,13 @@ int Channel::InitChannelOptions(const ChannelOptions* options) {
         return -1;
     }
 
+    if (_options.batch_window_us > 0 &&
+        _options.protocol != PROTOCOL_BAIDU_STD) {
+        LOG(ERROR) << "batch_window_us is not supported by protocol="
+                   << _options.protocol.name();
+        return -1;
+    }
+
     if (_options.protocol == PROTOCOL_ESP) {
         if (_options.auth == NULL) {
             _options.auth = policy::global_esp_authenticator();
@@ -312,7 +329,7 @@ int Channel::InitSingle(const butil::EndPoint& server_addr_and_port,
         return -1;
     }
     if (SocketMapInsert(SocketMapKey(server_addr_and_port, sig),
-                        &_server_id, ssl_ctx) != 0) {
+                        &_server_id, ssl_ctx, _options.use_zerocopy) != 0) {
         LOG(ERROR) << "Fail to insert into SocketMap";
         return -1;
     }
@@ -353,6 +370,7 @@ int Channel::Init(const char* ns_url,
     if (CreateSocketSSLContext(_options, &ns_opt.ssl_ctx) != 0) {
         return -1;
     }
+    ns_opt.use_zerocopy = _options.use_zerocopy;
     if (lb->Init(ns_url, lb_name, _options.ns_filter, &ns_opt) != 0) {
         LOG(ERROR) << "Fail to initialize LoadBalancerWithNaming";
         delete lb;
@@ -459,6 +477,7 @@ void Channel::CallMethod(const google::protobuf::MethodDescriptor* method,
     // overriding connect_timeout_ms does not make sense, just use the
     // one in ChannelOptions
     cntl->_connect_timeout_ms = _options.connect_timeout_ms;
+    cntl->_batch_window_us = _options.batch_window_us;
     if (cntl->backup_request_ms() == UNSET_MAGIC_NUM) {
         cntl->set_backup_request_ms(_options.backup_request_ms);
     }
@@ -85,7 +85,10 @@ struct ChannelOptions {
     // of the protocol.
     // NOTE: You can assign name of the type to this field as well, for
     // Example: options.connection_type = "single";
-    // Possible values: "single", "pooled", "short".
+    // Possible values: "single", "pooled", "short", "multi".
+    // "multi" is similar with "single" but spreads RPCs over
+    // -multi_connection_count connections to each server, which may exceed
+    // throughput of a single connection on high-bandwidth links.
     AdaptiveConnectionType connection_type;
 
     // Channel.Init() succeeds even if there's no server in the NamingService. 
@@ -129,6 +132,24 @@ struct ChannelOptions {
     // Default: ""
     std::string connection_group;
 
+    // Send large requests (not less than -socket_zerocopy_min_bytes) with
+    // MSG_ZEROCOPY to save copying into the socket buffer. Written blocks
+    // are held until the kernel reports that it's done with them. Only
+    // TCP connections to remote hosts benefit (Linux 4.14+). Channels with
+    // different values do not share connections.
+    // Default: false
+    bool use_zerocopy;
+
+    // Requests issued within so many microseconds over the same connection
+    // are packed into one frame which is written at once, and the server
+    // replies in batches as well. Saves syscalls and wakeups for fan-out
+    // of many small requests at the cost of latency up to the window.
+    // Only supported by baidu_std, ignored unless connection_type is
+    // "single" or "multi", or the RPC has authentication or a stream. The server must
+    // be recent enough to understand batches.
+    // Default: 0 (disabled)
+    int32_t batch_window_us;
+
 private:
     // SSLOptions is large and not often used, allocate it on heap to
     // prevent ChannelOptions from being bloated in most cases.
@@ -24,6 +24,7 @@
 #include "butil/logging.h"
 #include <google/protobuf/service.h>            // google::protobuf::RpcChannel
 #include "brpc/describable.h"
+#include "brpc/coroutine.h"                 // CallMethodAwaiter
 
 // To brpc developers: This is a header included by user, don't depend
 // on internal structures, use opaque pointers instead.
@@ -41,6 +42,17 @@ public:
     };
 
     virtual int CheckHealth() = 0;
+
+    // Call `method' in C++20 coroutines without blocking the bthread:
+    //   co_await channel.CallMethodAsync(method, &cntl, &request, &response);
+    // See bthread/coroutine.h for details.
+    CallMethodAwaiter CallMethodAsync(
+        const google::protobuf::MethodDescriptor* method,
+        Controller* cntl,
+        const google::protobuf::Message* request,
+        google::protobuf::Message* response) {
+        return CallMethodAwaiter(this, method, cntl, request, response);
+    }
 };
 
 } // namespace brpc
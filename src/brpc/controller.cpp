@@ -41,6 +41,8 @@
 #include "brpc/retry_policy.h"
 #include "brpc/stream_impl.h"
 #include "brpc/policy/streaming_rpc_protocol.h" // FIXME
+#include "brpc/policy/baidu_rpc_protocol.h"     // PackRpcBatchHeader
+#include "brpc/details/rpc_batcher.h"
 #include "brpc/rpc_dump.h"
 #include "brpc/details/usercode_backup_pool.h"  // RunUserCode
 #include "brpc/mongo_service_adaptor.h"
@@ -243,6 +245,7 @@ void Controller::ResetPods() {
     _timeout_ms = UNSET_MAGIC_NUM;
     _backup_request_ms = UNSET_MAGIC_NUM;
     _connect_timeout_ms = UNSET_MAGIC_NUM;
+    _batch_window_us = 0;
     _real_timeout_ms = UNSET_MAGIC_NUM;
     _deadline_us = -1;
     _timeout_id = 0;
@@ -740,6 +743,14 @@ void Controller::Call::OnComplete(
     switch (c->connection_type()) {
     case CONNECTION_TYPE_UNKNOWN:
         break;
+    case CONNECTION_TYPE_MULTI:
+        // Multiplexed sockets are shared by RPCs, nothing to return. But
+        // the main socket should die as well if other sockets can't connect.
+        if (sending_sock != NULL && sending_sock->id() != peer_id &&
+            does_error_affect_main_socket(error_code)) {
+            Socket::SetFailed(peer_id);
+        }
+        break;
     case CONNECTION_TYPE_SINGLE:
         // Set main socket to be failed for connection refusal of streams.
         // "single" streams are often maintained in a separate SocketMap and
@@ -1081,6 +1092,18 @@ void Controller::IssueRPC(int64_t start_realtime_us) {
         int rc = 0;
         if (_connection_type == CONNECTION_TYPE_POOLED) {
             rc = tmp_sock->GetPooledSocket(&_current_call.sending_sock);
+        } else if (_connection_type == CONNECTION_TYPE_MULTI) {
+            // connection_type may be set to each controller, check it here
+            // rather than in Channel.Init() only.
+            const Protocol* protocol = FindProtocol(_request_protocol);
+            if (protocol == NULL || !(protocol->supported_connection_type &
+                                      CONNECTION_TYPE_SINGLE)) {
+                tmp_sock.reset();
+                SetFailed(EINVAL, "connection_type=multi is not supported by "
+                          "protocol=%s", protocol ? protocol->name : "unknown");
+                return HandleSendFailed();
+            }
+            rc = tmp_sock->GetMultiSocket(&_current_call.sending_sock);
         } else if (_connection_type == CONNECTION_TYPE_SHORT) {
             rc = tmp_sock->GetShortSocket(&_current_call.sending_sock);
         } else {
@@ -1172,6 +1195,22 @@ void Controller::IssueRPC(int64_t start_realtime_us) {
             packet_size = user_packet_guard->EstimatedByteSize();
         }
         rc = _current_call.sending_sock->Write(user_packet_guard, &wopt);
+    } else if (_batch_window_us > 0 &&
+               _request_protocol == PROTOCOL_BAIDU_STD &&
+               (_connection_type == CONNECTION_TYPE_SINGLE ||
+                _connection_type == CONNECTION_TYPE_MULTI) &&
+               using_auth == NULL &&
+               _request_stream == INVALID_STREAM_ID &&
+               wopt.pipelined_count == 0 && wopt.auth_flags == 0) {
+        // Packed with other requests to the same server.
+        packet_size = packet.size();
+        RpcBatcher::WriteOptions bopt;
+        bopt.id_wait = cid;
+        bopt.abstime = wopt.abstime;
+        bopt.window_us = _batch_window_us;
+        bopt.ignore_eovercrowded = wopt.ignore_eovercrowded;
+        bopt.pack_header = policy::PackRpcBatchHeader;
+        rc = RpcBatcher::Write(_current_call.sending_sock.get(), &packet, bopt);
     } else {
         packet_size = packet.size();
         rc = _current_call.sending_sock->Write(&packet, &wopt);
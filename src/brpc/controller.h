@@ -661,7 +661,8 @@ private:
         // The actual `Socket' for sending RPC. It's socket id will be
         // exactly the same as `peer_id' if `_connection_type' is
         // CONNECTION_TYPE_SINGLE. Otherwise, it may be a temporary
-        // socket fetched from socket pool
+        // socket fetched from socket pool, or one of the multiplexed
+        // sockets to the server for CONNECTION_TYPE_MULTI
         SocketUniquePtr sending_sock;
         StreamUserData* stream_user_data;
     };
@@ -740,6 +741,8 @@ private:
     // [Timeout related]
     int32_t _timeout_ms;
     int32_t _connect_timeout_ms;
+    // ChannelOptions.batch_window_us
+    int32_t _batch_window_us;
     int32_t _backup_request_ms;
     // If this rpc call has retry/backup request,this var save the real timeout for current call
     int64_t _real_timeout_ms;
@@ -0,0 +1,36 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include "brpc/callback.h"
+#include "brpc/controller.h"
+#include "brpc/coroutine.h"
+
+namespace brpc {
+
+void CallMethodAwaiter::call() {
+    // `done' may run before CallMethod returns, in which case the coroutine
+    // may already be resumed, don't touch `this' after CallMethod.
+    _channel->CallMethod(_method, _cntl, _request, _response,
+                         brpc::NewCallback(on_done, this));
+}
+
+void CallMethodAwaiter::on_done(CallMethodAwaiter* a) {
+    a->_resumer.resume_in_worker();
+}
+
+} // namespace brpc
@@ -0,0 +1,73 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_COROUTINE_H
+#define BRPC_COROUTINE_H
+
+#include <google/protobuf/service.h>            // google::protobuf::RpcChannel
+#include "bthread/coroutine.h"
+
+namespace google {
+namespace protobuf {
+class MethodDescriptor;
+class Message;
+}  // namespace protobuf
+}  // namespace google
+
+namespace brpc {
+
+class Controller;
+
+// Awaiter of ChannelBase::CallMethodAsync. The RPC is issued asynchronously
+// when the coroutine is suspended and the coroutine is resumed in a bthread
+// worker after the RPC ends, check cntl->Failed() after co_await.
+class CallMethodAwaiter {
+public:
+    CallMethodAwaiter(google::protobuf::RpcChannel* channel,
+                      const google::protobuf::MethodDescriptor* method,
+                      Controller* cntl,
+                      const google::protobuf::Message* request,
+                      google::protobuf::Message* response)
+        : _channel(channel)
+        , _method(method)
+        , _cntl(cntl)
+        , _request(request)
+        , _response(response) {}
+
+    bool await_ready() const { return false; }
+    template <typename Handle> void await_suspend(Handle h) {
+        _resumer.set(h);
+        call();
+    }
+    void await_resume() const {}
+
+private:
+    void call();
+    static void on_done(CallMethodAwaiter* a);
+
+    google::protobuf::RpcChannel* _channel;
+    const google::protobuf::MethodDescriptor* _method;
+    Controller* _cntl;
+    const google::protobuf::Message* _request;
+    google::protobuf::Message* _response;
+    bthread::CoroutineResumer _resumer;
+};
+
+} // namespace brpc
+
+#endif  // BRPC_COROUTINE_H
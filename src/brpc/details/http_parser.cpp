@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include "butil/simd_find.h"
 
 #ifndef ULLONG_MAX
 # define ULLONG_MAX ((uint64_t) -1) /* 2^64-1 */
@@ -1595,7 +1596,21 @@ size_t http_parser_execute (http_parser *parser,
 
         switch (parser->header_state) {
           case h_general:
+          {
+            /* Nothing to match in the value, skip to the ending CR/LF which
+             * is handled as the next byte. */
+            const char* end = butil::find_either_byte(p, data + len - p, CR, LF);
+            if (end == NULL) {
+              end = data + len;
+            }
+            parser->nread += end - p - 1;
+            if (parser->nread > (BRPC_HTTP_MAX_HEADER_SIZE)) {
+              SET_ERRNO(HPE_HEADER_OVERFLOW);
+              goto error;
+            }
+            p = end - 1;
             break;
+          }
 
           case h_connection:
           case h_transfer_encoding:
@@ -17,13 +17,36 @@
 
 
 #include <limits>
+#include <inttypes.h>
+#include <pthread.h>
+#include <gflags/gflags.h>
 #include "butil/macros.h"
+#include "butil/logging.h"
+#include "butil/time.h"
+#include "brpc/errno.pb.h"
+#include "brpc/reloadable_flags.h"
 #include "brpc/controller.h"
 #include "brpc/details/server_private_accessor.h"
 #include "brpc/details/method_status.h"
 
 namespace brpc {
 
+DEFINE_bool(shed_expired_requests, true,
+            "Fail requests whose timeouts set by clients have expired before"
+            " running user code, clients have given up waiting for them.");
+BRPC_VALIDATE_GFLAG(shed_expired_requests, PassValidate);
+
+static bvar::Adder<int64_t>* g_nshed_expired = NULL;
+static bvar::Adder<int64_t>* g_nshed_queue_time = NULL;
+
+static pthread_once_t s_create_vars_once = PTHREAD_ONCE_INIT;
+
+static void CreateVars() {
+    g_nshed_expired = new bvar::Adder<int64_t>("rpc_server_shed_expired_count");
+    g_nshed_queue_time =
+        new bvar::Adder<int64_t>("rpc_server_shed_queue_time_count");
+}
+
 static int cast_int(void* arg) {
     return *(int*)arg;
 }
@@ -37,11 +60,14 @@ static int cast_cl(void* arg) {
 }
 
 MethodStatus::MethodStatus()
-    : _nconcurrency(0)
+    : _max_queue_time_us(0)
+    , _nconcurrency(0)
+    , _avg_latency_us(0)
     , _nconcurrency_bvar(cast_int, &_nconcurrency)
     , _eps_bvar(&_nerror_bvar)
     , _max_concurrency_bvar(cast_cl, &_cl)
 {
+    CHECK_EQ(0, pthread_once(&s_create_vars_once, CreateVars));
 }
 
 MethodStatus::~MethodStatus() {
@@ -145,6 +171,36 @@ void MethodStatus::Describe(
     }
 }
 
+bool MethodStatus::CheckQueueTime(Controller* cntl) {
+    // Server-side controllers measure latency from receiving of the request.
+    const int64_t queue_time_us = cntl->latency_us();
+    if (FLAGS_shed_expired_requests) {
+        if (cntl->timeout_ms() > 0) {
+            if (queue_time_us >= cntl->timeout_ms() * 1000L) {
+                *g_nshed_expired << 1;
+                cntl->SetFailed(ERPCTIMEDOUT, "Queued for %" PRId64 "us which"
+                                " exceeds timeout_ms=%" PRId64 " of the request",
+                                queue_time_us, cntl->timeout_ms());
+                return false;
+            }
+        } else if (cntl->deadline_us() >= 0 &&
+                   butil::gettimeofday_us() >= cntl->deadline_us()) {
+            *g_nshed_expired << 1;
+            cntl->SetFailed(ERPCTIMEDOUT, "Queued for %" PRId64 "us which"
+                            " exceeds deadline of the request", queue_time_us);
+            return false;
+        }
+    }
+    if (_max_queue_time_us > 0 && queue_time_us > _max_queue_time_us) {
+        *g_nshed_queue_time << 1;
+        cntl->SetFailed(ELIMIT, "Queued for %" PRId64 "us which exceeds"
+                        " max_queue_time_us=%" PRId64,
+                        queue_time_us, _max_queue_time_us);
+        return false;
+    }
+    return true;
+}
+
 void MethodStatus::SetConcurrencyLimiter(ConcurrencyLimiter* cl) {
     _cl.reset(cl);
 }
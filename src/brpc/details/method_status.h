@@ -48,6 +48,14 @@ public:
     // did the time keeping and the cost is better saved. 
     void OnResponded(int error_code, int64_t latency_us);
 
+    // Call this after OnRequested() succeeded and right before running user
+    // code. Returns false and fails `cntl' when the request is not worth
+    // running anymore: the timeout sent by the client (baidu_std with
+    // -baidu_std_protocol_deliver_timeout_ms or grpc-timeout) has expired
+    // since the request was received, or the request has waited longer than
+    // max_queue_time_us of the method, see Server::SetMethodMaxQueueTime().
+    bool CheckQueueTime(Controller* cntl);
+
     // Expose internal vars.
     // Return 0 on success, -1 otherwise.
     int Expose(const butil::StringPiece& prefix);
@@ -58,6 +66,11 @@ public:
     // Current max_concurrency of the method.
     int MaxConcurrency() const { return _cl ? _cl->MaxConcurrency() : 0; }
 
+    // Moving average of latencies of recent successful calls, cheap enough
+    // to be read for every request. 0 if no calls have finished yet.
+    int64_t AverageLatency() const
+    { return _avg_latency_us.load(butil::memory_order_relaxed); }
+
 private:
 friend class Server;
     DISALLOW_COPY_AND_ASSIGN(MethodStatus);
@@ -67,7 +80,9 @@ friend class Server;
     void SetConcurrencyLimiter(ConcurrencyLimiter* cl);
 
     std::unique_ptr<ConcurrencyLimiter> _cl;
+    int64_t _max_queue_time_us;
     butil::atomic<int> _nconcurrency;
+    butil::atomic<int64_t> _avg_latency_us;
     bvar::Adder<int64_t>  _nerror_bvar;
     bvar::LatencyRecorder _latency_rec;
     bvar::PassiveStatus<int>  _nconcurrency_bvar;
@@ -104,6 +119,10 @@ inline void MethodStatus::OnResponded(int error_code, int64_t latency) {
     _nconcurrency.fetch_sub(1, butil::memory_order_relaxed);
     if (0 == error_code) {
         _latency_rec << latency;
+        // Racing updates lose a few samples which is fine for an average.
+        const int64_t avg = _avg_latency_us.load(butil::memory_order_relaxed);
+        _avg_latency_us.store(avg == 0 ? latency : (avg * 7 + latency) / 8,
+                              butil::memory_order_relaxed);
     } else {
         _nerror_bvar << 1;
     }
@@ -0,0 +1,250 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <algorithm>                             // std::min
+#include <gflags/gflags.h>
+#include "butil/logging.h"
+#include "butil/scoped_lock.h"                   // BAIDU_SCOPED_LOCK
+#include "butil/time.h"
+#include "bthread/bthread.h"                     // bthread_start_background
+#include "bvar/bvar.h"
+#include "brpc/reloadable_flags.h"               // BRPC_VALIDATE_GFLAG
+#include "brpc/socket.h"
+#include "brpc/details/rpc_batcher.h"
+
+namespace brpc {
+
+DEFINE_int32(max_rpc_batch_size, 64,
+             "A batch of frames is written immediately after it has so many "
+             "frames, without waiting for the window to expire");
+BRPC_VALIDATE_GFLAG(max_rpc_batch_size, PositiveInteger);
+
+DEFINE_int32(max_rpc_batch_bytes, 1024 * 1024,
+             "A batch is written before appending a frame makes it larger "
+             "than so many bytes or -max_body_size, frames not smaller than "
+             "that are written without batching");
+BRPC_VALIDATE_GFLAG(max_rpc_batch_bytes, PositiveInteger);
+
+DECLARE_uint64(max_body_size);
+
+// Max bytes of frames inside a batch, the header of the batch is not counted
+// by the peer's -max_body_size.
+static size_t max_batch_bytes() {
+    return std::min((uint64_t)FLAGS_max_rpc_batch_bytes, FLAGS_max_body_size);
+}
+
+struct RpcBatcher::Batch {
+    Batch() : nframe(0), ignore_eovercrowded(false), abstime_us(-1)
+            , pack_header(NULL) {}
+
+    butil::IOBuf frames;
+    int nframe;
+    std::vector<bthread_id_t> ids;
+    bool ignore_eovercrowded;
+    int64_t abstime_us;
+    PackBatchHeader pack_header;
+};
+
+struct RpcBatcherVars {
+    // Batches with more than one frame and frames in them.
+    bvar::Adder<int64_t> batch_count;
+    bvar::Adder<int64_t> batched_frame_count;
+
+    RpcBatcherVars()
+        : batch_count("rpc_batch_count")
+        , batched_frame_count("rpc_batched_frame_count") {}
+};
+static RpcBatcherVars* g_vars = NULL;
+static pthread_once_t s_create_vars_once = PTHREAD_ONCE_INIT;
+
+static void CreateVars() {
+    g_vars = new RpcBatcherVars;
+}
+
+RpcBatcher::RpcBatcher()
+    : _nframe(0)
+    , _flush_scheduled(false)
+    , _ignore_eovercrowded(false)
+    , _abstime_us(-1)
+    , _window_us(0)
+    , _pack_header(NULL) {
+    CHECK_EQ(0, pthread_once(&s_create_vars_once, CreateVars));
+}
+
+RpcBatcher::~RpcBatcher() {
+    // Flushing bthreads hold references of the socket, the batch should be
+    // empty when the socket is recycled.
+    LOG_IF(ERROR, _nframe != 0) << "Dropped " << _nframe << " batched frames";
+}
+
+int RpcBatcher::pending_count() const {
+    BAIDU_SCOPED_LOCK(_mutex);
+    return _nframe;
+}
+
+int RpcBatcher::Write(Socket* sock, butil::IOBuf* frame,
+                      const WriteOptions& options) {
+    const size_t max_bytes = max_batch_bytes();
+    if (options.window_us <= 0 || options.pack_header == NULL ||
+        frame->size() >= max_bytes) {
+        Socket::WriteOptions wopt;
+        wopt.id_wait = options.id_wait;
+        wopt.abstime = options.abstime;
+        wopt.ignore_eovercrowded = options.ignore_eovercrowded;
+        return sock->Write(frame, &wopt);
+    }
+    const int64_t abstime_us = (options.abstime ?
+        butil::timespec_to_microseconds(*options.abstime) : -1);
+    RpcBatcher* b = sock->GetOrNewRpcBatcher();
+    Batch full_batch;
+    bool flush_now = false;
+    bool schedule = false;
+    {
+        BAIDU_SCOPED_LOCK(b->_mutex);
+        if (b->_nframe != 0 && b->_frames.size() + frame->size() > max_bytes) {
+            // Write the batch before it's too big for the peer. Pending
+            // flushing bthread (if any) handles the new batch.
+            b->CutBatch(&full_batch);
+        }
+        if (b->_nframe == 0) {
+            b->_window_us = options.window_us;
+            b->_ignore_eovercrowded = options.ignore_eovercrowded;
+            b->_pack_header = options.pack_header;
+            b->_abstime_us = abstime_us;
+        } else {
+            if (!options.ignore_eovercrowded) {
+                b->_ignore_eovercrowded = false;
+            }
+            if (abstime_us >= 0 &&
+                (b->_abstime_us < 0 || abstime_us < b->_abstime_us)) {
+                b->_abstime_us = abstime_us;
+            }
+        }
+        b->_frames.append(frame->movable());
+        ++b->_nframe;
+        if (options.id_wait != INVALID_BTHREAD_ID) {
+            b->_ids.push_back(options.id_wait);
+        }
+        if (b->_nframe >= FLAGS_max_rpc_batch_size) {
+            flush_now = true;
+        } else if (!b->_flush_scheduled) {
+            b->_flush_scheduled = true;
+            schedule = true;
+        }
+    }
+    if (full_batch.nframe != 0) {
+        // Failures are notified to RPC in that batch, not this one.
+        WriteBatch(sock, &full_batch);
+    }
+    if (schedule) {
+        // The reference is released by FlushAfterWindow, which keeps the
+        // socket (and the batcher) alive until the batch is written.
+        SocketUniquePtr ptr;
+        sock->ReAddress(&ptr);
+        bthread_t th;
+        if (bthread_start_background(&th, NULL, FlushAfterWindow,
+                                     ptr.get()) == 0) {
+            ptr.release();
+        } else {
+            LOG(ERROR) << "Fail to start bthread to flush the batch";
+            return b->Flush(sock, true);
+        }
+    }
+    if (flush_now) {
+        return b->Flush(sock, false);
+    }
+    return 0;
+}
+
+void* RpcBatcher::FlushAfterWindow(void* arg) {
+    SocketUniquePtr sock(static_cast<Socket*>(arg));
+    RpcBatcher* b = sock->rpc_batcher();
+    int64_t window_us = 0;
+    {
+        BAIDU_SCOPED_LOCK(b->_mutex);
+        window_us = b->_window_us;
+    }
+    bthread_usleep(window_us);
+    b->Flush(sock.get(), true);
+    return NULL;
+}
+
+int RpcBatcher::Flush(Socket* sock, bool by_timer) {
+    Batch batch;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        if (by_timer) {
+            _flush_scheduled = false;
+        }
+        if (_nframe == 0) {
+            return 0;
+        }
+        CutBatch(&batch);
+    }
+    return WriteBatch(sock, &batch);
+}
+
+void RpcBatcher::CutBatch(Batch* batch) {
+    batch->frames.swap(_frames);
+    batch->ids.swap(_ids);
+    batch->nframe = _nframe;
+    batch->ignore_eovercrowded = _ignore_eovercrowded;
+    batch->abstime_us = _abstime_us;
+    batch->pack_header = _pack_header;
+    _nframe = 0;
+    _abstime_us = -1;
+}
+
+int RpcBatcher::WriteBatch(Socket* sock, Batch* batch) {
+    Socket::WriteOptions wopt;
+    wopt.ignore_eovercrowded = batch->ignore_eovercrowded;
+    timespec abstime;
+    if (batch->abstime_us >= 0) {
+        abstime = butil::microseconds_to_timespec(batch->abstime_us);
+        wopt.abstime = &abstime;
+    }
+    butil::IOBuf out;
+    if (batch->nframe == 1) {
+        out.swap(batch->frames);
+    } else {
+        batch->pack_header(&out, batch->frames.size());
+        out.append(batch->frames.movable());
+        g_vars->batch_count << 1;
+        g_vars->batched_frame_count << batch->nframe;
+    }
+    const std::vector<bthread_id_t>& ids = batch->ids;
+    if (sock->Write(&out, &wopt) != 0) {
+        const int saved_errno = errno;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            bthread_id_error(ids[i], saved_errno);
+        }
+        errno = saved_errno;
+        return -1;
+    }
+    // Like successful write requests, RPC in the batch should be notified
+    // if the socket fails before they get responses.
+    for (size_t i = 0; i < ids.size(); ++i) {
+        sock->NotifyOnFailed(ids[i]);
+    }
+    return 0;
+}
+
+} // namespace brpc
@@ -0,0 +1,113 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_DETAILS_RPC_BATCHER_H
+#define BRPC_DETAILS_RPC_BATCHER_H
+
+#include <stdint.h>
+#include <vector>
+#include "butil/iobuf.h"
+#include "butil/synchronization/lock.h"
+#include "bthread/types.h"                      // bthread_id_t
+
+namespace brpc {
+
+class Socket;
+
+// Coalesce frames written into a socket within a short window into one
+// frame so that concurrent small RPCs to the same server cost one write
+// on this side and one read on the other side. The batch is written when
+// the window of its first frame expires or it has -max_rpc_batch_size
+// frames, and before it grows beyond -max_rpc_batch_bytes so that the peer
+// never rejects it by -max_body_size. A batch of one frame and frames not
+// smaller than the byte limit are written as they are.
+// Created by Socket::GetOrNewRpcBatcher(), all methods are thread-safe.
+class RpcBatcher {
+public:
+    // Append the header of a batch with `body_size' bytes of frames to `out'.
+    typedef void (*PackBatchHeader)(butil::IOBuf* out, size_t body_size);
+
+    struct WriteOptions {
+        WriteOptions()
+            : id_wait(INVALID_BTHREAD_ID)
+            , abstime(NULL)
+            , window_us(0)
+            , ignore_eovercrowded(false)
+            , pack_header(NULL) {}
+
+        // Same as Socket::WriteOptions.id_wait: signalled with the error
+        // when the batch is not written or the socket fails after.
+        bthread_id_t id_wait;
+
+        // Same as Socket::WriteOptions.abstime. The batch is written with
+        // the earliest deadline of its frames.
+        const timespec* abstime;
+
+        // Max microseconds that the frame waits for others. <= 0 means the
+        // frame is written immediately without batching.
+        int64_t window_us;
+
+        // The batch ignores EOVERCROWDED iff all frames in it do.
+        bool ignore_eovercrowded;
+
+        PackBatchHeader pack_header;
+    };
+
+    RpcBatcher();
+    ~RpcBatcher();
+
+    // Move `frame' into the batch of `sock'.
+    // Returns 0 on success, -1 otherwise and errno is set.
+    static int Write(Socket* sock, butil::IOBuf* frame,
+                     const WriteOptions& options);
+
+    // Number of frames waiting to be written.
+    int pending_count() const;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(RpcBatcher);
+
+    // Frames cut from the batcher to be written.
+    struct Batch;
+
+    static void* FlushAfterWindow(void* arg);
+
+    // Write pending frames into `sock'. `by_timer' is true when called
+    // after the window expires.
+    int Flush(Socket* sock, bool by_timer);
+
+    // Move pending frames into `batch'. Called with _mutex held.
+    void CutBatch(Batch* batch);
+
+    static int WriteBatch(Socket* sock, Batch* batch);
+
+    mutable butil::Mutex _mutex;
+    butil::IOBuf _frames;
+    int _nframe;
+    std::vector<bthread_id_t> _ids;
+    bool _flush_scheduled;
+    bool _ignore_eovercrowded;
+    // Earliest abstime of pending frames in microseconds, -1 means none.
+    int64_t _abstime_us;
+    int64_t _window_us;
+    PackBatchHeader _pack_header;
+};
+
+} // namespace brpc
+
+#endif  // BRPC_DETAILS_RPC_BATCHER_H
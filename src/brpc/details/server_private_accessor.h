@@ -56,6 +56,14 @@ public:
         }
     }
 
+    bool has_high_priority_method() const {
+        return _server->_has_high_priority_method;
+    }
+
+    bool has_inline_safe_method() const {
+        return _server->_has_inline_safe_method;
+    }
+
     // Find by MethodDescriptor::full_name
     const Server::MethodProperty*
     FindMethodPropertyByFullName(const butil::StringPiece &fullname) {
@@ -0,0 +1,297 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include "butil/build_config.h"
+#include <errno.h>
+#include <string.h>                        // memset
+#include <sys/types.h>
+#include <sys/socket.h>                    // sendmsg, recvmsg
+#include <sys/uio.h>                       // iovec
+#include <netinet/in.h>                    // IP_RECVERR
+#if defined(OS_LINUX)
+#include <linux/errqueue.h>                // sock_extended_err
+#endif
+#include <unistd.h>                        // close
+#include "butil/logging.h"
+#include "butil/scoped_lock.h"                // BAIDU_SCOPED_LOCK
+#include "butil/time.h"
+#include "brpc/periodic_task.h"
+#include "brpc/details/zerocopy.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+namespace brpc {
+
+// Same limit as IOBuf::cut_multiple_into_file_descriptor
+static const size_t ZEROCOPY_IOV_MAX = 256;
+// How often and how long pending sends on a closing fd are reaped.
+static const int64_t ZEROCOPY_REAP_INTERVAL_MS = 10;
+static const int64_t ZEROCOPY_REAP_TIMEOUT_MS = 5000;
+
+ZeroCopyTracker::ZeroCopyTracker()
+    : _enabled(false)
+    , _next_seq(0)
+    , _pending_bytes(0) {
+}
+
+ZeroCopyTracker::~ZeroCopyTracker() {
+}
+
+int ZeroCopyTracker::EnableOnFileDescriptor(int fd) {
+#if defined(OS_LINUX)
+    int one = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+#else
+    (void)fd;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+void ZeroCopyTracker::Reset(bool enabled) {
+    std::deque<PendingSend> tmp;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        tmp.swap(_pending);
+        _next_seq = 0;
+        _pending_bytes = 0;
+        _enabled.store(enabled, butil::memory_order_relaxed);
+    }
+    // Release blocks outside the lock.
+}
+
+// Owns a closing fd and the tracker of sends pending on it.
+class ZeroCopyReaper : public PeriodicTask {
+public:
+    ZeroCopyReaper(int fd, ZeroCopyTracker* tracker)
+        : _fd(fd)
+        , _tracker(tracker)
+        , _deadline_us(butil::gettimeofday_us() +
+                       ZEROCOPY_REAP_TIMEOUT_MS * 1000L) {}
+    bool OnTriggeringTask(timespec* next_abstime) override;
+    void OnDestroyingTask() override;
+
+private:
+    int _fd;
+    ZeroCopyTracker* _tracker;
+    int64_t _deadline_us;
+};
+
+bool ZeroCopyReaper::OnTriggeringTask(timespec* next_abstime) {
+    _tracker->Reap(_fd);
+    if (_tracker->pending_count() == 0 ||
+        butil::gettimeofday_us() >= _deadline_us) {
+        return false;
+    }
+    *next_abstime = butil::milliseconds_from_now(ZEROCOPY_REAP_INTERVAL_MS);
+    return true;
+}
+
+void ZeroCopyReaper::OnDestroyingTask() {
+    if (_tracker->pending_count() != 0) {
+        // The peer does not ack. Reset the connection so that the kernel
+        // drops the unsent data instead of reading released blocks.
+        LOG(WARNING) << "Abort fd=" << _fd << " with "
+                     << _tracker->pending_count()
+                     << " uncompleted zero-copy sends";
+        struct linger lg = { 1, 0 };
+        setsockopt(_fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+    close(_fd);
+    delete _tracker;
+    delete this;
+}
+
+void ZeroCopyTracker::CloseFileDescriptor(int fd) {
+    ZeroCopyTracker* reaped = NULL;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        if (!_pending.empty()) {
+            reaped = new ZeroCopyTracker;
+            reaped->_pending.swap(_pending);
+            reaped->_next_seq = _next_seq;
+            reaped->_pending_bytes = _pending_bytes;
+            _pending_bytes = 0;
+        }
+    }
+    if (reaped == NULL) {
+        close(fd);
+        return;
+    }
+    // Same as close() for the peer, queued data is still sent.
+    shutdown(fd, SHUT_RDWR);
+    PeriodicTaskManager::StartTaskAt(
+        new ZeroCopyReaper(fd, reaped),
+        butil::milliseconds_from_now(ZEROCOPY_REAP_INTERVAL_MS));
+}
+
+ssize_t ZeroCopyTracker::CutMultipleIntoFileDescriptor(
+    int fd, butil::IOBuf* const* pieces, size_t count) {
+    struct iovec vec[ZEROCOPY_IOV_MAX];
+    size_t nvec = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const butil::IOBuf* p = pieces[i];
+        const size_t nref = p->backing_block_num();
+        for (size_t j = 0; j < nref && nvec < ZEROCOPY_IOV_MAX; ++j) {
+            const butil::StringPiece blk = p->backing_block(j);
+            vec[nvec].iov_base = const_cast<char*>(blk.data());
+            vec[nvec].iov_len = blk.size();
+            ++nvec;
+        }
+    }
+    if (nvec == 0) {
+        return 0;
+    }
+    // Queue the send before sendmsg: the completion may be reaped by
+    // another thread(e.g. EventDispatcher on EPOLLERR) before sendmsg
+    // returns, especially over loopback, and must find the entry.
+    uint32_t seq = 0;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        seq = _next_seq++;
+        _pending.push_back(PendingSend());
+        _pending.back().seq = seq;
+        _pending.back().done = false;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = nvec;
+    const ssize_t nw = sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (nw <= 0) {
+        const int saved_errno = errno;
+        {
+            // Nothing was sent and the kernel did not consume `seq'. The
+            // entry can't be completed and is still the last one.
+            BAIDU_SCOPED_LOCK(_mutex);
+            if (!_pending.empty() && _pending.back().seq == seq) {
+                _pending.pop_back();
+                --_next_seq;
+            }
+        }
+        errno = saved_errno;
+        return nw;
+    }
+    // Kernel now references user pages of the written part, move the
+    // corresponding blocks into the pending list rather than releasing them.
+    butil::IOBuf written;
+    size_t npop_all = nw;
+    for (size_t i = 0; i < count && npop_all > 0; ++i) {
+        npop_all -= pieces[i]->cutn(&written, npop_all);
+    }
+    BAIDU_SCOPED_LOCK(_mutex);
+    if (!_pending.empty() && _pending.back().seq == seq) {
+        _pending.back().data.swap(written);
+        _pending_bytes += nw;
+    }
+    // Otherwise the send was completed and released by Reap() already,
+    // `written' is released at return.
+    return nw;
+}
+
+void ZeroCopyTracker::MarkDone(uint32_t lo, uint32_t hi) {
+    // [lo, hi] may wrap around.
+    const uint32_t range = hi - lo;
+    for (size_t i = 0; i < _pending.size(); ++i) {
+        PendingSend& ps = _pending[i];
+        if (ps.seq - lo <= range) {
+            ps.done = true;
+        }
+    }
+}
+
+int ZeroCopyTracker::Reap(int fd) {
+#if defined(OS_LINUX)
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        if (_pending.empty()) {
+            return 0;
+        }
+    }
+    int ncompleted = 0;
+    std::deque<PendingSend> released;
+    while (true) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // EAGAIN: no more notifications.
+            break;
+        }
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 &&
+                   cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            const struct sock_extended_err* serr =
+                (const struct sock_extended_err*)CMSG_DATA(cm);
+            if (serr->ee_errno != 0 ||
+                serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                _enabled.store(false, butil::memory_order_relaxed);
+            }
+            BAIDU_SCOPED_LOCK(_mutex);
+            MarkDone(serr->ee_info, serr->ee_data);
+            while (!_pending.empty() && _pending.front().done) {
+                _pending_bytes -= _pending.front().data.size();
+                released.push_back(PendingSend());
+                released.back().data.swap(_pending.front().data);
+                _pending.pop_front();
+                ++ncompleted;
+            }
+        }
+    }
+    // Blocks in `released' are returned to IOBuf pool outside the lock.
+    return ncompleted;
+#else
+    (void)fd;
+    return 0;
+#endif
+}
+
+size_t ZeroCopyTracker::pending_count() const {
+    BAIDU_SCOPED_LOCK(_mutex);
+    return _pending.size();
+}
+
+size_t ZeroCopyTracker::pending_bytes() const {
+    BAIDU_SCOPED_LOCK(_mutex);
+    return _pending_bytes;
+}
+
+} // namespace brpc
@@ -0,0 +1,105 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_DETAILS_ZEROCOPY_H
+#define BRPC_DETAILS_ZEROCOPY_H
+
+#include <stdint.h>
+#include <deque>
+#include "butil/iobuf.h"
+#include "butil/atomicops.h"
+#include "butil/synchronization/lock.h"
+
+namespace brpc {
+
+// Sends IOBuf with sendmsg(MSG_ZEROCOPY) and keeps the written blocks alive
+// until the kernel reports completion on the error queue of the fd. Without
+// the tracking, blocks returned to the IOBuf pool could be overwritten while
+// the NIC is still reading from them.
+// Only one thread may call CutMultipleIntoFileDescriptor at the same time
+// (guaranteed by the write exclusion of Socket), Reap() is thread-safe.
+class ZeroCopyTracker {
+public:
+    ZeroCopyTracker();
+    ~ZeroCopyTracker();
+
+    // Set SO_ZEROCOPY on `fd'. Return 0 on success, -1 otherwise(not
+    // supported by the kernel or the fd is not a TCP socket).
+    static int EnableOnFileDescriptor(int fd);
+
+    // Drop all pending data and start tracking a new fd. Sequence numbers
+    // of completions are per-socket in the kernel, so this must be called
+    // whenever the fd changes. Zero-copy is used only if `enabled' is true.
+    // Call CloseFileDescriptor() on the previous fd first, otherwise blocks
+    // still referenced by the kernel are released.
+    void Reset(bool enabled);
+
+    // Close `fd' which was written by this tracker. If sends are pending,
+    // they are moved to a background task which keeps their blocks until
+    // the kernel reports completion and closes `fd' after that, since the
+    // completions can only be read from the error queue of `fd'. The
+    // connection is aborted if they don't complete in a few seconds.
+    // This tracker has nothing pending after the call.
+    void CloseFileDescriptor(int fd);
+
+    // True if sendmsg(MSG_ZEROCOPY) should be tried. Becomes false after
+    // the kernel reports that it had to copy the data anyway(e.g. loopback
+    // or the device does not support scatter-gather), in which case
+    // zero-copy is only overhead.
+    bool enabled() const
+    { return _enabled.load(butil::memory_order_relaxed); }
+
+    // Like IOBuf::cut_multiple_into_file_descriptor() but written bytes are
+    // moved into the pending list instead of being released.
+    // Returns bytes written or -1 with errno set. ENOBUFS means the
+    // optmem limit of the socket is exhausted and caller should fall back
+    // to normal writes.
+    ssize_t CutMultipleIntoFileDescriptor(int fd, butil::IOBuf* const* pieces,
+                                          size_t count);
+
+    // Read completion notifications from the error queue of `fd' and
+    // release data of finished sends.
+    // Returns number of sends completed.
+    int Reap(int fd);
+
+    // Number of sends(and bytes) not completed by the kernel yet.
+    size_t pending_count() const;
+    size_t pending_bytes() const;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(ZeroCopyTracker);
+
+    struct PendingSend {
+        uint32_t seq;
+        bool done;
+        butil::IOBuf data;
+    };
+
+    void MarkDone(uint32_t lo, uint32_t hi);
+
+    mutable butil::Mutex _mutex;
+    butil::atomic<bool> _enabled;
+    // Kernel numbers successful MSG_ZEROCOPY sends of a socket from 0.
+    uint32_t _next_seq;
+    size_t _pending_bytes;
+    std::deque<PendingSend> _pending;
+};
+
+} // namespace brpc
+
+#endif  // BRPC_DETAILS_ZEROCOPY_H
@@ -20,6 +20,7 @@
 #include "butil/compat.h"
 #include "butil/fd_utility.h"                         // make_close_on_exec
 #include "butil/logging.h"                            // LOG
+#include "butil/time.h"                               // cpuwide_time_us
 #include "butil/third_party/murmurhash3/murmurhash3.h"// fmix32
 #include "bthread/bthread.h"                          // bthread_start_background
 #include "brpc/event_dispatcher.h"
@@ -29,6 +30,13 @@ namespace brpc {
 
 DEFINE_int32(event_dispatcher_num, 1, "Number of event dispatcher");
 
+DEFINE_int32(event_dispatcher_busy_poll_us, 0,
+             "Keep polling events without blocking for so many microseconds"
+             " before waiting in the kernel, which saves the latency of waking"
+             " up dispatchers at the cost of burning cpu. Only for servers"
+             " with dedicated cores. 0 means never busy-polling");
+BRPC_VALIDATE_GFLAG(event_dispatcher_busy_poll_us, NonNegativeInteger);
+
 DEFINE_bool(usercode_in_pthread, false, 
             "Call user's callback in pthreads, use bthreads otherwise");
 
@@ -44,8 +52,10 @@ static void StopAndJoinGlobalDispatchers() {
 void InitializeGlobalDispatchers() {
     g_edisp = new EventDispatcher[FLAGS_event_dispatcher_num];
     for (int i = 0; i < FLAGS_event_dispatcher_num; ++i) {
-        const bthread_attr_t attr = FLAGS_usercode_in_pthread ?
+        bthread_attr_t attr = FLAGS_usercode_in_pthread ?
             BTHREAD_ATTR_PTHREAD : BTHREAD_ATTR_NORMAL;
+        // Dispatchers serve all pools, don't run in the pool of the caller.
+        bthread_attr_settag(&attr, BTHREAD_TAG_DEFAULT);
         CHECK_EQ(0, g_edisp[i].Start(&attr));
     }
     // This atexit is will be run before g_task_control.stop() because above
@@ -62,9 +72,29 @@ EventDispatcher& GetGlobalEventDispatcher(int fd) {
     return g_edisp[index];
 }
 
+EventDispatcher& GetGlobalEventDispatcher(int fd, int index) {
+    if (index < 0) {
+        return GetGlobalEventDispatcher(fd);
+    }
+    pthread_once(&g_edisp_once, InitializeGlobalDispatchers);
+    return g_edisp[index % FLAGS_event_dispatcher_num];
+}
+
+static butil::atomic<bool> g_edisp_bound_to_workers(false);
+
+void BindGlobalEventDispatchersToWorkers() {
+    g_edisp_bound_to_workers.store(true, butil::memory_order_relaxed);
+}
+
+bool GlobalEventDispatchersBoundToWorkers() {
+    return g_edisp_bound_to_workers.load(butil::memory_order_relaxed);
+}
+
 } // namespace brpc
 
-#if defined(OS_LINUX)
+#if defined(OS_LINUX) && defined(BRPC_WITH_IO_URING)
+    #include "brpc/event_dispatcher_iouring.cpp"
+#elif defined(OS_LINUX)
     #include "brpc/event_dispatcher_epoll.cpp"
 #elif defined(OS_MACOSX)
     #include "brpc/event_dispatcher_kqueue.cpp"
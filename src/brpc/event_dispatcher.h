@@ -96,10 +96,26 @@ private:
 
     // Pipe fds to wakeup EventDispatcher from `epoll_wait' in order to quit
     int _wakeup_fds[2];
+
+#ifdef BRPC_WITH_IO_URING
+    // Rings shared with the kernel, _epfd is the io_uring fd.
+    struct IOUring;
+    IOUring* _ring;
+#endif
 };
 
 EventDispatcher& GetGlobalEventDispatcher(int fd);
 
+// Same as above, but returns the (index % -event_dispatcher_num)-th
+// dispatcher if `index' is non-negative.
+EventDispatcher& GetGlobalEventDispatcher(int fd, int index);
+
+// After calling this function, bthreads reading sockets bound to the i-th
+// global dispatcher (SocketOptions.dispatcher_index) are started in bthread
+// workers whose index modulo -event_dispatcher_num is i.
+void BindGlobalEventDispatchersToWorkers();
+bool GlobalEventDispatchersBoundToWorkers();
+
 } // namespace brpc
 
 
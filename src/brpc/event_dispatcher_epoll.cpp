@@ -195,15 +195,24 @@ void* EventDispatcher::RunThis(void* arg) {
 void EventDispatcher::Run() {
     while (!_stop) {
         epoll_event e[32];
+        int n = 0;
+        const int busy_poll_us = FLAGS_event_dispatcher_busy_poll_us;
+        if (busy_poll_us > 0) {
+            const int64_t deadline_us = butil::cpuwide_time_us() + busy_poll_us;
+            do {
+                n = epoll_wait(_epfd, e, ARRAY_SIZE(e), 0);
+            } while (n == 0 && !_stop &&
+                     butil::cpuwide_time_us() < deadline_us);
+        }
 #ifdef BRPC_ADDITIONAL_EPOLL
         // Performance downgrades in examples.
-        int n = epoll_wait(_epfd, e, ARRAY_SIZE(e), 0);
         if (n == 0) {
-            n = epoll_wait(_epfd, e, ARRAY_SIZE(e), -1);
+            n = epoll_wait(_epfd, e, ARRAY_SIZE(e), 0);
         }
-#else
-        const int n = epoll_wait(_epfd, e, ARRAY_SIZE(e), -1);
 #endif
+        if (n <= 0) {
+            n = epoll_wait(_epfd, e, ARRAY_SIZE(e), -1);
+        }
         if (_stop) {
             // epoll_ctl/epoll_wait should have some sort of memory fencing
             // guaranteeing that we(after epoll_wait) see _stop set before
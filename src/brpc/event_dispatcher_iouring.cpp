@@ -0,0 +1,649 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+// EventDispatcher on top of io_uring (Linux 5.13+), enabled by compiling
+// with -DBRPC_WITH_IO_URING. Every watched fd owns exactly one multishot
+// IORING_OP_POLL_ADD, so that EPOLL_CTL_MOD maps to an in-place poll update
+// and RemoveConsumer(fd) maps to a IORING_OP_POLL_REMOVE. user_data of the
+// poll is the fd plus a generation of the registration, completions of a
+// removed poll are ignored even if the fd number has been reused.
+// This dispatcher only reports readiness: there're no recv/send/accept
+// SQEs, reads and writes are still done by Socket in the readiness-driven
+// way. What's saved are syscalls of the dispatcher itself:
+//  - Completions are reaped directly from the mmaped CQ ring without
+//    entering the kernel as long as there're pending ones.
+//  - SQEs prepared while the polling bthread is busy are not submitted
+//    immediately but together in its next io_uring_enter, which also waits
+//    for completions. Only SQEs prepared while it's blocked in the kernel
+//    are submitted by callers.
+//  - With -io_uring_sqpoll, submissions don't enter the kernel at all.
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#include "butil/containers/flat_map.h"
+#include "butil/scoped_lock.h"
+
+namespace brpc {
+
+DEFINE_int32(io_uring_entries, 4096, "Number of SQ entries of each io_uring, "
+             "the CQ is 4 times larger");
+DEFINE_bool(io_uring_sqpoll, false, "Let a kernel thread poll the SQ of "
+            "io_uring so that adding/removing consumers does not need "
+            "syscalls. May require CAP_SYS_NICE on kernels before 5.11");
+DEFINE_int32(io_uring_sqpoll_idle_ms, 1000, "The SQ polling kernel thread "
+             "sleeps after being idle for so many milliseconds");
+
+// user_data of SQEs whose completions are not interesting.
+static const uint64_t IOURING_CONTROL_DATA = (uint64_t)-1;
+
+static const uint32_t IOURING_IN_EVENTS = POLLIN | POLLRDHUP | EPOLLET;
+static const uint32_t IOURING_OUT_EVENTS = POLLOUT | EPOLLET;
+
+inline uint64_t MakePollData(int fd, uint32_t generation) {
+    return ((uint64_t)generation << 32) | (uint32_t)fd;
+}
+
+struct EventDispatcher::IOUring {
+    struct PollEntry {
+        SocketId socket_id;
+        uint32_t events;
+        uint32_t generation;
+        uint64_t user_data(int fd) const { return MakePollData(fd, generation); }
+    };
+
+    IOUring() : sq_ring(NULL), sq_ring_size(0), cq_ring(NULL)
+              , cq_ring_size(0), sqes(NULL), sqes_size(0)
+              , next_generation(0), polling_in_kernel(false) {}
+
+    ~IOUring() {
+        if (sqes) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ring && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring) {
+            munmap(sq_ring, sq_ring_size);
+        }
+    }
+
+    int Map(int ring_fd);
+
+    // Get the next free SQE, must be called with `mutex' held.
+    io_uring_sqe* GetSQE(int ring_fd);
+
+    // Submit all filled SQEs, must be called with `mutex' held.
+    int Submit(int ring_fd);
+
+    // Submit filled SQEs only when the polling bthread is blocked in
+    // io_uring_enter, otherwise they're submitted by its next call to
+    // io_uring_enter. Must be called with `mutex' held.
+    int SubmitLazily(int ring_fd);
+
+    // Publish filled SQEs to the kernel and return the number of SQEs to be
+    // submitted by the next io_uring_enter. Must be called with `mutex' held.
+    unsigned PublishSQEs();
+
+    // Prepare a multishot poll on `fd', must be called with `mutex' held.
+    int PreparePollAdd(int ring_fd, int fd, const PollEntry& entry);
+
+    // Prepare the removal of the poll on `fd', must be called with `mutex'
+    // held.
+    int PreparePollRemove(int ring_fd, int fd, const PollEntry& entry);
+
+    // Prepare changing events of the poll on `fd' to `entry.events', must
+    // be called with `mutex' held.
+    int PreparePollUpdate(int ring_fd, int fd, const PollEntry& entry);
+
+    io_uring_params params;
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_flags;
+    unsigned* sq_array;
+    // Written by submitters only, protected by `mutex'
+    unsigned sq_local_tail;
+
+    void* cq_ring;
+    size_t cq_ring_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    // Protects SQ and `entries'. CQ is only touched by the polling bthread.
+    butil::Mutex mutex;
+    // fd -> the poll watching it
+    butil::FlatMap<int, PollEntry> entries;
+    uint32_t next_generation;
+    // True when the polling bthread is (going to be) blocked in
+    // io_uring_enter and can't submit SQEs.
+    bool polling_in_kernel;
+};
+
+static int sys_io_uring_setup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit,
+                        min_complete, flags, NULL, 0);
+}
+
+int EventDispatcher::IOUring::Map(int ring_fd) {
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        cq_ring_size = sq_ring_size;
+    }
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = NULL;
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            cq_ring = NULL;
+            return -1;
+        }
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* p = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+    sqes = (io_uring_sqe*)p;
+
+    char* sq = (char*)sq_ring;
+    sq_head = (unsigned*)(sq + params.sq_off.head);
+    sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    sq_flags = (unsigned*)(sq + params.sq_off.flags);
+    sq_array = (unsigned*)(sq + params.sq_off.array);
+    sq_local_tail = *sq_tail;
+
+    char* cq = (char*)cq_ring;
+    cq_head = (unsigned*)(cq + params.cq_off.head);
+    cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+io_uring_sqe* EventDispatcher::IOUring::GetSQE(int ring_fd) {
+    while (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)
+           >= params.sq_entries) {
+        // SQ is full, which only happens when the SQ polling thread lags.
+        if (Submit(ring_fd) < 0) {
+            return NULL;
+        }
+        sched_yield();
+    }
+    const unsigned index = sq_local_tail & *sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++sq_local_tail;
+    return sqe;
+}
+
+unsigned EventDispatcher::IOUring::PublishSQEs() {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    if (params.flags & IORING_SETUP_SQPOLL) {
+        return 0;
+    }
+    // SQEs not consumed by the kernel yet, including the ones published by
+    // a failed io_uring_enter.
+    return sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+}
+
+int EventDispatcher::IOUring::SubmitLazily(int ring_fd) {
+    if (!polling_in_kernel && !(params.flags & IORING_SETUP_SQPOLL)) {
+        return 0;
+    }
+    return Submit(ring_fd);
+}
+
+int EventDispatcher::IOUring::Submit(int ring_fd) {
+    const unsigned to_submit = PublishSQEs();
+    if (params.flags & IORING_SETUP_SQPOLL) {
+        // Pairs with the barrier in kernel before setting NEED_WAKEUP.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+            if (sys_io_uring_enter(ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if (to_submit == 0) {
+        return 0;
+    }
+    int rc = 0;
+    do {
+        rc = sys_io_uring_enter(ring_fd, to_submit, 0, 0);
+    } while (rc < 0 && errno == EINTR);
+    return rc < 0 ? -1 : 0;
+}
+
+int EventDispatcher::IOUring::PreparePollAdd(
+    int ring_fd, int fd, const PollEntry& entry) {
+    io_uring_sqe* sqe = GetSQE(ring_fd);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = entry.events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = entry.user_data(fd);
+    return 0;
+}
+
+int EventDispatcher::IOUring::PreparePollRemove(
+    int ring_fd, int fd, const PollEntry& entry) {
+    io_uring_sqe* sqe = GetSQE(ring_fd);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = entry.user_data(fd);
+    sqe->user_data = IOURING_CONTROL_DATA;
+    return 0;
+}
+
+int EventDispatcher::IOUring::PreparePollUpdate(
+    int ring_fd, int fd, const PollEntry& entry) {
+    io_uring_sqe* sqe = GetSQE(ring_fd);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = entry.user_data(fd);
+    sqe->poll32_events = entry.events;
+    // Without IORING_POLL_ADD_MULTI, the updated poll would be oneshot.
+    sqe->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+    sqe->user_data = IOURING_CONTROL_DATA;
+    return 0;
+}
+
+EventDispatcher::EventDispatcher()
+    : _epfd(-1)
+    , _stop(false)
+    , _tid(0)
+    , _consumer_thread_attr(BTHREAD_ATTR_NORMAL)
+    , _ring(NULL)
+{
+    _wakeup_fds[0] = -1;
+    _wakeup_fds[1] = -1;
+
+    IOUring* ring = new IOUring;
+    memset(&ring->params, 0, sizeof(ring->params));
+    ring->params.flags = IORING_SETUP_CQSIZE;
+    ring->params.cq_entries = FLAGS_io_uring_entries * 4;
+    if (FLAGS_io_uring_sqpoll) {
+        ring->params.flags |= IORING_SETUP_SQPOLL;
+        ring->params.sq_thread_idle = FLAGS_io_uring_sqpoll_idle_ms;
+    }
+    _epfd = sys_io_uring_setup(FLAGS_io_uring_entries, &ring->params);
+    if (_epfd < 0) {
+        PLOG(FATAL) << "Fail to create io_uring";
+        delete ring;
+        return;
+    }
+    CHECK_EQ(0, butil::make_close_on_exec(_epfd));
+    if (ring->Map(_epfd) != 0) {
+        PLOG(FATAL) << "Fail to mmap io_uring";
+        delete ring;
+        close(_epfd);
+        _epfd = -1;
+        return;
+    }
+    if (ring->entries.init(1024) != 0) {
+        LOG(FATAL) << "Fail to init entries of io_uring";
+        delete ring;
+        close(_epfd);
+        _epfd = -1;
+        return;
+    }
+    _ring = ring;
+}
+
+EventDispatcher::~EventDispatcher() {
+    Stop();
+    Join();
+    if (_epfd >= 0) {
+        close(_epfd);
+        _epfd = -1;
+    }
+    delete _ring;
+    _ring = NULL;
+}
+
+int EventDispatcher::Start(const bthread_attr_t* consumer_thread_attr) {
+    if (_epfd < 0) {
+        LOG(FATAL) << "io_uring was not created";
+        return -1;
+    }
+
+    if (_tid != 0) {
+        LOG(FATAL) << "Already started this dispatcher(" << this
+                   << ") in bthread=" << _tid;
+        return -1;
+    }
+
+    // Set _consumer_thread_attr before creating polling thread to make sure
+    // everyting seems sane to the thread.
+    _consumer_thread_attr = (consumer_thread_attr  ?
+                             *consumer_thread_attr : BTHREAD_ATTR_NORMAL);
+
+    // Same as the epoll version, the flag NEVER_QUIT must not be in
+    // _consumer_thread_attr.
+    bthread_attr_t epoll_thread_attr = _consumer_thread_attr | BTHREAD_NEVER_QUIT;
+
+    int rc = bthread_start_background(
+        &_tid, &epoll_thread_attr, RunThis, this);
+    if (rc) {
+        LOG(FATAL) << "Fail to create io_uring thread: " << berror(rc);
+        return -1;
+    }
+    return 0;
+}
+
+bool EventDispatcher::Running() const {
+    return !_stop  && _epfd >= 0 && _tid != 0;
+}
+
+void EventDispatcher::Stop() {
+    _stop = true;
+
+    if (_epfd >= 0) {
+        // Wake up the polling thread with a NOP.
+        BAIDU_SCOPED_LOCK(_ring->mutex);
+        io_uring_sqe* sqe = _ring->GetSQE(_epfd);
+        if (sqe) {
+            sqe->opcode = IORING_OP_NOP;
+            sqe->user_data = IOURING_CONTROL_DATA;
+            _ring->Submit(_epfd);
+        }
+    }
+}
+
+void EventDispatcher::Join() {
+    if (_tid) {
+        bthread_join(_tid, NULL);
+        _tid = 0;
+    }
+}
+
+int EventDispatcher::AddEpollOut(SocketId socket_id, int fd, bool pollin) {
+    if (_epfd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    BAIDU_SCOPED_LOCK(_ring->mutex);
+    IOUring::PollEntry* entry = _ring->entries.seek(fd);
+    if (pollin) {
+        if (entry == NULL) {
+            // This fd has been removed via `RemoveConsumer'
+            errno = ENOENT;
+            return -1;
+        }
+        entry->events = IOURING_IN_EVENTS | IOURING_OUT_EVENTS;
+        if (_ring->PreparePollUpdate(_epfd, fd, *entry) != 0) {
+            return -1;
+        }
+    } else {
+        if (entry != NULL) {
+            errno = EEXIST;
+            return -1;
+        }
+        IOUring::PollEntry e = { socket_id, IOURING_OUT_EVENTS,
+                                 _ring->next_generation++ };
+        if (_ring->PreparePollAdd(_epfd, fd, e) != 0) {
+            return -1;
+        }
+        _ring->entries[fd] = e;
+    }
+    return _ring->SubmitLazily(_epfd);
+}
+
+int EventDispatcher::RemoveEpollOut(SocketId socket_id,
+                                    int fd, bool pollin) {
+    if (_epfd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    BAIDU_SCOPED_LOCK(_ring->mutex);
+    IOUring::PollEntry* entry = _ring->entries.seek(fd);
+    if (entry == NULL || entry->socket_id != socket_id) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (pollin) {
+        entry->events = IOURING_IN_EVENTS;
+        if (_ring->PreparePollUpdate(_epfd, fd, *entry) != 0) {
+            return -1;
+        }
+    } else {
+        if (_ring->PreparePollRemove(_epfd, fd, *entry) != 0) {
+            return -1;
+        }
+        _ring->entries.erase(fd);
+    }
+    return _ring->SubmitLazily(_epfd);
+}
+
+int EventDispatcher::AddConsumer(SocketId socket_id, int fd) {
+    if (_epfd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    BAIDU_SCOPED_LOCK(_ring->mutex);
+    if (_ring->entries.seek(fd) != NULL) {
+        errno = EEXIST;
+        return -1;
+    }
+    IOUring::PollEntry e = { socket_id, IOURING_IN_EVENTS,
+                             _ring->next_generation++ };
+    if (_ring->PreparePollAdd(_epfd, fd, e) != 0) {
+        return -1;
+    }
+    _ring->entries[fd] = e;
+    return _ring->SubmitLazily(_epfd);
+}
+
+int EventDispatcher::RemoveConsumer(int fd) {
+    if (fd < 0) {
+        return -1;
+    }
+    // The poll holds a reference to the file, which is not released by
+    // closing the fd. The removal may be submitted later by the polling
+    // bthread, completions before that are ignored since the entry is gone.
+    BAIDU_SCOPED_LOCK(_ring->mutex);
+    IOUring::PollEntry* entry = _ring->entries.seek(fd);
+    if (entry == NULL) {
+        LOG(WARNING) << "Fail to remove fd=" << fd << " from io_uring="
+                     << _epfd << ": not found";
+        return -1;
+    }
+    const int rc = _ring->PreparePollRemove(_epfd, fd, *entry);
+    _ring->entries.erase(fd);
+    if (rc != 0 || _ring->SubmitLazily(_epfd) != 0) {
+        PLOG(WARNING) << "Fail to remove fd=" << fd << " from io_uring="
+                      << _epfd;
+        return -1;
+    }
+    return 0;
+}
+
+void* EventDispatcher::RunThis(void* arg) {
+    ((EventDispatcher*)arg)->Run();
+    return NULL;
+}
+
+void EventDispatcher::Run() {
+    struct Event {
+        SocketId socket_id;
+        uint32_t events;
+    };
+    struct FailedPoll {
+        SocketId socket_id;
+        int fd;
+        int error_code;
+    };
+    IOUring* const ring = _ring;
+    while (!_stop) {
+        Event e[32];
+        int n = 0;
+        FailedPoll failed[ARRAY_SIZE(e)];
+        int nfailed = 0;
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        const int busy_poll_us = FLAGS_event_dispatcher_busy_poll_us;
+        if (head == tail && busy_poll_us > 0) {
+            // Completions are posted to the shared ring without entering
+            // the kernel, spinning on the tail is enough.
+            const int64_t deadline_us = butil::cpuwide_time_us() + busy_poll_us;
+            do {
+                tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            } while (head == tail && !_stop &&
+                     // Stop spinning when there are SQEs to submit.
+                     __atomic_load_n(&ring->sq_local_tail, __ATOMIC_RELAXED) ==
+                     __atomic_load_n(ring->sq_tail, __ATOMIC_RELAXED) &&
+                     butil::cpuwide_time_us() < deadline_us);
+        }
+        if (head == tail) {
+            unsigned to_submit = 0;
+            {
+                // SQEs prepared after this point are submitted by callers.
+                BAIDU_SCOPED_LOCK(ring->mutex);
+                to_submit = ring->PublishSQEs();
+                ring->polling_in_kernel = true;
+            }
+            const int rc = sys_io_uring_enter(
+                _epfd, to_submit, 1, IORING_ENTER_GETEVENTS);
+            const int saved_errno = errno;
+            {
+                BAIDU_SCOPED_LOCK(ring->mutex);
+                ring->polling_in_kernel = false;
+            }
+            errno = saved_errno;
+            if (_stop) {
+                // Same as epoll_wait, io_uring_enter orders with the
+                // submission of the NOP in Stop().
+                break;
+            }
+            if (rc < 0 && errno != EINTR && errno != EAGAIN &&
+                errno != EBUSY) {
+                PLOG(FATAL) << "Fail to io_uring_enter fd=" << _epfd;
+                break;
+            }
+            continue;
+        }
+        {
+            BAIDU_SCOPED_LOCK(ring->mutex);
+            for (; head != tail && n + nfailed < (int)ARRAY_SIZE(e); ++head) {
+                const io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+                if (cqe->user_data == IOURING_CONTROL_DATA) {
+                    continue;
+                }
+                const int fd = (int)(uint32_t)cqe->user_data;
+                IOUring::PollEntry* entry = ring->entries.seek(fd);
+                if (entry == NULL || entry->user_data(fd) != cqe->user_data) {
+                    // Removed by RemoveConsumer/RemoveEpollOut, the fd may
+                    // have been reused by another socket.
+                    continue;
+                }
+                if (cqe->res < 0) {
+                    if (cqe->res != -ECANCELED) {
+                        // The poll is terminated and the fd would never be
+                        // polled again. Fail the socket which removes the
+                        // entry when it closes the fd.
+                        failed[nfailed].socket_id = entry->socket_id;
+                        failed[nfailed].fd = fd;
+                        failed[nfailed].error_code = -cqe->res;
+                        ++nfailed;
+                    }
+                } else {
+                    e[n].socket_id = entry->socket_id;
+                    e[n].events = (uint32_t)cqe->res;
+                    ++n;
+                }
+                if (!(cqe->flags & IORING_CQE_F_MORE) && cqe->res >= 0) {
+                    // The multishot poll was terminated by kernel, typically
+                    // because CQ was overflowed, arm it again.
+                    ring->PreparePollAdd(_epfd, fd, *entry);
+                }
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+            // Submit SQEs prepared since last io_uring_enter in one syscall,
+            // otherwise they may wait for long when completions keep coming.
+            if (ring->PublishSQEs() != 0) {
+                ring->Submit(_epfd);
+            }
+        }
+        // Failing a socket may recycle it and call RemoveConsumer(), which
+        // locks `mutex'.
+        for (int i = 0; i < nfailed; ++i) {
+            SocketUniquePtr s;
+            if (Socket::Address(failed[i].socket_id, &s) == 0) {
+                s->SetFailed(failed[i].error_code,
+                             "Fail to poll fd=%d in io_uring=%d: %s",
+                             failed[i].fd, _epfd,
+                             berror(failed[i].error_code));
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            if (e[i].events & (POLLIN | POLLERR | POLLHUP | POLLRDHUP)) {
+                // We don't care about the return value.
+                Socket::StartInputEvent(e[i].socket_id, e[i].events,
+                                        _consumer_thread_attr);
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            if (e[i].events & (POLLOUT | POLLERR | POLLHUP)) {
+                // We don't care about the return value.
+                Socket::HandleEpollOut(e[i].socket_id);
+            }
+        }
+    }
+}
+
+} // namespace brpc
@@ -189,7 +189,19 @@ void* EventDispatcher::RunThis(void* arg) {
 void EventDispatcher::Run() {
     while (!_stop) {
         struct kevent e[32];
-        int n = kevent(_epfd, NULL, 0, e, ARRAY_SIZE(e), NULL);
+        int n = 0;
+        const int busy_poll_us = FLAGS_event_dispatcher_busy_poll_us;
+        if (busy_poll_us > 0) {
+            const timespec zero = { 0, 0 };
+            const int64_t deadline_us = butil::cpuwide_time_us() + busy_poll_us;
+            do {
+                n = kevent(_epfd, NULL, 0, e, ARRAY_SIZE(e), &zero);
+            } while (n == 0 && !_stop &&
+                     butil::cpuwide_time_us() < deadline_us);
+        }
+        if (n <= 0) {
+            n = kevent(_epfd, NULL, 0, e, ARRAY_SIZE(e), NULL);
+        }
         if (_stop) {
             // EV_SET/kevent should have some sort of memory fencing
             // guaranteeing that we(after kevent) see _stop set before
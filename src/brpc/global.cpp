@@ -54,6 +54,8 @@
 #include "brpc/compress.h"
 #include "brpc/policy/gzip_compress.h"
 #include "brpc/policy/snappy_compress.h"
+#include "brpc/policy/lz4_compress.h"
+#include "brpc/policy/zstd_compress.h"
 
 // Protocols
 #include "brpc/protocol.h"
@@ -194,6 +196,12 @@ static int64_t GetIOBufNewBigViewCount(void*) {
 static int64_t GetIOBufBlockMemory(void*) {
     return butil::IOBuf::block_memory();
 }
+static int64_t GetIOBufBlockCountOfSize(void* arg) {
+    return butil::IOBuf::block_count_of_size((size_t)arg);
+}
+static int64_t GetIOBufHugePageArenaMemory(void*) {
+    return butil::IOBuf::hugepage_arena_memory();
+}
 
 // Defined in server.cpp
 extern butil::static_atomic<int> g_running_server_count;
@@ -215,6 +223,14 @@ static void* GlobalUpdate(void*) {
         "iobuf_newbigview_second", &var_iobuf_new_bigview_count);
     bvar::PassiveStatus<int64_t> var_iobuf_block_memory(
         "iobuf_block_memory", GetIOBufBlockMemory, NULL);
+    bvar::PassiveStatus<int64_t> var_iobuf_block_count_8k(
+        "iobuf_block_count_8k", GetIOBufBlockCountOfSize, (void*)(8 * 1024));
+    bvar::PassiveStatus<int64_t> var_iobuf_block_count_64k(
+        "iobuf_block_count_64k", GetIOBufBlockCountOfSize, (void*)(64 * 1024));
+    bvar::PassiveStatus<int64_t> var_iobuf_block_count_1m(
+        "iobuf_block_count_1m", GetIOBufBlockCountOfSize, (void*)(1024 * 1024));
+    bvar::PassiveStatus<int64_t> var_iobuf_hugepage_arena_memory(
+        "iobuf_hugepage_arena_memory", GetIOBufHugePageArenaMemory, NULL);
     bvar::PassiveStatus<int> var_running_server_count(
         "rpc_server_count", GetRunningServerCount, NULL);
 
@@ -389,13 +405,29 @@ static void GlobalInitializeOrDieImpl() {
     if (RegisterCompressHandler(COMPRESS_TYPE_SNAPPY, snappy_compress) != 0) {
         exit(1);
     }
+#ifdef BRPC_WITH_LZ4
+    const CompressHandler lz4_compress =
+        { Lz4Compress, Lz4Decompress, "lz4" };
+    if (RegisterCompressHandler(COMPRESS_TYPE_LZ4, lz4_compress) != 0) {
+        exit(1);
+    }
+#endif
+#ifdef BRPC_WITH_ZSTD
+    const CompressHandler zstd_compress =
+        { ZstdCompress, ZstdDecompress, "zstd" };
+    if (RegisterCompressHandler(COMPRESS_TYPE_ZSTD, zstd_compress) != 0) {
+        exit(1);
+    }
+#endif
 
     // Protocols
     Protocol baidu_protocol = { ParseRpcMessage,
                                 SerializeRequestDefault, PackRpcRequest,
                                 ProcessRpcRequest, ProcessRpcResponse,
                                 VerifyRpcRequest, NULL, NULL,
-                                CONNECTION_TYPE_ALL, "baidu_std" };
+                                CONNECTION_TYPE_ALL, "baidu_std",
+                                IsHighPriorityRpcRequest,
+                                IsInlineSafeRpcRequest };
     if (RegisterProtocol(PROTOCOL_BAIDU_STD, baidu_protocol) != 0) {
         exit(1);
     }
@@ -404,7 +436,8 @@ static void GlobalInitializeOrDieImpl() {
                                     NULL, NULL, ProcessStreamingMessage,
                                     ProcessStreamingMessage,
                                     NULL, NULL, NULL,
-                                    CONNECTION_TYPE_SINGLE, "streaming_rpc" };
+                                    CONNECTION_TYPE_SINGLE, "streaming_rpc",
+                                    NULL, NULL };
 
     if (RegisterProtocol(PROTOCOL_STREAMING_RPC, streaming_protocol) != 0) {
         exit(1);
@@ -416,7 +449,8 @@ static void GlobalInitializeOrDieImpl() {
                                VerifyHttpRequest, ParseHttpServerAddress,
                                GetHttpMethodName,
                                CONNECTION_TYPE_POOLED_AND_SHORT,
-                               "http" };
+                               "http",
+                               NULL, NULL };
     if (RegisterProtocol(PROTOCOL_HTTP, http_protocol) != 0) {
         exit(1);
     }
@@ -427,7 +461,8 @@ static void GlobalInitializeOrDieImpl() {
                                 VerifyHttpRequest, ParseHttpServerAddress,
                                 GetHttpMethodName,
                                 CONNECTION_TYPE_SINGLE,
-                                "h2" };
+                                "h2",
+                                NULL, NULL };
     if (RegisterProtocol(PROTOCOL_H2, http2_protocol) != 0) {
         exit(1);
     }
@@ -436,7 +471,8 @@ static void GlobalInitializeOrDieImpl() {
                                SerializeRequestDefault, PackHuluRequest,
                                ProcessHuluRequest, ProcessHuluResponse,
                                VerifyHuluRequest, NULL, NULL,
-                               CONNECTION_TYPE_ALL, "hulu_pbrpc" };
+                               CONNECTION_TYPE_ALL, "hulu_pbrpc",
+                               NULL, NULL };
     if (RegisterProtocol(PROTOCOL_HULU_PBRPC, hulu_protocol) != 0) {
         exit(1);
     }
@@ -446,7 +482,8 @@ static void GlobalInitializeOrDieImpl() {
                                SerializeNovaRequest, PackNovaRequest,
                                NULL, ProcessNovaResponse,
                                NULL, NULL, NULL,
-                               CONNECTION_TYPE_POOLED_AND_SHORT,  "nova_pbrpc" };
+                               CONNECTION_TYPE_POOLED_AND_SHORT,  "nova_pbrpc",
+                               NULL, NULL };
     if (RegisterProtocol(PROTOCOL_NOVA_PBRPC, nova_protocol) != 0) {
         exit(1);
     }
@@ -460,7 +497,8 @@ static void GlobalInitializeOrDieImpl() {
                                        // public_pbrpc server implementation
                                        // doesn't support full duplex
                                        CONNECTION_TYPE_POOLED_AND_SHORT,
-                                       "public_pbrpc" };
+                                       "public_pbrpc",
+                                       NULL, NULL };
     if (RegisterProtocol(PROTOCOL_PUBLIC_PBRPC, public_pbrpc_protocol) != 0) {
         exit(1);
     }
@@ -469,7 +507,8 @@ static void GlobalInitializeOrDieImpl() {
                                SerializeRequestDefault, PackSofaRequest,
                                ProcessSofaRequest, ProcessSofaResponse,
                                VerifySofaRequest, NULL, NULL,
-                               CONNECTION_TYPE_ALL, "sofa_pbrpc" };
+                               CONNECTION_TYPE_ALL, "sofa_pbrpc",
+                               NULL, NULL };
     if (RegisterProtocol(PROTOCOL_SOFA_PBRPC, sofa_protocol) != 0) {
         exit(1);
     }
@@ -481,7 +520,8 @@ static void GlobalInitializeOrDieImpl() {
                                  SerializeNsheadRequest, PackNsheadRequest,
                                  ProcessNsheadRequest, ProcessNsheadResponse,
                                  VerifyNsheadRequest, NULL, NULL,
-                                 CONNECTION_TYPE_POOLED_AND_SHORT, "nshead" };
+                                 CONNECTION_TYPE_POOLED_AND_SHORT, "nshead",
+                                 NULL, NULL };
     if (RegisterProtocol(PROTOCOL_NSHEAD, nshead_protocol) != 0) {
         exit(1);
     }
@@ -491,7 +531,8 @@ static void GlobalInitializeOrDieImpl() {
                                     PackMemcacheRequest,
                                     NULL, ProcessMemcacheResponse,
                                     NULL, NULL, GetMemcacheMethodName,
-                                    CONNECTION_TYPE_ALL, "memcache" };
+                                    CONNECTION_TYPE_ALL, "memcache",
+                                    NULL, NULL };
     if (RegisterProtocol(PROTOCOL_MEMCACHE, mc_binary_protocol) != 0) {
         exit(1);
     }
@@ -501,7 +542,8 @@ static void GlobalInitializeOrDieImpl() {
                                 PackRedisRequest,
                                 ProcessRedisRequest, ProcessRedisResponse,
                                 NULL, NULL, GetRedisMethodName,
-                                CONNECTION_TYPE_ALL, "redis" };
+                                CONNECTION_TYPE_ALL, "redis",
+                                NULL, NULL };
     if (RegisterProtocol(PROTOCOL_REDIS, redis_protocol) != 0) {
         exit(1);
     }
@@ -510,7 +552,8 @@ static void GlobalInitializeOrDieImpl() {
                                 NULL, NULL,
                                 ProcessMongoRequest, NULL,
                                 NULL, NULL, NULL,
-                                CONNECTION_TYPE_POOLED, "mongo" };
+                                CONNECTION_TYPE_POOLED, "mongo",
+                                NULL, NULL };
     if (RegisterProtocol(PROTOCOL_MONGO, mongo_protocol) != 0) {
         exit(1);
     }
@@ -522,7 +565,8 @@ static void GlobalInitializeOrDieImpl() {
         policy::SerializeThriftRequest, policy::PackThriftRequest,
         policy::ProcessThriftRequest, policy::ProcessThriftResponse,
         policy::VerifyThriftRequest, NULL, NULL,
-        CONNECTION_TYPE_POOLED_AND_SHORT, "thrift" };
+        CONNECTION_TYPE_POOLED_AND_SHORT, "thrift",
+        NULL, NULL };
     if (RegisterProtocol(PROTOCOL_THRIFT, thrift_binary_protocol) != 0) {
         exit(1);
     }
@@ -534,7 +578,8 @@ static void GlobalInitializeOrDieImpl() {
         SerializeUbrpcCompackRequest, PackUbrpcRequest,
         NULL, ProcessUbrpcResponse,
         NULL, NULL, NULL,
-        CONNECTION_TYPE_POOLED_AND_SHORT,  "ubrpc_compack" };
+        CONNECTION_TYPE_POOLED_AND_SHORT,  "ubrpc_compack",
+        NULL, NULL };
     if (RegisterProtocol(PROTOCOL_UBRPC_COMPACK, ubrpc_compack_protocol) != 0) {
         exit(1);
     }
@@ -543,7 +588,8 @@ static void GlobalInitializeOrDieImpl() {
         SerializeUbrpcMcpack2Request, PackUbrpcRequest,
         NULL, ProcessUbrpcResponse,
         NULL, NULL, NULL,
-        CONNECTION_TYPE_POOLED_AND_SHORT,  "ubrpc_mcpack2" };
+        CONNECTION_TYPE_POOLED_AND_SHORT,  "ubrpc_mcpack2",
+        NULL, NULL };
     if (RegisterProtocol(PROTOCOL_UBRPC_MCPACK2, ubrpc_mcpack2_protocol) != 0) {
         exit(1);
     }
@@ -554,7 +600,8 @@ static void GlobalInitializeOrDieImpl() {
         SerializeNsheadMcpackRequest, PackNsheadMcpackRequest,
         NULL, ProcessNsheadMcpackResponse,
         NULL, NULL, NULL,
-        CONNECTION_TYPE_POOLED_AND_SHORT,  "nshead_mcpack" };
+        CONNECTION_TYPE_POOLED_AND_SHORT,  "nshead_mcpack",
+        NULL, NULL };
     if (RegisterProtocol(PROTOCOL_NSHEAD_MCPACK, nshead_mcpack_protocol) != 0) {
         exit(1);
     }
@@ -565,7 +612,8 @@ static void GlobalInitializeOrDieImpl() {
         ProcessRtmpMessage, ProcessRtmpMessage,
         NULL, NULL, NULL,
         (ConnectionType)(CONNECTION_TYPE_SINGLE|CONNECTION_TYPE_SHORT),
-        "rtmp" };
+        "rtmp",
+        NULL, NULL };
     if (RegisterProtocol(PROTOCOL_RTMP, rtmp_protocol) != 0) {
         exit(1);
     }
@@ -575,7 +623,8 @@ static void GlobalInitializeOrDieImpl() {
         SerializeEspRequest, PackEspRequest,
         NULL, ProcessEspResponse,
         NULL, NULL, NULL,
-        CONNECTION_TYPE_POOLED_AND_SHORT, "esp"};
+        CONNECTION_TYPE_POOLED_AND_SHORT, "esp",
+        NULL, NULL };
     if (RegisterProtocol(PROTOCOL_ESP, esp_protocol) != 0) {
         exit(1);
     }
@@ -592,6 +641,8 @@ static void GlobalInitializeOrDieImpl() {
             handler.verify = NULL;
             handler.arg = NULL;
             handler.name = protocols[i].name;
+            handler.is_high_priority = NULL;
+            handler.is_inline_safe = NULL;
             if (get_or_new_client_side_messenger()->AddHandler(handler) != 0) {
                 exit(1);
             }
@@ -44,6 +44,9 @@ public:
     // Arg of the InputMessageHandler which parses this message successfully.
     const void* arg() const { return _arg; }
 
+    // True if the message should be processed in a high-priority bthread.
+    bool high_priority() const { return _high_priority; }
+
     // [Internal]
     int64_t received_us() const { return _received_us; }
     int64_t base_real_us() const { return _base_real_us; }
@@ -60,6 +63,7 @@ friend class Stream;
     SocketUniquePtr _socket;
     void (*_process)(InputMessageBase* msg);
     const void* _arg;
+    bool _high_priority;
 };
 
 } // namespace brpc
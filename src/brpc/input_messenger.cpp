@@ -16,6 +16,7 @@
 // under the License.
 
 
+#include <sys/ioctl.h>                           // FIONREAD
 #include <gflags/gflags.h>
 #include "butil/fd_guard.h"                      // fd_guard
 #include "butil/logging.h"                       // CHECK
@@ -52,12 +53,28 @@ DEFINE_bool(log_connection_close, false,
             "Print log when remote side closes the connection");
 BRPC_VALIDATE_GFLAG(log_connection_close, PassValidate);
 
+DEFINE_int32(inline_process_budget_us, 100,
+             "Max microseconds spent on processing inline-safe messages in the "
+             "bthread reading a connection after each read, other messages "
+             "are processed in new bthreads as usual");
+BRPC_VALIDATE_GFLAG(inline_process_budget_us, PassValidate);
+
 DECLARE_bool(usercode_in_pthread);
 DECLARE_uint64(max_body_size);
 
+static bvar::Adder<int64_t>* g_inline_processed = NULL;
+static pthread_once_t s_create_vars_once = PTHREAD_ONCE_INIT;
+
+static void CreateVars() {
+    g_inline_processed = new bvar::Adder<int64_t>("rpc_inline_processed_count");
+}
+
 const size_t MSG_SIZE_WINDOW = 10;  // Take last so many message into stat.
 const size_t MIN_ONCE_READ = 4096;
 const size_t MAX_ONCE_READ = 524288;
+// Reads for large messages or long backlogs can go beyond MAX_ONCE_READ,
+// which fill at most 64 blocks of 64KB in one readv.
+const size_t MAX_LARGE_ONCE_READ = 4194304;
 
 ParseResult InputMessenger::CutInputMessage(
         Socket* m, size_t* index, bool read_eof) {
@@ -168,6 +185,9 @@ static void QueueMessage(InputMessageBase* to_run_msg,
     bthread_attr_t tmp = (FLAGS_usercode_in_pthread ?
                           BTHREAD_ATTR_PTHREAD :
                           BTHREAD_ATTR_NORMAL) | BTHREAD_NOSIGNAL;
+    if (to_run_msg->high_priority()) {
+        tmp.flags |= BTHREAD_HIGH_PRIORITY;
+    }
     tmp.keytable_pool = keytable_pool;
     if (bthread_start_background(
             &th, &tmp, ProcessInputMessage, to_run_msg) == 0) {
@@ -186,6 +206,9 @@ void InputMessenger::OnNewMessages(Socket* m) {
     //   "process") in this bthread. All messages except the last one will be
     //   processed in separate bthreads. To minimize the overhead, scheduling
     //   is batched(notice the BTHREAD_NOSIGNAL and bthread_flush).
+    // - Messages classified as inline-safe are processed in this bthread
+    //   right after being parsed, until -inline_process_budget_us is used
+    //   up for the read.
     // - Verify will always be called in this bthread at most once and before
     //   any process.
     InputMessenger* messenger = static_cast<InputMessenger*>(m->user());
@@ -197,6 +220,7 @@ void InputMessenger::OnNewMessages(Socket* m) {
     // OK in most cases.
     std::unique_ptr<InputMessageBase, RunLastMessage> last_msg;
     bool read_eof = false;
+    bool last_read_full = false;
     while (!read_eof) {
         const int64_t received_us = butil::cpuwide_time_us();
         const int64_t base_realtime = butil::gettimeofday_us() - received_us;
@@ -208,9 +232,29 @@ void InputMessenger::OnNewMessages(Socket* m) {
         } else if (once_read > MAX_ONCE_READ) {
             once_read = MAX_ONCE_READ;
         }
+        // A message larger than the average is partially received, read at
+        // least as many bytes as received so far so that the message is
+        // completed in a logarithmic number of reads.
+        const size_t partial_size = m->_last_msg_size + m->_read_buf.length();
+        if (partial_size > once_read) {
+            once_read = partial_size;
+        }
+        // Last read filled the buffer, more bytes are probably queued in
+        // the kernel, read all of them at once.
+        if (last_read_full) {
+            int backlog = 0;
+            if (ioctl(m->fd(), FIONREAD, &backlog) == 0 &&
+                (size_t)backlog > once_read) {
+                once_read = backlog;
+            }
+        }
+        if (once_read > MAX_LARGE_ONCE_READ) {
+            once_read = MAX_LARGE_ONCE_READ;
+        }
 
         // Read.
         const ssize_t nr = m->DoRead(once_read);
+        last_read_full = (nr > 0 && (size_t)nr >= once_read);
         if (nr <= 0) {
             if (0 == nr) {
                 // Set `read_eof' flag and proceed to feed EOF into `Protocol'
@@ -241,6 +285,7 @@ void InputMessenger::OnNewMessages(Socket* m) {
         
         size_t last_size = m->_read_buf.length();
         int num_bthread_created = 0;
+        int64_t inline_used_us = 0;
         while (1) {
             size_t index = 8888;
             ParseResult pr = messenger->CutInputMessage(m, &index, read_eof);
@@ -306,6 +351,13 @@ void InputMessenger::OnNewMessages(Socket* m) {
             m->PostponeEOF();
             msg->_process = handlers[index].process;
             msg->_arg = handlers[index].arg;
+            msg->_high_priority = (handlers[index].is_high_priority != NULL &&
+                                   handlers[index].is_high_priority(msg.get()));
+            const bool run_inline =
+                !msg->_high_priority &&
+                inline_used_us < FLAGS_inline_process_budget_us &&
+                handlers[index].is_inline_safe != NULL &&
+                handlers[index].is_inline_safe(msg.get());
             
             if (handlers[index].verify != NULL) {
                 int auth_error = 0;
@@ -327,8 +379,27 @@ void InputMessenger::OnNewMessages(Socket* m) {
                 }
             }
             if (!m->is_read_progressive()) {
-                // Transfer ownership to last_msg
-                last_msg.reset(msg.release());
+                if (msg->_high_priority) {
+                    // Not processed in-place, the high-priority bthread runs
+                    // before other bthreads in the worker.
+                    QueueMessage(msg.release(), &num_bthread_created,
+                                 m->_keytable_pool);
+                } else if (run_inline) {
+                    // Cheaper than creating a bthread. Messages queued
+                    // before are flushed first to not wait for this one.
+                    if (num_bthread_created) {
+                        bthread_flush();
+                        num_bthread_created = 0;
+                    }
+                    pthread_once(&s_create_vars_once, CreateVars);
+                    const int64_t begin_us = butil::cpuwide_time_us();
+                    ProcessInputMessage(msg.release());
+                    inline_used_us += butil::cpuwide_time_us() - begin_us;
+                    *g_inline_processed << 1;
+                } else {
+                    // Transfer ownership to last_msg
+                    last_msg.reset(msg.release());
+                }
             } else {
                 QueueMessage(msg.release(), &num_bthread_created,
                                  m->_keytable_pool);
@@ -65,6 +65,15 @@ struct InputMessageHandler {
 
     // Name of this handler, must be string constant.
     const char* name;
+
+    // [Optional] Returns true to process `msg' in a high-priority bthread.
+    typedef bool (*IsHighPriority)(const InputMessageBase* msg);
+    IsHighPriority is_high_priority;
+
+    // [Optional] Returns true if `msg' can be processed in the bthread
+    // reading the connection, within -inline_process_budget_us.
+    typedef bool (*IsInlineSafe)(const InputMessageBase* msg);
+    IsInlineSafe is_inline_safe;
 };
 
 // Process messages from connections.
@@ -16,6 +16,7 @@
 // under the License.
 
 
+#include <limits.h>                             // INT_MAX
 #include <google/protobuf/descriptor.h>         // MethodDescriptor
 #include <google/protobuf/message.h>            // Message
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
@@ -26,6 +27,7 @@
 #include "butil/raw_pack.h"                      // RawPacker RawUnpacker
 #include "brpc/controller.h"                    // Controller
 #include "brpc/socket.h"                        // Socket
+#include "brpc/reloadable_flags.h"              // BRPC_VALIDATE_GFLAG
 #include "brpc/server.h"                        // Server
 #include "brpc/span.h"
 #include "brpc/compress.h"                      // ParseFromCompressedData
@@ -38,6 +40,7 @@
 #include "brpc/details/usercode_backup_pool.h"
 #include "brpc/details/controller_private_accessor.h"
 #include "brpc/details/server_private_accessor.h"
+#include "brpc/details/rpc_batcher.h"
 
 extern "C" {
 void bthread_assign_data(void* data);
@@ -45,6 +48,9 @@ void bthread_assign_data(void* data);
 
 
 namespace brpc {
+
+DECLARE_int32(max_inline_latency_us);
+
 namespace policy {
 
 DEFINE_bool(baidu_protocol_use_fullname, true,
@@ -54,12 +60,50 @@ DEFINE_bool(baidu_protocol_use_fullname, true,
 DEFINE_bool(baidu_std_protocol_deliver_timeout_ms, false,
             "If this flag is true, baidu_std puts timeout_ms in requests.");
 
+DEFINE_int32(baidu_std_response_batch_window_us, 50,
+             "Responses to a client sending batched requests are batched "
+             "within so many microseconds. <= 0 means never batch responses");
+BRPC_VALIDATE_GFLAG(baidu_std_response_batch_window_us, PassValidate);
+
 // Notes:
 // 1. 12-byte header [PRPC][body_size][meta_size]
 // 2. body_size and meta_size are in network byte order
 // 3. Use service->full_name() + method_name to specify the method to call
 // 4. `attachment_size' is set iff request/response has attachment
 // 5. Not supported: chunk_info
+// 6. A frame with meta_size=0 and non-empty body is a batch, whose body is
+//    consecutive complete frames. Batches are sent only when the client
+//    enables ChannelOptions.batch_window_us, and the server replies in
+//    batches to such clients.
+
+// MostCommonMessage with the meta parsed by baidu_std when the request is
+// inspected before Process() (priority and inline checks), together with the
+// method it targets, so that the meta is parsed and looked up only once.
+// Pooled separately to keep other protocols free of RpcMeta.
+struct BAIDU_CACHELINE_ALIGNMENT BaiduRpcMessage : public MostCommonMessage {
+    mutable RpcMeta rpc_meta;
+    mutable bool rpc_meta_parsed;
+    mutable const Server::MethodProperty* method_property;
+
+    BaiduRpcMessage() : rpc_meta_parsed(false), method_property(NULL) {}
+
+    inline static BaiduRpcMessage* Get() {
+        return butil::get_object<BaiduRpcMessage>();
+    }
+
+    // @InputMessageBase
+    void DestroyImpl() {
+        meta.clear();
+        payload.clear();
+        pi.reset();
+        if (rpc_meta_parsed) {
+            rpc_meta.Clear();
+            rpc_meta_parsed = false;
+        }
+        method_property = NULL;
+        butil::return_object(this);
+    }
+};
 
 // Pack header into `buf'
 inline void PackRpcHeader(char* rpc_header, uint32_t meta_size, int payload_size) {
@@ -92,44 +136,97 @@ static void SerializeRpcHeaderAndMeta(
     }
 }
 
+void PackRpcBatchHeader(butil::IOBuf* out, size_t body_size) {
+    // RpcBatcher keeps batches within -max_rpc_batch_bytes(int32).
+    CHECK_LE(body_size, (size_t)INT_MAX);
+    char header[12];
+    PackRpcHeader(header, 0, (int)body_size);
+    out->append(header, sizeof(header));
+}
+
 ParseResult ParseRpcMessage(butil::IOBuf* source, Socket* socket,
                             bool /*read_eof*/, const void*) {
+    // Bytes left in the batch that frames are being cut from, 0 if the next
+    // frame is not inside a batch. Inner frames are plain frames that must
+    // not run past their batch.
+    size_t batch_remaining = (socket ? socket->rpc_batch_remaining() : 0);
     char header_buf[12];
-    const size_t n = source->copy_to(header_buf, sizeof(header_buf));
-    if (n >= 4) {
-        void* dummy = header_buf;
-        if (*(const uint32_t*)dummy != *(const uint32_t*)"PRPC") {
-            return MakeParseError(PARSE_ERROR_TRY_OTHERS);
-        }
-    } else {
-        if (memcmp(header_buf, "PRPC", n) != 0) {
-            return MakeParseError(PARSE_ERROR_TRY_OTHERS);
-        }
-    }
-    if (n < sizeof(header_buf)) {
-        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
-    }
     uint32_t body_size;
     uint32_t meta_size;
-    butil::RawUnpacker(header_buf + 4).unpack32(body_size).unpack32(meta_size);
-    if (body_size > FLAGS_max_body_size) {
-        // We need this log to report the body_size to give users some clues
-        // which is not printed in InputMessenger.
-        LOG(ERROR) << "body_size=" << body_size << " from "
-                   << socket->remote_side() << " is too large";
-        return MakeParseError(PARSE_ERROR_TOO_BIG_DATA);
-    } else if (source->length() < sizeof(header_buf) + body_size) {
-        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+    while (true) {
+        const ParseError not_rpc = (batch_remaining != 0 ?
+            PARSE_ERROR_ABSOLUTELY_WRONG : PARSE_ERROR_TRY_OTHERS);
+        const size_t n = source->copy_to(header_buf, sizeof(header_buf));
+        if (n >= 4) {
+            void* dummy = header_buf;
+            if (*(const uint32_t*)dummy != *(const uint32_t*)"PRPC") {
+                return MakeParseError(not_rpc);
+            }
+        } else {
+            if (memcmp(header_buf, "PRPC", n) != 0) {
+                return MakeParseError(not_rpc);
+            }
+        }
+        if (n < sizeof(header_buf)) {
+            // The whole batch is in `source' before its header is removed.
+            return MakeParseError(batch_remaining != 0 ?
+                                  PARSE_ERROR_ABSOLUTELY_WRONG :
+                                  PARSE_ERROR_NOT_ENOUGH_DATA);
+        }
+        butil::RawUnpacker(header_buf + 4).unpack32(body_size).unpack32(meta_size);
+        if (body_size > FLAGS_max_body_size) {
+            // We need this log to report the body_size to give users some clues
+            // which is not printed in InputMessenger.
+            LOG(ERROR) << "body_size=" << body_size << " from "
+                       << socket->remote_side() << " is too large";
+            return MakeParseError(PARSE_ERROR_TOO_BIG_DATA);
+        }
+        if (batch_remaining != 0) {
+            if (sizeof(header_buf) + body_size > batch_remaining) {
+                LOG(ERROR) << "Frame with body_size=" << body_size
+                           << " from " << socket->remote_side()
+                           << " runs past its batch";
+                return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+            }
+            if (meta_size == 0 && body_size != 0) {
+                LOG(ERROR) << "Nested batch from " << socket->remote_side();
+                return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+            }
+            break;
+        }
+        if (source->length() < sizeof(header_buf) + body_size) {
+            return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+        }
+        if (meta_size != 0 || body_size == 0) {
+            break;
+        }
+        if (socket == NULL) {
+            LOG(ERROR) << "Unexpected batch of " << body_size << " bytes";
+            return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+        }
+        // Remove header of the batch and cut frames inside one by one, each
+        // of them is processed as a separate message. Remember that the peer
+        // sends batches so that responses are batched as well.
+        source->pop_front(sizeof(header_buf));
+        socket->GetOrNewRpcBatcher();
+        batch_remaining = body_size;
     }
     if (meta_size > body_size) {
         LOG(ERROR) << "meta_size=" << meta_size << " is bigger than body_size="
                    << body_size;
+        if (batch_remaining != 0) {
+            return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+        }
         // Pop the message
         source->pop_front(sizeof(header_buf) + body_size);
         return MakeParseError(PARSE_ERROR_TRY_OTHERS);
     }
+    if (batch_remaining != 0) {
+        socket->set_rpc_batch_remaining(
+            batch_remaining - sizeof(header_buf) - body_size);
+    }
     source->pop_front(sizeof(header_buf));
-    MostCommonMessage* msg = MostCommonMessage::Get();
+    BaiduRpcMessage* msg = BaiduRpcMessage::Get();
     source->cutn(&msg->meta, meta_size);
     source->cutn(&msg->payload, body_size - meta_size);
     return MakeMessage(msg);
@@ -258,9 +355,20 @@ void SendRpcResponse(int64_t correlation_id,
     } else{
         // Have the risk of unlimited pending responses, in which case, tell
         // users to set max_concurrency.
-        Socket::WriteOptions wopt;
-        wopt.ignore_eovercrowded = true;
-        if (sock->Write(&res_buf, &wopt) != 0) {
+        int rc = 0;
+        if (FLAGS_baidu_std_response_batch_window_us > 0 &&
+            sock->rpc_batcher() != NULL) {
+            RpcBatcher::WriteOptions bopt;
+            bopt.window_us = FLAGS_baidu_std_response_batch_window_us;
+            bopt.ignore_eovercrowded = true;
+            bopt.pack_header = PackRpcBatchHeader;
+            rc = RpcBatcher::Write(sock, &res_buf, bopt);
+        } else {
+            Socket::WriteOptions wopt;
+            wopt.ignore_eovercrowded = true;
+            rc = sock->Write(&res_buf, &wopt);
+        }
+        if (rc != 0) {
             const int errcode = errno;
             PLOG_IF(WARNING, errcode != EPIPE) << "Fail to write into " << *sock;
             cntl->SetFailed(errcode, "Fail to write into %s",
@@ -309,21 +417,32 @@ void EndRunningCallMethodInPool(
     return EndRunningUserCodeInPool(CallMethodInBackupThread, args);
 };
 
+// Parse meta of `msg' into msg->rpc_meta unless it was parsed before.
+static bool ParseRpcMetaOnce(const BaiduRpcMessage* msg) {
+    if (!msg->rpc_meta_parsed) {
+        if (!ParsePbFromIOBuf(&msg->rpc_meta, msg->meta)) {
+            return false;
+        }
+        msg->rpc_meta_parsed = true;
+    }
+    return true;
+}
+
 void ProcessRpcRequest(InputMessageBase* msg_base) {
     const int64_t start_parse_us = butil::cpuwide_time_us();
-    DestroyingPtr<MostCommonMessage> msg(static_cast<MostCommonMessage*>(msg_base));
+    DestroyingPtr<BaiduRpcMessage> msg(static_cast<BaiduRpcMessage*>(msg_base));
     SocketUniquePtr socket_guard(msg->ReleaseSocket());
     Socket* socket = socket_guard.get();
     const Server* server = static_cast<const Server*>(msg_base->arg());
     ScopedNonServiceError non_service_error(server);
 
-    RpcMeta meta;
-    if (!ParsePbFromIOBuf(&meta, msg->meta)) {
+    if (!ParseRpcMetaOnce(msg.get())) {
         LOG(WARNING) << "Fail to parse RpcMeta from " << *socket;
         socket->SetFailed(EREQUEST, "Fail to parse RpcMeta from %s",
                           socket->description().c_str());
         return;
     }
+    RpcMeta& meta = msg->rpc_meta;
     const RpcRequestMeta &request_meta = meta.request();
 
     SampledRequest* sample = AskToBeSampled();
@@ -419,22 +538,26 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
             break;
         }
 
-        // NOTE(gejun): jprotobuf sends service names without packages. So the
-        // name should be changed to full when it's not.
-        butil::StringPiece svc_name(request_meta.service_name());
-        if (svc_name.find('.') == butil::StringPiece::npos) {
-            const Server::ServiceProperty* sp =
-                server_accessor.FindServicePropertyByName(svc_name);
-            if (NULL == sp) {
-                cntl->SetFailed(ENOSERVICE, "Fail to find service=%s",
-                                request_meta.service_name().c_str());
-                break;
+        // Reuse the method found when the request was inspected in
+        // InputMessenger, if any.
+        const Server::MethodProperty* mp = msg->method_property;
+        if (NULL == mp) {
+            // NOTE(gejun): jprotobuf sends service names without packages.
+            // So the name should be changed to full when it's not.
+            butil::StringPiece svc_name(request_meta.service_name());
+            if (svc_name.find('.') == butil::StringPiece::npos) {
+                const Server::ServiceProperty* sp =
+                    server_accessor.FindServicePropertyByName(svc_name);
+                if (NULL == sp) {
+                    cntl->SetFailed(ENOSERVICE, "Fail to find service=%s",
+                                    request_meta.service_name().c_str());
+                    break;
+                }
+                svc_name = sp->service->GetDescriptor()->full_name();
             }
-            svc_name = sp->service->GetDescriptor()->full_name();
-        }
-        const Server::MethodProperty* mp =
-            server_accessor.FindMethodPropertyByFullName(
+            mp = server_accessor.FindMethodPropertyByFullName(
                 svc_name, request_meta.method_name());
+        }
         if (NULL == mp) {
             cntl->SetFailed(ENOMETHOD, "Fail to find method=%s/%s",
                             request_meta.service_name().c_str(),
@@ -458,6 +581,9 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
                                 mp->method->full_name().c_str(), rejected_cc);
                 break;
             }
+            if (!method_status->CheckQueueTime(cntl.get())) {
+                break;
+            }
         }
         google::protobuf::Service* svc = mp->service;
         const google::protobuf::MethodDescriptor* method = mp->method;
@@ -531,16 +657,16 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
 }
 
 bool VerifyRpcRequest(const InputMessageBase* msg_base) {
-    const MostCommonMessage* msg =
-        static_cast<const MostCommonMessage*>(msg_base);
+    const BaiduRpcMessage* msg =
+        static_cast<const BaiduRpcMessage*>(msg_base);
     const Server* server = static_cast<const Server*>(msg->arg());
     Socket* socket = msg->socket();
     
-    RpcMeta meta;
-    if (!ParsePbFromIOBuf(&meta, msg->meta)) {
+    if (!ParseRpcMetaOnce(msg)) {
         LOG(WARNING) << "Fail to parse RpcRequestMeta";
         return false;
     }
+    const RpcMeta& meta = msg->rpc_meta;
     const Authenticator* auth = server->options().auth;
     if (NULL == auth) {
         // Fast pass (no authentication)
@@ -554,6 +680,65 @@ bool VerifyRpcRequest(const InputMessageBase* msg_base) {
     return true;
 }
 
+// Find the method that `msg' is sent to, NULL if not found. Both the parsed
+// meta and the method are cached in `msg' for ProcessRpcRequest.
+static const Server::MethodProperty* FindMethodPropertyOfRequest(
+    const BaiduRpcMessage* msg, ServerPrivateAccessor* server_accessor) {
+    if (msg->method_property != NULL) {
+        return msg->method_property;
+    }
+    if (!ParseRpcMetaOnce(msg) || !msg->rpc_meta.has_request()) {
+        return NULL;
+    }
+    const RpcRequestMeta& request_meta = msg->rpc_meta.request();
+    butil::StringPiece svc_name(request_meta.service_name());
+    if (svc_name.find('.') == butil::StringPiece::npos) {
+        const Server::ServiceProperty* sp =
+            server_accessor->FindServicePropertyByName(svc_name);
+        if (NULL == sp) {
+            return NULL;
+        }
+        svc_name = sp->service->GetDescriptor()->full_name();
+    }
+    msg->method_property = server_accessor->FindMethodPropertyByFullName(
+        svc_name, request_meta.method_name());
+    return msg->method_property;
+}
+
+bool IsHighPriorityRpcRequest(const InputMessageBase* msg_base) {
+    const BaiduRpcMessage* msg =
+        static_cast<const BaiduRpcMessage*>(msg_base);
+    ServerPrivateAccessor server_accessor(
+        static_cast<const Server*>(msg->arg()));
+    if (!server_accessor.has_high_priority_method()) {
+        // Don't parse the meta twice.
+        return false;
+    }
+    const Server::MethodProperty* mp =
+        FindMethodPropertyOfRequest(msg, &server_accessor);
+    return mp != NULL && mp->high_priority;
+}
+
+bool IsInlineSafeRpcRequest(const InputMessageBase* msg_base) {
+    const BaiduRpcMessage* msg =
+        static_cast<const BaiduRpcMessage*>(msg_base);
+    ServerPrivateAccessor server_accessor(
+        static_cast<const Server*>(msg->arg()));
+    if (!server_accessor.has_inline_safe_method()) {
+        return false;
+    }
+    const Server::MethodProperty* mp =
+        FindMethodPropertyOfRequest(msg, &server_accessor);
+    if (mp == NULL || !mp->inline_safe) {
+        return false;
+    }
+    // Stop inlining once the method becomes slow (e.g. cache misses fall
+    // through to backends), the average recovers with requests processed
+    // in bthreads.
+    return mp->status == NULL ||
+        mp->status->AverageLatency() <= FLAGS_max_inline_latency_us;
+}
+
 void ProcessRpcResponse(InputMessageBase* msg_base) {
     const int64_t start_parse_us = butil::cpuwide_time_us();
     DestroyingPtr<MostCommonMessage> msg(static_cast<MostCommonMessage*>(msg_base));
@@ -37,6 +37,13 @@ void ProcessRpcResponse(InputMessageBase* msg);
 // Verify authentication information in baidu_std format
 bool VerifyRpcRequest(const InputMessageBase* msg);
 
+// Returns true if the request is sent to a high-priority method.
+bool IsHighPriorityRpcRequest(const InputMessageBase* msg);
+
+// Returns true if the request is sent to an inline-safe method which is
+// fast recently.
+bool IsInlineSafeRpcRequest(const InputMessageBase* msg);
+
 // Pack `request' to `method' into `buf'.
 void PackRpcRequest(butil::IOBuf* buf,
                     SocketMessage**,
@@ -46,6 +53,9 @@ void PackRpcRequest(butil::IOBuf* buf,
                     const butil::IOBuf& request,
                     const Authenticator* auth);
 
+// Append the header of a batch of frames to `out', see RpcBatcher.
+void PackRpcBatchHeader(butil::IOBuf* out, size_t body_size);
+
 }  // namespace policy
 } // namespace brpc
 
@@ -1472,8 +1472,11 @@ void ProcessHttpRequest(InputMessageBase *msg) {
                     int64_t timeout_value_us =
                         ConvertGrpcTimeoutToUS(req_header.GetHeader(common->GRPC_TIMEOUT));
                     if (timeout_value_us >= 0) {
+                        // Count from receiving of the request so that time
+                        // spent in queues is deducted as well.
                         accessor.set_deadline_us(
-                                butil::gettimeofday_us() + timeout_value_us);
+                                msg->base_real_us() + msg->received_us() +
+                                timeout_value_us);
                     }
                 }
             } else {
@@ -1531,6 +1534,10 @@ void ProcessHttpRequest(InputMessageBase *msg) {
         cntl->request_attachment().swap(req_body);
     }
 
+    if (method_status && !method_status->CheckQueueTime(cntl)) {
+        return;
+    }
+
     google::protobuf::Closure* done = new HttpResponseSenderAsDone(&resp_sender);
     imsg_guard.reset();  // optional, just release resource ASAP
 
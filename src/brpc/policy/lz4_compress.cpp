@@ -0,0 +1,239 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <stdlib.h>                            // malloc
+#include <string.h>                            // memset
+#include <algorithm>                           // std::min
+#include "butil/logging.h"
+#include "butil/thread_local.h"                // get_thread_local
+#include "brpc/policy/lz4_compress.h"
+#include "brpc/protocol.h"
+#ifdef BRPC_WITH_LZ4
+#include <lz4frame.h>
+#endif
+
+
+namespace brpc {
+namespace policy {
+
+#ifdef BRPC_WITH_LZ4
+
+// Input is fed to LZ4F in slices not larger than one LZ4 block.
+static const size_t LZ4_MAX_SLICE = 64 * 1024;
+
+// Contexts are expensive to create, keep one pair for each thread.
+class Lz4Contexts {
+public:
+    Lz4Contexts() : _cctx(NULL), _dctx(NULL), _buf(NULL), _buf_size(0) {
+        memset(&_prefs, 0, sizeof(_prefs));
+        _prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+        _prefs.frameInfo.blockMode = LZ4F_blockLinked;
+    }
+    ~Lz4Contexts() {
+        if (_cctx) {
+            LZ4F_freeCompressionContext(_cctx);
+        }
+        if (_dctx) {
+            LZ4F_freeDecompressionContext(_dctx);
+        }
+        free(_buf);
+    }
+
+    LZ4F_cctx* cctx() {
+        if (_cctx == NULL) {
+            const size_t rc = LZ4F_createCompressionContext(&_cctx, LZ4F_VERSION);
+            if (LZ4F_isError(rc)) {
+                LOG(ERROR) << "Fail to create LZ4F_cctx: " << LZ4F_getErrorName(rc);
+                _cctx = NULL;
+            }
+        }
+        return _cctx;
+    }
+
+    LZ4F_dctx* dctx() {
+        if (_dctx == NULL) {
+            const size_t rc = LZ4F_createDecompressionContext(&_dctx, LZ4F_VERSION);
+            if (LZ4F_isError(rc)) {
+                LOG(ERROR) << "Fail to create LZ4F_dctx: " << LZ4F_getErrorName(rc);
+                _dctx = NULL;
+            }
+        }
+        return _dctx;
+    }
+
+    // LZ4F_compressUpdate() requires the whole worst-case output to fit into
+    // the destination, which is larger than remaining space of IOBuf blocks
+    // in most cases. Compressed slices are written into this buffer first.
+    char* buf() {
+        if (_buf == NULL) {
+            _buf_size = LZ4F_compressBound(LZ4_MAX_SLICE, &_prefs);
+            if (_buf_size < LZ4F_HEADER_SIZE_MAX) {
+                _buf_size = LZ4F_HEADER_SIZE_MAX;
+            }
+            _buf = (char*)malloc(_buf_size);
+        }
+        return _buf;
+    }
+    size_t buf_size() const { return _buf_size; }
+
+    LZ4F_preferences_t* prefs() { return &_prefs; }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(Lz4Contexts);
+
+    LZ4F_cctx* _cctx;
+    LZ4F_dctx* _dctx;
+    char* _buf;
+    size_t _buf_size;
+    LZ4F_preferences_t _prefs;
+};
+
+bool Lz4Compress(const butil::IOBuf& in, butil::IOBuf* out) {
+    Lz4Contexts* ctx = butil::get_thread_local<Lz4Contexts>();
+    LZ4F_cctx* cctx = ctx->cctx();
+    char* buf = ctx->buf();
+    if (cctx == NULL || buf == NULL) {
+        return false;
+    }
+    LZ4F_preferences_t* prefs = ctx->prefs();
+    prefs->frameInfo.contentSize = in.size();
+    size_t rc = LZ4F_compressBegin(cctx, buf, ctx->buf_size(), prefs);
+    if (LZ4F_isError(rc)) {
+        LOG(WARNING) << "Fail to LZ4F_compressBegin: " << LZ4F_getErrorName(rc);
+        return false;
+    }
+    out->append(buf, rc);
+    // Compress the blocks referenced by `in' one by one, no flattening.
+    const size_t nblock = in.backing_block_num();
+    for (size_t i = 0; i < nblock; ++i) {
+        butil::StringPiece blk = in.backing_block(i);
+        while (!blk.empty()) {
+            const size_t len = std::min(blk.size(), LZ4_MAX_SLICE);
+            rc = LZ4F_compressUpdate(cctx, buf, ctx->buf_size(),
+                                     blk.data(), len, NULL);
+            if (LZ4F_isError(rc)) {
+                LOG(WARNING) << "Fail to LZ4F_compressUpdate: "
+                             << LZ4F_getErrorName(rc);
+                return false;
+            }
+            if (rc) {
+                out->append(buf, rc);
+            }
+            blk.remove_prefix(len);
+        }
+    }
+    rc = LZ4F_compressEnd(cctx, buf, ctx->buf_size(), NULL);
+    if (LZ4F_isError(rc)) {
+        LOG(WARNING) << "Fail to LZ4F_compressEnd: " << LZ4F_getErrorName(rc);
+        return false;
+    }
+    out->append(buf, rc);
+    return true;
+}
+
+bool Lz4Decompress(const butil::IOBuf& in, butil::IOBuf* out) {
+    Lz4Contexts* ctx = butil::get_thread_local<Lz4Contexts>();
+    LZ4F_dctx* dctx = ctx->dctx();
+    if (dctx == NULL) {
+        return false;
+    }
+    // Decompress into blocks of `out' directly.
+    butil::IOBufAsZeroCopyOutputStream wrapper(out);
+    char* dst = NULL;
+    int dst_size = 0;
+    size_t hint = 1;  // 0 means the frame is fully decoded.
+    const size_t nblock = in.backing_block_num();
+    for (size_t i = 0; i < nblock && hint != 0; ++i) {
+        butil::StringPiece blk = in.backing_block(i);
+        // Keep calling when the input is consumed but the output is full,
+        // decoded data may be still buffered inside dctx.
+        bool output_full = false;
+        while (!blk.empty() || output_full) {
+            if (dst_size == 0 && !wrapper.Next((void**)&dst, &dst_size)) {
+                LZ4F_resetDecompressionContext(dctx);
+                return false;
+            }
+            size_t dst_len = dst_size;
+            size_t src_len = blk.size();
+            hint = LZ4F_decompress(dctx, dst, &dst_len,
+                                   blk.data(), &src_len, NULL);
+            if (LZ4F_isError(hint)) {
+                LOG(WARNING) << "Fail to LZ4F_decompress: "
+                             << LZ4F_getErrorName(hint);
+                LZ4F_resetDecompressionContext(dctx);
+                return false;
+            }
+            blk.remove_prefix(src_len);
+            output_full = (dst_len == (size_t)dst_size);
+            dst += dst_len;
+            dst_size -= dst_len;
+            if (hint == 0) {
+                break;
+            }
+        }
+        if (hint == 0 && (!blk.empty() || i + 1 != nblock)) {
+            LOG(WARNING) << "Unexpected data after the LZ4 frame";
+            return false;
+        }
+    }
+    if (dst_size) {
+        wrapper.BackUp(dst_size);
+    }
+    if (hint != 0) {
+        LOG(WARNING) << "Incomplete LZ4 frame, size=" << in.size();
+        LZ4F_resetDecompressionContext(dctx);
+        return false;
+    }
+    return true;
+}
+
+#else
+
+bool Lz4Compress(const butil::IOBuf&, butil::IOBuf*) {
+    LOG(ERROR) << "brpc is not compiled with lz4";
+    return false;
+}
+
+bool Lz4Decompress(const butil::IOBuf&, butil::IOBuf*) {
+    LOG(ERROR) << "brpc is not compiled with lz4";
+    return false;
+}
+
+#endif  // BRPC_WITH_LZ4
+
+bool Lz4Compress(const google::protobuf::Message& msg, butil::IOBuf* buf) {
+    butil::IOBuf serialized_pb;
+    butil::IOBufAsZeroCopyOutputStream wrapper(&serialized_pb);
+    if (msg.SerializeToZeroCopyStream(&wrapper)) {
+        return Lz4Compress(serialized_pb, buf);
+    }
+    LOG(WARNING) << "Fail to serialize input pb=" << &msg;
+    return false;
+}
+
+bool Lz4Decompress(const butil::IOBuf& data, google::protobuf::Message* msg) {
+    butil::IOBuf binary_pb;
+    if (Lz4Decompress(data, &binary_pb)) {
+        return ParsePbFromIOBuf(msg, binary_pb);
+    }
+    LOG(WARNING) << "Fail to decompress lz4, size=" << data.size();
+    return false;
+}
+
+}  // namespace policy
+} // namespace brpc
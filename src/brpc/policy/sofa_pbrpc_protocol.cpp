@@ -78,6 +78,9 @@ SofaCompressType CompressType2Sofa(CompressType type) {
     case COMPRESS_TYPE_LZ4:
         LOG(ERROR) << "sofa-pbrpc does not support LZ4";
         return SOFA_COMPRESS_TYPE_NONE;
+    case COMPRESS_TYPE_ZSTD:
+        LOG(ERROR) << "sofa-pbrpc does not support ZSTD";
+        return SOFA_COMPRESS_TYPE_NONE;
     default:
         LOG(ERROR) << "Unknown SofaCompressType=" << type;
         return SOFA_COMPRESS_TYPE_NONE;
@@ -416,6 +419,9 @@ void ProcessSofaRequest(InputMessageBase* msg_base) {
                                 sp->method->full_name().c_str(), rejected_cc);
                 break;
             }
+            if (!method_status->CheckQueueTime(cntl.get())) {
+                break;
+            }
         }
         google::protobuf::Service* svc = sp->service;
         const google::protobuf::MethodDescriptor* method = sp->method;
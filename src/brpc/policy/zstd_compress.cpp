@@ -0,0 +1,287 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <pthread.h>
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
+#include "butil/file_util.h"                   // ReadFileToString
+#include "butil/logging.h"
+#include "butil/scoped_lock.h"                 // BAIDU_SCOPED_LOCK
+#include "butil/thread_local.h"                // get_thread_local
+#include "brpc/reloadable_flags.h"             // BRPC_VALIDATE_GFLAG
+#include "brpc/policy/zstd_compress.h"
+#include "brpc/protocol.h"
+#ifdef BRPC_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace brpc {
+namespace policy {
+
+DEFINE_int32(zstd_compression_level, 3, "Compression level of zstd, "
+             "negative values are faster, the maximum is 22");
+BRPC_VALIDATE_GFLAG(zstd_compression_level, PassValidate);
+
+#ifdef BRPC_WITH_ZSTD
+
+// Contexts are expensive to create, keep one pair for each thread.
+class ZstdContexts {
+public:
+    ZstdContexts() : _cctx(ZSTD_createCCtx()), _dctx(ZSTD_createDCtx()) {}
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(_cctx);
+        ZSTD_freeDCtx(_dctx);
+    }
+    ZSTD_CCtx* cctx() const { return _cctx; }
+    ZSTD_DCtx* dctx() const { return _dctx; }
+private:
+    DISALLOW_COPY_AND_ASSIGN(ZstdContexts);
+    ZSTD_CCtx* _cctx;
+    ZSTD_DCtx* _dctx;
+};
+
+// Dictionaries are appended and never removed, readers go through the array
+// without locking.
+static const size_t MAX_ZSTD_DICTS = 64;
+struct ZstdDictEntry {
+    unsigned id;
+    ZSTD_DDict* ddict;
+};
+static ZstdDictEntry g_ddicts[MAX_ZSTD_DICTS];
+static butil::static_atomic<size_t> g_nddict = BUTIL_STATIC_ATOMIC_INIT(0);
+static butil::static_atomic<ZSTD_CDict*> g_cdict = BUTIL_STATIC_ATOMIC_INIT(NULL);
+static unsigned g_cdict_id = 0;  // protected by g_dict_mutex
+static pthread_mutex_t g_dict_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const ZSTD_DDict* FindZstdDDict(unsigned id) {
+    const size_t n = g_nddict.load(butil::memory_order_acquire);
+    for (size_t i = 0; i < n; ++i) {
+        if (g_ddicts[i].id == id) {
+            return g_ddicts[i].ddict;
+        }
+    }
+    return NULL;
+}
+
+int AddZstdDictionary(const butil::StringPiece& dict, bool use_for_compression) {
+    const unsigned id = ZSTD_getDictID_fromDict(dict.data(), dict.size());
+    if (id == 0) {
+        // Raw content dictionaries do not carry ids, the receiver can't
+        // tell which dictionary to use.
+        LOG(ERROR) << "Not a zstd dictionary, train one with `zstd --train'";
+        return -1;
+    }
+    BAIDU_SCOPED_LOCK(g_dict_mutex);
+    if (FindZstdDDict(id) == NULL) {
+        const size_t n = g_nddict.load(butil::memory_order_relaxed);
+        if (n >= MAX_ZSTD_DICTS) {
+            LOG(ERROR) << "Too many zstd dictionaries, at most "
+                       << MAX_ZSTD_DICTS;
+            return -1;
+        }
+        ZSTD_DDict* ddict = ZSTD_createDDict(dict.data(), dict.size());
+        if (ddict == NULL) {
+            LOG(ERROR) << "Fail to create ZSTD_DDict, id=" << id;
+            return -1;
+        }
+        g_ddicts[n].id = id;
+        g_ddicts[n].ddict = ddict;
+        g_nddict.store(n + 1, butil::memory_order_release);
+    }
+    if (use_for_compression && id != g_cdict_id) {
+        // The replaced one may still be used by other threads, leak it.
+        ZSTD_CDict* cdict = ZSTD_createCDict(
+            dict.data(), dict.size(), FLAGS_zstd_compression_level);
+        if (cdict == NULL) {
+            LOG(ERROR) << "Fail to create ZSTD_CDict, id=" << id;
+            return -1;
+        }
+        g_cdict.store(cdict, butil::memory_order_release);
+        g_cdict_id = id;
+    }
+    return 0;
+}
+
+bool ZstdCompress(const butil::IOBuf& in, butil::IOBuf* out) {
+    ZSTD_CCtx* cctx = butil::get_thread_local<ZstdContexts>()->cctx();
+    if (cctx == NULL) {
+        LOG(ERROR) << "Fail to create ZSTD_CCtx";
+        return false;
+    }
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    const ZSTD_CDict* cdict = g_cdict.load(butil::memory_order_acquire);
+    size_t rc = 0;
+    if (cdict) {
+        rc = ZSTD_CCtx_refCDict(cctx, cdict);
+    } else {
+        rc = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                                    FLAGS_zstd_compression_level);
+    }
+    if (ZSTD_isError(rc) ||
+        ZSTD_isError(rc = ZSTD_CCtx_setPledgedSrcSize(cctx, in.size()))) {
+        LOG(WARNING) << "Fail to set ZSTD_CCtx: " << ZSTD_getErrorName(rc);
+        return false;
+    }
+    // Stream blocks of `in' into blocks of `out', no flattening.
+    butil::IOBufAsZeroCopyOutputStream wrapper(out);
+    ZSTD_outBuffer output = { NULL, 0, 0 };
+    const size_t nblock = in.backing_block_num();
+    // Run at least once to end the frame for empty input.
+    for (size_t i = 0; i < nblock || i == 0; ++i) {
+        const butil::StringPiece blk = in.backing_block(i);
+        ZSTD_inBuffer input = { blk.data(), blk.size(), 0 };
+        const ZSTD_EndDirective mode =
+            (i + 1 >= nblock ? ZSTD_e_end : ZSTD_e_continue);
+        while (true) {
+            if (output.pos == output.size) {
+                int size = 0;
+                if (!wrapper.Next(&output.dst, &size)) {
+                    return false;
+                }
+                output.size = size;
+                output.pos = 0;
+            }
+            rc = ZSTD_compressStream2(cctx, &output, &input, mode);
+            if (ZSTD_isError(rc)) {
+                LOG(WARNING) << "Fail to ZSTD_compressStream2: "
+                             << ZSTD_getErrorName(rc);
+                return false;
+            }
+            // ZSTD_e_end returns 0 when the frame is completely flushed.
+            if (mode == ZSTD_e_end ? rc == 0 : input.pos == input.size) {
+                break;
+            }
+        }
+    }
+    wrapper.BackUp(output.size - output.pos);
+    return true;
+}
+
+bool ZstdDecompress(const butil::IOBuf& in, butil::IOBuf* out) {
+    ZSTD_DCtx* dctx = butil::get_thread_local<ZstdContexts>()->dctx();
+    if (dctx == NULL) {
+        LOG(ERROR) << "Fail to create ZSTD_DCtx";
+        return false;
+    }
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+    // Same as ZSTD_FRAMEHEADERSIZE_MAX which is only exposed to static
+    // linking users.
+    char header[18];
+    const size_t header_len = in.copy_to(header, sizeof(header));
+    const unsigned dict_id = ZSTD_getDictID_fromFrame(header, header_len);
+    if (dict_id != 0) {
+        const ZSTD_DDict* ddict = FindZstdDDict(dict_id);
+        if (ddict == NULL) {
+            LOG(WARNING) << "Unknown zstd dictionary, id=" << dict_id;
+            return false;
+        }
+        ZSTD_DCtx_refDDict(dctx, ddict);
+    }
+    // Stream blocks of `in' into blocks of `out', no flattening.
+    butil::IOBufAsZeroCopyOutputStream wrapper(out);
+    ZSTD_outBuffer output = { NULL, 0, 0 };
+    size_t rc = 1;  // 0 means the frame is fully decoded and flushed.
+    const size_t nblock = in.backing_block_num();
+    for (size_t i = 0; i < nblock && rc != 0; ++i) {
+        const butil::StringPiece blk = in.backing_block(i);
+        ZSTD_inBuffer input = { blk.data(), blk.size(), 0 };
+        // Keep calling when the input is consumed but the output is full,
+        // decoded data may be still buffered inside dctx.
+        while (input.pos < input.size || output.pos == output.size) {
+            if (output.pos == output.size) {
+                int size = 0;
+                if (!wrapper.Next(&output.dst, &size)) {
+                    return false;
+                }
+                output.size = size;
+                output.pos = 0;
+            }
+            const size_t old_pos = output.pos;
+            rc = ZSTD_decompressStream(dctx, &output, &input);
+            if (ZSTD_isError(rc)) {
+                LOG(WARNING) << "Fail to ZSTD_decompressStream: "
+                             << ZSTD_getErrorName(rc);
+                return false;
+            }
+            if (rc == 0 || (input.pos == input.size && output.pos == old_pos)) {
+                break;
+            }
+        }
+        if (rc == 0 && (input.pos != input.size || i + 1 != nblock)) {
+            LOG(WARNING) << "Unexpected data after the zstd frame";
+            return false;
+        }
+    }
+    wrapper.BackUp(output.size - output.pos);
+    if (rc != 0) {
+        LOG(WARNING) << "Incomplete zstd frame, size=" << in.size();
+        return false;
+    }
+    return true;
+}
+
+#else
+
+int AddZstdDictionary(const butil::StringPiece&, bool) {
+    LOG(ERROR) << "brpc is not compiled with zstd";
+    return -1;
+}
+
+bool ZstdCompress(const butil::IOBuf&, butil::IOBuf*) {
+    LOG(ERROR) << "brpc is not compiled with zstd";
+    return false;
+}
+
+bool ZstdDecompress(const butil::IOBuf&, butil::IOBuf*) {
+    LOG(ERROR) << "brpc is not compiled with zstd";
+    return false;
+}
+
+#endif  // BRPC_WITH_ZSTD
+
+int LoadZstdDictionary(const std::string& path, bool use_for_compression) {
+    std::string dict;
+    if (!butil::ReadFileToString(butil::FilePath(path), &dict)) {
+        PLOG(ERROR) << "Fail to read zstd dictionary from " << path;
+        return -1;
+    }
+    return AddZstdDictionary(dict, use_for_compression);
+}
+
+bool ZstdCompress(const google::protobuf::Message& msg, butil::IOBuf* buf) {
+    butil::IOBuf serialized_pb;
+    butil::IOBufAsZeroCopyOutputStream wrapper(&serialized_pb);
+    if (msg.SerializeToZeroCopyStream(&wrapper)) {
+        return ZstdCompress(serialized_pb, buf);
+    }
+    LOG(WARNING) << "Fail to serialize input pb=" << &msg;
+    return false;
+}
+
+bool ZstdDecompress(const butil::IOBuf& data, google::protobuf::Message* msg) {
+    butil::IOBuf binary_pb;
+    if (ZstdDecompress(data, &binary_pb)) {
+        return ParsePbFromIOBuf(msg, binary_pb);
+    }
+    LOG(WARNING) << "Fail to decompress zstd, size=" << data.size();
+    return false;
+}
+
+}  // namespace policy
+} // namespace brpc
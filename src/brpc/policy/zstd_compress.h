@@ -0,0 +1,67 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_POLICY_ZSTD_COMPRESS_H
+#define BRPC_POLICY_ZSTD_COMPRESS_H
+
+#include <string>
+#include <google/protobuf/message.h>          // Message
+#include "butil/iobuf.h"                       // IOBuf
+#include "butil/strings/string_piece.h"        // StringPiece
+
+
+namespace brpc {
+namespace policy {
+
+// Data is in Zstandard frame format. Available only when brpc is built with
+// zstd, otherwise these functions always fail.
+
+// Compress serialized `msg' into `buf'.
+bool ZstdCompress(const google::protobuf::Message& msg, butil::IOBuf* buf);
+
+// Parse `msg' from decompressed `buf'
+bool ZstdDecompress(const butil::IOBuf& data, google::protobuf::Message* msg);
+
+// Put compressed `in' into `out'.
+bool ZstdCompress(const butil::IOBuf& in, butil::IOBuf* out);
+
+// Put decompressed `in' into `out'.
+bool ZstdDecompress(const butil::IOBuf& in, butil::IOBuf* out);
+
+// Small messages of similar contents compress much better with a dictionary
+// trained from samples (`zstd --train samples/* -o dict'). The id of the
+// dictionary is written in each frame, so the receiver picks the right one
+// from all dictionaries added to the process, and frames compressed without
+// a dictionary can always be decompressed.
+// If `use_for_compression' is true, ZstdCompress() compresses with this
+// dictionary afterwards at the level of -zstd_compression_level when it's
+// added. The receiver must have the dictionary as well, otherwise it fails
+// to decompress.
+// Dictionaries are never removed. Adding a dictionary with an id that was
+// added before only changes the dictionary for compression.
+// Returns 0 on success, -1 otherwise.
+int AddZstdDictionary(const butil::StringPiece& dict, bool use_for_compression);
+
+// Read the dictionary from file `path' and call AddZstdDictionary().
+int LoadZstdDictionary(const std::string& path, bool use_for_compression);
+
+}  // namespace policy
+} // namespace brpc
+
+
+#endif // BRPC_POLICY_ZSTD_COMPRESS_H
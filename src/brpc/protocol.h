@@ -163,6 +163,19 @@ struct Protocol {
     // Name of this protocol, must be string constant.
     const char* name;
 
+    // [Optional] Called at server-side before `msg' is processed in a new
+    // bthread. Returns true to create the bthread with BTHREAD_HIGH_PRIORITY.
+    typedef bool (*IsHighPriorityRequest)(const InputMessageBase* msg);
+    IsHighPriorityRequest is_high_priority_request;
+
+    // [Optional] Called at server-side before `msg' is processed in a new
+    // bthread. Returns true if `msg' is handled shortly without blocking,
+    // in which case it may be processed in the bthread reading the
+    // connection to save creation and scheduling of a bthread. A protocol
+    // whose handlers are all inline-safe may simply return true.
+    typedef bool (*IsInlineSafeRequest)(const InputMessageBase* msg);
+    IsInlineSafeRequest is_inline_safe_request;
+
     // True if this protocol is supported at client-side.
     bool support_client() const {
         return serialize_request && pack_request && process_response;
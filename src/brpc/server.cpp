@@ -32,11 +32,14 @@
 #include "butil/class_name.h"
 #include "butil/string_printf.h"
 #include "brpc/log.h"
+#include "brpc/reloadable_flags.h"             // BRPC_VALIDATE_GFLAG
 #include "brpc/compress.h"
 #include "brpc/policy/nova_pbrpc_protocol.h"
+#include "brpc/policy/zstd_compress.h"       // LoadZstdDictionary
 #include "brpc/global.h"
 #include "brpc/socket_map.h"                   // SocketMapList
 #include "brpc/acceptor.h"                     // Acceptor
+#include "brpc/event_dispatcher.h"             // BindGlobalEventDispatchersToWorkers
 #include "brpc/details/ssl_helper.h"           // CreateServerSSLContext
 #include "brpc/protocol.h"                     // ListProtocols
 #include "brpc/nshead_service.h"               // NsheadService
@@ -87,6 +90,8 @@ extern "C" {
 void* bthread_get_assigned_data();
 }
 
+DECLARE_int32(task_group_ntags);
+
 namespace brpc {
 
 BAIDU_CASSERT(sizeof(int32_t) == sizeof(butil::subtle::Atomic32),
@@ -110,8 +115,15 @@ butil::static_atomic<int> g_running_server_count = BUTIL_STATIC_ATOMIC_INIT(0);
 DEFINE_bool(enable_dir_service, false, "Enable /dir");
 DEFINE_bool(enable_threads_service, false, "Enable /threads");
 
+DEFINE_int32(max_inline_latency_us, 50,
+             "Requests to inline-safe methods are processed in new bthreads "
+             "when average latency of the method is larger than this value, "
+             "see Server::SetMethodInlineSafe()");
+BRPC_VALIDATE_GFLAG(max_inline_latency_us, PassValidate);
+
 DECLARE_int32(usercode_backup_threads);
 DECLARE_bool(usercode_in_pthread);
+DECLARE_int32(event_dispatcher_num);
 
 const int INITIAL_SERVICE_CAP = 64;
 const int INITIAL_CERT_MAP = 64;
@@ -140,7 +152,10 @@ ServerOptions::ServerOptions()
     , http_master_service(NULL)
     , health_reporter(NULL)
     , rtmp_service(NULL)
-    , redis_service(NULL) {
+    , redis_service(NULL)
+    , use_zerocopy(false)
+    , reuse_port_sharding(false)
+    , bthread_tag(BTHREAD_TAG_DEFAULT) {
     if (s_ncore > 0) {
         num_threads = s_ncore + 1;
     }
@@ -167,7 +182,9 @@ Server::MethodProperty::MethodProperty()
     , http_url(NULL)
     , service(NULL)
     , method(NULL)
-    , status(NULL) {
+    , status(NULL)
+    , high_priority(false)
+    , inline_safe(false) {
 }
 
 static timeval GetUptime(void* arg/*start_time*/) {
@@ -390,6 +407,8 @@ Server::Server(ProfilerLinker)
     , _builtin_service_count(0)
     , _virtual_service_count(0)
     , _failed_to_set_max_concurrency_of_method(false)
+    , _has_high_priority_method(false)
+    , _has_inline_safe_method(false)
     , _am(NULL)
     , _internal_am(NULL)
     , _first_service(NULL)
@@ -568,6 +587,8 @@ Acceptor* Server::BuildAcceptor() {
         LOG(ERROR) << "Fail to new Acceptor";
         return NULL;
     }
+    acceptor->set_use_zerocopy(_options.use_zerocopy);
+    acceptor->set_bthread_tag(_options.bthread_tag);
     InputMessageHandler handler;
     std::vector<Protocol> protocols;
     ListProtocols(&protocols);
@@ -589,6 +610,8 @@ Acceptor* Server::BuildAcceptor() {
         handler.verify = protocols[i].verify;
         handler.arg = this;
         handler.name = protocols[i].name;
+        handler.is_high_priority = protocols[i].is_high_priority_request;
+        handler.is_inline_safe = protocols[i].is_inline_safe_request;
         if (acceptor->AddHandler(handler) != 0) {
             LOG(ERROR) << "Fail to add handler into Acceptor("
                        << acceptor << ')';
@@ -768,6 +791,20 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
         }
     }
 
+    if (_options.bthread_tag < BTHREAD_TAG_DEFAULT ||
+        _options.bthread_tag >= FLAGS_task_group_ntags) {
+        LOG(ERROR) << "Invalid bthread_tag=" << _options.bthread_tag
+                   << ", -task_group_ntags=" << FLAGS_task_group_ntags;
+        return -1;
+    }
+
+    if (!_options.zstd_dictionary_path.empty() &&
+        policy::LoadZstdDictionary(_options.zstd_dictionary_path, true) != 0) {
+        LOG(ERROR) << "Fail to load zstd dictionary from "
+                   << _options.zstd_dictionary_path;
+        return -1;
+    }
+
     // CAUTION:
     //   Following code may run multiple times if this server is started and
     //   stopped more than once. Reuse or delete previous resources!
@@ -829,6 +866,7 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
             init_args[i].stop = false;
             bthread_attr_t tmp = BTHREAD_ATTR_NORMAL;
             tmp.keytable_pool = _keytable_pool;
+            bthread_attr_settag(&tmp, _options.bthread_tag);
             if (bthread_start_background(
                     &init_args[i].th, &tmp, BthreadInitEntry, &init_args[i]) != 0) {
                 break;
@@ -918,10 +956,15 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
         if (FLAGS_usercode_in_pthread) {
             _options.num_threads += FLAGS_usercode_backup_threads;
         }
-        if (_options.num_threads < BTHREAD_MIN_CONCURRENCY) {
-            _options.num_threads = BTHREAD_MIN_CONCURRENCY;
+        if (_options.bthread_tag != BTHREAD_TAG_DEFAULT) {
+            bthread_setconcurrency_by_tag(_options.num_threads,
+                                          _options.bthread_tag);
+        } else {
+            if (_options.num_threads < BTHREAD_MIN_CONCURRENCY) {
+                _options.num_threads = BTHREAD_MIN_CONCURRENCY;
+            }
+            bthread_setconcurrency(_options.num_threads);
         }
-        bthread_setconcurrency(_options.num_threads);
     }
 
     for (MethodMap::iterator it = _method_map.begin();
@@ -954,9 +997,14 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
         return -1;
     }
     _listen_addr = endpoint;
+    const bool reuse_port_sharding = _options.reuse_port_sharding &&
+        FLAGS_event_dispatcher_num > 1 &&
+        !butil::is_endpoint_extended(endpoint);
     for (int port = port_range.min_port; port <= port_range.max_port; ++port) {
         _listen_addr.port = port;
-        butil::fd_guard sockfd(tcp_listen(_listen_addr));
+        butil::fd_guard sockfd(reuse_port_sharding ?
+                               tcp_listen(_listen_addr, true) :
+                               tcp_listen(_listen_addr));
         if (sockfd < 0) {
             if (port != port_range.max_port) { // not the last port, try next
                 continue;
@@ -979,10 +1027,30 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
                 return -1;
             }
         }
+        std::vector<int> listened_fds;
+        if (reuse_port_sharding) {
+            // The port is known now, add other sockets listening to it.
+            listened_fds.push_back(sockfd);
+            for (int i = 1; i < FLAGS_event_dispatcher_num; ++i) {
+                const int fd = tcp_listen(_listen_addr, true);
+                if (fd < 0) {
+                    PLOG(ERROR) << "Fail to listen " << _listen_addr
+                                << " with SO_REUSEPORT";
+                    for (size_t j = 1; j < listened_fds.size(); ++j) {
+                        close(listened_fds[j]);
+                    }
+                    return -1;
+                }
+                listened_fds.push_back(fd);
+            }
+        }
         if (_am == NULL) {
             _am = BuildAcceptor();
             if (NULL == _am) {
                 LOG(ERROR) << "Fail to build acceptor";
+                for (size_t j = 1; j < listened_fds.size(); ++j) {
+                    close(listened_fds[j]);
+                }
                 return -1;
             }
         }
@@ -993,6 +1061,17 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
         GenerateVersionIfNeeded();
         g_running_server_count.fetch_add(1, butil::memory_order_relaxed);
 
+        if (reuse_port_sharding) {
+            BindGlobalEventDispatchersToWorkers();
+            // Pass ownership of all fds to `_am' whether it succeeds or not.
+            sockfd.release();
+            if (_am->StartAccept(listened_fds, _options.idle_timeout_sec,
+                                 _default_ssl_ctx) != 0) {
+                LOG(ERROR) << "Fail to start acceptor";
+                return -1;
+            }
+            break;
+        }
         // Pass ownership of `sockfd' to `_am'
         if (_am->StartAccept(sockfd, _options.idle_timeout_sec,
                              _default_ssl_ctx) != 0) {
@@ -2147,6 +2226,113 @@ int Server::MaxConcurrencyOf(google::protobuf::Service* service,
     return MaxConcurrencyOf(service->GetDescriptor()->full_name(), method_name);
 }
 
+int Server::SetMethodHighPriority(MethodProperty* mp, bool high_priority) {
+    if (IsRunning()) {
+        LOG(WARNING) << "SetMethodHighPriority is only allowed before Server started";
+        return -1;
+    }
+    mp->high_priority = high_priority;
+    if (high_priority) {
+        _has_high_priority_method = true;
+    }
+    return 0;
+}
+
+int Server::SetMethodHighPriority(const butil::StringPiece& full_method_name,
+                                  bool high_priority) {
+    MethodProperty* mp = _method_map.seek(full_method_name);
+    if (mp == NULL) {
+        LOG(ERROR) << "Fail to find method=" << full_method_name;
+        return -1;
+    }
+    return SetMethodHighPriority(mp, high_priority);
+}
+
+int Server::SetMethodHighPriority(const butil::StringPiece& full_service_name,
+                                  const butil::StringPiece& method_name,
+                                  bool high_priority) {
+    MethodProperty* mp = const_cast<MethodProperty*>(
+        FindMethodPropertyByFullName(full_service_name, method_name));
+    if (mp == NULL) {
+        LOG(ERROR) << "Fail to find method=" << full_service_name
+                   << '/' << method_name;
+        return -1;
+    }
+    return SetMethodHighPriority(mp, high_priority);
+}
+
+int Server::SetMethodInlineSafe(MethodProperty* mp, bool inline_safe) {
+    if (IsRunning()) {
+        LOG(WARNING) << "SetMethodInlineSafe is only allowed before Server started";
+        return -1;
+    }
+    mp->inline_safe = inline_safe;
+    if (inline_safe) {
+        _has_inline_safe_method = true;
+    }
+    return 0;
+}
+
+int Server::SetMethodInlineSafe(const butil::StringPiece& full_method_name,
+                                bool inline_safe) {
+    MethodProperty* mp = _method_map.seek(full_method_name);
+    if (mp == NULL) {
+        LOG(ERROR) << "Fail to find method=" << full_method_name;
+        return -1;
+    }
+    return SetMethodInlineSafe(mp, inline_safe);
+}
+
+int Server::SetMethodInlineSafe(const butil::StringPiece& full_service_name,
+                                const butil::StringPiece& method_name,
+                                bool inline_safe) {
+    MethodProperty* mp = const_cast<MethodProperty*>(
+        FindMethodPropertyByFullName(full_service_name, method_name));
+    if (mp == NULL) {
+        LOG(ERROR) << "Fail to find method=" << full_service_name
+                   << '/' << method_name;
+        return -1;
+    }
+    return SetMethodInlineSafe(mp, inline_safe);
+}
+
+int Server::SetMethodMaxQueueTime(MethodProperty* mp, int64_t max_queue_time_us) {
+    if (IsRunning()) {
+        LOG(WARNING) << "SetMethodMaxQueueTime is only allowed before Server started";
+        return -1;
+    }
+    if (mp->status == NULL || max_queue_time_us < 0) {
+        LOG(ERROR) << "Fail to set max_queue_time_us=" << max_queue_time_us
+                   << " of method=" << mp->method->full_name();
+        return -1;
+    }
+    mp->status->_max_queue_time_us = max_queue_time_us;
+    return 0;
+}
+
+int Server::SetMethodMaxQueueTime(const butil::StringPiece& full_method_name,
+                                  int64_t max_queue_time_us) {
+    MethodProperty* mp = _method_map.seek(full_method_name);
+    if (mp == NULL) {
+        LOG(ERROR) << "Fail to find method=" << full_method_name;
+        return -1;
+    }
+    return SetMethodMaxQueueTime(mp, max_queue_time_us);
+}
+
+int Server::SetMethodMaxQueueTime(const butil::StringPiece& full_service_name,
+                                  const butil::StringPiece& method_name,
+                                  int64_t max_queue_time_us) {
+    MethodProperty* mp = const_cast<MethodProperty*>(
+        FindMethodPropertyByFullName(full_service_name, method_name));
+    if (mp == NULL) {
+        LOG(ERROR) << "Fail to find method=" << full_service_name
+                   << '/' << method_name;
+        return -1;
+    }
+    return SetMethodMaxQueueTime(mp, max_queue_time_us);
+}
+
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
 int Server::SSLSwitchCTXByHostname(struct ssl_st* ssl,
                                    int* al, Server* server) {
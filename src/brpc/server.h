@@ -245,6 +245,39 @@ struct ServerOptions {
     // Default: ""
     std::string server_info_name;
 
+    // Send large responses (not less than -socket_zerocopy_min_bytes) over
+    // accepted connections with MSG_ZEROCOPY. Written blocks are held until
+    // the kernel reports that it's done with them. Linux 4.14+ only.
+    // Default: false
+    bool use_zerocopy;
+
+    // Path of a zstd dictionary(trained by `zstd --train') to be loaded when
+    // the server starts. Requests compressed with the dictionary can be
+    // decompressed and responses in COMPRESS_TYPE_ZSTD are compressed with
+    // it, so clients must have the same dictionary, see
+    // brpc/policy/zstd_compress.h. Requires brpc built with zstd.
+    // Default: "" (no dictionary)
+    std::string zstd_dictionary_path;
+
+    // Listen to the port with -event_dispatcher_num SO_REUSEPORT sockets
+    // instead of one, so that the kernel spreads new connections over them.
+    // Connections accepted by the i-th socket are handled by the i-th
+    // EventDispatcher, and bthreads reading and processing them are started
+    // in bthread workers whose index modulo -event_dispatcher_num is i, so
+    // that a connection tends to stay in the same group of workers.
+    // No effect when -event_dispatcher_num is 1 or listening to a unix
+    // domain socket. Linux 3.9+ only.
+    // Default: false
+    bool reuse_port_sharding;
+
+    // Read and process requests of this server in the bthread worker pool
+    // `bthread_tag', which must be less than -task_group_ntags. Servers in
+    // different pools don't share workers, so that a busy server does not
+    // starve others. If num_threads > 0, the pool is resized to num_threads
+    // instead of the default pool.
+    // Default: BTHREAD_TAG_DEFAULT
+    bthread_tag_t bthread_tag;
+
 private:
     // SSLOptions is large and not often used, allocate it on heap to
     // prevent ServerOptions from being bloated in most cases.
@@ -365,6 +398,10 @@ public:
         const google::protobuf::MethodDescriptor* method;
         MethodStatus* status;
         AdaptiveMaxConcurrency max_concurrency;
+        // Process requests in high-priority bthreads, see SetMethodHighPriority()
+        bool high_priority;
+        // Requests may be processed inline, see SetMethodInlineSafe()
+        bool inline_safe;
 
         MethodProperty();
     };
@@ -543,6 +580,76 @@ public:
     int MaxConcurrencyOf(google::protobuf::Service* service,
                          const butil::StringPiece& method_name) const;
 
+    // Process requests to the method in bthreads created with
+    // BTHREAD_HIGH_PRIORITY, which run before bthreads of other requests
+    // whenever they're ready, so that a flood of heavy requests does not
+    // inflate latencies of light ones (health checks, control-plane RPCs).
+    // Currently only baidu_std requests are classified before being queued.
+    // Example:
+    //    server.SetMethodHighPriority("example.EchoService.Echo");
+    // or server.SetMethodHighPriority("example.EchoService", "Echo");
+    // Note: These interfaces can ONLY be called before the server is started.
+    // Returns 0 on success, -1 otherwise.
+    int SetMethodHighPriority(const butil::StringPiece& full_method_name,
+                              bool high_priority = true);
+    int SetMethodHighPriority(const butil::StringPiece& full_service_name,
+                              const butil::StringPiece& method_name,
+                              bool high_priority = true);
+    // Without this overload, SetMethodHighPriority("a.Service", "Method")
+    // converts the method name to bool and calls the overload above.
+    int SetMethodHighPriority(const butil::StringPiece& full_service_name,
+                              const char* method_name,
+                              bool high_priority = true) {
+        return SetMethodHighPriority(full_service_name,
+                                     butil::StringPiece(method_name),
+                                     high_priority);
+    }
+
+    // Mark the method as short and never blocking. When several requests
+    // are read from a connection at once, requests to such methods are
+    // processed one after another in the bthread reading the connection
+    // instead of in new bthreads, as long as the time spent does not exceed
+    // -inline_process_budget_us after each read and the average latency of
+    // the method is not larger than -max_inline_latency_us. Good for cache
+    // lookups and alike which are cheaper than creating bthreads.
+    // Blocking in such methods delays all other requests on the connection.
+    // Currently only baidu_std requests are classified.
+    // Example:
+    //    server.SetMethodInlineSafe("example.CacheService.Get");
+    // or server.SetMethodInlineSafe("example.CacheService", "Get");
+    // Note: These interfaces can ONLY be called before the server is started.
+    // Returns 0 on success, -1 otherwise.
+    int SetMethodInlineSafe(const butil::StringPiece& full_method_name,
+                            bool inline_safe = true);
+    int SetMethodInlineSafe(const butil::StringPiece& full_service_name,
+                            const butil::StringPiece& method_name,
+                            bool inline_safe = true);
+    int SetMethodInlineSafe(const butil::StringPiece& full_service_name,
+                            const char* method_name,
+                            bool inline_safe = true) {
+        return SetMethodInlineSafe(full_service_name,
+                                   butil::StringPiece(method_name),
+                                   inline_safe);
+    }
+
+    // Fail requests to the method with ELIMIT instead of running them when
+    // they have waited longer than `max_queue_time_us' since being received
+    // (in socket buffers, runqueues of bthreads, etc). Under overload, such
+    // requests are likely to time out in clients anyway and running them
+    // only delays the requests behind. 0 means no limit, which is default.
+    // Requests whose timeouts from clients have already expired are dropped
+    // regardless, unless -shed_expired_requests is off.
+    // Example:
+    //    server.SetMethodMaxQueueTime("example.EchoService.Echo", 50000);
+    // or server.SetMethodMaxQueueTime("example.EchoService", "Echo", 50000);
+    // Note: These interfaces can ONLY be called before the server is started.
+    // Returns 0 on success, -1 otherwise.
+    int SetMethodMaxQueueTime(const butil::StringPiece& full_method_name,
+                              int64_t max_queue_time_us);
+    int SetMethodMaxQueueTime(const butil::StringPiece& full_service_name,
+                              const butil::StringPiece& method_name,
+                              int64_t max_queue_time_us);
+
 private:
 friend class StatusService;
 friend class ProtobufsService;
@@ -634,6 +741,9 @@ friend class Controller;
 
     AdaptiveMaxConcurrency& MaxConcurrencyOf(MethodProperty*);
     int MaxConcurrencyOf(const MethodProperty*) const;
+    int SetMethodHighPriority(MethodProperty*, bool high_priority);
+    int SetMethodInlineSafe(MethodProperty*, bool inline_safe);
+    int SetMethodMaxQueueTime(MethodProperty*, int64_t max_queue_time_us);
     
     DISALLOW_COPY_AND_ASSIGN(Server);
 
@@ -646,6 +756,8 @@ friend class Controller;
     // number of the virtual services for mapping URL to methods.
     int _virtual_service_count;
     bool _failed_to_set_max_concurrency_of_method;
+    bool _has_high_priority_method;
+    bool _has_inline_safe_method;
     Acceptor* _am;
     Acceptor* _internal_am;
     
@@ -27,13 +27,17 @@
 #include <netinet/tcp.h>                         // getsockopt
 #include <gflags/gflags.h>
 #include "bthread/unstable.h"                    // bthread_timer_del
+#include "bthread/execution_queue.h"             // execution_queue_execute
+#include "bthread/contention_profiler.h"         // start_async_contention
 #include "butil/fd_utility.h"                     // make_non_blocking
+#include "butil/fast_rand.h"                      // fast_rand_less_than
 #include "butil/fd_guard.h"                       // fd_guard
 #include "butil/time.h"                           // cpuwide_time_us
 #include "butil/object_pool.h"                    // get_object
 #include "butil/logging.h"                        // CHECK
 #include "butil/macros.h"
 #include "butil/class_name.h"                     // butil::class_name
+#include "butil/third_party/murmurhash3/murmurhash3.h"  // fmix32
 #include "brpc/log.h"
 #include "brpc/reloadable_flags.h"          // BRPC_VALIDATE_GFLAG
 #include "brpc/errno.pb.h"
@@ -48,6 +52,8 @@
 #include "brpc/policy/rtmp_protocol.h"  // FIXME
 #include "brpc/periodic_task.h"
 #include "brpc/details/health_check.h"
+#include "brpc/details/zerocopy.h"
+#include "brpc/details/rpc_batcher.h"
 #if defined(OS_MACOSX)
 #include <sys/event.h>
 #endif
@@ -77,6 +83,12 @@ DEFINE_int32(socket_recv_buffer_size, -1,
 DEFINE_int32(socket_send_buffer_size, -1, 
             "Set send buffer size of sockets if this value is positive");
 
+// Linux 3.11+, raising the value above net.core.busy_read needs CAP_NET_ADMIN.
+DEFINE_int32(socket_busy_poll_us, 0,
+             "Set SO_BUSY_POLL of sockets to this value if it's positive, "
+             "making reads poll the device queue for so many microseconds "
+             "when there's no data");
+
 DEFINE_int32(ssl_bio_buffer_size, 16*1024, "Set buffer size for SSL read/write");
 
 DEFINE_int64(socket_max_unwritten_bytes, 64 * 1024 * 1024,
@@ -87,12 +99,39 @@ DEFINE_int32(max_connection_pool_size, 100,
              "Max number of pooled connections to a single endpoint");
 BRPC_VALIDATE_GFLAG(max_connection_pool_size, PassValidate);
 
+// Max value of -multi_connection_count
+static const int MAX_MULTI_CONNECTION_COUNT = 64;
+
+DEFINE_int32(multi_connection_count, 4,
+             "Number of multiplexed connections to a single endpoint when "
+             "connection_type is multi, requests are sent to the one with "
+             "least unwritten bytes");
+static bool validate_multi_connection_count(const char*, int32_t v) {
+    return v >= 1 && v <= MAX_MULTI_CONNECTION_COUNT;
+}
+BRPC_VALIDATE_GFLAG(multi_connection_count, validate_multi_connection_count);
+
 DEFINE_int32(connect_timeout_as_unreachable, 3,
              "If the socket failed to connect due to ETIMEDOUT for so many "
              "times *continuously*, the error is changed to ENETUNREACH which "
              "fails the main socket as well when this socket is pooled.");
 
+DEFINE_bool(socket_write_combining, false,
+            "If a write in the calling thread is not complete, hand the "
+            "remaining data over to a flusher shared by sockets of the same "
+            "EventDispatcher, which writes pending data of many sockets in "
+            "one run and merges requests queued to a socket meanwhile into "
+            "one writev");
+BRPC_VALIDATE_GFLAG(socket_write_combining, PassValidate);
+
+DEFINE_int32(socket_zerocopy_min_bytes, 16 * 1024,
+             "Sockets created with use_zerocopy send with MSG_ZEROCOPY when "
+             "bytes to write are not less than this value. Pinning pages "
+             "and handling completions cost more than copying small data");
+BRPC_VALIDATE_GFLAG(socket_zerocopy_min_bytes, PassValidate);
+
 DECLARE_int32(health_check_timeout_ms);
+DECLARE_int32(event_dispatcher_num);
 
 static bool validate_connect_timeout_as_unreachable(const char*, int32_t v) {
     return v >= 2 && v < 1000/*large enough*/;
@@ -102,6 +141,11 @@ BRPC_VALIDATE_GFLAG(connect_timeout_as_unreachable,
 
 const int WAIT_EPOLLOUT_TIMEOUT_MS = 50;
 
+// Reads of at least so many bytes are done into blocks of
+// LARGE_READ_BLOCK_SIZE rather than default ones.
+const size_t LARGE_READ_THRESHOLD = 262144;
+const size_t LARGE_READ_BLOCK_SIZE = 65536;
+
 class BAIDU_CACHELINE_ALIGNMENT SocketPool {
 friend class Socket;
 public:
@@ -129,6 +173,31 @@ private:
     butil::atomic<int> _numinflight; // #inflight sockets in all sub pools.
 };
 
+// Sockets connecting to the same place as a main socket and shared by
+// RPCs simultaneously like the main socket, corresponding to
+// CONNECTION_TYPE_MULTI. The main socket is the first one and not stored.
+// Others are created on demand and replaced after they fail.
+class MultiSocketSet {
+public:
+    MultiSocketSet() {
+        for (int i = 0; i < MAX_MULTI_CONNECTION_COUNT; ++i) {
+            ids[i].store(INVALID_SOCKET_ID, butil::memory_order_relaxed);
+        }
+    }
+    ~MultiSocketSet() {
+        for (int i = 0; i < MAX_MULTI_CONNECTION_COUNT; ++i) {
+            const SocketId sid = ids[i].load(butil::memory_order_relaxed);
+            SocketUniquePtr ptr;
+            if (sid != INVALID_SOCKET_ID && Socket::Address(sid, &ptr) == 0) {
+                ptr->ReleaseAdditionalReference();
+            }
+        }
+    }
+
+    // ids[0] is unused.
+    butil::atomic<SocketId> ids[MAX_MULTI_CONNECTION_COUNT];
+};
+
 // NOTE: sizeof of this class is 1200 bytes. If we have 10K sockets, total
 // memory is 12MB, not lightweight, but acceptable.
 struct ExtendedSocketStat : public SocketStat {
@@ -303,7 +372,17 @@ struct BAIDU_CACHELINE_ALIGNMENT Socket::WriteRequest {
     butil::IOBuf data;
     WriteRequest* next;
     bthread_id_t id_wait;
-    Socket* socket;
+    // Lifetimes of the two fields do not overlap, sharing the space to
+    // keep the struct in 64 bytes.
+    union {
+        // Set when the request owning the right to write is passed to
+        // connecting, KeepWrite or FlushCombinedWrite.
+        Socket* socket;
+        // Non-NULL when time that a request waits for other writers to
+        // pick it up is sampled by contention profiler. Submitted in
+        // IsWriteComplete().
+        bthread::SampledContention* contention;
+    };
     
     uint32_t pipelined_count() const {
         return (_pc_and_udmsg >> 48) & 0x3FFF;
@@ -455,6 +534,12 @@ Socket::Socket(Forbidden)
     , _epollout_butex(NULL)
     , _write_head(NULL)
     , _stream_set(NULL)
+    , _zerocopy(NULL)
+    , _rpc_batcher(NULL)
+    , _rpc_batch_remaining(0)
+    , _multi_sockets(NULL)
+    , _dispatcher_index(-1)
+    , _bthread_tag(BTHREAD_TAG_DEFAULT)
     , _ninflight_app_health_check(0)
 {
     CreateVarsOnce();
@@ -522,6 +607,7 @@ int Socket::ResetFileDescriptor(int fd) {
     // Reset message sizes when fd is changed.
     _last_msg_size = 0;
     _avg_msg_size = 0;
+    _rpc_batch_remaining = 0;
     // MUST store `_fd' before adding itself into epoll device to avoid
     // race conditions with the callback function inside epoll
     _fd.store(fd, butil::memory_order_release);
@@ -570,8 +656,27 @@ int Socket::ResetFileDescriptor(int fd) {
         }
     }
 
+#if defined(OS_LINUX)
+    if (FLAGS_socket_busy_poll_us > 0) {
+        int busy_poll_us = FLAGS_socket_busy_poll_us;
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us,
+                       sizeof(busy_poll_us)) != 0) {
+            PLOG_EVERY_SECOND(WARNING) << "Fail to set SO_BUSY_POLL of fd="
+                                       << fd << " to " << busy_poll_us;
+        }
+    }
+#endif
+
+    if (_zerocopy) {
+        // Sequence numbers of completions restart with the new fd. OK to
+        // fail, namely unix domain socket does not support this, in which
+        // case data is written normally.
+        _zerocopy->Reset(ZeroCopyTracker::EnableOnFileDescriptor(fd) == 0);
+    }
+
     if (_on_edge_triggered_events) {
-        if (GetGlobalEventDispatcher(fd).AddConsumer(id(), fd) != 0) {
+        if (GetGlobalEventDispatcher(fd, _dispatcher_index).
+            AddConsumer(id(), fd) != 0) {
             PLOG(ERROR) << "Fail to add SocketId=" << id() 
                         << " into EventDispatcher";
             _fd.store(-1, butil::memory_order_release);
@@ -651,6 +756,12 @@ int Socket::Create(const SocketOptions& options, SocketId* id) {
     m->_last_writetime_us.store(cpuwide_now, butil::memory_order_relaxed);
     m->_unwritten_bytes.store(0, butil::memory_order_relaxed);
     CHECK(NULL == m->_write_head.load(butil::memory_order_relaxed));
+    CHECK(NULL == m->_zerocopy);
+    if (options.use_zerocopy) {
+        m->_zerocopy = new ZeroCopyTracker;
+    }
+    m->_dispatcher_index = options.dispatcher_index;
+    m->_bthread_tag = options.bthread_tag;
     // Must be last one! Internal fields of this Socket may be access
     // just after calling ResetFileDescriptor.
     if (m->ResetFileDescriptor(options.fd) != 0) {
@@ -702,9 +813,10 @@ int Socket::WaitAndReset(int32_t expected_nref) {
     const int prev_fd = _fd.exchange(-1, butil::memory_order_relaxed);
     if (ValidFileDescriptor(prev_fd)) {
         if (_on_edge_triggered_events != NULL) {
-            GetGlobalEventDispatcher(prev_fd).RemoveConsumer(prev_fd);
+            GetGlobalEventDispatcher(prev_fd, _dispatcher_index).
+                RemoveConsumer(prev_fd);
         }
-        close(prev_fd);
+        CloseFileDescriptor(prev_fd);
         if (CreatedByConnect()) {
             g_vars->channel_conn << -1;
         }
@@ -941,6 +1053,21 @@ int Socket::SetFailed(SocketId id) {
     return ptr->SetFailed();
 }
 
+RpcBatcher* Socket::GetOrNewRpcBatcher() {
+    RpcBatcher* b = _rpc_batcher.load(butil::memory_order_consume);
+    if (b != NULL) {
+        return b;
+    }
+    RpcBatcher* new_b = new RpcBatcher;
+    if (_rpc_batcher.compare_exchange_strong(
+            b, new_b, butil::memory_order_acq_rel,
+            butil::memory_order_acquire)) {
+        return new_b;
+    }
+    delete new_b;
+    return b;
+}
+
 void Socket::NotifyOnFailed(bthread_id_t id) {
     pthread_mutex_lock(&_id_wait_list_mutex);
     if (!Failed()) {
@@ -1002,9 +1129,10 @@ void Socket::OnRecycle() {
     const int prev_fd = _fd.exchange(-1, butil::memory_order_relaxed);
     if (ValidFileDescriptor(prev_fd)) {
         if (_on_edge_triggered_events != NULL) {
-            GetGlobalEventDispatcher(prev_fd).RemoveConsumer(prev_fd);
+            GetGlobalEventDispatcher(prev_fd, _dispatcher_index).
+                RemoveConsumer(prev_fd);
         }
-        close(prev_fd);
+        CloseFileDescriptor(prev_fd);
         if (create_by_connect) {
             g_vars->channel_conn << -1;
         }
@@ -1033,6 +1161,14 @@ void Socket::OnRecycle() {
     delete _stream_set;
     _stream_set = NULL;
 
+    // Pending zero-copy sends were moved to the reaper when fd was closed.
+    delete _zerocopy;
+    _zerocopy = NULL;
+
+    delete _rpc_batcher.exchange(NULL, butil::memory_order_relaxed);
+
+    delete _multi_sockets.exchange(NULL, butil::memory_order_relaxed);
+
     const SocketId asid = _agent_socket_id.load(butil::memory_order_relaxed);
     if (asid != INVALID_SOCKET_ID) {
         SocketUniquePtr ptr;
@@ -1047,6 +1183,10 @@ void Socket::OnRecycle() {
 void* Socket::ProcessEvent(void* arg) {
     // the enclosed Socket is valid and free to access inside this function.
     SocketUniquePtr s(static_cast<Socket*>(arg));
+    if (s->_zerocopy) {
+        // Completions of MSG_ZEROCOPY are signaled as EPOLLERR.
+        s->ReapZeroCopyCompletions();
+    }
     s->_on_edge_triggered_events(s.get());
     return NULL;
 }
@@ -1106,6 +1246,10 @@ bool Socket::IsWriteComplete(Socket::WriteRequest* old_head,
     // matters for protocols using pipelined_count, this is why we don't
     // calling Setup in above loop which is from newest to oldest.
     for (WriteRequest* q = tail; q; q = q->next) {
+        if (q->contention) {
+            bthread::end_async_contention(q->contention);
+            q->contention = NULL;
+        }
         q->Setup(this);
     }
     if (new_tail) {
@@ -1121,7 +1265,7 @@ int Socket::WaitEpollOut(int fd, bool pollin, const timespec* abstime) {
     // Do not need to check addressable since it will be called by
     // health checker which called `SetFailed' before
     const int expected_val = _epollout_butex->load(butil::memory_order_relaxed);
-    EventDispatcher& edisp = GetGlobalEventDispatcher(fd);
+    EventDispatcher& edisp = GetGlobalEventDispatcher(fd, _dispatcher_index);
     if (edisp.AddEpollOut(id(), fd, pollin) != 0) {
         return -1;
     }
@@ -1493,6 +1637,7 @@ int Socket::Write(butil::IOBuf* data, const WriteOptions* options_in) {
     // wait until it points to a valid WriteRequest or NULL.
     req->next = WriteRequest::UNCONNECTED;
     req->id_wait = opt.id_wait;
+    req->contention = NULL;
     req->set_pipelined_count_and_user_message(
         opt.pipelined_count, DUMMY_USER_MESSAGE, opt.auth_flags);
     return StartWrite(req, opt);
@@ -1529,11 +1674,18 @@ int Socket::Write(SocketMessagePtr<>& msg, const WriteOptions* options_in) {
     // wait until it points to a valid WriteRequest or NULL.
     req->next = WriteRequest::UNCONNECTED;
     req->id_wait = opt.id_wait;
+    req->contention = NULL;
     req->set_pipelined_count_and_user_message(opt.pipelined_count, msg.release(), opt.auth_flags);
     return StartWrite(req, opt);
 }
 
 int Socket::StartWrite(WriteRequest* req, const WriteOptions& opt) {
+    // Someone is probably writing, sample the time that `req' waits for
+    // the writer to pick it up. This must be done before the exchange
+    // which publishes `req'.
+    if (_write_head.load(butil::memory_order_relaxed) != NULL) {
+        req->contention = bthread::start_async_contention();
+    }
     // Release fence makes sure the thread getting request sees *req
     WriteRequest* const prev_head =
         _write_head.exchange(req, butil::memory_order_release);
@@ -1554,6 +1706,10 @@ int Socket::StartWrite(WriteRequest* req, const WriteOptions& opt) {
 
     // We've got the right to write.
     req->next = NULL;
+    if (req->contention) {
+        bthread::cancel_async_contention(req->contention);
+        req->contention = NULL;
+    }
     
     // Connect to remote_side() if not.
     int ret = ConnectIfNot(opt.abstime, req);
@@ -1577,12 +1733,15 @@ int Socket::StartWrite(WriteRequest* req, const WriteOptions& opt) {
         // in the background.
         goto KEEPWRITE_IN_BACKGROUND;
     }
-    
+
     // Write once in the calling thread. If the write is not complete,
     // continue it in KeepWrite thread.
     if (_conn) {
         butil::IOBuf* data_arr[1] = { &req->data };
         nw = _conn->CutMessageIntoFileDescriptor(fd(), data_arr, 1);
+    } else if (_zerocopy) {
+        butil::IOBuf* data_arr[1] = { &req->data };
+        nw = DoZeroCopyWrite(data_arr, 1);
     } else {
         nw = req->data.cut_into_file_descriptor(fd());
     }
@@ -1603,6 +1762,18 @@ int Socket::StartWrite(WriteRequest* req, const WriteOptions& opt) {
         ReturnSuccessfulWriteRequest(req);
         return 0;
     }
+    if (FLAGS_socket_write_combining && nw >= 0) {
+        // Hand the remaining data and requests queued meanwhile over to the
+        // combiner, which owns the reference after CombineWrite() succeeds.
+        // The fd is full if nothing was written, wait for EPOLLOUT in
+        // KeepWrite instead.
+        ReAddress(&ptr_for_keep_write);
+        req->socket = ptr_for_keep_write.get();
+        if (CombineWrite(req) == 0) {
+            ptr_for_keep_write.release();
+            return 0;
+        }
+    }
 
 KEEPWRITE_IN_BACKGROUND:
     ReAddress(&ptr_for_keep_write);
@@ -1625,6 +1796,111 @@ FAIL_TO_WRITE:
 
 static const size_t DATA_LIST_MAX = 256;
 
+// Values of ExecutionQueueId<WriteRequest*>, one for each EventDispatcher.
+static uint64_t* g_write_combiners = NULL;
+static int g_write_combiner_num = 0;
+static pthread_once_t g_write_combiners_once = PTHREAD_ONCE_INIT;
+
+void Socket::CreateWriteCombiners() {
+    const int n = std::max(FLAGS_event_dispatcher_num, 1);
+    uint64_t* combiners = new uint64_t[n];
+    for (int i = 0; i < n; ++i) {
+        bthread::ExecutionQueueId<WriteRequest*> queue_id = { 0 };
+        if (bthread::execution_queue_start(
+                &queue_id, NULL, FlushCombinedWrites, NULL) != 0) {
+            LOG(ERROR) << "Fail to start write combiner";
+            delete [] combiners;
+            return;
+        }
+        combiners[i] = queue_id.value;
+    }
+    g_write_combiner_num = n;
+    g_write_combiners = combiners;
+}
+
+int Socket::CombineWrite(WriteRequest* req) {
+    pthread_once(&g_write_combiners_once, CreateWriteCombiners);
+    if (g_write_combiners == NULL) {
+        return -1;
+    }
+    // Same partitioning as GetGlobalEventDispatcher()
+    int index = 0;
+    if (_dispatcher_index >= 0) {
+        index = _dispatcher_index % g_write_combiner_num;
+    } else if (g_write_combiner_num != 1) {
+        index = butil::fmix32(fd()) % g_write_combiner_num;
+    }
+    bthread::ExecutionQueueId<WriteRequest*> queue_id =
+        { g_write_combiners[index] };
+    return bthread::execution_queue_execute(queue_id, req);
+}
+
+int Socket::FlushCombinedWrites(void*,
+                                bthread::TaskIterator<WriteRequest*>& iter) {
+    if (iter.is_queue_stopped()) {
+        return 0;
+    }
+    int64_t nsocket = 0;
+    for (; iter; ++iter) {
+        WriteRequest* req = *iter;
+        req->socket->FlushCombinedWrite(req);
+        ++nsocket;
+    }
+    g_vars->ncombinedwrite_batch << nsocket;
+    return 0;
+}
+
+void Socket::FlushCombinedWrite(WriteRequest* req) {
+    SocketUniquePtr s(req->socket);
+    // Link requests written after `req' was handed over, so that all of
+    // them are written by one writev. Requests linked before the hand-over
+    // are already after `req'.
+    WriteRequest* cur_tail = req;
+    while (cur_tail->next != NULL) {
+        cur_tail = cur_tail->next;
+    }
+    IsWriteComplete(cur_tail, false, &cur_tail);
+    size_t nreq = 0;
+    for (WriteRequest* p = req; p != NULL && nreq < DATA_LIST_MAX;
+         p = p->next) {
+        ++nreq;
+    }
+    const ssize_t nw = DoWrite(req);
+    if (nw < 0) {
+        // RTMP may return EOVERCROWDED
+        if (errno != EAGAIN && errno != EOVERCROWDED) {
+            const int saved_errno = errno;
+            // EPIPE is common in pooled connections + backup requests.
+            PLOG_IF(WARNING, errno != EPIPE) << "Fail to write into " << *this;
+            SetFailed(saved_errno, "Fail to write into %s: %s",
+                      description().c_str(), berror(saved_errno));
+            ReleaseAllFailedWriteRequests(req);
+            return;
+        }
+    } else {
+        AddOutputBytes(nw);
+        g_vars->nsyscall_saved << (int64_t)(nreq - 1);
+    }
+    // Release WriteRequest until non-empty data or last request.
+    while (req->next != NULL && req->data.empty()) {
+        WriteRequest* const saved_req = req;
+        req = req->next;
+        ReturnSuccessfulWriteRequest(saved_req);
+    }
+    if (IsWriteComplete(cur_tail, (req == cur_tail), &cur_tail)) {
+        CHECK_EQ(cur_tail, req);
+        ReturnSuccessfulWriteRequest(req);
+        return;
+    }
+    req->socket = s.release();
+    bthread_t th;
+    if (bthread_start_background(&th, &BTHREAD_ATTR_NORMAL,
+                                 KeepWrite, req) != 0) {
+        LOG(FATAL) << "Fail to start KeepWrite";
+        KeepWrite(req);
+    }
+}
+
 void* Socket::KeepWrite(void* void_arg) {
     g_vars->nkeepwrite << 1;
     WriteRequest* req = static_cast<WriteRequest*>(void_arg);
@@ -1714,6 +1990,8 @@ ssize_t Socket::DoWrite(WriteRequest* req) {
         // Write IOBuf in the batch array into the fd.
         if (_conn) {
             return _conn->CutMessageIntoFileDescriptor(fd(), data_list, ndata);
+        } else if (_zerocopy) {
+            return DoZeroCopyWrite(data_list, ndata);
         } else {
             ssize_t nw = butil::IOBuf::cut_multiple_into_file_descriptor(
                 fd(), data_list, ndata);
@@ -1758,6 +2036,49 @@ ssize_t Socket::DoWrite(WriteRequest* req) {
     return nw;
 }
 
+ssize_t Socket::DoZeroCopyWrite(butil::IOBuf* const* data_list,
+                                 size_t ndata) {
+    ReapZeroCopyCompletions();
+    // Don't start new zero-copy sends on a failing socket, which has to
+    // keep blocks of pending sends after closing the fd.
+    if (_zerocopy->enabled() && !Failed()) {
+        size_t total = 0;
+        for (size_t i = 0; i < ndata; ++i) {
+            total += data_list[i]->size();
+        }
+        if (total >= (size_t)FLAGS_socket_zerocopy_min_bytes) {
+            const ssize_t nw = _zerocopy->CutMultipleIntoFileDescriptor(
+                fd(), data_list, ndata);
+            if (nw > 0) {
+                g_vars->nzerocopy_bytes << nw;
+            }
+            if (nw >= 0 || errno != ENOBUFS) {
+                return nw;
+            }
+            // Too many pages pinned by pending sends(limited by optmem_max),
+            // copy this time.
+        }
+    }
+    return butil::IOBuf::cut_multiple_into_file_descriptor(
+        fd(), data_list, ndata);
+}
+
+void Socket::CloseFileDescriptor(int fd) {
+    if (_zerocopy) {
+        // Blocks of pending sends must be kept until they complete.
+        _zerocopy->CloseFileDescriptor(fd);
+    } else {
+        close(fd);
+    }
+}
+
+void Socket::ReapZeroCopyCompletions() {
+    const int fd2 = fd();
+    if (fd2 >= 0) {
+        _zerocopy->Reap(fd2);
+    }
+}
+
 int Socket::SSLHandshake(int fd, bool server_mode) {
     if (_ssl_ctx == NULL) {
         if (server_mode) {
@@ -1865,7 +2186,12 @@ ssize_t Socket::DoRead(size_t size_hint) {
     }
     // _ssl_state has been set
     if (ssl_state() == SSL_OFF) {
-        return _read_buf.append_from_file_descriptor(fd(), size_hint);
+        // Big reads are issued for large messages or long backlogs, read
+        // them into large blocks to use fewer iovecs and BlockRefs.
+        return _read_buf.append_from_file_descriptor(
+            fd(), size_hint, (size_hint >= LARGE_READ_THRESHOLD ?
+                              LARGE_READ_BLOCK_SIZE :
+                              butil::IOBuf::DEFAULT_BLOCK_SIZE));
     }
 
     CHECK_EQ(SSL_CONNECTED, ssl_state());
@@ -1989,7 +2315,19 @@ int Socket::StartInputEvent(SocketId id, uint32_t events,
 
         bthread_attr_t attr = thread_attr;
         attr.keytable_pool = p->_keytable_pool;
-        if (bthread_start_urgent(&tid, &attr, ProcessEvent, p) != 0) {
+        bthread_attr_settag(&attr, p->_bthread_tag);
+        int rc = 0;
+        if (p->_dispatcher_index >= 0 &&
+            GlobalEventDispatchersBoundToWorkers()) {
+            // Keep reading and processing in workers of the dispatcher.
+            const int nset = FLAGS_event_dispatcher_num;
+            rc = bthread_start_in_worker_set(
+                &tid, &attr, ProcessEvent, p,
+                p->_dispatcher_index % nset, nset);
+        } else {
+            rc = bthread_start_urgent(&tid, &attr, ProcessEvent, p);
+        }
+        if (rc != 0) {
             LOG(FATAL) << "Fail to start ProcessEvent";
             ProcessEvent(p);
         }
@@ -2168,6 +2506,28 @@ void Socket::DebugSocket(std::ostream& os, SocketId id) {
             os << "\nsni_name=" << ssl_ctx->sni_name;
         }
     }
+    if (ptr->_zerocopy) {
+        os << "\nzerocopy_enabled=" << ptr->_zerocopy->enabled()
+           << "\nzerocopy_pending_count=" << ptr->_zerocopy->pending_count()
+           << "\nzerocopy_pending_bytes=" << ptr->_zerocopy->pending_bytes();
+    }
+    const RpcBatcher* batcher = ptr->rpc_batcher();
+    if (batcher) {
+        os << "\nrpc_batch_pending_count=" << batcher->pending_count();
+    }
+    const MultiSocketSet* multi_sockets =
+        ptr->_multi_sockets.load(butil::memory_order_consume);
+    if (multi_sockets) {
+        os << "\nmulti_socket_ids=[";
+        for (int i = 1; i < MAX_MULTI_CONNECTION_COUNT; ++i) {
+            const SocketId sid =
+                multi_sockets->ids[i].load(butil::memory_order_relaxed);
+            if (sid != INVALID_SOCKET_ID) {
+                os << ' ' << sid;
+            }
+        }
+        os << " ]";
+    }
     if (ssl_state == SSL_CONNECTED) {
         os << "\nssl_session={\n  ";
         Print(os, ptr->_ssl_session, "\n  ");
@@ -2450,7 +2810,9 @@ int Socket::GetPooledSocket(SocketUniquePtr* pooled_socket) {
         opt.user = user();
         opt.on_edge_triggered_events = _on_edge_triggered_events;
         opt.initial_ssl_ctx = _ssl_ctx;
+        opt.use_zerocopy = (_zerocopy != NULL);
         opt.keytable_pool = _keytable_pool;
+        opt.bthread_tag = _bthread_tag;
         opt.app_connect = _app_connect;
         socket_pool = new SocketPool(opt);
         SocketPool* expected = NULL;
@@ -2546,7 +2908,9 @@ int Socket::GetShortSocket(SocketUniquePtr* short_socket) {
     opt.user = user();
     opt.on_edge_triggered_events = _on_edge_triggered_events;
     opt.initial_ssl_ctx = _ssl_ctx;
+    opt.use_zerocopy = (_zerocopy != NULL);
     opt.keytable_pool = _keytable_pool;
+    opt.bthread_tag = _bthread_tag;
     opt.app_connect = _app_connect;
     if (get_client_side_messenger()->Create(opt, &id) != 0 ||
         Socket::Address(id, short_socket) != 0) {
@@ -2556,6 +2920,70 @@ int Socket::GetShortSocket(SocketUniquePtr* short_socket) {
     return 0;
 }
 
+int Socket::GetMultiSocket(SocketUniquePtr* multi_socket) {
+    if (multi_socket == NULL) {
+        LOG(ERROR) << "multi_socket is NULL";
+        return -1;
+    }
+    // NOTE: save the gflag which may be reloaded at any time.
+    const int count = FLAGS_multi_connection_count;
+    MultiSocketSet* set = _multi_sockets.load(butil::memory_order_consume);
+    if (set == NULL && count > 1) {
+        MultiSocketSet* new_set = new MultiSocketSet;
+        if (_multi_sockets.compare_exchange_strong(
+                set, new_set, butil::memory_order_acq_rel,
+                butil::memory_order_acquire)) {
+            set = new_set;
+        } else {
+            delete new_set;
+        }
+    }
+    if (set == NULL) {
+        ReAddress(multi_socket);
+        return 0;
+    }
+    // Start from a random one so that calls are spread evenly when
+    // sockets are equally idle.
+    SocketUniquePtr best;
+    int64_t best_unwritten = 0;
+    const int start = butil::fast_rand_less_than(count);
+    for (int k = 0; k < count; ++k) {
+        const int i = (start + k) % count;
+        SocketUniquePtr ptr;
+        if (i == 0) {
+            ReAddress(&ptr);
+        } else {
+            SocketId sid = set->ids[i].load(butil::memory_order_relaxed);
+            if (sid == INVALID_SOCKET_ID || Socket::Address(sid, &ptr) != 0) {
+                // Failed sockets have released the additional reference
+                // themselves, just replace them.
+                SocketUniquePtr new_ptr;
+                if (GetShortSocket(&new_ptr) != 0) {
+                    continue;
+                }
+                if (set->ids[i].compare_exchange_strong(
+                        sid, new_ptr->id(), butil::memory_order_relaxed)) {
+                    ptr.swap(new_ptr);
+                } else {
+                    new_ptr->SetFailed(EUNUSED, "Close redundant multi socket");
+                    if (sid == INVALID_SOCKET_ID ||
+                        Socket::Address(sid, &ptr) != 0) {
+                        continue;
+                    }
+                }
+            }
+        }
+        const int64_t unwritten =
+            ptr->_unwritten_bytes.load(butil::memory_order_relaxed);
+        if (best == NULL || unwritten < best_unwritten) {
+            best_unwritten = unwritten;
+            best.swap(ptr);
+        }
+    }
+    multi_socket->swap(best);
+    return 0;
+}
+
 int Socket::GetAgentSocket(SocketUniquePtr* out, bool (*checkfn)(Socket*)) {
     SocketId id = _agent_socket_id.load(butil::memory_order_relaxed);
     SocketUniquePtr tmp_sock;
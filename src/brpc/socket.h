@@ -39,6 +39,10 @@
 #include "brpc/socket_message.h"          // SocketMessagePtr
 #include "bvar/bvar.h"
 
+namespace bthread {
+template <typename T> class TaskIterator;
+}  // namespace bthread
+
 namespace brpc {
 namespace policy {
 class ConsistentHashingLoadBalancer;
@@ -53,6 +57,9 @@ class Socket;
 class AuthContext;
 class EventDispatcher;
 class Stream;
+class ZeroCopyTracker;
+class RpcBatcher;
+class MultiSocketSet;
 
 // A special closure for processing the about-to-recycle socket. Socket does
 // not delete SocketUser, if you want, `delete this' at the end of
@@ -136,6 +143,14 @@ struct SocketVarsCollector {
         , nkeepwrite_second("rpc_keepwrite_second", &nkeepwrite)
         , nwaitepollout("rpc_waitepollout_count")
         , nwaitepollout_second("rpc_waitepollout_second", &nwaitepollout)
+        , ncombinedwrite_batch_window("rpc_combined_write_batch",
+                                      &ncombinedwrite_batch, -1)
+        , nsyscall_saved("rpc_combined_write_syscall_saved")
+        , nsyscall_saved_second("rpc_combined_write_syscall_saved_second",
+                                &nsyscall_saved)
+        , nzerocopy_bytes("rpc_zerocopy_send_bytes")
+        , nzerocopy_bytes_second("rpc_zerocopy_send_bytes_second",
+                                 &nzerocopy_bytes)
     {}
 
     bvar::Adder<int64_t> nsocket;
@@ -147,6 +162,15 @@ struct SocketVarsCollector {
     bvar::PerSecond<bvar::Adder<int64_t> > nkeepwrite_second;
     bvar::Adder<int64_t> nwaitepollout;
     bvar::PerSecond<bvar::Adder<int64_t> > nwaitepollout_second;
+    // Number of sockets flushed in each run of write combiners.
+    bvar::IntRecorder ncombinedwrite_batch;
+    bvar::Window<bvar::IntRecorder> ncombinedwrite_batch_window;
+    // Number of writes merged into writes of other WriteRequests.
+    bvar::Adder<int64_t> nsyscall_saved;
+    bvar::PerSecond<bvar::Adder<int64_t> > nsyscall_saved_second;
+    // Bytes sent with MSG_ZEROCOPY.
+    bvar::Adder<int64_t> nzerocopy_bytes;
+    bvar::PerSecond<bvar::Adder<int64_t> > nzerocopy_bytes_second;
 };
 
 struct PipelinedInfo {
@@ -193,6 +217,15 @@ struct SocketOptions {
     std::shared_ptr<AppConnect> app_connect;
     // The created socket will set parsing_context with this value.
     Destroyable* initial_parsing_context;
+    // Send large writes with MSG_ZEROCOPY(Linux 4.14+, TCP only). Written
+    // blocks are held until the kernel reports completion.
+    bool use_zerocopy;
+    // If non-negative, events of the fd are handled by the
+    // (dispatcher_index % -event_dispatcher_num)-th EventDispatcher,
+    // otherwise the dispatcher is chosen by hashing the fd.
+    int dispatcher_index;
+    // Worker pool to read and process messages of the socket.
+    bthread_tag_t bthread_tag;
 };
 
 // Abstractions on reading from and writing into file descriptors.
@@ -319,6 +352,18 @@ public:
     // _parsing_context, and false is returned. This process is thread-safe.
     template <typename T> bool initialize_parsing_context(T** ctx);
 
+    // Frames waiting to be written in batch, NULL until GetOrNewRpcBatcher()
+    // is called. Protocols may also use existence of the batcher to mark
+    // that the peer sends batches. See details/rpc_batcher.h
+    RpcBatcher* rpc_batcher() const
+    { return _rpc_batcher.load(butil::memory_order_consume); }
+    RpcBatcher* GetOrNewRpcBatcher();
+
+    // Bytes of the batch being parsed that are not cut into frames yet, 0
+    // when the parser is not inside a batch. Reset when fd is changed.
+    size_t rpc_batch_remaining() const { return _rpc_batch_remaining; }
+    void set_rpc_batch_remaining(size_t n) { _rpc_batch_remaining = n; }
+
     // Connection-specific result of authentication.
     const AuthContext* auth_context() const { return _auth_context; }
     AuthContext* mutable_auth_context();
@@ -481,6 +526,11 @@ public:
     // Create a socket connecting to the same place as this socket.
     int GetShortSocket(SocketUniquePtr* short_socket);
 
+    // Get the one with least unwritten bytes from -multi_connection_count
+    // sockets connecting to the same place as this socket, including this
+    // socket. All of them are shared by RPCs simultaneously.
+    int GetMultiSocket(SocketUniquePtr* multi_socket);
+
     // Get and persist a socket connecting to the same place as this socket.
     // If an agent socket was already created and persisted, it's returned
     // directly (provided other constraints are satisfied)
@@ -569,6 +619,14 @@ friend void DereferenceSocket(Socket*);
     // success, -1 otherwise and errno is set
     ssize_t DoWrite(WriteRequest* req);
 
+    // Write with MSG_ZEROCOPY if `data_list' is large enough.
+    ssize_t DoZeroCopyWrite(butil::IOBuf* const* data_list, size_t ndata);
+    // Release data of zero-copy writes that the kernel has finished.
+    void ReapZeroCopyCompletions();
+    // Close `fd' of this socket. Data of zero-copy writes pending on it is
+    // kept until they're finished.
+    void CloseFileDescriptor(int fd);
+
     // Called before returning to pool.
     void OnRecycle();
 
@@ -608,6 +666,19 @@ friend void DereferenceSocket(Socket*);
 
     static void* KeepWrite(void*);
 
+    // Hand `req' over to the write combiner shared by sockets of the same
+    // EventDispatcher, see -socket_write_combining.
+    // Returns 0 on success, -1 otherwise.
+    int CombineWrite(WriteRequest* req);
+    static void CreateWriteCombiners();
+    // Consumer of write combiners, writes WriteRequests of many sockets
+    // in one run.
+    static int FlushCombinedWrites(void* meta,
+                                   bthread::TaskIterator<WriteRequest*>& iter);
+    // Write `req' along with requests queued behind it, continue in a
+    // KeepWrite thread if the data can't be written completely.
+    void FlushCombinedWrite(WriteRequest* req);
+
     bool IsWriteComplete(WriteRequest* old_head, bool singular_node,
                          WriteRequest** new_tail);
 
@@ -849,6 +920,25 @@ private:
     butil::Mutex _stream_mutex;
     std::set<StreamId> *_stream_set;
 
+    // Non-NULL iff SocketOptions.use_zerocopy is true. Holds data written
+    // with MSG_ZEROCOPY until the kernel is done with it.
+    ZeroCopyTracker* _zerocopy;
+
+    // Created on demand, deleted when the socket is recycled.
+    butil::atomic<RpcBatcher*> _rpc_batcher;
+    // Only accessed by the parser.
+    size_t _rpc_batch_remaining;
+
+    // Sockets for CONNECTION_TYPE_MULTI besides this one. Created on
+    // demand, deleted when the socket is recycled.
+    butil::atomic<MultiSocketSet*> _multi_sockets;
+
+    // SocketOptions.dispatcher_index
+    int _dispatcher_index;
+
+    // SocketOptions.bthread_tag
+    bthread_tag_t _bthread_tag;
+
     butil::atomic<int64_t> _ninflight_app_health_check;
 };
 
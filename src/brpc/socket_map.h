@@ -79,12 +79,20 @@ struct SocketMapKeyHasher {
 // The corresponding SocketId is written to `*id'. If this function returns
 // successfully, SocketMapRemove() MUST be called when the Socket is not needed.
 // Return 0 on success, -1 otherwise.
+// Sockets created by this function send with MSG_ZEROCOPY iff
+// `use_zerocopy' is true.
 int SocketMapInsert(const SocketMapKey& key, SocketId* id,
-                    const std::shared_ptr<SocketSSLContext>& ssl_ctx);
+                    const std::shared_ptr<SocketSSLContext>& ssl_ctx,
+                    bool use_zerocopy);
+
+inline int SocketMapInsert(const SocketMapKey& key, SocketId* id,
+                           const std::shared_ptr<SocketSSLContext>& ssl_ctx) {
+    return SocketMapInsert(key, id, ssl_ctx, false);
+}
 
 inline int SocketMapInsert(const SocketMapKey& key, SocketId* id) {
     std::shared_ptr<SocketSSLContext> empty_ptr;
-    return SocketMapInsert(key, id, empty_ptr);
+    return SocketMapInsert(key, id, empty_ptr, false);
 }
 
 // Find the SocketId associated with `key'.
@@ -144,10 +152,15 @@ public:
     ~SocketMap();
     int Init(const SocketMapOptions&);
     int Insert(const SocketMapKey& key, SocketId* id,
-               const std::shared_ptr<SocketSSLContext>& ssl_ctx);
+               const std::shared_ptr<SocketSSLContext>& ssl_ctx,
+               bool use_zerocopy);
+    int Insert(const SocketMapKey& key, SocketId* id,
+               const std::shared_ptr<SocketSSLContext>& ssl_ctx) {
+        return Insert(key, id, ssl_ctx, false);
+    }
     int Insert(const SocketMapKey& key, SocketId* id) {
         std::shared_ptr<SocketSSLContext> empty_ptr;
-        return Insert(key, id, empty_ptr);
+        return Insert(key, id, empty_ptr, false);
     }
 
     void Remove(const SocketMapKey& key, SocketId expected_id);
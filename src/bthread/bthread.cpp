@@ -129,22 +129,53 @@ start_from_non_worker(bthread_t* __restrict tid,
     if (NULL == c) {
         return ENOMEM;
     }
+    bthread_tag_t tag = BTHREAD_TAG_DEFAULT;
+    if (attr != NULL && bthread_attr_gettag(attr) != BTHREAD_TAG_INVALID) {
+        tag = bthread_attr_gettag(attr);
+        if (tag < 0 || tag >= c->tag_count()) {
+            return EINVAL;
+        }
+    }
     if (attr != NULL && (attr->flags & BTHREAD_NOSIGNAL)) {
         // Remember the TaskGroup to insert NOSIGNAL tasks for 2 reasons:
         // 1. NOSIGNAL is often for creating many bthreads in batch,
         //    inserting into the same TaskGroup maximizes the batch.
         // 2. bthread_flush() needs to know which TaskGroup to flush.
         TaskGroup* g = tls_task_group_nosignal;
-        if (NULL == g) {
-            g = c->choose_one_group();
+        if (NULL == g || g->tag() != tag) {
+            if (g) {
+                g->flush_nosignal_tasks_remote();
+            }
+            g = c->choose_one_group(tag);
             tls_task_group_nosignal = g;
         }
         return g->start_background<true>(tid, attr, fn, arg);
     }
-    return c->choose_one_group()->start_background<true>(
+    return c->choose_one_group(tag)->start_background<true>(
         tid, attr, fn, arg);
 }
 
+// True if a bthread with `attr' can be run by the worker running `g'.
+inline bool can_run_in_group(const TaskGroup* g,
+                             const bthread_attr_t* __restrict attr) {
+    if (attr == NULL) {
+        return true;
+    }
+    const bthread_tag_t tag = bthread_attr_gettag(attr);
+    return tag == BTHREAD_TAG_INVALID || tag == g->tag();
+}
+
+// Start a bthread in another pool from a worker. BTHREAD_NOSIGNAL is
+// ignored since bthread_flush() in the worker only flushes its own pool.
+inline int start_in_other_pool(bthread_t* __restrict tid,
+                               const bthread_attr_t* __restrict attr,
+                               void * (*fn)(void*),
+                               void* __restrict arg) {
+    bthread_attr_t tmp = *attr;
+    tmp.flags &= ~BTHREAD_NOSIGNAL;
+    return start_from_non_worker(tid, &tmp, fn, arg);
+}
+
 struct TidTraits {
     static const size_t BLOCK_SIZE = 63;
     static const size_t MAX_ENTRIES = 65536;
@@ -175,6 +206,9 @@ int bthread_start_urgent(bthread_t* __restrict tid,
                          void* __restrict arg) {
     bthread::TaskGroup* g = bthread::tls_task_group;
     if (g) {
+        if (!bthread::can_run_in_group(g, attr)) {
+            return bthread::start_in_other_pool(tid, attr, fn, arg);
+        }
         // start from worker
         return bthread::TaskGroup::start_foreground(&g, tid, attr, fn, arg);
     }
@@ -187,12 +221,51 @@ int bthread_start_background(bthread_t* __restrict tid,
                              void* __restrict arg) {
     bthread::TaskGroup* g = bthread::tls_task_group;
     if (g) {
+        if (!bthread::can_run_in_group(g, attr)) {
+            return bthread::start_in_other_pool(tid, attr, fn, arg);
+        }
         // start from worker
         return g->start_background<false>(tid, attr, fn, arg);
     }
     return bthread::start_from_non_worker(tid, attr, fn, arg);
 }
 
+int bthread_start_in_worker_set(bthread_t* __restrict tid,
+                                const bthread_attr_t* __restrict attr,
+                                void * (*fn)(void*),
+                                void* __restrict arg,
+                                int set, int nset) {
+    if (nset <= 0 || set < 0 || set >= nset) {
+        return EINVAL;
+    }
+    if (attr != NULL &&
+        bthread_attr_gettag(attr) != BTHREAD_TAG_INVALID &&
+        bthread_attr_gettag(attr) != BTHREAD_TAG_DEFAULT) {
+        // Worker sets are only in the default pool.
+        return bthread_start_urgent(tid, attr, fn, arg);
+    }
+    bthread::TaskGroup* g = bthread::tls_task_group;
+    bthread::TaskControl* c = NULL;
+    if (g) {
+        c = g->control();
+        if (c->in_worker_set(g, set, nset) &&
+            bthread::can_run_in_group(g, attr)) {
+            return bthread::TaskGroup::start_foreground(&g, tid, attr, fn, arg);
+        }
+    } else {
+        c = bthread::get_or_new_task_control();
+        if (NULL == c) {
+            return ENOMEM;
+        }
+    }
+    bthread::TaskGroup* target = c->choose_one_group_in_set(set, nset);
+    if (NULL == target) {
+        // Not enough workers.
+        return bthread_start_urgent(tid, attr, fn, arg);
+    }
+    return target->start_background<true>(tid, attr, fn, arg);
+}
+
 void bthread_flush() {
     bthread::TaskGroup* g = bthread::tls_task_group;
     if (g) {
@@ -313,6 +386,45 @@ int bthread_setconcurrency(int num) {
     return (num == bthread::FLAGS_bthread_concurrency ? 0 : EPERM);
 }
 
+int bthread_getconcurrency_by_tag(bthread_tag_t tag) {
+    bthread::TaskControl* c = bthread::get_task_control();
+    if (c == NULL || tag < 0 || tag >= c->tag_count()) {
+        return 0;
+    }
+    return c->concurrency(tag);
+}
+
+int bthread_setconcurrency_by_tag(int num, bthread_tag_t tag) {
+    if (num <= 0 || num > BTHREAD_MAX_CONCURRENCY) {
+        LOG(ERROR) << "Invalid concurrency=" << num;
+        return EINVAL;
+    }
+    // Pools are created along with workers.
+    bthread::TaskControl* c = bthread::get_or_new_task_control();
+    if (c == NULL) {
+        return ENOMEM;
+    }
+    if (tag < 0 || tag >= c->tag_count()) {
+        LOG(ERROR) << "Invalid tag=" << tag;
+        return EINVAL;
+    }
+    BAIDU_SCOPED_LOCK(bthread::g_task_control_mutex);
+    const int old_num = c->concurrency(tag);
+    if (num < old_num) {
+        return EPERM;
+    } else if (num == old_num) {
+        return 0;
+    }
+    if (c->concurrency() + num - old_num > BTHREAD_MAX_CONCURRENCY) {
+        return EINVAL;
+    }
+    const int added = c->add_workers(num - old_num, tag);
+    if (c->concurrency() > bthread::FLAGS_bthread_concurrency) {
+        bthread::FLAGS_bthread_concurrency = c->concurrency();
+    }
+    return (added == num - old_num ? 0 : ENOMEM);
+}
+
 int bthread_about_to_quit() {
     bthread::TaskGroup* g = bthread::tls_task_group;
     if (g != NULL) {
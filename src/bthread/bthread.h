@@ -30,6 +30,7 @@
 #if defined(__cplusplus)
 #  include <iostream>
 #  include "bthread/mutex.h"        // use bthread_mutex_t in the RAII way
+#  include "bthread/rwlock.h"       // bthread::RWLock
 #endif
 
 #include "bthread/id.h"
@@ -146,6 +147,16 @@ extern int bthread_getconcurrency(void);
 // NOTE: currently concurrency cannot be reduced after any bthread created.
 extern int bthread_setconcurrency(int num);
 
+// Get number of worker pthreads in the pool `tag', 0 if the pool does not
+// exist or workers are not created yet.
+extern int bthread_getconcurrency_by_tag(bthread_tag_t tag);
+
+// Set number of worker pthreads in the pool `tag' to `num', creating workers
+// if needed. Pools are in [0, -task_group_ntags). Workers added are counted
+// in bthread_getconcurrency() as well.
+// NOTE: concurrency of a pool cannot be reduced.
+extern int bthread_setconcurrency_by_tag(int num, bthread_tag_t tag);
+
 // Yield processor to another bthread. 
 // Notice that current implementation is not fair, which means that 
 // even if bthread_yield() is called, suspended threads may still starve.
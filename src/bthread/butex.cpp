@@ -106,6 +106,19 @@ struct ButexBthreadWaiter : public ButexWaiter {
 // in Butex::waiters.
 struct ButexPthreadWaiter : public ButexWaiter {
     butil::atomic<int> sig;
+    // Not NULL iff this is a ButexCallbackWaiter.
+    void (*on_wakeup)(void* arg, int error);
+};
+
+// butex_wait_async allocates this structure and queue it in Butex::waiters.
+// Woken up like pthread waiters(tid is 0), but calls `on_wakeup' instead
+// of waking up a pthread.
+struct ButexCallbackWaiter : public ButexPthreadWaiter {
+    void* arg;
+    TimerThread::TaskId sleep_id;
+    // Referenced by the one calling `on_wakeup' and TimerThread if there's
+    // a timeout.
+    butil::atomic<int> nref;
 };
 
 typedef butil::LinkedList<ButexWaiter> ButexWaiterList;
@@ -124,7 +137,26 @@ struct BAIDU_CACHELINE_ALIGNMENT Butex {
 BAIDU_CASSERT(offsetof(Butex, value) == 0, offsetof_value_must_0);
 BAIDU_CASSERT(sizeof(Butex) == BAIDU_CACHELINE_SIZE, butex_fits_in_one_cacheline);
 
-static void wakeup_pthread(ButexPthreadWaiter* pw) {
+static void release_callback_waiter(ButexCallbackWaiter* cw) {
+    if (cw->nref.fetch_sub(1, butil::memory_order_acq_rel) == 1) {
+        butil::return_object(cw);
+    }
+}
+
+static void run_callback_waiter(ButexCallbackWaiter* cw, int error) {
+    if (error != ETIMEDOUT && cw->sleep_id != 0 &&
+        get_global_timer_thread()->unschedule(cw->sleep_id) == 0) {
+        // The timer will never run, release its reference.
+        release_callback_waiter(cw);
+    }
+    cw->on_wakeup(cw->arg, error);
+    release_callback_waiter(cw);
+}
+
+static void wakeup_pthread(ButexPthreadWaiter* pw, int error = 0) {
+    if (pw->on_wakeup) {
+        return run_callback_waiter(static_cast<ButexCallbackWaiter*>(pw), error);
+    }
     // release fence makes wait_pthread see changes before wakeup.
     pw->sig.store(PTHREAD_SIGNALLED, butil::memory_order_release);
     // At this point, wait_pthread() possibly has woken up and destroyed `pw'.
@@ -257,20 +289,30 @@ void butex_destroy(void* butex) {
     butil::return_object(b);
 }
 
-inline TaskGroup* get_task_group(TaskControl* c, bool nosignal = false) {
+// Get a group in the pool `tag' to run woken bthreads.
+inline TaskGroup* get_task_group(TaskControl* c, bthread_tag_t tag,
+                                 bool nosignal = false) {
     TaskGroup* g;
     if (nosignal) {
         g = tls_task_group_nosignal;
-        if (NULL == g) {
-            g = c->choose_one_group();
+        if (NULL == g || g->tag() != tag) {
+            if (g) {
+                g->flush_nosignal_tasks_general();
+            }
+            g = c->choose_one_group(tag);
             tls_task_group_nosignal = g;
         }
     } else {
-        g = tls_task_group ? tls_task_group : c->choose_one_group();
+        g = (tls_task_group && tls_task_group->tag() == tag) ?
+            tls_task_group : c->choose_one_group(tag);
     }
     return g;
 }
 
+inline bthread_tag_t waiter_tag(const ButexBthreadWaiter* bw) {
+    return bthread_attr_gettag(&bw->task_meta->attr);
+}
+
 inline void run_in_local_task_group(TaskGroup* g, bthread_t tid, bool nosignal) {
     if (!nosignal) {
         TaskGroup::exchange(&g, tid);
@@ -297,7 +339,7 @@ int butex_wake(void* arg, bool nosignal) {
     }
     ButexBthreadWaiter* bbw = static_cast<ButexBthreadWaiter*>(front);
     unsleep_if_necessary(bbw, get_global_timer_thread());
-    TaskGroup* g = get_task_group(bbw->control, nosignal);
+    TaskGroup* g = get_task_group(bbw->control, waiter_tag(bbw), nosignal);
     if (g == tls_task_group) {
         run_in_local_task_group(g, bbw->tid, nosignal);
     } else {
@@ -342,7 +384,7 @@ int butex_wake_all(void* arg, bool nosignal) {
     next->RemoveFromList();
     unsleep_if_necessary(next, get_global_timer_thread());
     ++nwakeup;
-    TaskGroup* g = get_task_group(next->control, nosignal);
+    TaskGroup* g = get_task_group(next->control, waiter_tag(next), nosignal);
     const int saved_nwakeup = nwakeup;
     while (!bthread_waiters.empty()) {
         // pop reversely
@@ -350,7 +392,13 @@ int butex_wake_all(void* arg, bool nosignal) {
             bthread_waiters.tail()->value());
         w->RemoveFromList();
         unsleep_if_necessary(w, get_global_timer_thread());
-        g->ready_to_run_general(w->tid, true);
+        if (waiter_tag(w) == g->tag()) {
+            g->ready_to_run_general(w->tid, true);
+        } else {
+            // Waiters of other pools are signalled individually.
+            get_task_group(w->control, waiter_tag(w))
+                ->ready_to_run_general(w->tid);
+        }
         ++nwakeup;
     }
     if (!nosignal && saved_nwakeup != nwakeup) {
@@ -409,7 +457,7 @@ int butex_wake_except(void* arg, bthread_t excluded_bthread) {
     ButexBthreadWaiter* front = static_cast<ButexBthreadWaiter*>(
                 bthread_waiters.head()->value());
 
-    TaskGroup* g = get_task_group(front->control);
+    TaskGroup* g = get_task_group(front->control, waiter_tag(front));
     const int saved_nwakeup = nwakeup;
     do {
         // pop reversely
@@ -417,7 +465,12 @@ int butex_wake_except(void* arg, bthread_t excluded_bthread) {
             bthread_waiters.tail()->value());
         w->RemoveFromList();
         unsleep_if_necessary(w, get_global_timer_thread());
-        g->ready_to_run_general(w->tid, true);
+        if (waiter_tag(w) == g->tag()) {
+            g->ready_to_run_general(w->tid, true);
+        } else {
+            get_task_group(w->control, waiter_tag(w))
+                ->ready_to_run_general(w->tid);
+        }
         ++nwakeup;
     } while (!bthread_waiters.empty());
     if (saved_nwakeup != nwakeup) {
@@ -458,10 +511,11 @@ int butex_requeue(void* arg, void* arg2) {
     ButexBthreadWaiter* bbw = static_cast<ButexBthreadWaiter*>(front);
     unsleep_if_necessary(bbw, get_global_timer_thread());
     TaskGroup* g = tls_task_group;
-    if (g) {
+    if (g && g->tag() == waiter_tag(bbw)) {
         TaskGroup::exchange(&g, front->tid);
     } else {
-        bbw->control->choose_one_group()->ready_to_run_remote(front->tid);
+        bbw->control->choose_one_group(waiter_tag(bbw))
+            ->ready_to_run_remote(front->tid);
     }
     return 1;
 }
@@ -499,10 +553,11 @@ inline bool erase_from_butex(ButexWaiter* bw, bool wakeup, WaiterState state) {
     if (erased && wakeup) {
         if (bw->tid) {
             ButexBthreadWaiter* bbw = static_cast<ButexBthreadWaiter*>(bw);
-            get_task_group(bbw->control)->ready_to_run_general(bw->tid);
+            get_task_group(bbw->control, waiter_tag(bbw))
+                ->ready_to_run_general(bw->tid);
         } else {
             ButexPthreadWaiter* pw = static_cast<ButexPthreadWaiter*>(bw);
-            wakeup_pthread(pw);
+            wakeup_pthread(pw, (state == WAITER_STATE_TIMEDOUT ? ETIMEDOUT : EINTR));
         }
     }
     errno = saved_errno;
@@ -577,6 +632,7 @@ static int butex_wait_from_pthread(TaskGroup* g, Butex* b, int expected_value,
     ButexPthreadWaiter pw;
     pw.tid = 0;
     pw.sig.store(PTHREAD_NOT_SIGNALLED, butil::memory_order_relaxed);
+    pw.on_wakeup = NULL;
     int rc = 0;
     
     if (g) {
@@ -635,6 +691,8 @@ int butex_wait(void* arg, int expected_value, const timespec* abstime) {
         return -1;
     }
     TaskGroup* g = tls_task_group;
+    DCHECK(NULL == g || g->current_task()->stack_type() != STACK_TYPE_NONE)
+        << "Stackless bthread=" << g->current_tid() << " must not block";
     if (NULL == g || g->is_current_pthread_task()) {
         return butex_wait_from_pthread(g, b, expected_value, abstime);
     }
@@ -710,6 +768,68 @@ int butex_wait(void* arg, int expected_value, const timespec* abstime) {
     return 0;
 }
 
+static void erase_callback_waiter_and_wakeup(void* arg) {
+    ButexCallbackWaiter* cw = static_cast<ButexCallbackWaiter*>(arg);
+    erase_from_butex(cw, true, WAITER_STATE_TIMEDOUT);
+    release_callback_waiter(cw);
+}
+
+int butex_wait_async(void* arg, int expected_value, const timespec* abstime,
+                     void (*on_wakeup)(void*, int), void* on_wakeup_arg) {
+    Butex* b = container_of(static_cast<butil::atomic<int>*>(arg), Butex, value);
+    if (b->value.load(butil::memory_order_relaxed) != expected_value) {
+        errno = EWOULDBLOCK;
+        butil::atomic_thread_fence(butil::memory_order_acquire);
+        return -1;
+    }
+    if (abstime != NULL &&
+        butil::timespec_to_microseconds(*abstime) <
+        (butil::gettimeofday_us() + MIN_SLEEP_US)) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    ButexCallbackWaiter* cw = butil::get_object<ButexCallbackWaiter>();
+    if (cw == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    cw->tid = 0;
+    cw->container.store(NULL, butil::memory_order_relaxed);
+    cw->on_wakeup = on_wakeup;
+    cw->arg = on_wakeup_arg;
+    cw->sleep_id = 0;
+    cw->nref.store((abstime ? 2 : 1), butil::memory_order_relaxed);
+    TimerThread* timer_thread =
+        (abstime ? get_or_create_global_timer_thread() : NULL);
+    {
+        BAIDU_SCOPED_LOCK(b->waiter_lock);
+        if (b->value.load(butil::memory_order_relaxed) != expected_value) {
+            errno = EWOULDBLOCK;
+        } else {
+            // Queue the waiter before scheduling the timer, otherwise a timer
+            // firing in-between finds `container' NULL and the timeout is
+            // lost. The timer blocks on waiter_lock until we're done here,
+            // so does butex_wake() which reads `sleep_id'.
+            b->waiters.Append(cw);
+            cw->container.store(b, butil::memory_order_relaxed);
+            if (abstime == NULL) {
+                return 0;
+            }
+            cw->sleep_id = timer_thread->schedule(
+                erase_callback_waiter_and_wakeup, cw, *abstime);
+            if (cw->sleep_id != 0) {
+                return 0;
+            }
+            // TimerThread stopped, nobody else can see the waiter yet.
+            cw->RemoveFromList();
+            cw->container.store(NULL, butil::memory_order_relaxed);
+            errno = ESTOP;
+        }
+    }
+    butil::return_object(cw);
+    return -1;
+}
+
 }  // namespace bthread
 
 namespace butil {
@@ -70,6 +70,15 @@ int butex_requeue(void* butex1, void* butex2);
 // Returns 0 on success, -1 otherwise and errno is set.
 int butex_wait(void* butex, int expected_value, const timespec* abstime);
 
+// Like butex_wait, but returns immediately. If *butex equals |expected_value|,
+// on_wakeup(arg, error) will be called once the butex is woken up(error=0)
+// or |abstime| is reached(error=ETIMEDOUT), in the thread waking up the
+// butex or in TimerThread, thus it should be quick and never block.
+// Returns 0 if the callback is queued, -1 otherwise and errno is set, in
+// which case the callback is never called.
+int butex_wait_async(void* butex, int expected_value, const timespec* abstime,
+                     void (*on_wakeup)(void* arg, int error), void* arg);
+
 }  // namespace bthread
 
 #endif  // BTHREAD_BUTEX_H
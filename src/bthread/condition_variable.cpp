@@ -22,6 +22,7 @@
 #include "butil/atomicops.h"
 #include "butil/macros.h"                         // BAIDU_CASSERT
 #include "bthread/butex.h"                       // butex_*
+#include "bthread/contention_profiler.h"        // ScopedContentionSampler
 #include "bthread/types.h"                       // bthread_cond_t
 
 namespace bthread {
@@ -97,6 +98,8 @@ int bthread_cond_wait(bthread_cond_t* __restrict c,
     }
     bthread_mutex_unlock(m);
     int rc1 = 0;
+    const size_t sampling_range = bthread::contention_sampling_range();
+    const int64_t start_ns = sampling_range ? butil::cpuwide_time_ns() : 0;
     if (bthread::butex_wait(ic->seq, expected_seq, NULL) < 0 &&
         errno != EWOULDBLOCK && errno != EINTR/*note*/) {
         // EINTR should not be returned by cond_*wait according to docs on
@@ -112,6 +115,9 @@ int bthread_cond_wait(bthread_cond_t* __restrict c,
         // soon and check the `stop' flag and other predicates.
         rc1 = errno;
     }
+    if (sampling_range) {
+        bthread::submit_wait_contention(sampling_range, start_ns);
+    }
     const int rc2 = bthread_mutex_lock_contended(m);
     return (rc2 ? rc2 : rc1);
 }
@@ -131,11 +137,16 @@ int bthread_cond_timedwait(bthread_cond_t* __restrict c,
     }
     bthread_mutex_unlock(m);
     int rc1 = 0;
+    const size_t sampling_range = bthread::contention_sampling_range();
+    const int64_t start_ns = sampling_range ? butil::cpuwide_time_ns() : 0;
     if (bthread::butex_wait(ic->seq, expected_seq, abstime) < 0 &&
         errno != EWOULDBLOCK && errno != EINTR/*note*/) {
         // note: see comments in bthread_cond_wait on EINTR.
         rc1 = errno;
     }
+    if (sampling_range) {
+        bthread::submit_wait_contention(sampling_range, start_ns);
+    }
     const int rc2 = bthread_mutex_lock_contended(m);
     return (rc2 ? rc2 : rc1);
 }
@@ -0,0 +1,87 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+// bthread - A M:N threading library to make applications more concurrent.
+
+#ifndef BTHREAD_CONTENTION_PROFILER_H
+#define BTHREAD_CONTENTION_PROFILER_H
+
+#include <stddef.h>                             // size_t
+#include <stdint.h>                             // int64_t
+#include "butil/macros.h"                       // DISALLOW_COPY_AND_ASSIGN
+#include "butil/time.h"                         // cpuwide_time_ns
+
+namespace bthread {
+
+// Start/stop collecting contentions into `filename' which can be read by
+// pprof. Returns false if the profiler was already started.
+bool ContentionProfilerStart(const char* filename);
+void ContentionProfilerStop();
+
+// Besides bthread_mutex_t and pthread_mutex_t which are sampled at unlocking,
+// waits on other primitives are sampled with stacks of the waiting sites,
+// namely bthread_id_lock/join, CountdownEvent and bthread_cond_t.
+
+// Returns non-zero if a wait starting now should be sampled, 0 otherwise
+// (including the case that contention profiler is off).
+size_t contention_sampling_range();
+
+// Submit a sampled wait which began at `start_ns' (butil::cpuwide_time_ns())
+// along with the stack of the caller.
+void submit_wait_contention(size_t sampling_range, int64_t start_ns);
+
+// Sample the blocking wait inside the scope.
+// Example:
+//   {
+//       bthread::ScopedContentionSampler sampler;
+//       butex_wait(...);
+//   }
+class ScopedContentionSampler {
+public:
+    ScopedContentionSampler()
+        : _sampling_range(contention_sampling_range())
+        , _start_ns(_sampling_range ? butil::cpuwide_time_ns() : 0) {}
+    ~ScopedContentionSampler() {
+        if (_sampling_range) {
+            submit_wait_contention(_sampling_range, _start_ns);
+        }
+    }
+private:
+    DISALLOW_COPY_AND_ASSIGN(ScopedContentionSampler);
+    size_t _sampling_range;
+    int64_t _start_ns;
+};
+
+// For waits ended by other threads, e.g. a write queued behind the
+// one being written to the same socket.
+struct SampledContention;
+
+// Returns a sample with the stack of the caller, NULL if the wait is not
+// sampled. A non-NULL sample must be passed to end_async_contention() or
+// cancel_async_contention() exactly once, from any thread.
+SampledContention* start_async_contention();
+
+// Submit the time elapsed since start_async_contention().
+void end_async_contention(SampledContention* c);
+
+// Discard the sample.
+void cancel_async_contention(SampledContention* c);
+
+}  // namespace bthread
+
+#endif  // BTHREAD_CONTENTION_PROFILER_H
@@ -0,0 +1,110 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+// bthread - A M:N threading library to make applications more concurrent.
+
+#include <errno.h>
+#include "butil/time.h"
+#include "bthread/bthread.h"
+#include "bthread/butex.h"
+#include "bthread/timer_thread.h"
+#include "bthread/coroutine.h"
+
+namespace bthread {
+
+static void* run_resumer(void* arg) {
+    static_cast<CoroutineResumer*>(arg)->resume();
+    return NULL;
+}
+
+int CoroutineResumer::start_in_worker() {
+    bthread_t th;
+    return bthread_start_background(&th, &BTHREAD_ATTR_STACKLESS,
+                                    run_resumer, this);
+}
+
+void CoroutineResumer::resume_in_worker() {
+    if (start_in_worker() != 0) {
+        resume();
+    }
+}
+
+bool UsleepAwaiter::suspend() {
+    TimerThread* tt = get_or_create_global_timer_thread();
+    if (tt == NULL) {
+        _error = ESTOP;
+        return false;
+    }
+    const timespec abstime = butil::microseconds_from_now(_microseconds);
+    if (tt->schedule(on_timer, this, abstime) == 0) {
+        _error = ESTOP;
+        return false;
+    }
+    // The coroutine may already be resumed, don't touch `this' anymore.
+    return true;
+}
+
+void UsleepAwaiter::on_timer(void* arg) {
+    static_cast<UsleepAwaiter*>(arg)->_resumer.resume_in_worker();
+}
+
+int UsleepAwaiter::await_resume() const {
+    if (_error) {
+        errno = _error;
+        return -1;
+    }
+    return 0;
+}
+
+ButexAwaiter::ButexAwaiter(void* butex, int expected_value,
+                           const timespec* abstime)
+    : _butex(butex)
+    , _expected_value(expected_value)
+    , _has_abstime(abstime != NULL)
+    , _error(0) {
+    if (abstime) {
+        _abstime = *abstime;
+    }
+}
+
+bool ButexAwaiter::suspend() {
+    if (butex_wait_async(_butex, _expected_value,
+                         (_has_abstime ? &_abstime : NULL),
+                         on_wakeup, this) != 0) {
+        _error = errno;
+        return false;
+    }
+    // The coroutine may already be resumed, don't touch `this' anymore.
+    return true;
+}
+
+void ButexAwaiter::on_wakeup(void* arg, int error) {
+    ButexAwaiter* a = static_cast<ButexAwaiter*>(arg);
+    a->_error = error;
+    a->_resumer.resume_in_worker();
+}
+
+int ButexAwaiter::await_resume() const {
+    if (_error) {
+        errno = _error;
+        return -1;
+    }
+    return 0;
+}
+
+}  // namespace bthread
@@ -0,0 +1,327 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+// bthread - A M:N threading library to make applications more concurrent.
+
+#ifndef BTHREAD_COROUTINE_H
+#define BTHREAD_COROUTINE_H
+
+#include <stdint.h>
+#include <time.h>                               // timespec
+#include "bthread/types.h"
+
+// Awaiters of bthread primitives for C++20 coroutines. A coroutine
+// suspended on them does not occupy a bthread or its stack, only the
+// coroutine frame (usually hundreds of bytes) which is resumed in a
+// stackless bthread(BTHREAD_ATTR_STACKLESS) on a worker of TaskControl when
+// the event happens. Code between two co_await must not block(bthread_usleep,
+// butex_wait, synchronous RPC ...) since it runs on a borrowed stack.
+//
+//   bthread::Awaitable<int> get(brpc::Channel* ch) {
+//       co_await bthread::co_usleep(1000);
+//       ...
+//       co_await ch->CallMethodAsync(method, &cntl, &req, &res);
+//       co_return cntl.Failed() ? -1 : 0;
+//   }
+//   bthread::start_coroutine(do_something());    // detached
+//   int rc = bthread::sync_wait(get(&channel));  // block until done
+//
+// Awaiters in this file are usable by any coroutine library, while
+// Awaitable/start_coroutine/sync_wait are only defined for C++20 compilers.
+
+namespace bthread {
+
+// Resume a suspended coroutine in bthread workers.
+class CoroutineResumer {
+public:
+    CoroutineResumer() : _addr(NULL), _resume(NULL) {}
+
+    // `h' is a std::coroutine_handle<P>.
+    template <typename Handle> void set(Handle h) {
+        _addr = h.address();
+        _resume = resume_handle<Handle>;
+    }
+
+    // Resume the coroutine in the calling thread.
+    void resume() { _resume(_addr); }
+
+    // Resume the coroutine in a stackless bthread. Returns 0 on success,
+    // error code otherwise.
+    int start_in_worker();
+
+    // Resume the coroutine in a stackless bthread, or in the calling thread
+    // if the bthread can't be created.
+    void resume_in_worker();
+
+private:
+    template <typename Handle> static void resume_handle(void* addr) {
+        Handle::from_address(addr).resume();
+    }
+
+    void* _addr;
+    void (*_resume)(void*);
+};
+
+// co_await SwitchToWorker() moves the coroutine into a bthread worker.
+class SwitchToWorker {
+public:
+    bool await_ready() const { return false; }
+    template <typename Handle> bool await_suspend(Handle h) {
+        _resumer.set(h);
+        return _resumer.start_in_worker() == 0;
+    }
+    void await_resume() const {}
+
+private:
+    CoroutineResumer _resumer;
+};
+
+// Awaiter of co_usleep().
+class UsleepAwaiter {
+public:
+    explicit UsleepAwaiter(uint64_t microseconds)
+        : _microseconds(microseconds), _error(0) {}
+    bool await_ready() const { return _microseconds == 0; }
+    template <typename Handle> bool await_suspend(Handle h) {
+        _resumer.set(h);
+        return suspend();
+    }
+    // Returns 0 on success, -1 otherwise and errno is set.
+    int await_resume() const;
+
+private:
+    bool suspend();
+    static void on_timer(void* arg);
+
+    uint64_t _microseconds;
+    int _error;
+    CoroutineResumer _resumer;
+};
+
+// Awaiter of co_butex_wait().
+class ButexAwaiter {
+public:
+    ButexAwaiter(void* butex, int expected_value, const timespec* abstime);
+    bool await_ready() const { return false; }
+    template <typename Handle> bool await_suspend(Handle h) {
+        _resumer.set(h);
+        return suspend();
+    }
+    // Returns 0 on success, -1 otherwise and errno is set.
+    int await_resume() const;
+
+private:
+    bool suspend();
+    static void on_wakeup(void* arg, int error);
+
+    void* _butex;
+    int _expected_value;
+    bool _has_abstime;
+    int _error;
+    timespec _abstime;
+    CoroutineResumer _resumer;
+};
+
+// Suspend the coroutine for at least |microseconds|, like bthread_usleep.
+// co_await returns 0 on success, -1 otherwise and errno is set.
+inline UsleepAwaiter co_usleep(uint64_t microseconds) {
+    return UsleepAwaiter(microseconds);
+}
+
+// Suspend the coroutine until |butex| is woken up or |abstime| is reached,
+// if *butex equals |expected_value|, like butex_wait.
+// co_await returns 0 on success, -1 otherwise and errno is set.
+inline ButexAwaiter co_butex_wait(void* butex, int expected_value,
+                                  const timespec* abstime = NULL) {
+    return ButexAwaiter(butex, expected_value, abstime);
+}
+
+}  // namespace bthread
+
+#if defined(__cplusplus) && __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<coroutine>)
+#define BTHREAD_HAS_COROUTINE
+#endif
+#endif
+
+#ifdef BTHREAD_HAS_COROUTINE
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "butil/logging.h"
+#include "bthread/countdown_event.h"
+
+namespace bthread {
+namespace coroutine_internal {
+
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+    // Transfer to the awaiting coroutine directly without growing the stack.
+    template <typename Promise> std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> h) const noexcept {
+        std::coroutine_handle<> c = h.promise().continuation;
+        return c ? c : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+    void rethrow_if_failed() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+template <typename T> struct Promise : public PromiseBase {
+    std::optional<T> value;
+
+    template <typename U> void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+    T result() {
+        rethrow_if_failed();
+        return std::move(*value);
+    }
+};
+
+template <> struct Promise<void> : public PromiseBase {
+    void return_void() const {}
+    void result() { rethrow_if_failed(); }
+};
+
+// Run `h' and get back to the awaiting coroutine when it's done.
+template <typename P> struct RunAwaiter {
+    std::coroutine_handle<P> h;
+
+    bool await_ready() const noexcept { return h.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept {
+        h.promise().continuation = c;
+        return h;
+    }
+    void await_resume() const noexcept {}
+};
+
+// A coroutine which starts eagerly and destroys itself when it ends.
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+}  // namespace coroutine_internal
+
+// Return type of coroutines awaiting bthread primitives. The coroutine
+// starts to run when it's co_await-ed, start_coroutine-ed or sync_wait-ed.
+// Exceptions escaping from the coroutine are rethrown to the awaiter.
+template <typename T = void> class Awaitable {
+public:
+    struct promise_type : public coroutine_internal::Promise<T> {
+        Awaitable get_return_object() {
+            return Awaitable(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    Awaitable(Awaitable&& other) noexcept : _handle(other._handle) {
+        other._handle = nullptr;
+    }
+    Awaitable& operator=(Awaitable&& other) noexcept {
+        if (this != &other) {
+            reset();
+            _handle = other._handle;
+            other._handle = nullptr;
+        }
+        return *this;
+    }
+    Awaitable(const Awaitable&) = delete;
+    Awaitable& operator=(const Awaitable&) = delete;
+    ~Awaitable() { reset(); }
+
+    struct Awaiter : public coroutine_internal::RunAwaiter<promise_type> {
+        T await_resume() { return this->h.promise().result(); }
+    };
+    Awaiter operator co_await() const noexcept { return Awaiter{{_handle}}; }
+
+    Handle handle() const { return _handle; }
+
+private:
+    explicit Awaitable(Handle h) : _handle(h) {}
+    void reset() {
+        if (_handle) {
+            _handle.destroy();
+            _handle = nullptr;
+        }
+    }
+
+    Handle _handle;
+};
+
+namespace coroutine_internal {
+
+inline DetachedTask run_detached(Awaitable<void> a) {
+    co_await SwitchToWorker();
+    co_await RunAwaiter<Awaitable<void>::promise_type>{a.handle()};
+    if (a.handle().promise().exception) {
+        LOG(ERROR) << "Uncaught exception in coroutine started by "
+            "start_coroutine";
+    }
+}
+
+template <typename T>
+DetachedTask run_and_signal(typename Awaitable<T>::Handle h,
+                            CountdownEvent* ev) {
+    co_await SwitchToWorker();
+    co_await RunAwaiter<typename Awaitable<T>::promise_type>{h};
+    ev->signal();
+}
+
+}  // namespace coroutine_internal
+
+// Run `a' in bthread workers without waiting for it, like
+// bthread_start_background.
+inline void start_coroutine(Awaitable<void>&& a) {
+    coroutine_internal::run_detached(std::move(a));
+}
+
+// Run `a' in bthread workers and block the calling bthread or pthread until
+// it's done. Returns what `a' returns.
+template <typename T> T sync_wait(Awaitable<T> a) {
+    CountdownEvent ev(1);
+    coroutine_internal::run_and_signal<T>(a.handle(), &ev);
+    ev.wait();
+    return a.handle().promise().result();
+}
+
+}  // namespace bthread
+
+#endif  // BTHREAD_HAS_COROUTINE
+
+#endif  // BTHREAD_COROUTINE_H
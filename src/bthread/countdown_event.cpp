@@ -21,6 +21,7 @@
 
 #include "butil/atomicops.h"     // butil::atomic<int>
 #include "bthread/butex.h"
+#include "bthread/contention_profiler.h"
 #include "bthread/countdown_event.h"
 
 namespace bthread {
@@ -61,6 +62,7 @@ int CountdownEvent::wait() {
         if (seen_counter <= 0) {
             return 0;
         }
+        ScopedContentionSampler sampler;
         if (butex_wait(_butex, seen_counter, NULL) < 0 &&
             errno != EWOULDBLOCK && errno != EINTR) {
             return errno;
@@ -99,6 +101,7 @@ int CountdownEvent::timed_wait(const timespec& duetime) {
         if (seen_counter <= 0) {
             return 0;
         }
+        ScopedContentionSampler sampler;
         if (butex_wait(_butex, seen_counter, &duetime) < 0 &&
             errno != EWOULDBLOCK && errno != EINTR) {
             return errno;
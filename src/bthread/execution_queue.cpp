@@ -65,41 +65,75 @@ inline ExecutionQueueVars* get_execq_vars() {
     return butil::get_leaky_singleton<ExecutionQueueVars>();
 }
 
-void ExecutionQueueBase::start_execute(TaskNode* node) {
-    node->next = TaskNode::UNCONNECTED;
-    node->status = UNEXECUTED;
-    node->iterated = false;
-    if (node->high_priority) {
+// Exposed when ExecutionQueueOptions.bvar_prefix is not empty.
+struct ExecutionQueueStats {
+    bvar::IntRecorder batch_size;
+    bvar::LatencyRecorder execute;
+
+    explicit ExecutionQueueStats(const std::string& prefix)
+        : batch_size(prefix, "batch_size")
+        , execute(prefix, "execute") {}
+};
+
+void ExecutionQueueBase::start_execute_batch(
+        TaskNode* oldest, TaskNode* newest, size_t n) {
+    for (TaskNode* node = newest; node != oldest; node = node->next) {
+        node->status = UNEXECUTED;
+        node->iterated = false;
+    }
+    oldest->next = TaskNode::UNCONNECTED;
+    oldest->status = UNEXECUTED;
+    oldest->iterated = false;
+    if (oldest->high_priority) {
         // Add _high_priority_tasks before pushing this task into queue to
         // make sure that _execute_tasks sees the newest number when this 
         // task is in the queue. Although there might be some useless for 
         // loops in _execute_tasks if this thread is scheduled out at this 
         // point, we think it's just fine.
-        _high_priority_tasks.fetch_add(1, butil::memory_order_relaxed);
+        _high_priority_tasks.fetch_add(n, butil::memory_order_relaxed);
     }
-    TaskNode* const prev_head = _head.exchange(node, butil::memory_order_release);
+    TaskNode* const prev_head = _head.exchange(newest, butil::memory_order_release);
     if (prev_head != NULL) {
-        node->next = prev_head;
+        oldest->next = prev_head;
         return;
     }
-    // Get the right to execute the task, start a bthread to avoid deadlock
-    // or stack overflow
-    node->next = NULL;
-    node->q = this;
+    // Get the right to execute the tasks, start a bthread to avoid deadlock
+    // or stack overflow. Nodes of this batch are not visible to others
+    // except that _head is |newest|, reverse them into executing order.
+    TaskNode* tail = NULL;
+    for (TaskNode* p = newest; p != oldest;) {
+        TaskNode* const saved_next = p->next;
+        p->next = tail;
+        tail = p;
+        p = saved_next;
+    }
+    oldest->next = tail;
+    oldest->q = this;
 
     ExecutionQueueVars* const vars = get_execq_vars();
     vars->execq_active_count << 1;
-    if (node->in_place) {
+    if (oldest->in_place) {
         int niterated = 0;
-        _execute(node, node->high_priority, &niterated);
-        TaskNode* tmp = node;
-        // return if no more
-        if (node->high_priority) {
+        _execute(oldest, oldest->high_priority, &niterated);
+        if (oldest->high_priority) {
             _high_priority_tasks.fetch_sub(niterated, butil::memory_order_relaxed);
         }
-        if (!_more_tasks(tmp, &tmp, !node->iterated)) {
+        bool has_uniterated = false;
+        for (TaskNode* p = oldest; p != NULL; p = p->next) {
+            if (!p->iterated) {
+                has_uniterated = true;
+                break;
+            }
+        }
+        TaskNode* tmp = newest;
+        // return if no more
+        if (!_more_tasks(newest, &tmp, has_uniterated)) {
             vars->execq_active_count << -1;
-            return_task_node(node);
+            while (oldest != NULL) {
+                TaskNode* const saved_next = oldest->next;
+                return_task_node(oldest);
+                oldest = saved_next;
+            }
             return;
         }
     }
@@ -111,14 +145,14 @@ void ExecutionQueueBase::start_execute(TaskNode* node) {
         // unlock a pthread_mutex_t) in which case implicit context switch may
         // cause undefined behavior (e.g. deadlock)
         if (bthread_start_background(&tid, &_options.bthread_attr,
-                                     _execute_tasks, node) != 0) {
+                                     _execute_tasks, oldest) != 0) {
             PLOG(FATAL) << "Fail to start bthread";
-            _execute_tasks(node);
+            _execute_tasks(oldest);
         }
     } else {
-        if (_options.executor->submit(_execute_tasks, node) != 0) {
+        if (_options.executor->submit(_execute_tasks, oldest) != 0) {
             PLOG(FATAL) << "Fail to submit task";
-            _execute_tasks(node);
+            _execute_tasks(oldest);
         }
     }
 }
@@ -183,6 +217,8 @@ void* ExecutionQueueBase::_execute_tasks(void* arg) {
         m->_join_butex->fetch_add(2, butil::memory_order_release/*1*/);
         butex_wake_all(m->_join_butex);
         vars->execq_count << -1;
+        delete m->_stats;
+        m->_stats = NULL;
         butil::return_resource(slot_of_id(m->_this_id));
     }
     vars->execq_active_count << -1;
@@ -269,7 +305,14 @@ int ExecutionQueueBase::_execute(TaskNode* head, bool high_priority, int* nitera
     }
     TaskIteratorBase iter(head, this, false, high_priority);
     if (iter) {
-        _execute_func(_meta, _type_specific_function, iter);
+        if (_stats == NULL) {
+            _execute_func(_meta, _type_specific_function, iter);
+        } else {
+            const int64_t start_us = butil::cpuwide_time_us();
+            _execute_func(_meta, _type_specific_function, iter);
+            _stats->execute << butil::cpuwide_time_us() - start_us;
+            _stats->batch_size << iter.num_iterated();
+        }
     }
     // We must assign |niterated| with num_iterated even if we couldn't peek
     // any task to execute at the begining, in which case all the iterated 
@@ -286,6 +329,33 @@ TaskNode* ExecutionQueueBase::allocate_node() {
     return butil::get_object<TaskNode>();
 }
 
+TaskNode* ExecutionQueueBase::allocate_nodes(size_t n) {
+    TaskNode* newest = NULL;
+    for (size_t i = 0; i < n; ++i) {
+        TaskNode* node = butil::get_object<TaskNode>();
+        if (BAIDU_UNLIKELY(node == NULL)) {
+            get_execq_vars()->running_task_count << i;
+            return_unused_nodes(newest);
+            return NULL;
+        }
+        node->next = newest;
+        newest = node;
+    }
+    get_execq_vars()->running_task_count << n;
+    return newest;
+}
+
+void ExecutionQueueBase::return_unused_nodes(TaskNode* newest) {
+    int64_t nreturned = 0;
+    while (newest != NULL) {
+        TaskNode* const saved_next = newest->next;
+        butil::return_object(newest);
+        newest = saved_next;
+        ++nreturned;
+    }
+    get_execq_vars()->running_task_count << -nreturned;
+}
+
 TaskNode* const TaskNode::UNCONNECTED = (TaskNode*)-1L;
 
 ExecutionQueueBase::scoped_ptr_t ExecutionQueueBase::address(uint64_t id) {
@@ -360,6 +430,10 @@ int ExecutionQueueBase::create(uint64_t* id, const ExecutionQueueOptions* option
             opt = *options;   
         }
         m->_options = opt;
+        CHECK(m->_stats == NULL);
+        if (!opt.bvar_prefix.empty()) {
+            m->_stats = new (std::nothrow) ExecutionQueueStats(opt.bvar_prefix);
+        }
         m->_stopped.store(false, butil::memory_order_relaxed);
         m->_this_id = make_id(
                 _version_of_vref(m->_versioned_ref.fetch_add(
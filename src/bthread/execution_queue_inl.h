@@ -150,6 +150,7 @@ struct TaskAllocator : public TaskAllocatorBase<
 {};
 
 class TaskIteratorBase;
+struct ExecutionQueueStats;
 
 class BAIDU_CACHELINE_ALIGNMENT ExecutionQueueBase {
 DISALLOW_COPY_AND_ASSIGN(ExecutionQueueBase);
@@ -168,6 +169,7 @@ public:
         : _head(NULL)
         , _versioned_ref(0)  // join() depends on even version
         , _high_priority_tasks(0)
+        , _stats(NULL)
     {
         _join_butex = butex_create_checked<butil::atomic<int> >();
         _join_butex->store(0, butil::memory_order_relaxed);
@@ -189,8 +191,15 @@ protected:
                       clear_task_mem clear_func,
                       void* meta, void* type_specific_function);
     static scoped_ptr_t address(uint64_t id) WARN_UNUSED_RESULT;
-    void start_execute(TaskNode* node);
+    void start_execute(TaskNode* node) { start_execute_batch(node, node, 1); }
+    // Push |n| nodes linked from |newest| to |oldest| by TaskNode::next.
+    void start_execute_batch(TaskNode* oldest, TaskNode* newest, size_t n);
     TaskNode* allocate_node();
+    // Allocate |n| nodes, each of which links to the one allocated before it
+    // by TaskNode::next. Returns the last allocated one, NULL on failure.
+    TaskNode* allocate_nodes(size_t n);
+    // Return nodes allocated by allocate_nodes() which are never executed.
+    void return_unused_nodes(TaskNode* newest);
     void return_task_node(TaskNode* node);
 
 private:
@@ -234,6 +243,7 @@ private:
     clear_task_mem _clear_func;
     ExecutionQueueOptions _options;
     butil::atomic<int>* _join_butex;
+    ExecutionQueueStats* _stats;
 };
 
 template <typename T>
@@ -317,6 +327,48 @@ public:
         start_execute(node);
         return 0;
     }
+
+    int execute_batch(const T* tasks, size_t n, const TaskOptions* options,
+                      TaskHandle* handles) {
+        if (stopped()) {
+            return EINVAL;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        TaskNode* const newest = allocate_nodes(n);
+        if (BAIDU_UNLIKELY(newest == NULL)) {
+            return ENOMEM;
+        }
+        TaskOptions opt;
+        if (options) {
+            opt = *options;
+        }
+        TaskNode* oldest = newest;
+        size_t i = n;
+        for (TaskNode* node = newest; node != NULL; node = node->next) {
+            --i;
+            void* const mem = allocator::allocate(node);
+            if (BAIDU_UNLIKELY(!mem)) {
+                for (TaskNode* p = newest; p != node; p = p->next) {
+                    clear_task_mem(p);
+                }
+                return_unused_nodes(newest);
+                return ENOMEM;
+            }
+            new (mem) T(tasks[i]);
+            node->stop_task = false;
+            node->high_priority = opt.high_priority;
+            node->in_place = opt.in_place_if_possible;
+            if (handles) {
+                handles[i].node = node;
+                handles[i].version = node->version;
+            }
+            oldest = node;
+        }
+        start_execute_batch(oldest, newest, n);
+        return 0;
+    }
 };
 
 inline ExecutionQueueOptions::ExecutionQueueOptions()
@@ -365,6 +417,33 @@ inline int execution_queue_execute(ExecutionQueueId<T> id,
     }
 }
 
+template <typename T>
+inline int execution_queue_execute_batch(ExecutionQueueId<T> id,
+                                         const T* tasks, size_t n) {
+    return execution_queue_execute_batch(id, tasks, n, NULL);
+}
+
+template <typename T>
+inline int execution_queue_execute_batch(ExecutionQueueId<T> id,
+                                         const T* tasks, size_t n,
+                                         const TaskOptions* options) {
+    return execution_queue_execute_batch(id, tasks, n, options, NULL);
+}
+
+template <typename T>
+inline int execution_queue_execute_batch(ExecutionQueueId<T> id,
+                                         const T* tasks, size_t n,
+                                         const TaskOptions* options,
+                                         TaskHandle* handles) {
+    typename ExecutionQueue<T>::scoped_ptr_t
+        ptr = ExecutionQueue<T>::address(id);
+    if (ptr != NULL) {
+        return ptr->execute_batch(tasks, n, options, handles);
+    } else {
+        return EINVAL;
+    }
+}
+
 template <typename T>
 inline int execution_queue_stop(ExecutionQueueId<T> id) {
     typename ExecutionQueue<T>::scoped_ptr_t 
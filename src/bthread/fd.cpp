@@ -136,8 +136,11 @@ public:
             PLOG(FATAL) << "Fail to epoll_create/kqueue";
             return -1;
         }
+        // Serve all pools in the default one.
+        bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+        bthread_attr_settag(&attr, BTHREAD_TAG_DEFAULT);
         if (bthread_start_background(
-                &_tid, NULL, EpollThread::run_this, this) != 0) {
+                &_tid, &attr, EpollThread::run_this, this) != 0) {
             close(_epfd);
             _epfd = -1;
             LOG(FATAL) << "Fail to create epoll bthread";
@@ -23,6 +23,7 @@
 #include "butil/logging.h"
 #include "bthread/butex.h"                       // butex_*
 #include "bthread/mutex.h"
+#include "bthread/contention_profiler.h"
 #include "bthread/list_of_abafree_id.h"
 #include "butil/resource_pool.h"
 #include "bthread/bthread.h"
@@ -439,10 +440,16 @@ int bthread_id_lock_and_reset_range_verbose(
             uint32_t expected_ver = *butex;
             meta->mutex.unlock();
             ever_contended = true;
+            const size_t sampling_range = bthread::contention_sampling_range();
+            const int64_t start_ns =
+                sampling_range ? butil::cpuwide_time_ns() : 0;
             if (bthread::butex_wait(butex, expected_ver, NULL) < 0 &&
                 errno != EWOULDBLOCK && errno != EINTR) {
                 return errno;
             }
+            if (sampling_range) {
+                bthread::submit_wait_contention(sampling_range, start_ns);
+            }
             meta->mutex.lock();
         } else { // bthread_id_about_to_destroy was called.
             meta->mutex.unlock();
@@ -526,6 +533,7 @@ int bthread_id_join(bthread_id_t id) {
         if (!has_ver) {
             break;
         }
+        bthread::ScopedContentionSampler sampler;
         if (bthread::butex_wait(join_butex, expected_ver, NULL) < 0 &&
             errno != EWOULDBLOCK && errno != EINTR) {
             return errno;
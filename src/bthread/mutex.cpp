@@ -40,6 +40,7 @@
 #include "bthread/butex.h"                       // butex_*
 #include "bthread/processor.h"                   // cpu_relax, barrier
 #include "bthread/mutex.h"                       // bthread_mutex_t
+#include "bthread/contention_profiler.h"
 #include "bthread/sys_futex.h"
 #include "bthread/log.h"
 
@@ -56,7 +57,8 @@ const int ALLOW_UNUSED dummy_bt = backtrace(dummy_buf, arraysize(dummy_buf));
 static bvar::CollectorSpeedLimit g_cp_sl = BVAR_COLLECTOR_SPEED_LIMIT_INITIALIZER;
 
 const size_t MAX_CACHED_CONTENTIONS = 512;
-// Skip frames which are always same: the unlock function and submit_contention()
+// Skip frames which are always same: the unlock function and submit_contention(),
+// or submit_wait_contention() and submit_contention() for sampled waits.
 const int SKIPPED_STACK_FRAMES = 2;
 
 struct SampledContention : public bvar::Collected {
@@ -509,7 +511,7 @@ inline bool remove_pthread_contention_site(
 }
 
 // Submit the contention along with the callsite('s stacktrace)
-void submit_contention(const bthread_contention_site_t& csite, int64_t now_ns) {
+NOINLINE void submit_contention(const bthread_contention_site_t& csite, int64_t now_ns) {
     tls_inside_lock = true;
     SampledContention* sc = butil::get_object<SampledContention>();
     // Normalize duration_us and count so that they're addable in later
@@ -523,6 +525,55 @@ void submit_contention(const bthread_contention_site_t& csite, int64_t now_ns) {
     tls_inside_lock = false;
 }
 
+size_t contention_sampling_range() {
+    if (!g_cp) {
+        return 0;
+    }
+    return bvar::is_collectable(&g_cp_sl);
+}
+
+// NOINLINE to make the waiting site always the third frame.
+NOINLINE void submit_wait_contention(size_t sampling_range, int64_t start_ns) {
+    const int64_t now_ns = butil::cpuwide_time_ns();
+    const bthread_contention_site_t csite = { now_ns - start_ns, sampling_range };
+    submit_contention(csite, now_ns);
+}
+
+static NOINLINE void capture_contention_stack(SampledContention* sc) {
+    tls_inside_lock = true;
+    sc->nframes = backtrace(sc->stack, arraysize(sc->stack)); // may lock
+    tls_inside_lock = false;
+}
+
+SampledContention* start_async_contention() {
+    const size_t sampling_range = contention_sampling_range();
+    if (!sampling_range) {
+        return NULL;
+    }
+    SampledContention* sc = butil::get_object<SampledContention>();
+    if (sc == NULL) {
+        return NULL;
+    }
+    // duration_ns holds the starting time until end_async_contention().
+    sc->duration_ns = butil::cpuwide_time_ns();
+    sc->count = bvar::COLLECTOR_SAMPLING_BASE / (double)sampling_range;
+    // Frames: capture_contention_stack, start_async_contention, the caller.
+    capture_contention_stack(sc);
+    return sc;
+}
+
+void end_async_contention(SampledContention* sc) {
+    const int64_t now_ns = butil::cpuwide_time_ns();
+    sc->duration_ns = (int64_t)((now_ns - sc->duration_ns) * sc->count);
+    tls_inside_lock = true;
+    sc->submit(now_ns / 1000);  // may lock
+    tls_inside_lock = false;
+}
+
+void cancel_async_contention(SampledContention* sc) {
+    sc->destroy();
+}
+
 BUTIL_FORCE_INLINE int pthread_mutex_lock_impl(pthread_mutex_t* mutex) {
     // Don't change behavior of lock when profiler is off.
     if (!g_cp ||
@@ -0,0 +1,188 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// bthread - A M:N threading library to make applications more concurrent.
+
+#include "butil/build_config.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>                             // strtol
+#include <pthread.h>
+#if defined(OS_LINUX)
+#include <sched.h>                              // cpu_set_t
+#include <unistd.h>                             // syscall
+#include <sys/syscall.h>                        // SYS_mbind
+#endif
+#include "butil/logging.h"
+#include "butil/memory/singleton_on_pthread_once.h"
+#include "bthread/numa.h"
+
+namespace bthread {
+
+BAIDU_THREAD_LOCAL int tls_numa_node = -1;
+
+int parse_cpu_list(const char* str, std::vector<int>* cpus) {
+    cpus->clear();
+    const char* p = str;
+    while (*p != '\0' && *p != '\n') {
+        char* endptr = NULL;
+        const long lo = strtol(p, &endptr, 10);
+        if (endptr == p || lo < 0) {
+            return -1;
+        }
+        long hi = lo;
+        p = endptr;
+        if (*p == '-') {
+            ++p;
+            hi = strtol(p, &endptr, 10);
+            if (endptr == p || hi < lo) {
+                return -1;
+            }
+            p = endptr;
+        }
+        for (long i = lo; i <= hi; ++i) {
+            cpus->push_back((int)i);
+        }
+        if (*p == ',') {
+            ++p;
+        } else if (*p != '\0' && *p != '\n') {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#if defined(OS_LINUX)
+
+// Nodes with cpus, read from /sys once.
+class NumaTopology {
+public:
+    NumaTopology() {
+        std::vector<int> online;
+        if (read_list("/sys/devices/system/node/online", &online) != 0) {
+            return;
+        }
+        for (size_t i = 0; i < online.size(); ++i) {
+            char path[64];
+            snprintf(path, sizeof(path),
+                     "/sys/devices/system/node/node%d/cpulist", online[i]);
+            Node node;
+            node.id = online[i];
+            if (read_list(path, &node.cpus) == 0 && !node.cpus.empty()) {
+                _nodes.push_back(node);
+            }
+        }
+    }
+
+    int node_count() const { return _nodes.empty() ? 1 : (int)_nodes.size(); }
+
+    int bind_thread(int index) const {
+        if (index < 0 || (size_t)index >= _nodes.size()) {
+            errno = EINVAL;
+            return -1;
+        }
+        cpu_set_t cs;
+        CPU_ZERO(&cs);
+        const std::vector<int>& cpus = _nodes[index].cpus;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            if (cpus[i] < CPU_SETSIZE) {
+                CPU_SET(cpus[i], &cs);
+            }
+        }
+        const int rc = pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs);
+        if (rc != 0) {
+            errno = rc;
+            return -1;
+        }
+        return 0;
+    }
+
+    int prefer_node(void* addr, size_t len, int index) const {
+        if (index < 0 || (size_t)index >= _nodes.size()) {
+            errno = EINVAL;
+            return -1;
+        }
+        const int id = _nodes[index].id;
+        // Enough for 512 nodes.
+        unsigned long mask[8] = { 0 };
+        const int nbits = sizeof(mask) * 8;
+        if (id >= nbits) {
+            errno = EINVAL;
+            return -1;
+        }
+        mask[id / (sizeof(unsigned long) * 8)] |=
+            (1UL << (id % (sizeof(unsigned long) * 8)));
+        const int MPOL_PREFERRED = 1;
+        return syscall(SYS_mbind, addr, len, MPOL_PREFERRED,
+                       mask, nbits + 1, 0) == 0 ? 0 : -1;
+    }
+
+private:
+    struct Node {
+        int id;
+        std::vector<int> cpus;
+    };
+
+    static int read_list(const char* path, std::vector<int>* list) {
+        FILE* fp = fopen(path, "r");
+        if (fp == NULL) {
+            return -1;
+        }
+        char buf[4096];
+        const bool ok = (fgets(buf, sizeof(buf), fp) != NULL);
+        fclose(fp);
+        if (!ok) {
+            return -1;
+        }
+        return parse_cpu_list(buf, list);
+    }
+
+    std::vector<Node> _nodes;
+};
+
+int numa_node_count() {
+    return butil::get_leaky_singleton<NumaTopology>()->node_count();
+}
+
+int bind_thread_to_numa_node(int node) {
+    return butil::get_leaky_singleton<NumaTopology>()->bind_thread(node);
+}
+
+int prefer_numa_node_for_memory(void* addr, size_t len, int node) {
+    return butil::get_leaky_singleton<NumaTopology>()->prefer_node(
+        addr, len, node);
+}
+
+#else
+
+int numa_node_count() {
+    return 1;
+}
+
+int bind_thread_to_numa_node(int) {
+    errno = ENOTSUP;
+    return -1;
+}
+
+int prefer_numa_node_for_memory(void*, size_t, int) {
+    errno = ENOTSUP;
+    return -1;
+}
+
+#endif  // OS_LINUX
+
+}  // namespace bthread
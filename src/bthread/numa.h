@@ -0,0 +1,56 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// bthread - A M:N threading library to make applications more concurrent.
+
+#ifndef BTHREAD_NUMA_H
+#define BTHREAD_NUMA_H
+
+#include <stddef.h>                             // size_t
+#include <vector>
+#include "butil/thread_local.h"                 // BAIDU_THREAD_LOCAL
+
+namespace bthread {
+
+// NUMA nodes are numbered from 0 to numa_node_count()-1 in this file, which
+// are not necessarily the ids used by the kernel (some nodes may have no
+// cpus).
+
+// Number of NUMA nodes with cpus. Returns 1 when the topology is unknown
+// (non-linux, or /sys is not mounted).
+int numa_node_count();
+
+// Restrict the calling pthread to cpus of `node'.
+// Returns 0 on success, -1 otherwise.
+int bind_thread_to_numa_node(int node);
+
+// Ask the kernel to allocate pages of [addr, addr + len) on `node' when
+// possible. `addr' must be page-aligned.
+// Returns 0 on success, -1 otherwise.
+int prefer_numa_node_for_memory(void* addr, size_t len, int node);
+
+// Parse lists like "0-23,48-71" in /sys/devices/system/node/node*/cpulist
+// into `cpus'. Returns 0 on success, -1 otherwise.
+int parse_cpu_list(const char* str, std::vector<int>* cpus);
+
+// NUMA node of the worker pthread running the caller, -1 if the caller is
+// not a worker or NUMA-aware scheduling is off.
+extern BAIDU_THREAD_LOCAL int tls_numa_node;
+
+}  // namespace bthread
+
+#endif  // BTHREAD_NUMA_H
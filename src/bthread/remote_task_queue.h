@@ -22,60 +22,61 @@
 #ifndef BTHREAD_REMOTE_TASK_QUEUE_H
 #define BTHREAD_REMOTE_TASK_QUEUE_H
 
-#include "butil/containers/bounded_queue.h"
+#include "butil/atomicops.h"
 #include "butil/macros.h"
+#include "bthread/task_meta.h"
 
 namespace bthread {
 
 class TaskGroup;
 
-// A queue for storing bthreads created by non-workers. Since non-workers
-// randomly choose a TaskGroup to push which distributes the contentions,
-// this queue is simply implemented as a queue protected with a lock.
-// The function names should be self-explanatory.
+// A queue for storing bthreads created by non-workers. Pushing is lock-free:
+// metas of the tasks are linked intrusively into a stack with CAS. Consumers
+// (the owner and workers stealing from it) grab all tasks at once with an
+// atomic exchange and are supposed to run them in batch, so neither side
+// contends on a lock even if many pthreads are creating bthreads. Grabbing
+// the whole stack instead of popping one node does not suffer from ABA.
 class RemoteTaskQueue {
 public:
-    RemoteTaskQueue() {}
+    RemoteTaskQueue() : _head(NULL) {}
 
-    int init(size_t cap) {
-        const size_t memsize = sizeof(bthread_t) * cap;
-        void* q_mem = malloc(memsize);
-        if (q_mem == NULL) {
-            return -1;
-        }
-        butil::BoundedQueue<bthread_t> q(q_mem, memsize, butil::OWNS_STORAGE);
-        _tasks.swap(q);
-        return 0;
-    }
-
-    bool pop(bthread_t* task) {
-        if (_tasks.empty()) {
-            return false;
-        }
-        _mutex.lock();
-        const bool result = _tasks.pop(task);
-        _mutex.unlock();
-        return result;
+    bool empty() const {
+        return _head.load(butil::memory_order_relaxed) == NULL;
     }
 
-    bool push(bthread_t task) {
-        _mutex.lock();
-        const bool res = push_locked(task);
-        _mutex.unlock();
-        return res;
+    // `m' must not be in any queue.
+    void push(TaskMeta* m) {
+        TaskMeta* head = _head.load(butil::memory_order_relaxed);
+        do {
+            m->remote_next = head;
+        } while (!_head.compare_exchange_weak(
+                     head, m, butil::memory_order_release,
+                     butil::memory_order_relaxed));
     }
 
-    bool push_locked(bthread_t task) {
-        return _tasks.push(task);
+    // Remove all tasks from the queue and return them linked by
+    // TaskMeta.remote_next in pushing order, NULL if the queue is empty.
+    // remote_next of a returned task must be read before the task is
+    // scheduled, because it may be pushed into a RemoteTaskQueue again.
+    TaskMeta* pop_all() {
+        if (empty()) {
+            return NULL;
+        }
+        TaskMeta* m = _head.exchange(NULL, butil::memory_order_acquire);
+        // Reverse the stack to be FIFO.
+        TaskMeta* prev = NULL;
+        while (m) {
+            TaskMeta* next = m->remote_next;
+            m->remote_next = prev;
+            prev = m;
+            m = next;
+        }
+        return prev;
     }
 
-    size_t capacity() const { return _tasks.capacity(); }
-    
 private:
-friend class TaskGroup;
     DISALLOW_COPY_AND_ASSIGN(RemoteTaskQueue);
-    butil::BoundedQueue<bthread_t> _tasks;
-    butil::Mutex _mutex;
+    butil::atomic<TaskMeta*> _head;
 };
 
 }  // namespace bthread
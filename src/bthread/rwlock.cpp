@@ -0,0 +1,257 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// bthread - A M:N threading library to make applications more concurrent.
+
+#include <errno.h>
+#include <stdlib.h>                               // posix_memalign
+#include <pthread.h>                              // PTHREAD_RWLOCK_*
+#include "butil/atomicops.h"
+#include "butil/macros.h"                         // BAIDU_CACHELINE_ALIGNMENT
+#include "butil/thread_local.h"                   // BAIDU_THREAD_LOCAL
+#include "bthread/butex.h"                        // butex_*
+#include "bthread/rwlock.h"
+
+namespace bthread {
+
+// Readers are counted in slots on separate cachelines so that entering the
+// read side does not bounce a shared cacheline between cpus. Each pthread
+// (namely each worker) sticks to one slot, a bthread may leave the read side
+// in a slot different from the one it entered since only the sum matters.
+//
+// Writers are serialized by writer_mutex. A writer sets *writer_butex to 1
+// which stops new readers (writer-preferring), then waits on reader_butex
+// until the sum of slots drops to 0. The reader increments its slot and
+// checks *writer_butex, the writer does the reverse, both with seq_cst
+// ordering, so at least one of them sees the other.
+static const int RWLOCK_READER_SLOTS = 16;
+
+struct BAIDU_CACHELINE_ALIGNMENT ReaderSlot {
+    butil::atomic<int> nreader;
+};
+
+static butil::static_atomic<int> g_nreader_thread = BUTIL_STATIC_ATOMIC_INIT(0);
+static BAIDU_THREAD_LOCAL int tls_reader_slot = -1;
+
+inline butil::atomic<int>* get_reader_slot(bthread_rwlock_t* rw) {
+    int s = tls_reader_slot;
+    if (s < 0) {
+        s = g_nreader_thread.fetch_add(1, butil::memory_order_relaxed)
+            % RWLOCK_READER_SLOTS;
+        tls_reader_slot = s;
+    }
+    return &static_cast<ReaderSlot*>(rw->reader_slots)[s].nreader;
+}
+
+inline butil::atomic<unsigned>* writer_butex(bthread_rwlock_t* rw) {
+    return (butil::atomic<unsigned>*)rw->writer_butex;
+}
+
+inline butil::atomic<unsigned>* reader_butex(bthread_rwlock_t* rw) {
+    return (butil::atomic<unsigned>*)rw->reader_butex;
+}
+
+static int count_readers(bthread_rwlock_t* rw) {
+    const ReaderSlot* slots = static_cast<ReaderSlot*>(rw->reader_slots);
+    int n = 0;
+    for (int i = 0; i < RWLOCK_READER_SLOTS; ++i) {
+        n += slots[i].nreader.load();
+    }
+    return n;
+}
+
+static void leave_read_side(bthread_rwlock_t* rw) {
+    // Save butexes, *rw may be destroyed by the writer seeing the decrement.
+    // Butexes are never returned to the system, touching them is safe.
+    butil::atomic<unsigned>* const wb = writer_butex(rw);
+    butil::atomic<unsigned>* const rb = reader_butex(rw);
+    get_reader_slot(rw)->fetch_sub(1);
+    // DON'T touch *rw ever after
+    if (wb->load()) {
+        rb->fetch_add(1, butil::memory_order_release);
+        butex_wake(rb);
+    }
+}
+
+static int rwlock_rdlock(bthread_rwlock_t* rw, bool try_only,
+                         const struct timespec* abstime) {
+    butil::atomic<unsigned>* const wb = writer_butex(rw);
+    while (true) {
+        get_reader_slot(rw)->fetch_add(1);
+        if (!wb->load()) {
+            return 0;
+        }
+        // A writer holds or is waiting for the lock, give way.
+        leave_read_side(rw);
+        if (try_only) {
+            return EBUSY;
+        }
+        if (butex_wait(wb, 1, abstime) < 0 &&
+            errno != EWOULDBLOCK && errno != EINTR) {
+            return errno;
+        }
+    }
+}
+
+static int rwlock_wrlock(bthread_rwlock_t* rw, bool try_only,
+                         const struct timespec* abstime) {
+    int rc = 0;
+    if (try_only) {
+        rc = bthread_mutex_trylock(&rw->writer_mutex);
+    } else if (abstime) {
+        rc = bthread_mutex_timedlock(&rw->writer_mutex, abstime);
+    } else {
+        rc = bthread_mutex_lock(&rw->writer_mutex);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+    butil::atomic<unsigned>* const wb = writer_butex(rw);
+    butil::atomic<unsigned>* const rb = reader_butex(rw);
+    wb->store(1);
+    while (true) {
+        const unsigned expected = rb->load(butil::memory_order_acquire);
+        if (count_readers(rw) == 0) {
+            rw->write_locked = 1;
+            return 0;
+        }
+        if (try_only) {
+            rc = EBUSY;
+            break;
+        }
+        if (butex_wait(rb, expected, abstime) < 0 &&
+            errno != EWOULDBLOCK && errno != EINTR) {
+            rc = errno;
+            break;
+        }
+    }
+    // Failed, let blocked readers in.
+    wb->store(0, butil::memory_order_release);
+    butex_wake_all(wb);
+    bthread_mutex_unlock(&rw->writer_mutex);
+    return rc;
+}
+
+static int rwlock_unlock(bthread_rwlock_t* rw) {
+    // Readers can't hold the lock when write_locked is set.
+    if (!rw->write_locked) {
+        leave_read_side(rw);
+        return 0;
+    }
+    rw->write_locked = 0;
+    butil::atomic<unsigned>* const wb = writer_butex(rw);
+    wb->store(0, butil::memory_order_release);
+    butex_wake_all(wb);
+    bthread_mutex_unlock(&rw->writer_mutex);
+    return 0;
+}
+
+} // namespace bthread
+
+extern "C" {
+
+int bthread_rwlock_init(bthread_rwlock_t* __restrict rw,
+                        const bthread_rwlockattr_t* __restrict) {
+    void* slots = NULL;
+    const size_t memsize = sizeof(bthread::ReaderSlot) *
+        bthread::RWLOCK_READER_SLOTS;
+    if (posix_memalign(&slots, BAIDU_CACHELINE_SIZE, memsize) != 0) {
+        return ENOMEM;
+    }
+    for (int i = 0; i < bthread::RWLOCK_READER_SLOTS; ++i) {
+        new (&static_cast<bthread::ReaderSlot*>(slots)[i].nreader)
+            butil::atomic<int>(0);
+    }
+    rw->writer_butex = bthread::butex_create_checked<unsigned>();
+    rw->reader_butex = bthread::butex_create_checked<unsigned>();
+    const int rc = bthread_mutex_init(&rw->writer_mutex, NULL);
+    if (!rw->writer_butex || !rw->reader_butex || rc != 0) {
+        bthread::butex_destroy(rw->writer_butex);
+        bthread::butex_destroy(rw->reader_butex);
+        if (rc == 0) {
+            bthread_mutex_destroy(&rw->writer_mutex);
+        }
+        free(slots);
+        return ENOMEM;
+    }
+    *rw->writer_butex = 0;
+    *rw->reader_butex = 0;
+    rw->reader_slots = slots;
+    rw->write_locked = 0;
+    return 0;
+}
+
+int bthread_rwlock_destroy(bthread_rwlock_t* rw) {
+    bthread::butex_destroy(rw->writer_butex);
+    bthread::butex_destroy(rw->reader_butex);
+    bthread_mutex_destroy(&rw->writer_mutex);
+    free(rw->reader_slots);
+    rw->reader_slots = NULL;
+    return 0;
+}
+
+int bthread_rwlock_rdlock(bthread_rwlock_t* rw) {
+    return bthread::rwlock_rdlock(rw, false, NULL);
+}
+
+int bthread_rwlock_tryrdlock(bthread_rwlock_t* rw) {
+    return bthread::rwlock_rdlock(rw, true, NULL);
+}
+
+int bthread_rwlock_timedrdlock(bthread_rwlock_t* __restrict rw,
+                               const struct timespec* __restrict abstime) {
+    return bthread::rwlock_rdlock(rw, false, abstime);
+}
+
+int bthread_rwlock_wrlock(bthread_rwlock_t* rw) {
+    return bthread::rwlock_wrlock(rw, false, NULL);
+}
+
+int bthread_rwlock_trywrlock(bthread_rwlock_t* rw) {
+    return bthread::rwlock_wrlock(rw, true, NULL);
+}
+
+int bthread_rwlock_timedwrlock(bthread_rwlock_t* __restrict rw,
+                               const struct timespec* __restrict abstime) {
+    return bthread::rwlock_wrlock(rw, false, abstime);
+}
+
+int bthread_rwlock_unlock(bthread_rwlock_t* rw) {
+    return bthread::rwlock_unlock(rw);
+}
+
+// The lock always prefers writers, kind is saved but not used.
+int bthread_rwlockattr_init(bthread_rwlockattr_t* attr) {
+    attr->kind = PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP;
+    return 0;
+}
+
+int bthread_rwlockattr_destroy(bthread_rwlockattr_t*) {
+    return 0;
+}
+
+int bthread_rwlockattr_getkind_np(const bthread_rwlockattr_t* attr, int* pref) {
+    *pref = attr->kind;
+    return 0;
+}
+
+int bthread_rwlockattr_setkind_np(bthread_rwlockattr_t* attr, int pref) {
+    attr->kind = pref;
+    return 0;
+}
+
+}  // extern "C"
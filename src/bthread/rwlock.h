@@ -0,0 +1,79 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// bthread - A M:N threading library to make applications more concurrent.
+
+#ifndef  BTHREAD_RWLOCK_H
+#define  BTHREAD_RWLOCK_H
+
+#include "bthread/types.h"
+#include "bthread/mutex.h"
+
+__BEGIN_DECLS
+extern int bthread_rwlock_init(bthread_rwlock_t* __restrict rwlock,
+                               const bthread_rwlockattr_t* __restrict attr);
+extern int bthread_rwlock_destroy(bthread_rwlock_t* rwlock);
+extern int bthread_rwlock_rdlock(bthread_rwlock_t* rwlock);
+extern int bthread_rwlock_tryrdlock(bthread_rwlock_t* rwlock);
+extern int bthread_rwlock_timedrdlock(bthread_rwlock_t* __restrict rwlock,
+                                      const struct timespec* __restrict abstime);
+extern int bthread_rwlock_wrlock(bthread_rwlock_t* rwlock);
+extern int bthread_rwlock_trywrlock(bthread_rwlock_t* rwlock);
+extern int bthread_rwlock_timedwrlock(bthread_rwlock_t* __restrict rwlock,
+                                      const struct timespec* __restrict abstime);
+extern int bthread_rwlock_unlock(bthread_rwlock_t* rwlock);
+__END_DECLS
+
+namespace bthread {
+
+// The C++ Wrapper of bthread_rwlock, usable with std::lock_guard and
+// std::shared_lock(C++14).
+class RWLock {
+public:
+    typedef bthread_rwlock_t* native_handler_type;
+    RWLock() {
+        int ec = bthread_rwlock_init(&_rwlock, NULL);
+        if (ec != 0) {
+            throw std::system_error(std::error_code(ec, std::system_category()), "RWLock constructor failed");
+        }
+    }
+    ~RWLock() { CHECK_EQ(0, bthread_rwlock_destroy(&_rwlock)); }
+    native_handler_type native_handler() { return &_rwlock; }
+    void lock() {
+        int ec = bthread_rwlock_wrlock(&_rwlock);
+        if (ec != 0) {
+            throw std::system_error(std::error_code(ec, std::system_category()), "RWLock lock failed");
+        }
+    }
+    bool try_lock() { return !bthread_rwlock_trywrlock(&_rwlock); }
+    void unlock() { bthread_rwlock_unlock(&_rwlock); }
+    void lock_shared() {
+        int ec = bthread_rwlock_rdlock(&_rwlock);
+        if (ec != 0) {
+            throw std::system_error(std::error_code(ec, std::system_category()), "RWLock lock_shared failed");
+        }
+    }
+    bool try_lock_shared() { return !bthread_rwlock_tryrdlock(&_rwlock); }
+    void unlock_shared() { bthread_rwlock_unlock(&_rwlock); }
+private:
+    DISALLOW_COPY_AND_ASSIGN(RWLock);
+    bthread_rwlock_t _rwlock;
+};
+
+}  // namespace bthread
+
+#endif  // BTHREAD_RWLOCK_H
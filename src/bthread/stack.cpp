@@ -19,17 +19,26 @@
 
 // Date: Sun Sep  7 22:37:39 CST 2014
 
+#include "butil/build_config.h"                   // OS_LINUX
 #include <unistd.h>                               // getpagesize
 #include <sys/mman.h>                             // mmap, munmap, mprotect
-#include <algorithm>                              // std::max
+#include <algorithm>                              // std::max, std::sort
 #include <stdlib.h>                               // posix_memalign
+#include <iomanip>                                // std::setw
+#include <map>
 #include "butil/macros.h"                          // BAIDU_CASSERT
+#include "butil/fast_rand.h"
+#include "butil/scoped_lock.h"
+#include "butil/synchronization/lock.h"
 #include "butil/memory/singleton_on_pthread_once.h"
 #include "butil/third_party/dynamic_annotations/dynamic_annotations.h" // RunningOnValgrind
 #include "butil/third_party/valgrind/valgrind.h"   // VALGRIND_STACK_REGISTER
 #include "bvar/passive_status.h"
 #include "bthread/types.h"                        // BTHREAD_STACKTYPE_*
 #include "bthread/stack.h"
+#if defined(USE_SYMBOLIZE)
+#include "butil/third_party/symbolize/symbolize.h"  // google::Symbolize
+#endif
 
 DEFINE_int32(stack_size_small, 32768, "size of small stacks");
 DEFINE_int32(stack_size_normal, 1048576, "size of normal stacks");
@@ -37,6 +46,12 @@ DEFINE_int32(stack_size_large, 8388608, "size of large stacks");
 DEFINE_int32(guard_page_size, 4096, "size of guard page, allocate stacks by malloc if it's 0(not recommended)");
 DEFINE_int32(tc_stack_small, 32, "maximum small stacks cached by each thread");
 DEFINE_int32(tc_stack_normal, 8, "maximum normal stacks cached by each thread");
+DEFINE_bool(bthread_stack_shrink, false, "Release physical pages of stacks "
+            "by madvise(MADV_DONTNEED) when they're returned to the pool, "
+            "which costs a syscall per bthread");
+DEFINE_int32(bthread_stack_usage_sample_interval, 0, "Measure peak stack "
+             "usage of one in so many bthreads, grouped by entry functions "
+             "in /bthreads/stack_usage. 0 means disabled");
 
 namespace bthread {
 
@@ -44,6 +59,7 @@ BAIDU_CASSERT(BTHREAD_STACKTYPE_PTHREAD == STACK_TYPE_PTHREAD, must_match);
 BAIDU_CASSERT(BTHREAD_STACKTYPE_SMALL == STACK_TYPE_SMALL, must_match);
 BAIDU_CASSERT(BTHREAD_STACKTYPE_NORMAL == STACK_TYPE_NORMAL, must_match);
 BAIDU_CASSERT(BTHREAD_STACKTYPE_LARGE == STACK_TYPE_LARGE, must_match);
+BAIDU_CASSERT(BTHREAD_STACKTYPE_NONE == STACK_TYPE_NONE, must_match);
 BAIDU_CASSERT(STACK_TYPE_MAIN == 0, must_be_0);
 
 static butil::static_atomic<int64_t> s_stack_count = BUTIL_STATIC_ATOMIC_INIT(0);
@@ -146,6 +162,169 @@ void deallocate_stack_storage(StackStorage* s) {
     }
 }
 
+void shrink_stack(ContextualStack* s) {
+    if (s->storage.guardsize <= 0 || s->context == NULL) {
+        // Not allocated by mmap.
+        return;
+    }
+    const static uintptr_t PAGESIZE = getpagesize();
+    char* const lo = (char*)s->storage.bottom - s->storage.stacksize;
+    // Registers saved by last jump are above `context' which is resumed
+    // when the stack is used again.
+    char* const hi = (char*)((uintptr_t)s->context & ~(PAGESIZE - 1));
+    if (hi > lo && hi <= (char*)s->storage.bottom) {
+        madvise(lo, hi - lo, MADV_DONTNEED);
+    }
+}
+
+int64_t get_stack_usage(const ContextualStack* s) {
+#if defined(OS_LINUX)
+    if (s == NULL || s->storage.guardsize <= 0) {
+        return -1;
+    }
+    const static size_t PAGESIZE = getpagesize();
+    char* const lo = (char*)s->storage.bottom - s->storage.stacksize;
+    const size_t npage = s->storage.stacksize / PAGESIZE;
+    // Not large to be called on small stacks.
+    unsigned char vec[128];
+    for (size_t i = 0; i < npage; i += sizeof(vec)) {
+        const size_t n = std::min(sizeof(vec), npage - i);
+        if (mincore(lo + i * PAGESIZE, n * PAGESIZE, vec) != 0) {
+            return -1;
+        }
+        for (size_t j = 0; j < n; ++j) {
+            if (vec[j] & 1) {
+                return (char*)s->storage.bottom - (lo + (i + j) * PAGESIZE);
+            }
+        }
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+bool should_sample_stack_usage(StackType type, const ContextualStack* s) {
+    const int interval = FLAGS_bthread_stack_usage_sample_interval;
+    if (interval <= 0 || s == NULL || s->stacktype != type ||
+        s->storage.guardsize <= 0) {
+        return false;
+    }
+    return interval == 1 || butil::fast_rand_less_than(interval) == 0;
+}
+
+void begin_stack_usage_sampling(ContextualStack* s) {
+    const static uintptr_t PAGESIZE = getpagesize();
+    char* const lo = (char*)s->storage.bottom - s->storage.stacksize;
+    // Pages below the frame of this function are not used by anyone.
+    char dummy;
+    char* const hi = (char*)(((uintptr_t)&dummy & ~(PAGESIZE - 1)) - PAGESIZE);
+    if (hi > lo) {
+        madvise(lo, hi - lo, MADV_DONTNEED);
+    }
+}
+
+namespace {
+struct StackUsageKey {
+    void* (*fn)(void*);
+    StackType stacktype;
+    bool operator<(const StackUsageKey& rhs) const {
+        return fn != rhs.fn ? fn < rhs.fn : stacktype < rhs.stacktype;
+    }
+};
+
+struct StackUsageMap {
+    butil::Mutex mutex;
+    std::map<StackUsageKey, StackUsage> usages;
+};
+}  // namespace
+
+void end_stack_usage_sampling(const ContextualStack* s, void* (*fn)(void*)) {
+    const int64_t bytes = get_stack_usage(s);
+    if (bytes < 0) {
+        return;
+    }
+    StackUsageMap* m = butil::get_leaky_singleton<StackUsageMap>();
+    const StackUsageKey key = { fn, s->stacktype };
+    BAIDU_SCOPED_LOCK(m->mutex);
+    StackUsage& u = m->usages[key];
+    if (u.count == 0) {
+        u.fn = fn;
+        u.stacktype = s->stacktype;
+        u.total_bytes = 0;
+        u.max_bytes = 0;
+    }
+    ++u.count;
+    u.total_bytes += bytes;
+    u.max_bytes = std::max(u.max_bytes, bytes);
+}
+
+void get_stack_usages(std::vector<StackUsage>* usages) {
+    usages->clear();
+    StackUsageMap* m = butil::get_leaky_singleton<StackUsageMap>();
+    BAIDU_SCOPED_LOCK(m->mutex);
+    for (std::map<StackUsageKey, StackUsage>::const_iterator
+             it = m->usages.begin(); it != m->usages.end(); ++it) {
+        usages->push_back(it->second);
+    }
+}
+
+static const char* stack_type_name(int type) {
+    switch (type) {
+    case STACK_TYPE_SMALL:
+        return "small";
+    case STACK_TYPE_NORMAL:
+        return "normal";
+    case STACK_TYPE_LARGE:
+        return "large";
+    }
+    return "unknown";
+}
+
+// Smallest stack type with twice the peak usage, since the peak is sampled.
+static const char* suggest_stack_type(int64_t max_bytes) {
+    if (max_bytes * 2 <= FLAGS_stack_size_small) {
+        return "small";
+    } else if (max_bytes * 2 <= FLAGS_stack_size_normal) {
+        return "normal";
+    }
+    return "large";
+}
+
+static bool greater_max_bytes(const StackUsage& a, const StackUsage& b) {
+    return a.max_bytes > b.max_bytes;
+}
+
+void print_stack_usages(std::ostream& os) {
+    if (FLAGS_bthread_stack_usage_sample_interval <= 0) {
+        os << "Set -bthread_stack_usage_sample_interval to a positive number"
+            " to sample stack usages\n";
+    }
+    std::vector<StackUsage> usages;
+    get_stack_usages(&usages);
+    std::sort(usages.begin(), usages.end(), greater_max_bytes);
+    os << std::left << std::setw(10) << "count" << std::setw(12) << "avg_bytes"
+       << std::setw(12) << "max_bytes" << std::setw(8) << "stack"
+       << std::setw(11) << "suggested" << "function\n";
+    for (size_t i = 0; i < usages.size(); ++i) {
+        const StackUsage& u = usages[i];
+        os << std::setw(10) << u.count << std::setw(12)
+           << u.total_bytes / u.count << std::setw(12) << u.max_bytes
+           << std::setw(8) << stack_type_name(u.stacktype)
+           << std::setw(11) << suggest_stack_type(u.max_bytes);
+        char buf[256];
+#if defined(USE_SYMBOLIZE)
+        if (google::Symbolize((void*)u.fn, buf, sizeof(buf))) {
+            os << buf << '\n';
+            continue;
+        }
+#endif
+        snprintf(buf, sizeof(buf), "%p", (void*)u.fn);
+        os << buf << '\n';
+    }
+    os << std::right;
+}
+
 int* SmallStackClass::stack_size_flag = &FLAGS_stack_size_small;
 int* NormalStackClass::stack_size_flag = &FLAGS_stack_size_normal;
 int* LargeStackClass::stack_size_flag = &FLAGS_stack_size_large;
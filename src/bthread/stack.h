@@ -23,9 +23,12 @@
 #define BTHREAD_ALLOCATE_STACK_H
 
 #include <assert.h>
+#include <ostream>
+#include <vector>
 #include <gflags/gflags.h>          // DECLARE_int32
 #include "bthread/types.h"
 #include "bthread/context.h"        // bthread_fcontext_t
+#include "bthread/numa.h"           // tls_numa_node
 #include "butil/object_pool.h"
 
 namespace bthread {
@@ -58,17 +61,25 @@ enum StackType {
     STACK_TYPE_PTHREAD = BTHREAD_STACKTYPE_PTHREAD,
     STACK_TYPE_SMALL = BTHREAD_STACKTYPE_SMALL,
     STACK_TYPE_NORMAL = BTHREAD_STACKTYPE_NORMAL,
-    STACK_TYPE_LARGE = BTHREAD_STACKTYPE_LARGE
+    STACK_TYPE_LARGE = BTHREAD_STACKTYPE_LARGE,
+    // Borrows the stack of other tasks, no ContextualStack has this type.
+    STACK_TYPE_NONE = BTHREAD_STACKTYPE_NONE
 };
 
 struct ContextualStack {
     bthread_fcontext_t context;
     StackType stacktype;
+    // Stacks are pooled separately for first MAX_NUMA_STACK_POOLS NUMA nodes
+    // when -bthread_numa_aware is on, -1 otherwise.
+    int numa_node;
     StackStorage storage;
 };
 
+static const int MAX_NUMA_STACK_POOLS = 4;
+
 // Get a stack in the `type' and run `entry' at the first time that the
-// stack is jumped.
+// stack is jumped. The stack comes from the pool of NUMA node of the calling
+// worker(if NUMA-aware scheduling is on).
 ContextualStack* get_stack(StackType type, void (*entry)(intptr_t));
 // Recycle a stack. NULL does nothing.
 void return_stack(ContextualStack*);
@@ -76,6 +87,39 @@ void return_stack(ContextualStack*);
 // (to save contexts before jumping)
 void jump_stack(ContextualStack* from, ContextualStack* to);
 
+// Release physical pages of `s' below its saved context, so that a cached
+// stack only occupies pages touched after being got again. Called when the
+// stack is returned and -bthread_stack_shrink is on.
+void shrink_stack(ContextualStack* s);
+
+// Bytes from the bottom of `s' to the lowest resident page, which is the
+// peak usage of the stack since last shrink. Returns -1 if `s' is not
+// allocated by mmap or the usage can't be known.
+int64_t get_stack_usage(const ContextualStack* s);
+
+// Returns true if peak stack usage of the task about to run on `s' should be
+// sampled according to -bthread_stack_usage_sample_interval. `type' is the
+// type requested by the task, which differs from s->stacktype if the stack
+// is borrowed.
+bool should_sample_stack_usage(StackType type, const ContextualStack* s);
+// Drop pages of `s' below the caller so that get_stack_usage() afterwards
+// only counts pages touched by the sampled task.
+void begin_stack_usage_sampling(ContextualStack* s);
+// Record peak usage of `s' for tasks started with `fn'.
+void end_stack_usage_sampling(const ContextualStack* s, void* (*fn)(void*));
+
+struct StackUsage {
+    void* (*fn)(void*);
+    StackType stacktype;
+    int64_t count;
+    int64_t total_bytes;
+    int64_t max_bytes;
+};
+// Get sampled stack usages grouped by entry function and stack type.
+void get_stack_usages(std::vector<StackUsage>* usages);
+// Print sampled stack usages and stack types suggested by them.
+void print_stack_usages(std::ostream& os);
+
 }  // namespace bthread
 
 #include "bthread/stack_inl.h"
@@ -25,6 +25,7 @@
 DECLARE_int32(guard_page_size);
 DECLARE_int32(tc_stack_small);
 DECLARE_int32(tc_stack_normal);
+DECLARE_bool(bthread_stack_shrink);
 
 namespace bthread {
 
@@ -46,33 +47,81 @@ struct LargeStackClass {
     static const int stacktype = (int)STACK_TYPE_LARGE;
 };
 
-template <typename StackClass> struct StackFactory {
-    struct Wrapper : public ContextualStack {
-        explicit Wrapper(void (*entry)(intptr_t)) {
-            if (allocate_stack_storage(&storage, *StackClass::stack_size_flag,
-                                       FLAGS_guard_page_size) != 0) {
-                storage.zeroize();
-                context = NULL;
-                return;
-            }
-            context = bthread_make_fcontext(storage.bottom, storage.stacksize, entry);
-            stacktype = (StackType)StackClass::stacktype;
+// Stacks of NUMA_NODE >= 0 are preferred to be allocated on the node and
+// pooled separately, so that a worker does not reuse stacks in memory of
+// other nodes.
+template <typename StackClass, int NUMA_NODE>
+struct StackWrapper : public ContextualStack {
+    explicit StackWrapper(void (*entry)(intptr_t)) {
+        if (allocate_stack_storage(&storage, *StackClass::stack_size_flag,
+                                   FLAGS_guard_page_size) != 0) {
+            storage.zeroize();
+            context = NULL;
+            return;
         }
-        ~Wrapper() {
-            if (context) {
-                context = NULL;
-                deallocate_stack_storage(&storage);
-                storage.zeroize();
-            }
+        if (NUMA_NODE >= 0 && storage.guardsize > 0) {
+            // Pages are not touched yet.
+            prefer_numa_node_for_memory(
+                (char*)storage.bottom - storage.stacksize,
+                storage.stacksize, NUMA_NODE);
         }
-    };
-    
+        context = bthread_make_fcontext(storage.bottom, storage.stacksize, entry);
+        stacktype = (StackType)StackClass::stacktype;
+        numa_node = NUMA_NODE;
+    }
+    ~StackWrapper() {
+        if (context) {
+            context = NULL;
+            deallocate_stack_storage(&storage);
+            storage.zeroize();
+        }
+    }
+};
+
+template <typename StackClass> struct StackFactory {
+    template <int NUMA_NODE>
+    static ContextualStack* get_stack_on_node(void (*entry)(intptr_t)) {
+        return butil::get_object<StackWrapper<StackClass, NUMA_NODE> >(entry);
+    }
+
     static ContextualStack* get_stack(void (*entry)(intptr_t)) {
-        return butil::get_object<Wrapper>(entry);
+        switch (tls_numa_node) {
+        case 0:
+            return get_stack_on_node<0>(entry);
+        case 1:
+            return get_stack_on_node<1>(entry);
+        case 2:
+            return get_stack_on_node<2>(entry);
+        case 3:
+            return get_stack_on_node<3>(entry);
+        default:
+            return get_stack_on_node<-1>(entry);
+        }
     }
-    
+
+    template <int NUMA_NODE>
+    static void return_stack_to_node(ContextualStack* sc) {
+        butil::return_object(
+            static_cast<StackWrapper<StackClass, NUMA_NODE>*>(sc));
+    }
+
     static void return_stack(ContextualStack* sc) {
-        butil::return_object(static_cast<Wrapper*>(sc));
+        if (FLAGS_bthread_stack_shrink) {
+            shrink_stack(sc);
+        }
+        // Return to the pool where the stack was got.
+        switch (sc->numa_node) {
+        case 0:
+            return return_stack_to_node<0>(sc);
+        case 1:
+            return return_stack_to_node<1>(sc);
+        case 2:
+            return return_stack_to_node<2>(sc);
+        case 3:
+            return return_stack_to_node<3>(sc);
+        default:
+            return return_stack_to_node<-1>(sc);
+        }
     }
 };
 
@@ -84,6 +133,7 @@ template <> struct StackFactory<MainStackClass> {
         }
         s->context = NULL;
         s->stacktype = STACK_TYPE_MAIN;
+        s->numa_node = -1;
         s->storage.zeroize();
         return s;
     }
@@ -96,6 +146,7 @@ template <> struct StackFactory<MainStackClass> {
 inline ContextualStack* get_stack(StackType type, void (*entry)(intptr_t)) {
     switch (type) {
     case STACK_TYPE_PTHREAD:
+    case STACK_TYPE_NONE:
         return NULL;
     case STACK_TYPE_SMALL:
         return StackFactory<SmallStackClass>::get_stack(entry);
@@ -115,6 +166,7 @@ inline void return_stack(ContextualStack* s) {
     }
     switch (s->stacktype) {
     case STACK_TYPE_PTHREAD:
+    case STACK_TYPE_NONE:
         assert(false);
         return;
     case STACK_TYPE_SMALL:
@@ -136,59 +188,34 @@ inline void jump_stack(ContextualStack* from, ContextualStack* to) {
 
 namespace butil {
 
-template <> struct ObjectPoolBlockMaxItem<
-    bthread::StackFactory<bthread::LargeStackClass>::Wrapper> {
-    static const size_t value = 64;
-};
-template <> struct ObjectPoolBlockMaxItem<
-    bthread::StackFactory<bthread::NormalStackClass>::Wrapper> {
-    static const size_t value = 64;
-};
-
-template <> struct ObjectPoolBlockMaxItem<
-    bthread::StackFactory<bthread::SmallStackClass>::Wrapper> {
+template <typename StackClass, int NUMA_NODE> struct ObjectPoolBlockMaxItem<
+    bthread::StackWrapper<StackClass, NUMA_NODE> > {
     static const size_t value = 64;
 };
 
-template <> struct ObjectPoolFreeChunkMaxItem<
-    bthread::StackFactory<bthread::SmallStackClass>::Wrapper> {
+template <int NUMA_NODE> struct ObjectPoolFreeChunkMaxItem<
+    bthread::StackWrapper<bthread::SmallStackClass, NUMA_NODE> > {
     inline static size_t value() {
         return (FLAGS_tc_stack_small <= 0 ? 0 : FLAGS_tc_stack_small);
     }
 };
 
-template <> struct ObjectPoolFreeChunkMaxItem<
-    bthread::StackFactory<bthread::NormalStackClass>::Wrapper> {
+template <int NUMA_NODE> struct ObjectPoolFreeChunkMaxItem<
+    bthread::StackWrapper<bthread::NormalStackClass, NUMA_NODE> > {
     inline static size_t value() {
         return (FLAGS_tc_stack_normal <= 0 ? 0 : FLAGS_tc_stack_normal);
     }
 };
 
-template <> struct ObjectPoolFreeChunkMaxItem<
-    bthread::StackFactory<bthread::LargeStackClass>::Wrapper> {
+template <int NUMA_NODE> struct ObjectPoolFreeChunkMaxItem<
+    bthread::StackWrapper<bthread::LargeStackClass, NUMA_NODE> > {
     inline static size_t value() { return 1UL; }
 };
 
-template <> struct ObjectPoolValidator<
-    bthread::StackFactory<bthread::LargeStackClass>::Wrapper> {
-    inline static bool validate(
-        const bthread::StackFactory<bthread::LargeStackClass>::Wrapper* w) {
-        return w->context != NULL;
-    }
-};
-
-template <> struct ObjectPoolValidator<
-    bthread::StackFactory<bthread::NormalStackClass>::Wrapper> {
-    inline static bool validate(
-        const bthread::StackFactory<bthread::NormalStackClass>::Wrapper* w) {
-        return w->context != NULL;
-    }
-};
-
-template <> struct ObjectPoolValidator<
-    bthread::StackFactory<bthread::SmallStackClass>::Wrapper> {
+template <typename StackClass, int NUMA_NODE> struct ObjectPoolValidator<
+    bthread::StackWrapper<StackClass, NUMA_NODE> > {
     inline static bool validate(
-        const bthread::StackFactory<bthread::SmallStackClass>::Wrapper* w) {
+        const bthread::StackWrapper<StackClass, NUMA_NODE>* w) {
         return w->context != NULL;
     }
 };
@@ -26,6 +26,7 @@
 #include "bthread/sys_futex.h"            // futex_wake_private
 #include "bthread/interrupt_pthread.h"
 #include "bthread/processor.h"            // cpu_relax
+#include "bthread/numa.h"                 // bind_thread_to_numa_node
 #include "bthread/task_group.h"           // TaskGroup
 #include "bthread/task_control.h"
 #include "bthread/timer_thread.h"         // global_timer_thread
@@ -38,6 +39,22 @@ DEFINE_int32(task_group_runqueue_capacity, 4096,
              "capacity of runqueue in each TaskGroup");
 DEFINE_int32(task_group_yield_before_idle, 0,
              "TaskGroup yields so many times before idle");
+DEFINE_bool(bthread_numa_aware, false,
+            "Bind workers to NUMA nodes in turn, steal tasks from workers "
+            "on the same node first and pool bthread stacks by nodes. "
+            "Must be set before any bthread is created");
+DEFINE_int32(task_group_ntags, 1,
+             "Number of worker pools, each pool has its own workers and "
+             "runqueues, bthreads are only run and stolen by workers of the "
+             "pool specified by bthread_attr_settag. Must be set before any "
+             "bthread is created");
+
+static bool validate_task_group_ntags(const char*, int32_t val) {
+    return val >= 1 && val <= BTHREAD_MAX_TAG_NUM;
+}
+const int ALLOW_UNUSED register_FLAGS_task_group_ntags =
+    ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_task_group_ntags,
+                                       validate_task_group_ntags);
 
 namespace bthread {
 
@@ -55,21 +72,39 @@ void run_worker_startfn() {
     }
 }
 
+struct WorkerArgs {
+    TaskControl* control;
+    bthread_tag_t tag;
+};
+
 void* TaskControl::worker_thread(void* arg) {
     run_worker_startfn();    
 #ifdef BAIDU_INTERNAL
     logging::ComlogInitializer comlog_initializer;
 #endif
     
-    TaskControl* c = static_cast<TaskControl*>(arg);
-    TaskGroup* g = c->create_group();
+    WorkerArgs* args = static_cast<WorkerArgs*>(arg);
+    TaskControl* c = args->control;
+    const bthread_tag_t tag = args->tag;
+    delete args;
+    int numa_node = -1;
+    if (c->_nnode > 0) {
+        numa_node = c->_next_numa_node.fetch_add(
+            1, butil::memory_order_relaxed) % c->_nnode;
+        if (bind_thread_to_numa_node(numa_node) != 0) {
+            PLOG(WARNING) << "Fail to bind worker=" << pthread_self()
+                          << " to NUMA node " << numa_node;
+        }
+        tls_numa_node = numa_node;
+    }
+    TaskGroup* g = c->create_group(numa_node, tag);
     TaskStatistics stat;
     if (NULL == g) {
         LOG(ERROR) << "Fail to create TaskGroup in pthread=" << pthread_self();
         return NULL;
     }
     BT_VLOG << "Created worker=" << pthread_self()
-            << " bthread=" << g->main_tid();
+            << " bthread=" << g->main_tid() << " tag=" << tag;
 
     tls_task_group = g;
     c->_nworkers << 1;
@@ -81,16 +116,32 @@ void* TaskControl::worker_thread(void* arg) {
             << "ms uptime=" << g->current_uptime_ns() / 1000000.0 << "ms";
     tls_task_group = NULL;
     g->destroy_self();
+    tls_numa_node = -1;
     c->_nworkers << -1;
     return NULL;
 }
 
-TaskGroup* TaskControl::create_group() {
-    TaskGroup* g = new (std::nothrow) TaskGroup(this);
+int TaskControl::create_worker(pthread_t* th, bthread_tag_t tag) {
+    WorkerArgs* args = new (std::nothrow) WorkerArgs;
+    if (NULL == args) {
+        return ENOMEM;
+    }
+    args->control = this;
+    args->tag = tag;
+    const int rc = pthread_create(th, NULL, worker_thread, args);
+    if (rc) {
+        delete args;
+    }
+    return rc;
+}
+
+TaskGroup* TaskControl::create_group(int numa_node, bthread_tag_t tag) {
+    TaskGroup* g = new (std::nothrow) TaskGroup(this, tag);
     if (NULL == g) {
         LOG(FATAL) << "Fail to new TaskGroup";
         return NULL;
     }
+    g->_numa_node = numa_node;
     if (g->init(FLAGS_task_group_runqueue_capacity) != 0) {
         LOG(ERROR) << "Fail to init TaskGroup";
         delete g;
@@ -120,14 +171,75 @@ static int64_t get_cumulated_signal_count_from_this(void *arg) {
     return static_cast<TaskControl*>(arg)->get_cumulated_signal_count();
 }
 
+static int64_t get_cumulated_local_steal_count_from_this(void *arg) {
+    return static_cast<TaskControl*>(arg)->get_cumulated_local_steal_count();
+}
+
+static int64_t get_cumulated_remote_steal_count_from_this(void *arg) {
+    return static_cast<TaskControl*>(arg)->get_cumulated_remote_steal_count();
+}
+
+static int64_t get_cumulated_steal_count_from_this(void *arg) {
+    return static_cast<TaskControl*>(arg)->get_cumulated_steal_count();
+}
+
+static int64_t get_cumulated_wakeup_failure_count_from_this(void *arg) {
+    return static_cast<TaskControl*>(arg)->get_cumulated_wakeup_failure_count();
+}
+
+struct TaskControl::TaggedVars {
+    TaggedVars(TaskControl* c, bthread_tag_t t)
+        : control(c)
+        , tag(t)
+        , cumulated_worker_time(get_cumulated_worker_time_from_vars, this)
+        , worker_usage_second(&cumulated_worker_time, 1)
+        , worker_count(get_worker_count_from_vars, this)
+        , runqueue_size(get_runqueue_size_from_vars, this) {}
+
+    void expose() {
+        char name[64];
+        snprintf(name, sizeof(name), "bthread_worker_usage_tag%d", tag);
+        worker_usage_second.expose(name);
+        snprintf(name, sizeof(name), "bthread_worker_count_tag%d", tag);
+        worker_count.expose(name);
+        snprintf(name, sizeof(name), "bthread_runqueue_size_tag%d", tag);
+        runqueue_size.expose(name);
+    }
+
+    static double get_cumulated_worker_time_from_vars(void* arg) {
+        TaggedVars* v = static_cast<TaggedVars*>(arg);
+        return v->control->get_cumulated_worker_time(v->tag);
+    }
+    static int get_worker_count_from_vars(void* arg) {
+        TaggedVars* v = static_cast<TaggedVars*>(arg);
+        return v->control->concurrency(v->tag);
+    }
+    static int64_t get_runqueue_size_from_vars(void* arg) {
+        TaggedVars* v = static_cast<TaggedVars*>(arg);
+        return v->control->get_runqueue_size(v->tag);
+    }
+
+    TaskControl* control;
+    bthread_tag_t tag;
+    bvar::PassiveStatus<double> cumulated_worker_time;
+    bvar::PerSecond<bvar::PassiveStatus<double> > worker_usage_second;
+    bvar::PassiveStatus<int> worker_count;
+    bvar::PassiveStatus<int64_t> runqueue_size;
+};
+
 TaskControl::TaskControl()
     // NOTE: all fileds must be initialized before the vars.
     : _ngroup(0)
     , _groups((TaskGroup**)calloc(BTHREAD_MAX_CONCURRENCY, sizeof(TaskGroup*)))
+    , _ntags(0)
+    , _nnode(0)
+    , _node_groups(NULL)
+    , _next_numa_node(0)
     , _stop(false)
     , _concurrency(0)
     , _nworkers("bthread_worker_count")
     , _pending_time(NULL)
+    , _runqueue_wait(NULL)
       // Delay exposure of following two vars because they rely on TC which
       // is not initialized yet.
     , _cumulated_worker_time(get_cumulated_worker_time_from_this, this)
@@ -136,11 +248,28 @@ TaskControl::TaskControl()
     , _switch_per_second(&_cumulated_switch_count)
     , _cumulated_signal_count(get_cumulated_signal_count_from_this, this)
     , _signal_per_second(&_cumulated_signal_count)
+    , _cumulated_local_steal_count(
+        get_cumulated_local_steal_count_from_this, this)
+    , _local_steal_per_second(&_cumulated_local_steal_count)
+    , _cumulated_remote_steal_count(
+        get_cumulated_remote_steal_count_from_this, this)
+    , _remote_steal_per_second(&_cumulated_remote_steal_count)
+    , _cumulated_steal_count(get_cumulated_steal_count_from_this, this)
+    , _steal_per_second(&_cumulated_steal_count)
+    , _cumulated_wakeup_failure_count(
+        get_cumulated_wakeup_failure_count_from_this, this)
+    , _wakeup_failure_per_second(&_cumulated_wakeup_failure_count)
     , _status(print_rq_sizes_in_the_tc, this)
     , _nbthreads("bthread_count")
 {
     // calloc shall set memory to zero
     CHECK(_groups) << "Fail to create array of groups";
+    for (int i = 0; i < BTHREAD_MAX_TAG_NUM; ++i) {
+        _tagged[i].ngroup.store(0, butil::memory_order_relaxed);
+        _tagged[i].groups = NULL;
+        _tagged[i].concurrency.store(0, butil::memory_order_relaxed);
+        _tagged[i].vars = NULL;
+    }
 }
 
 int TaskControl::init(int concurrency) {
@@ -152,7 +281,48 @@ int TaskControl::init(int concurrency) {
         LOG(ERROR) << "Invalid concurrency=" << concurrency;
         return -1;
     }
+    _ntags = FLAGS_task_group_ntags;
+    if (concurrency < _ntags) {
+        // Each pool needs at least one worker.
+        concurrency = _ntags;
+    }
     _concurrency = concurrency;
+    for (int i = 0; i < _ntags; ++i) {
+        _tagged[i].groups = (TaskGroup**)calloc(
+            BTHREAD_MAX_CONCURRENCY, sizeof(TaskGroup*));
+        if (NULL == _tagged[i].groups) {
+            LOG(ERROR) << "Fail to create array of groups";
+            return -1;
+        }
+        if (_ntags > 1) {
+            _tagged[i].vars = new (std::nothrow) TaggedVars(this, i);
+            if (NULL == _tagged[i].vars) {
+                LOG(ERROR) << "Fail to new TaggedVars";
+                return -1;
+            }
+        }
+    }
+
+    if (FLAGS_bthread_numa_aware) {
+        const int nnode = bthread::numa_node_count();
+        _node_groups = new (std::nothrow) NumaNodeGroups[nnode];
+        if (NULL == _node_groups) {
+            LOG(ERROR) << "Fail to new NumaNodeGroups";
+            return -1;
+        }
+        for (int i = 0; i < nnode; ++i) {
+            _node_groups[i].ngroup.store(0, butil::memory_order_relaxed);
+            _node_groups[i].groups = (TaskGroup**)calloc(
+                BTHREAD_MAX_CONCURRENCY, sizeof(TaskGroup*));
+            if (NULL == _node_groups[i].groups) {
+                LOG(ERROR) << "Fail to create array of groups";
+                return -1;
+            }
+        }
+        _nnode = nnode;
+        LOG(INFO) << "Spread " << _concurrency << " workers over "
+                  << _nnode << " NUMA node(s)";
+    }
 
     // Make sure TimerThread is ready.
     if (get_or_create_global_timer_thread() == NULL) {
@@ -162,7 +332,9 @@ int TaskControl::init(int concurrency) {
     
     _workers.resize(_concurrency);   
     for (int i = 0; i < _concurrency; ++i) {
-        const int rc = pthread_create(&_workers[i], NULL, worker_thread, this);
+        const bthread_tag_t tag = i % _ntags;
+        _tagged[tag].concurrency.fetch_add(1, butil::memory_order_relaxed);
+        const int rc = create_worker(&_workers[i], tag);
         if (rc) {
             LOG(ERROR) << "Fail to create _workers[" << i << "], " << berror(rc);
             return -1;
@@ -172,18 +344,35 @@ int TaskControl::init(int concurrency) {
     _switch_per_second.expose("bthread_switch_second");
     _signal_per_second.expose("bthread_signal_second");
     _status.expose("bthread_group_status");
+    _cumulated_steal_count.expose("bthread_steal_count");
+    _steal_per_second.expose("bthread_steal_second");
+    _cumulated_wakeup_failure_count.expose("bthread_wakeup_failure_count");
+    _wakeup_failure_per_second.expose("bthread_wakeup_failure_second");
+    if (_nnode > 0) {
+        _cumulated_local_steal_count.expose("bthread_numa_local_steal_count");
+        _local_steal_per_second.expose("bthread_numa_local_steal_second");
+        _cumulated_remote_steal_count.expose("bthread_numa_remote_steal_count");
+        _remote_steal_per_second.expose("bthread_numa_remote_steal_second");
+    }
+    for (int i = 0; i < _ntags; ++i) {
+        if (_tagged[i].vars) {
+            _tagged[i].vars->expose();
+        }
+    }
 
-    // Wait for at least one group is added so that choose_one_group()
-    // never returns NULL.
+    // Wait for at least one group is added into each pool so that
+    // choose_one_group() never returns NULL.
     // TODO: Handle the case that worker quits before add_group
-    while (_ngroup == 0) {
-        usleep(100);  // TODO: Elaborate
+    for (int i = 0; i < _ntags; ++i) {
+        while (_tagged[i].ngroup == 0) {
+            usleep(100);  // TODO: Elaborate
+        }
     }
     return 0;
 }
 
-int TaskControl::add_workers(int num) {
-    if (num <= 0) {
+int TaskControl::add_workers(int num, bthread_tag_t tag) {
+    if (num <= 0 || tag < 0 || tag >= _ntags) {
         return 0;
     }
     try {
@@ -196,11 +385,12 @@ int TaskControl::add_workers(int num) {
         // Worker will add itself to _idle_workers, so we have to add
         // _concurrency before create a worker.
         _concurrency.fetch_add(1);
-        const int rc = pthread_create(
-                &_workers[i + old_concurency], NULL, worker_thread, this);
+        _tagged[tag].concurrency.fetch_add(1);
+        const int rc = create_worker(&_workers[i + old_concurency], tag);
         if (rc) {
             LOG(WARNING) << "Fail to create _workers[" << i + old_concurency
                          << "], " << berror(rc);
+            _tagged[tag].concurrency.fetch_sub(1, butil::memory_order_release);
             _concurrency.fetch_sub(1, butil::memory_order_release);
             break;
         }
@@ -210,15 +400,39 @@ int TaskControl::add_workers(int num) {
     return _concurrency.load(butil::memory_order_relaxed) - old_concurency;
 }
 
-TaskGroup* TaskControl::choose_one_group() {
-    const size_t ngroup = _ngroup.load(butil::memory_order_acquire);
+TaskGroup* TaskControl::choose_one_group(bthread_tag_t tag) {
+    CHECK(tag >= 0 && tag < _ntags) << "Invalid tag=" << tag;
+    const TaggedGroups& tg = _tagged[tag];
+    const size_t ngroup = tg.ngroup.load(butil::memory_order_acquire);
     if (ngroup != 0) {
-        return _groups[butil::fast_rand_less_than(ngroup)];
+        return tg.groups[butil::fast_rand_less_than(ngroup)];
     }
     CHECK(false) << "Impossible: ngroup is 0";
     return NULL;
 }
 
+TaskGroup* TaskControl::choose_one_group_in_set(int set, int nset) {
+    const TaggedGroups& tg = _tagged[BTHREAD_TAG_DEFAULT];
+    const size_t ngroup = tg.ngroup.load(butil::memory_order_acquire);
+    if ((size_t)set >= ngroup) {
+        return NULL;
+    }
+    const size_t nmember = (ngroup - set + nset - 1) / nset;
+    // Possibly NULL because of concurrent _destroy_group
+    return tg.groups[set + butil::fast_rand_less_than(nmember) * nset];
+}
+
+bool TaskControl::in_worker_set(const TaskGroup* g, int set, int nset) {
+    const TaggedGroups& tg = _tagged[BTHREAD_TAG_DEFAULT];
+    const size_t ngroup = tg.ngroup.load(butil::memory_order_acquire);
+    for (size_t i = set; i < ngroup; i += nset) {
+        if (tg.groups[i] == g) {
+            return true;
+        }
+    }
+    return false;
+}
+
 extern int stop_and_join_epoll_threads();
 
 void TaskControl::stop_and_join() {
@@ -231,9 +445,14 @@ void TaskControl::stop_and_join() {
         BAIDU_SCOPED_LOCK(_modify_group_mutex);
         _stop = true;
         _ngroup.exchange(0, butil::memory_order_relaxed); 
+        for (int i = 0; i < _ntags; ++i) {
+            _tagged[i].ngroup.exchange(0, butil::memory_order_relaxed);
+        }
     }
-    for (int i = 0; i < PARKING_LOT_NUM; ++i) {
-        _pl[i].stop();
+    for (int i = 0; i < _ntags; ++i) {
+        for (int j = 0; j < PARKING_LOT_NUM; ++j) {
+            _pl[i][j].stop();
+        }
     }
     // Interrupt blocking operations.
     for (size_t i = 0; i < _workers.size(); ++i) {
@@ -249,15 +468,35 @@ TaskControl::~TaskControl() {
     // NOTE: g_task_control is not destructed now because the situation
     //       is extremely racy.
     delete _pending_time.exchange(NULL, butil::memory_order_relaxed);
+    delete _runqueue_wait.exchange(NULL, butil::memory_order_relaxed);
     _worker_usage_second.hide();
     _switch_per_second.hide();
     _signal_per_second.hide();
     _status.hide();
+    _cumulated_local_steal_count.hide();
+    _local_steal_per_second.hide();
+    _cumulated_remote_steal_count.hide();
+    _remote_steal_per_second.hide();
+    _cumulated_steal_count.hide();
+    _steal_per_second.hide();
+    _cumulated_wakeup_failure_count.hide();
+    _wakeup_failure_per_second.hide();
     
     stop_and_join();
 
     free(_groups);
     _groups = NULL;
+    for (int i = 0; i < _ntags; ++i) {
+        delete _tagged[i].vars;
+        _tagged[i].vars = NULL;
+        free(_tagged[i].groups);
+        _tagged[i].groups = NULL;
+    }
+    for (int i = 0; i < _nnode; ++i) {
+        free(_node_groups[i].groups);
+    }
+    delete [] _node_groups;
+    _node_groups = NULL;
 }
 
 int TaskControl::_add_group(TaskGroup* g) {
@@ -273,10 +512,24 @@ int TaskControl::_add_group(TaskGroup* g) {
         _groups[ngroup] = g;
         _ngroup.store(ngroup + 1, butil::memory_order_release);
     }
+    TaggedGroups& tg = _tagged[g->_tag];
+    const size_t ntagged = tg.ngroup.load(butil::memory_order_relaxed);
+    if (ntagged < (size_t)BTHREAD_MAX_CONCURRENCY) {
+        tg.groups[ntagged] = g;
+        tg.ngroup.store(ntagged + 1, butil::memory_order_release);
+    }
+    if (g->_numa_node >= 0 && g->_numa_node < _nnode) {
+        NumaNodeGroups& ng = _node_groups[g->_numa_node];
+        const size_t n = ng.ngroup.load(butil::memory_order_relaxed);
+        if (n < (size_t)BTHREAD_MAX_CONCURRENCY) {
+            ng.groups[n] = g;
+            ng.ngroup.store(n + 1, butil::memory_order_release);
+        }
+    }
     mu.unlock();
     // See the comments in _destroy_group
     // TODO: Not needed anymore since non-worker pthread cannot have TaskGroup
-    signal_task(65536);
+    signal_task(65536, g->_tag);
     return 0;
 }
 
@@ -317,6 +570,28 @@ int TaskControl::_destroy_group(TaskGroup* g) {
                 break;
             }
         }
+        TaggedGroups& tg = _tagged[g->_tag];
+        const size_t ntagged = tg.ngroup.load(butil::memory_order_relaxed);
+        for (size_t i = 0; i < ntagged; ++i) {
+            // Same as above.
+            if (tg.groups[i] == g) {
+                tg.groups[i] = tg.groups[ntagged - 1];
+                tg.ngroup.store(ntagged - 1, butil::memory_order_release);
+                break;
+            }
+        }
+        if (g->_numa_node >= 0 && g->_numa_node < _nnode) {
+            // Same as above.
+            NumaNodeGroups& ng = _node_groups[g->_numa_node];
+            const size_t n = ng.ngroup.load(butil::memory_order_relaxed);
+            for (size_t i = 0; i < n; ++i) {
+                if (ng.groups[i] == g) {
+                    ng.groups[i] = ng.groups[n - 1];
+                    ng.ngroup.store(n - 1, butil::memory_order_release);
+                    break;
+                }
+            }
+        }
     }
 
     // Can't delete g immediately because for performance consideration,
@@ -332,27 +607,30 @@ int TaskControl::_destroy_group(TaskGroup* g) {
     return 0;
 }
 
-bool TaskControl::steal_task(bthread_t* tid, size_t* seed, size_t offset) {
-    // 1: Acquiring fence is paired with releasing fence in _add_group to
-    // avoid accessing uninitialized slot of _groups.
-    const size_t ngroup = _ngroup.load(butil::memory_order_acquire/*1*/);
+bool TaskControl::steal_from_groups(TaskGroup* thief,
+                                    TaskGroup* const* groups, size_t ngroup,
+                                    bthread_t* tid, size_t* seed,
+                                    size_t offset, TaskGroup** victim) {
     if (0 == ngroup) {
         return false;
     }
-
     // NOTE: Don't return inside `for' iteration since we need to update |seed|
     bool stolen = false;
     size_t s = *seed;
     for (size_t i = 0; i < ngroup; ++i, s += offset) {
-        TaskGroup* g = _groups[s % ngroup];
+        TaskGroup* g = groups[s % ngroup];
         // g is possibly NULL because of concurrent _destroy_group
-        if (g) {
-            if (g->_rq.steal(tid)) {
+        if (g && g->_tag == thief->_tag) {
+            if (g->_hp_rq.steal(tid) ||
+                thief->pop_remote_tasks(&g->_hp_remote_rq, tid) ||
+                g->_rq.steal(tid)) {
                 stolen = true;
+                *victim = g;
                 break;
             }
-            if (g->_remote_rq.pop(tid)) {
+            if (thief->pop_remote_tasks(&g->_remote_rq, tid)) {
                 stolen = true;
+                *victim = g;
                 break;
             }
         }
@@ -361,7 +639,44 @@ bool TaskControl::steal_task(bthread_t* tid, size_t* seed, size_t offset) {
     return stolen;
 }
 
-void TaskControl::signal_task(int num_task) {
+bool TaskControl::steal_task(TaskGroup* thief, bthread_t* tid) {
+    TaskGroup* victim = NULL;
+    const int node = thief->_numa_node;
+    if (node >= 0) {
+        // Tasks on the same node are likely to touch memory of the node,
+        // try them first to reduce cross-node traffic.
+        NumaNodeGroups& ng = _node_groups[node];
+        // 1: Acquiring fence is paired with releasing fence in _add_group to
+        // avoid accessing uninitialized slot of groups.
+        if (steal_from_groups(thief, ng.groups,
+                              ng.ngroup.load(butil::memory_order_acquire/*1*/),
+                              tid, &thief->_steal_seed, thief->_steal_offset,
+                              &victim)) {
+            ++thief->_nlocal_steal;
+            ++thief->_nsteal;
+            return true;
+        }
+    }
+    // Same as 1.
+    TaggedGroups& tg = _tagged[thief->_tag];
+    if (!steal_from_groups(thief, tg.groups,
+                           tg.ngroup.load(butil::memory_order_acquire),
+                           tid, &thief->_steal_seed, thief->_steal_offset,
+                           &victim)) {
+        return false;
+    }
+    ++thief->_nsteal;
+    if (node >= 0) {
+        if (victim->_numa_node == node) {
+            ++thief->_nlocal_steal;
+        } else {
+            ++thief->_nremote_steal;
+        }
+    }
+    return true;
+}
+
+void TaskControl::signal_task(int num_task, bthread_tag_t tag) {
     if (num_task <= 0) {
         return;
     }
@@ -372,17 +687,19 @@ void TaskControl::signal_task(int num_task) {
     if (num_task > 2) {
         num_task = 2;
     }
+    ParkingLot* pl = _pl[tag];
     int start_index = butil::fmix64(pthread_numeric_id()) % PARKING_LOT_NUM;
-    num_task -= _pl[start_index].signal(1);
+    num_task -= pl[start_index].signal(1);
     if (num_task > 0) {
         for (int i = 1; i < PARKING_LOT_NUM && num_task > 0; ++i) {
             if (++start_index >= PARKING_LOT_NUM) {
                 start_index = 0;
             }
-            num_task -= _pl[start_index].signal(1);
+            num_task -= pl[start_index].signal(1);
         }
     }
-    if (num_task > 0 &&
+    // Only the default pool grows on demand.
+    if (num_task > 0 && tag == BTHREAD_TAG_DEFAULT &&
         FLAGS_bthread_min_concurrency > 0 &&    // test min_concurrency for performance
         _concurrency.load(butil::memory_order_relaxed) < FLAGS_bthread_concurrency) {
         // TODO: Reduce this lock
@@ -401,7 +718,8 @@ void TaskControl::print_rq_sizes(std::ostream& os) {
         // ngroup > _ngroup: nums[_ngroup ... ngroup-1] = 0
         // ngroup < _ngroup: just ignore _groups[_ngroup ... ngroup-1]
         for (size_t i = 0; i < ngroup; ++i) {
-            nums[i] = (_groups[i] ? _groups[i]->_rq.volatile_size() : 0);
+            nums[i] = (_groups[i] ? _groups[i]->_rq.volatile_size() +
+                       _groups[i]->_hp_rq.volatile_size() : 0);
         }
     }
     for (size_t i = 0; i < ngroup; ++i) {
@@ -421,6 +739,33 @@ double TaskControl::get_cumulated_worker_time() {
     return cputime_ns / 1000000000.0;
 }
 
+double TaskControl::get_cumulated_worker_time(bthread_tag_t tag) {
+    int64_t cputime_ns = 0;
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const TaggedGroups& tg = _tagged[tag];
+    const size_t ngroup = tg.ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        if (tg.groups[i]) {
+            cputime_ns += tg.groups[i]->_cumulated_cputime_ns;
+        }
+    }
+    return cputime_ns / 1000000000.0;
+}
+
+int64_t TaskControl::get_runqueue_size(bthread_tag_t tag) {
+    int64_t n = 0;
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const TaggedGroups& tg = _tagged[tag];
+    const size_t ngroup = tg.ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        TaskGroup* g = tg.groups[i];
+        if (g) {
+            n += g->_rq.volatile_size() + g->_hp_rq.volatile_size();
+        }
+    }
+    return n;
+}
+
 int64_t TaskControl::get_cumulated_switch_count() {
     int64_t c = 0;
     BAIDU_SCOPED_LOCK(_modify_group_mutex);
@@ -440,26 +785,123 @@ int64_t TaskControl::get_cumulated_signal_count() {
     for (size_t i = 0; i < ngroup; ++i) {
         TaskGroup* g = _groups[i];
         if (g) {
-            c += g->_nsignaled + g->_remote_nsignaled;
+            c += g->_nsignaled +
+                g->_remote_nsignaled.load(butil::memory_order_relaxed);
+        }
+    }
+    return c;
+}
+
+int64_t TaskControl::get_cumulated_local_steal_count() {
+    int64_t c = 0;
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const size_t ngroup = _ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        if (_groups[i]) {
+            c += _groups[i]->_nlocal_steal;
         }
     }
     return c;
 }
 
+int64_t TaskControl::get_cumulated_remote_steal_count() {
+    int64_t c = 0;
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const size_t ngroup = _ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        if (_groups[i]) {
+            c += _groups[i]->_nremote_steal;
+        }
+    }
+    return c;
+}
+
+int64_t TaskControl::get_cumulated_steal_count() {
+    int64_t c = 0;
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const size_t ngroup = _ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        if (_groups[i]) {
+            c += _groups[i]->_nsteal;
+        }
+    }
+    return c;
+}
+
+int64_t TaskControl::get_cumulated_wakeup_failure_count() {
+    int64_t c = 0;
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const size_t ngroup = _ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        if (_groups[i]) {
+            c += _groups[i]->_nwakeup_failure;
+        }
+    }
+    return c;
+}
+
+void TaskControl::print_workers(std::ostream& os) {
+    if (!FLAGS_show_bthread_runqueue_wait_in_vars) {
+        os << "# Turn on -show_bthread_runqueue_wait_in_vars to see time "
+            "(in microseconds) that bthreads wait in runqueues\n";
+    }
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const size_t ngroup = _ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        TaskGroup* g = _groups[i];
+        if (g == NULL) {
+            continue;
+        }
+        os << "worker" << i << ": tag=" << g->_tag;
+        if (g->_numa_node >= 0) {
+            os << " numa_node=" << g->_numa_node;
+        }
+        os << " runqueue=" << g->_rq.volatile_size() + g->_hp_rq.volatile_size()
+           << " cputime_s=" << g->_cumulated_cputime_ns / 1000000000.0
+           << " nswitch=" << g->_nswitch
+           << " nsteal=" << g->_nsteal
+           << " nwakeup_failure=" << g->_nwakeup_failure;
+        bvar::LatencyRecorder* rw = g->runqueue_wait();
+        if (rw) {
+            os << " runqueue_wait={avg=" << rw->latency()
+               << " p99=" << rw->latency_percentile(0.99)
+               << " max=" << rw->max_latency()
+               << " count=" << rw->count() << '}';
+        }
+        os << '\n';
+    }
+}
+
 bvar::LatencyRecorder* TaskControl::create_exposed_pending_time() {
+    return create_exposed_latency(&_pending_time, "bthread_creation");
+}
+
+bvar::LatencyRecorder* TaskControl::create_exposed_latency(
+    butil::atomic<bvar::LatencyRecorder*>* latency, const char* name) {
     bool is_creator = false;
     _pending_time_mutex.lock();
-    bvar::LatencyRecorder* pt = _pending_time.load(butil::memory_order_consume);
+    bvar::LatencyRecorder* pt = latency->load(butil::memory_order_consume);
     if (!pt) {
         pt = new bvar::LatencyRecorder;
-        _pending_time.store(pt, butil::memory_order_release);
+        latency->store(pt, butil::memory_order_release);
         is_creator = true;
     }
     _pending_time_mutex.unlock();
     if (is_creator) {
-        pt->expose("bthread_creation");
+        pt->expose(name);
     }
     return pt;
 }
 
+extern TaskControl* g_task_control;
+
+void print_workers(std::ostream& os) {
+    TaskControl* c = g_task_control;
+    if (c == NULL) {
+        os << "bthread is not started yet";
+        return;
+    }
+    c->print_workers(os);
+}
+
 }  // namespace bthread
@@ -45,17 +45,21 @@ public:
     TaskControl();
     ~TaskControl();
 
-    // Must be called before using. `nconcurrency' is # of worker pthreads.
+    // Must be called before using. `nconcurrency' is # of worker pthreads,
+    // which are spread over -task_group_ntags pools in turn.
     int init(int nconcurrency);
     
-    // Create a TaskGroup in this control.
-    TaskGroup* create_group();
+    // Create a TaskGroup in pool `tag' of this control. `numa_node' is the
+    // NUMA node that the calling worker is bound to, or -1.
+    TaskGroup* create_group(int numa_node, bthread_tag_t tag);
 
-    // Steal a task from a "random" group.
-    bool steal_task(bthread_t* tid, size_t* seed, size_t offset);
+    // Steal a task for `thief' from a "random" group in the same pool.
+    // Groups on the same NUMA node as `thief' are tried first.
+    bool steal_task(TaskGroup* thief, bthread_t* tid);
 
-    // Tell other groups that `n' tasks was just added to caller's runqueue
-    void signal_task(int num_task);
+    // Tell other groups in pool `tag' that `n' tasks was just added to
+    // caller's runqueue
+    void signal_task(int num_task, bthread_tag_t tag);
 
     // Stop and join worker threads in TaskControl.
     void stop_and_join();
@@ -64,19 +68,48 @@ public:
     int concurrency() const 
     { return _concurrency.load(butil::memory_order_acquire); }
 
+    // Get # of worker threads in pool `tag'.
+    int concurrency(bthread_tag_t tag) const
+    { return _tagged[tag].concurrency.load(butil::memory_order_acquire); }
+
+    // Number of worker pools, tags of the pools are [0, tag_count()).
+    int tag_count() const { return _ntags; }
+
     void print_rq_sizes(std::ostream& os);
 
     double get_cumulated_worker_time();
+    double get_cumulated_worker_time(bthread_tag_t tag);
+    int64_t get_runqueue_size(bthread_tag_t tag);
     int64_t get_cumulated_switch_count();
     int64_t get_cumulated_signal_count();
+    int64_t get_cumulated_local_steal_count();
+    int64_t get_cumulated_remote_steal_count();
+    int64_t get_cumulated_steal_count();
+    int64_t get_cumulated_wakeup_failure_count();
+
+    // Print scheduling statistics of each worker.
+    void print_workers(std::ostream& os);
 
-    // [Not thread safe] Add more worker threads.
+    // Number of NUMA nodes that workers are spread over, 0 when NUMA-aware
+    // scheduling is off.
+    int numa_node_count() const { return _nnode; }
+
+    // [Not thread safe] Add more worker threads to pool `tag'.
     // Return the number of workers actually added, which may be less than |num|
-    int add_workers(int num);
+    int add_workers(int num, bthread_tag_t tag = BTHREAD_TAG_DEFAULT);
 
-    // Choose one TaskGroup (randomly right now).
+    // Choose one TaskGroup in pool `tag' (randomly right now).
     // If this method is called after init(), it never returns NULL.
-    TaskGroup* choose_one_group();
+    TaskGroup* choose_one_group(bthread_tag_t tag = BTHREAD_TAG_DEFAULT);
+
+    // Workers of the default pool are indexed by the order of being added.
+    // Return the group of a random worker whose index modulo `nset' is `set',
+    // or NULL if there's no such worker.
+    TaskGroup* choose_one_group_in_set(int set, int nset);
+
+    // True iff `g' is in the default pool and index of the worker running
+    // `g' modulo `nset' is `set'.
+    bool in_worker_set(const TaskGroup* g, int set, int nset);
 
 private:
     // Add/Remove a TaskGroup.
@@ -86,33 +119,74 @@ private:
 
     static void delete_task_group(void* arg);
 
-    static void* worker_thread(void* task_control);
+    static bool steal_from_groups(TaskGroup* thief,
+                                  TaskGroup* const* groups, size_t ngroup,
+                                  bthread_t* tid, size_t* seed, size_t offset,
+                                  TaskGroup** victim);
+
+    static void* worker_thread(void* arg);
+    int create_worker(pthread_t* th, bthread_tag_t tag);
 
     bvar::LatencyRecorder& exposed_pending_time();
     bvar::LatencyRecorder* create_exposed_pending_time();
+    bvar::LatencyRecorder& exposed_runqueue_wait();
+    bvar::LatencyRecorder* create_exposed_latency(
+        butil::atomic<bvar::LatencyRecorder*>* latency, const char* name);
 
     butil::atomic<size_t> _ngroup;
     TaskGroup** _groups;
     butil::Mutex _modify_group_mutex;
 
+    // Groups of each pool, modified along with _groups.
+    struct TaggedVars;
+    struct TaggedGroups {
+        butil::atomic<size_t> ngroup;
+        TaskGroup** groups;
+        butil::atomic<int> concurrency;
+        // Exposed when there're more than one pool.
+        TaggedVars* vars;
+    };
+    int _ntags;
+    TaggedGroups _tagged[BTHREAD_MAX_TAG_NUM];
+
+    // Groups on each NUMA node, modified along with _groups.
+    struct NumaNodeGroups {
+        butil::atomic<size_t> ngroup;
+        TaskGroup** groups;
+    };
+    int _nnode;
+    NumaNodeGroups* _node_groups;
+    butil::atomic<int> _next_numa_node;
+
     bool _stop;
     butil::atomic<int> _concurrency;
     std::vector<pthread_t> _workers;
 
     bvar::Adder<int64_t> _nworkers;
+    // Protecting creation of _pending_time and _runqueue_wait.
     butil::Mutex _pending_time_mutex;
     butil::atomic<bvar::LatencyRecorder*> _pending_time;
+    butil::atomic<bvar::LatencyRecorder*> _runqueue_wait;
     bvar::PassiveStatus<double> _cumulated_worker_time;
     bvar::PerSecond<bvar::PassiveStatus<double> > _worker_usage_second;
     bvar::PassiveStatus<int64_t> _cumulated_switch_count;
     bvar::PerSecond<bvar::PassiveStatus<int64_t> > _switch_per_second;
     bvar::PassiveStatus<int64_t> _cumulated_signal_count;
     bvar::PerSecond<bvar::PassiveStatus<int64_t> > _signal_per_second;
+    bvar::PassiveStatus<int64_t> _cumulated_local_steal_count;
+    bvar::PerSecond<bvar::PassiveStatus<int64_t> > _local_steal_per_second;
+    bvar::PassiveStatus<int64_t> _cumulated_remote_steal_count;
+    bvar::PerSecond<bvar::PassiveStatus<int64_t> > _remote_steal_per_second;
+    bvar::PassiveStatus<int64_t> _cumulated_steal_count;
+    bvar::PerSecond<bvar::PassiveStatus<int64_t> > _steal_per_second;
+    bvar::PassiveStatus<int64_t> _cumulated_wakeup_failure_count;
+    bvar::PerSecond<bvar::PassiveStatus<int64_t> > _wakeup_failure_per_second;
     bvar::PassiveStatus<std::string> _status;
     bvar::Adder<int64_t> _nbthreads;
 
     static const int PARKING_LOT_NUM = 4;
-    ParkingLot _pl[PARKING_LOT_NUM];
+    // Workers of different pools never wake each other.
+    ParkingLot _pl[BTHREAD_MAX_TAG_NUM][PARKING_LOT_NUM];
 };
 
 inline bvar::LatencyRecorder& TaskControl::exposed_pending_time() {
@@ -123,6 +197,14 @@ inline bvar::LatencyRecorder& TaskControl::exposed_pending_time() {
     return *pt;
 }
 
+inline bvar::LatencyRecorder& TaskControl::exposed_runqueue_wait() {
+    bvar::LatencyRecorder* rw = _runqueue_wait.load(butil::memory_order_consume);
+    if (!rw) {
+        rw = create_exposed_latency(&_runqueue_wait, "bthread_runqueue_wait");
+    }
+    return *rw;
+}
+
 }  // namespace bthread
 
 #endif  // BTHREAD_TASK_CONTROL_H
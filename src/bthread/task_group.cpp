@@ -40,7 +40,7 @@
 namespace bthread {
 
 static const bthread_attr_t BTHREAD_ATTR_TASKGROUP = {
-    BTHREAD_STACKTYPE_UNKNOWN, 0, NULL };
+    BTHREAD_STACKTYPE_UNKNOWN, 0, NULL, 0 };
 
 static bool pass_bool(const char*, bool) { return true; }
 
@@ -57,6 +57,26 @@ const bool ALLOW_UNUSED dummy_show_per_worker_usage_in_vars =
     ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_show_per_worker_usage_in_vars,
                                     pass_bool);
 
+DEFINE_bool(show_bthread_runqueue_wait_in_vars, false, "When this flag is on, "
+            "time that ready bthreads wait in runqueues before running will be "
+            "recorded and shown in /vars/bthread_runqueue_wait* and "
+            "/bthreads/workers");
+const bool ALLOW_UNUSED dummy_show_bthread_runqueue_wait_in_vars =
+    ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_show_bthread_runqueue_wait_in_vars,
+                                    pass_bool);
+
+static bool validate_bthread_busy_poll_us(const char*, int32_t val) {
+    return val >= 0;
+}
+DEFINE_int32(bthread_busy_poll_us, 0,
+             "Idle workers keep stealing bthreads for so many microseconds "
+             "before sleeping, which saves the latency of waking up workers "
+             "at the cost of burning cpu. Only for servers with dedicated "
+             "cores. 0 means never busy-polling");
+const bool ALLOW_UNUSED dummy_bthread_busy_poll_us =
+    ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_bthread_busy_poll_us,
+                                    validate_bthread_busy_poll_us);
+
 __thread TaskGroup* tls_task_group = NULL;
 // Sync with TaskMeta::local_storage when a bthread is created or destroyed.
 // During running, the two fields may be inconsistent, use tls_bls as the
@@ -115,17 +135,44 @@ bool TaskGroup::is_stopped(bthread_t tid) {
     return true;
 }
 
+bool TaskGroup::busy_poll_task(bthread_t* tid) {
+    const int busy_poll_us = FLAGS_bthread_busy_poll_us;
+    if (busy_poll_us <= 0) {
+        return false;
+    }
+    const int64_t deadline_us = butil::cpuwide_time_us() + busy_poll_us;
+    do {
+        if (steal_task(tid)) {
+            return true;
+        }
+        cpu_relax();
+    } while (butil::cpuwide_time_us() < deadline_us &&
+             !_pl->get_state().stopped());
+    return false;
+}
+
 bool TaskGroup::wait_task(bthread_t* tid) {
+#ifdef BTHREAD_DONT_SAVE_PARKING_STATE
+    bool woken_up = false;
+#endif
     do {
 #ifndef BTHREAD_DONT_SAVE_PARKING_STATE
         if (_last_pl_state.stopped()) {
             return false;
         }
+        // _last_pl_state is refreshed by steal_task() inside.
+        if (busy_poll_task(tid)) {
+            return true;
+        }
         _pl->wait(_last_pl_state);
         if (steal_task(tid)) {
             return true;
         }
+        ++_nwakeup_failure;
 #else
+        if (busy_poll_task(tid)) {
+            return true;
+        }
         const ParkingLot::State st = _pl->get_state();
         if (st.stopped()) {
             return false;
@@ -133,7 +180,12 @@ bool TaskGroup::wait_task(bthread_t* tid) {
         if (steal_task(tid)) {
             return true;
         }
+        if (woken_up) {
+            // Nothing to steal after the last wakeup.
+            ++_nwakeup_failure;
+        }
         _pl->wait(st);
+        woken_up = true;
 #endif
     } while (true);
 }
@@ -173,7 +225,7 @@ void TaskGroup::run_main_task() {
     current_task()->stat.cputime_ns += butil::cpuwide_time_ns() - _last_run_ns;
 }
 
-TaskGroup::TaskGroup(TaskControl* c)
+TaskGroup::TaskGroup(TaskControl* c, bthread_tag_t tag)
     :
 #ifndef NDEBUG
     _sched_recursive_guard(0),
@@ -187,7 +239,14 @@ TaskGroup::TaskGroup(TaskControl* c)
     , _nswitch(0)
     , _last_context_remained(NULL)
     , _last_context_remained_arg(NULL)
+    , _tag(tag)
     , _pl(NULL)
+    , _numa_node(-1)
+    , _nlocal_steal(0)
+    , _nremote_steal(0)
+    , _nsteal(0)
+    , _nwakeup_failure(0)
+    , _rq_wait(NULL)
     , _main_stack(NULL)
     , _main_tid(0)
     , _remote_num_nosignal(0)
@@ -195,7 +254,8 @@ TaskGroup::TaskGroup(TaskControl* c)
 {
     _steal_seed = butil::fast_rand();
     _steal_offset = OFFSET_TABLE[_steal_seed % ARRAY_SIZE(OFFSET_TABLE)];
-    _pl = &c->_pl[butil::fmix64(pthread_numeric_id()) % TaskControl::PARKING_LOT_NUM];
+    _pl = &c->_pl[tag][butil::fmix64(pthread_numeric_id()) %
+                       TaskControl::PARKING_LOT_NUM];
     CHECK(c);
 }
 
@@ -207,6 +267,7 @@ TaskGroup::~TaskGroup() {
         return_resource(get_slot(_main_tid));
         _main_tid = 0;
     }
+    delete _rq_wait.exchange(NULL, butil::memory_order_relaxed);
 }
 
 int TaskGroup::init(size_t runqueue_capacity) {
@@ -214,8 +275,8 @@ int TaskGroup::init(size_t runqueue_capacity) {
         LOG(FATAL) << "Fail to init _rq";
         return -1;
     }
-    if (_remote_rq.init(runqueue_capacity / 2) != 0) {
-        LOG(FATAL) << "Fail to init _remote_rq";
+    if (_hp_rq.init(runqueue_capacity) != 0) {
+        LOG(FATAL) << "Fail to init _hp_rq";
         return -1;
     }
     ContextualStack* stk = get_stack(STACK_TYPE_MAIN, NULL);
@@ -237,7 +298,9 @@ int TaskGroup::init(size_t runqueue_capacity) {
     m->local_storage = LOCAL_STORAGE_INIT;
     m->cpuwide_start_ns = butil::cpuwide_time_ns();
     m->stat = EMPTY_STAT;
+    m->enqueue_ns = 0;
     m->attr = BTHREAD_ATTR_TASKGROUP;
+    bthread_attr_settag(&m->attr, _tag);
     m->tid = make_tid(*m->version_butex, slot);
     m->set_stack(stk);
 
@@ -286,6 +349,12 @@ void TaskGroup::task_runner(intptr_t skip_remained) {
                 (butil::cpuwide_time_ns() - m->cpuwide_start_ns) / 1000L;
         }
 
+        const bool sample_stack = should_sample_stack_usage(
+            m->stack_type(), m->stack);
+        if (sample_stack) {
+            begin_stack_usage_sampling(m->stack);
+        }
+
         // Not catch exceptions except ExitException which is for implementing
         // bthread_exit(). User code is intended to crash when an exception is
         // not caught explicitly. This is consistent with other threading
@@ -296,6 +365,9 @@ void TaskGroup::task_runner(intptr_t skip_remained) {
         } catch (ExitException& e) {
             thread_return = e.value();
         }
+        if (sample_stack) {
+            end_stack_usage_sampling(m->stack, m->fn);
+        }
 
         // Group is probably changed
         g = tls_task_group;
@@ -346,11 +418,12 @@ void TaskGroup::task_runner(intptr_t skip_remained) {
 
 void TaskGroup::_release_last_context(void* arg) {
     TaskMeta* m = static_cast<TaskMeta*>(arg);
-    if (m->stack_type() != STACK_TYPE_PTHREAD) {
-        return_stack(m->release_stack()/*may be NULL*/);
-    } else {
-        // it's _main_stack, don't return.
+    if (m->stack_type() == STACK_TYPE_PTHREAD ||
+        (m->stack != NULL && m->stack->stacktype == STACK_TYPE_MAIN)) {
+        // it's _main_stack(stackless tasks may borrow it), don't return.
         m->set_stack(NULL);
+    } else {
+        return_stack(m->release_stack()/*may be NULL*/);
     }
     return_resource(get_slot(m->tid));
 }
@@ -378,12 +451,14 @@ int TaskGroup::start_foreground(TaskGroup** pg,
     m->arg = arg;
     CHECK(m->stack == NULL);
     m->attr = using_attr;
+    bthread_attr_settag(&m->attr, (*pg)->_tag);
     m->local_storage = LOCAL_STORAGE_INIT;
     if (using_attr.flags & BTHREAD_INHERIT_SPAN) {
         m->local_storage.rpcz_parent_span = tls_bls.rpcz_parent_span;
     }
     m->cpuwide_start_ns = start_ns;
     m->stat = EMPTY_STAT;
+    m->enqueue_ns = 0;
     m->tid = make_tid(*m->version_butex, slot);
     *th = m->tid;
     if (using_attr.flags & BTHREAD_LOG_START_AND_FINISH) {
@@ -436,12 +511,14 @@ int TaskGroup::start_background(bthread_t* __restrict th,
     m->arg = arg;
     CHECK(m->stack == NULL);
     m->attr = using_attr;
+    bthread_attr_settag(&m->attr, _tag);
     m->local_storage = LOCAL_STORAGE_INIT;
     if (using_attr.flags & BTHREAD_INHERIT_SPAN) {
         m->local_storage.rpcz_parent_span = tls_bls.rpcz_parent_span;
     }
     m->cpuwide_start_ns = start_ns;
     m->stat = EMPTY_STAT;
+    m->enqueue_ns = 0;
     m->tid = make_tid(*m->version_butex, slot);
     *th = m->tid;
     if (using_attr.flags & BTHREAD_LOG_START_AND_FINISH) {
@@ -514,15 +591,10 @@ void TaskGroup::ending_sched(TaskGroup** pg) {
     TaskGroup* g = *pg;
     bthread_t next_tid = 0;
     // Find next task to run, if none, switch to idle thread of the group.
-#ifndef BTHREAD_FAIR_WSQ
     // When BTHREAD_FAIR_WSQ is defined, profiling shows that cpu cost of
     // WSQ::steal() in example/multi_threaded_echo_c++ changes from 1.9%
     // to 2.9%
-    const bool popped = g->_rq.pop(&next_tid);
-#else
-    const bool popped = g->_rq.steal(&next_tid);
-#endif
-    if (!popped && !g->steal_task(&next_tid)) {
+    if (!g->pop_local_task(&next_tid) && !g->steal_task(&next_tid)) {
         // Jump to main task if there's no task to run.
         next_tid = g->_main_tid;
     }
@@ -530,9 +602,11 @@ void TaskGroup::ending_sched(TaskGroup** pg) {
     TaskMeta* const cur_meta = g->_cur_meta;
     TaskMeta* next_meta = address_meta(next_tid);
     if (next_meta->stack == NULL) {
-        if (next_meta->stack_type() == cur_meta->stack_type()) {
+        if (next_meta->stack_type() == cur_meta->stack_type() ||
+            next_meta->stack_type() == STACK_TYPE_NONE) {
             // also works with pthread_task scheduling to pthread_task, the
-            // transfered stack is just _main_stack.
+            // transfered stack is just _main_stack. Stackless tasks always
+            // continue on the stack of the ending task.
             next_meta->set_stack(cur_meta->release_stack());
         } else {
             ContextualStack* stk = get_stack(next_meta->stack_type(), task_runner);
@@ -555,12 +629,7 @@ void TaskGroup::sched(TaskGroup** pg) {
     TaskGroup* g = *pg;
     bthread_t next_tid = 0;
     // Find next task to run, if none, switch to idle thread of the group.
-#ifndef BTHREAD_FAIR_WSQ
-    const bool popped = g->_rq.pop(&next_tid);
-#else
-    const bool popped = g->_rq.steal(&next_tid);
-#endif
-    if (!popped && !g->steal_task(&next_tid)) {
+    if (!g->pop_local_task(&next_tid) && !g->steal_task(&next_tid)) {
         // Jump to main task if there's no task to run.
         next_tid = g->_main_tid;
     }
@@ -589,6 +658,10 @@ void TaskGroup::sched_to(TaskGroup** pg, TaskMeta* next_meta) {
     }
     ++cur_meta->stat.nswitch;
     ++ g->_nswitch;
+    if (next_meta->enqueue_ns) {
+        g->record_runqueue_wait(now - next_meta->enqueue_ns);
+        next_meta->enqueue_ns = 0;
+    }
     // Switch to the task
     if (__builtin_expect(next_meta != cur_meta, 1)) {
         g->_cur_meta = next_meta;
@@ -657,7 +730,7 @@ void TaskGroup::ready_to_run(bthread_t tid, bool nosignal) {
         const int additional_signal = _num_nosignal;
         _num_nosignal = 0;
         _nsignaled += 1 + additional_signal;
-        _control->signal_task(1 + additional_signal);
+        _control->signal_task(1 + additional_signal, _tag);
     }
 }
 
@@ -666,41 +739,55 @@ void TaskGroup::flush_nosignal_tasks() {
     if (val) {
         _num_nosignal = 0;
         _nsignaled += val;
-        _control->signal_task(val);
+        _control->signal_task(val, _tag);
     }
 }
 
 void TaskGroup::ready_to_run_remote(bthread_t tid, bool nosignal) {
-    _remote_rq._mutex.lock();
-    while (!_remote_rq.push_locked(tid)) {
-        flush_nosignal_tasks_remote_locked(_remote_rq._mutex);
-        LOG_EVERY_SECOND(ERROR) << "_remote_rq is full, capacity="
-                                << _remote_rq.capacity();
-        ::usleep(1000);
-        _remote_rq._mutex.lock();
+    TaskMeta* const m = address_meta(tid);
+    if (FLAGS_show_bthread_runqueue_wait_in_vars) {
+        m->enqueue_ns = butil::cpuwide_time_ns();
     }
+    (is_high_priority(m) ? _hp_remote_rq : _remote_rq).push(m);
     if (nosignal) {
-        ++_remote_num_nosignal;
-        _remote_rq._mutex.unlock();
+        _remote_num_nosignal.fetch_add(1, butil::memory_order_relaxed);
     } else {
-        const int additional_signal = _remote_num_nosignal;
-        _remote_num_nosignal = 0;
-        _remote_nsignaled += 1 + additional_signal;
-        _remote_rq._mutex.unlock();
-        _control->signal_task(1 + additional_signal);
+        const int additional_signal =
+            _remote_num_nosignal.exchange(0, butil::memory_order_relaxed);
+        _remote_nsignaled.fetch_add(1 + additional_signal,
+                                    butil::memory_order_relaxed);
+        _control->signal_task(1 + additional_signal, _tag);
     }
 }
 
-void TaskGroup::flush_nosignal_tasks_remote_locked(butil::Mutex& locked_mutex) {
-    const int val = _remote_num_nosignal;
-    if (!val) {
-        locked_mutex.unlock();
-        return;
+bool TaskGroup::pop_remote_tasks(RemoteTaskQueue* q, bthread_t* tid) {
+    TaskMeta* m = q->pop_all();
+    if (m == NULL) {
+        return false;
+    }
+    TaskMeta* first = m;
+    m = m->remote_next;
+    while (m) {
+        // Read next before the task becomes visible to other workers.
+        TaskMeta* const next = m->remote_next;
+        TaskMeta* to_push = m;
+        if (is_high_priority(m) && !is_high_priority(first)) {
+            to_push = first;
+            first = m;
+        }
+        if ((is_high_priority(to_push) ? _hp_rq : _rq).push(to_push->tid)) {
+            ++_num_nosignal;
+        } else {
+            // The queue is full, leave the task to be popped later.
+            (is_high_priority(to_push) ? _hp_remote_rq : _remote_rq)
+                .push(to_push);
+        }
+        m = next;
     }
-    _remote_num_nosignal = 0;
-    _remote_nsignaled += val;
-    locked_mutex.unlock();
-    _control->signal_task(val);
+    *tid = first->tid;
+    // Workers signalled for the tasks may have missed them during the move.
+    flush_nosignal_tasks();
+    return true;
 }
 
 void TaskGroup::ready_to_run_general(bthread_t tid, bool nosignal) {
@@ -717,6 +804,20 @@ void TaskGroup::flush_nosignal_tasks_general() {
     return flush_nosignal_tasks_remote();
 }
 
+void TaskGroup::record_runqueue_wait(int64_t wait_ns) {
+    bvar::LatencyRecorder* r = _rq_wait.load(butil::memory_order_relaxed);
+    if (r == NULL) {
+        // Only the worker of this group writes _rq_wait.
+        r = new bvar::LatencyRecorder;
+        _rq_wait.store(r, butil::memory_order_release);
+    }
+    const int64_t wait_us = wait_ns / 1000L;
+    *r << wait_us;
+    // NOTE: the worker triggering exposure of runqueue wait may spend
+    // considerable time, same as exposed_pending_time().
+    _control->exposed_runqueue_wait() << wait_us;
+}
+
 void TaskGroup::ready_to_run_in_worker(void* args_in) {
     ReadyToRunArgs* args = static_cast<ReadyToRunArgs*>(args_in);
     return tls_task_group->ready_to_run(args->tid, args->nosignal);
@@ -737,7 +838,8 @@ struct SleepArgs {
 static void ready_to_run_from_timer_thread(void* arg) {
     CHECK(tls_task_group == NULL);
     const SleepArgs* e = static_cast<const SleepArgs*>(arg);
-    e->group->control()->choose_one_group()->ready_to_run_remote(e->tid);
+    e->group->control()->choose_one_group(e->group->tag())
+        ->ready_to_run_remote(e->tid);
 }
 
 void TaskGroup::_add_sleep_event(void* void_args) {
@@ -874,13 +976,14 @@ int TaskGroup::interrupt(bthread_t tid, TaskControl* c) {
     } else if (sleep_id != 0) {
         if (get_global_timer_thread()->unschedule(sleep_id) == 0) {
             bthread::TaskGroup* g = bthread::tls_task_group;
-            if (g) {
+            const bthread_tag_t tag = bthread_attr_gettag(&address_meta(tid)->attr);
+            if (g && g->tag() == tag) {
                 g->ready_to_run(tid);
             } else {
                 if (!c) {
                     return EINVAL;
                 }
-                c->choose_one_group()->ready_to_run_remote(tid);
+                c->choose_one_group(tag)->ready_to_run_remote(tid);
             }
         }
     }
@@ -22,6 +22,7 @@
 #ifndef BTHREAD_TASK_GROUP_H
 #define BTHREAD_TASK_GROUP_H
 
+#include <gflags/gflags.h>                          // DECLARE_bool
 #include "butil/time.h"                             // cpuwide_time_ns
 #include "bthread/task_control.h"
 #include "bthread/task_meta.h"                     // bthread_t, TaskMeta
@@ -30,8 +31,15 @@
 #include "butil/resource_pool.h"                    // ResourceId
 #include "bthread/parking_lot.h"
 
+namespace bvar {
+class LatencyRecorder;
+}
+
 namespace bthread {
 
+// Defined in task_group.cpp
+DECLARE_bool(show_bthread_runqueue_wait_in_vars);
+
 // For exiting a bthread.
 class ExitException : public std::exception {
 public:
@@ -157,9 +165,15 @@ public:
 
     // Push a bthread into the runqueue from another non-worker thread.
     void ready_to_run_remote(bthread_t tid, bool nosignal = false);
-    void flush_nosignal_tasks_remote_locked(butil::Mutex& locked_mutex);
     void flush_nosignal_tasks_remote();
 
+    // Take all tasks in `q' (the remote queue of this or another group),
+    // put the first one (the first high-priority one if any) in `tid' and
+    // others into _rq or _hp_rq to run in batch.
+    // Must be called by the worker of this group.
+    // Returns false if `q' is empty.
+    bool pop_remote_tasks(RemoteTaskQueue* q, bthread_t* tid);
+
     // Automatically decide the caller is remote or local, and call
     // the corresponding function.
     void ready_to_run_general(bthread_t tid, bool nosignal = false);
@@ -168,6 +182,9 @@ public:
     // The TaskControl that this TaskGroup belongs to.
     TaskControl* control() const { return _control; }
 
+    // Tag of the worker pool that this TaskGroup belongs to.
+    bthread_tag_t tag() const { return _tag; }
+
     // Call this instead of delete.
     void destroy_self();
 
@@ -178,15 +195,25 @@ public:
     // Get the meta associate with the task.
     static TaskMeta* address_meta(bthread_t tid);
 
-    // Push a task into _rq, if _rq is full, retry after some time. This
+    // Pop a task from _hp_rq, _hp_remote_rq or _rq of this group.
+    bool pop_local_task(bthread_t* tid);
+
+    // Push a task into _rq (or _hp_rq for high-priority tasks), if the queue
+    // is full, retry after some time. This
     // process make go on indefinitely.
     void push_rq(bthread_t tid);
 
+    // Time (in microseconds) that tasks waited in runqueues before running
+    // on this worker, NULL if -show_bthread_runqueue_wait_in_vars was never
+    // turned on.
+    bvar::LatencyRecorder* runqueue_wait() const
+    { return _rq_wait.load(butil::memory_order_acquire); }
+
 private:
 friend class TaskControl;
 
     // You shall use TaskControl::create_group to create new instance.
-    explicit TaskGroup(TaskControl*);
+    TaskGroup(TaskControl*, bthread_tag_t tag);
 
     int init(size_t runqueue_capacity);
 
@@ -206,19 +233,25 @@ friend class TaskControl;
     static void ready_to_run_in_worker(void*);
     static void ready_to_run_in_worker_ignoresignal(void*);
 
+    void record_runqueue_wait(int64_t wait_ns);
+
     // Wait for a task to run.
     // Returns true on success, false is treated as permanent error and the
     // loop calling this function should end.
     bool wait_task(bthread_t* tid);
 
+    // Keep stealing for -bthread_busy_poll_us before parking.
+    bool busy_poll_task(bthread_t* tid);
+
     bool steal_task(bthread_t* tid) {
-        if (_remote_rq.pop(tid)) {
+        if (pop_remote_tasks(&_hp_remote_rq, tid) ||
+            pop_remote_tasks(&_remote_rq, tid)) {
             return true;
         }
 #ifndef BTHREAD_DONT_SAVE_PARKING_STATE
         _last_pl_state = _pl->get_state();
 #endif
-        return _control->steal_task(tid, &_steal_seed, _steal_offset);
+        return _control->steal_task(this, tid);
     }
 
 #ifndef NDEBUG
@@ -239,18 +272,37 @@ friend class TaskControl;
     RemainedFn _last_context_remained;
     void* _last_context_remained_arg;
 
+    // Pool of the group, tasks are only stolen from groups with same tag.
+    bthread_tag_t _tag;
     ParkingLot* _pl;
 #ifndef BTHREAD_DONT_SAVE_PARKING_STATE
     ParkingLot::State _last_pl_state;
 #endif
     size_t _steal_seed;
     size_t _steal_offset;
+    // NUMA node that the worker is bound to, -1 when NUMA-aware scheduling
+    // is off.
+    int _numa_node;
+    // Tasks stolen from groups on the same/other NUMA nodes.
+    size_t _nlocal_steal;
+    size_t _nremote_steal;
+    // Tasks stolen from other groups.
+    size_t _nsteal;
+    // Times that the worker was woken up but found no task to run.
+    size_t _nwakeup_failure;
+    // Created by the worker on demand.
+    butil::atomic<bvar::LatencyRecorder*> _rq_wait;
     ContextualStack* _main_stack;
     bthread_t _main_tid;
     WorkStealingQueue<bthread_t> _rq;
+    // Tasks created with BTHREAD_HIGH_PRIORITY, popped and stolen before
+    // tasks in _rq.
+    WorkStealingQueue<bthread_t> _hp_rq;
     RemoteTaskQueue _remote_rq;
-    int _remote_num_nosignal;
-    int _remote_nsignaled;
+    // High-priority tasks from non-workers, popped before tasks in _rq.
+    RemoteTaskQueue _hp_remote_rq;
+    butil::atomic<int> _remote_num_nosignal;
+    butil::atomic<int> _remote_nsignaled;
 };
 
 }  // namespace bthread
@@ -63,7 +63,10 @@ inline void TaskGroup::sched_to(TaskGroup** pg, bthread_t next_tid) {
     TaskMeta* next_meta = address_meta(next_tid);
     if (next_meta->stack == NULL) {
         ContextualStack* stk = get_stack(next_meta->stack_type(), task_runner);
-        if (stk) {
+        if (next_meta->stack_type() == STACK_TYPE_NONE) {
+            // Stackless task runs in the worker pthread directly.
+            next_meta->set_stack((*pg)->_main_stack);
+        } else if (stk) {
             next_meta->set_stack(stk);
         } else {
             // stack_type is BTHREAD_STACKTYPE_PTHREAD or out of memory,
@@ -78,8 +81,31 @@ inline void TaskGroup::sched_to(TaskGroup** pg, bthread_t next_tid) {
     sched_to(pg, next_meta);
 }
 
+inline bool TaskGroup::pop_local_task(bthread_t* tid) {
+    // High-priority tasks woken up by non-workers are in _hp_remote_rq,
+    // they should not wait for local normal tasks either.
+#ifndef BTHREAD_FAIR_WSQ
+    return _hp_rq.pop(tid) ||
+        (!_hp_remote_rq.empty() && pop_remote_tasks(&_hp_remote_rq, tid)) ||
+        _rq.pop(tid);
+#else
+    return _hp_rq.steal(tid) ||
+        (!_hp_remote_rq.empty() && pop_remote_tasks(&_hp_remote_rq, tid)) ||
+        _rq.steal(tid);
+#endif
+}
+
+inline bool is_high_priority(const TaskMeta* m) {
+    return m->attr.flags & BTHREAD_HIGH_PRIORITY;
+}
+
 inline void TaskGroup::push_rq(bthread_t tid) {
-    while (!_rq.push(tid)) {
+    TaskMeta* const m = address_meta(tid);
+    if (FLAGS_show_bthread_runqueue_wait_in_vars) {
+        m->enqueue_ns = butil::cpuwide_time_ns();
+    }
+    WorkStealingQueue<bthread_t>& rq = (is_high_priority(m) ? _hp_rq : _rq);
+    while (!rq.push(tid)) {
         // Created too many bthreads: a promising approach is to insert the
         // task into another TaskGroup, but we don't use it because:
         // * There're already many bthreads to run, inserting the bthread
@@ -88,7 +114,7 @@ inline void TaskGroup::push_rq(bthread_t tid) {
         //   are busy at creating bthreads (proved by test_input_messenger in
         //   brpc)
         flush_nosignal_tasks();
-        LOG_EVERY_SECOND(ERROR) << "_rq is full, capacity=" << _rq.capacity();
+        LOG_EVERY_SECOND(ERROR) << "_rq is full, capacity=" << rq.capacity();
         // TODO(gejun): May cause deadlock when all workers are spinning here.
         // A better solution is to pop and run existing bthreads, however which
         // make set_remained()-callbacks do context switches and need extensive
@@ -98,9 +124,13 @@ inline void TaskGroup::push_rq(bthread_t tid) {
 }
 
 inline void TaskGroup::flush_nosignal_tasks_remote() {
-    if (_remote_num_nosignal) {
-        _remote_rq._mutex.lock();
-        flush_nosignal_tasks_remote_locked(_remote_rq._mutex);
+    if (_remote_num_nosignal.load(butil::memory_order_relaxed)) {
+        const int val =
+            _remote_num_nosignal.exchange(0, butil::memory_order_relaxed);
+        if (val) {
+            _remote_nsignaled.fetch_add(val, butil::memory_order_relaxed);
+            _control->signal_task(val, _tag);
+        }
     }
 }
 
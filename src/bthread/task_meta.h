@@ -81,10 +81,17 @@ struct TaskMeta {
 
     // Attributes creating this task
     bthread_attr_t attr;
+
+    // Next task in the RemoteTaskQueue containing this task.
+    TaskMeta* remote_next;
     
     // Statistics
     int64_t cpuwide_start_ns;
     TaskStatistics stat;
+    // When the task was pushed into a runqueue, recorded only when
+    // -show_bthread_runqueue_wait_in_vars is on. 0 otherwise or after the
+    // task is scheduled.
+    int64_t enqueue_ns;
 
     // bthread local storage, sync with tls_bls (defined in task_group.cpp)
     // when the bthread is created or destroyed.
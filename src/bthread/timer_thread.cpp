@@ -18,7 +18,10 @@
 // bthread - A M:N threading library to make applications more concurrent.
 
 
+#include <string.h>                        // memset
 #include <queue>                           // heap functions
+#include <memory>                          // std::unique_ptr
+#include <gflags/gflags.h>
 #include "butil/scoped_lock.h"
 #include "butil/logging.h"
 #include "butil/third_party/murmurhash3/murmurhash3.h"   // fmix64
@@ -28,6 +31,11 @@
 #include "bthread/timer_thread.h"
 #include "bthread/log.h"
 
+DEFINE_bool(bthread_timer_use_wheel, false,
+            "Order tasks of the global TimerThread with a hierarchical "
+            "timing wheel of 1ms precision instead of a min-heap. Must be "
+            "set before any bthread is created");
+
 namespace bthread {
 
 // Defined in task_control.cpp
@@ -36,7 +44,9 @@ void run_worker_startfn();
 const TimerThread::TaskId TimerThread::INVALID_TASK_ID = 0;
 
 TimerThreadOptions::TimerThreadOptions()
-    : num_buckets(13) {
+    : num_buckets(13)
+    , use_timing_wheel(false)
+    , wheel_tick_us(1000) {
 }
 
 // A task contains the necessary information for running fn(arg).
@@ -96,6 +106,45 @@ private:
     Task* _task_head;
 };
 
+// Hierarchical timing wheel to order tasks in the timer thread, see
+// "Hashed and Hierarchical Timing Wheels" by Varghese and Lauck. Slots at
+// level 0 hold tasks of the next NSLOT ticks, a slot at level L covers
+// NSLOT^L ticks and is cascaded into lower levels when the wheel reaches
+// it. Adding a task is O(1) and each task is cascaded at most NLEVEL-1
+// times. Only touched by the timer thread, no locking.
+class TimerThread::Wheel {
+public:
+    static const int LEVEL_BITS = 8;
+    static const int NLEVEL = 4;
+    static const int64_t NSLOT = 1L << LEVEL_BITS;
+    static const int64_t SLOT_MASK = NSLOT - 1;
+
+    Wheel(int64_t tick_us, int64_t now_us)
+        : _tick_us(tick_us), _cur(now_us / tick_us) {
+        memset(_ntask, 0, sizeof(_ntask));
+        memset(_slots, 0, sizeof(_slots));
+    }
+
+    // Add a not-unscheduled task, task->next is overwritten.
+    void add(Task* task);
+
+    // Run tasks whose run_time is not later than `now_us'.
+    // Returns number of tasks that did run.
+    size_t run_until(int64_t now_us);
+
+    // The realtime that run_until() should be called again, max of int64
+    // if the wheel is empty.
+    int64_t next_run_time() const;
+
+private:
+    void cascade(int level, int64_t index);
+
+    const int64_t _tick_us;
+    int64_t _cur;                   // the next tick to run
+    size_t _ntask[NLEVEL];
+    Task* _slots[NLEVEL][NSLOT];
+};
+
 // Utilies for making and extracting TaskId.
 inline TimerThread::TaskId make_task_id(
     butil::ResourceId<TimerThread::Task> slot, uint32_t version) {
@@ -151,6 +200,11 @@ int TimerThread::start(const TimerThreadOptions* options_in) {
         LOG(ERROR) << "num_buckets=" << _options.num_buckets << " is too big";
         return EINVAL;
     }
+    if (_options.use_timing_wheel && _options.wheel_tick_us <= 0) {
+        LOG(ERROR) << "wheel_tick_us=" << _options.wheel_tick_us
+                   << " must be positive";
+        return EINVAL;
+    }
     _buckets = new (std::nothrow) Bucket[_options.num_buckets];
     if (NULL == _buckets) {
         LOG(ERROR) << "Fail to new _buckets";
@@ -305,6 +359,108 @@ bool TimerThread::Task::try_delete() {
     return false;
 }
 
+void TimerThread::Wheel::add(Task* task) {
+    // Never run a task before its run_time.
+    int64_t expires = (task->run_time + _tick_us - 1) / _tick_us;
+    if (expires < _cur) {
+        expires = _cur;
+    }
+    const int64_t delta = expires - _cur;
+    int level = 0;
+    while (level < NLEVEL - 1 && delta >= (NSLOT << (level * LEVEL_BITS))) {
+        ++level;
+    }
+    if (delta >= (1L << (NLEVEL * LEVEL_BITS))) {
+        // Too far away, park it in the farthest slot, it will be added
+        // again when the slot is cascaded.
+        expires = _cur + (1L << (NLEVEL * LEVEL_BITS)) - 1;
+    }
+    Task** const slot =
+        &_slots[level][(expires >> (level * LEVEL_BITS)) & SLOT_MASK];
+    task->next = *slot;
+    *slot = task;
+    ++_ntask[level];
+}
+
+void TimerThread::Wheel::cascade(int level, int64_t index) {
+    Task* p = _slots[level][index];
+    _slots[level][index] = NULL;
+    while (p != NULL) {
+        Task* next_task = p->next;
+        --_ntask[level];
+        if (!p->try_delete()) {
+            add(p);
+        }
+        p = next_task;
+    }
+}
+
+size_t TimerThread::Wheel::run_until(int64_t now_us) {
+    const int64_t last = now_us / _tick_us;
+    size_t ntriggered = 0;
+    while (_cur <= last) {
+        int64_t index = (_cur & SLOT_MASK);
+        if (index != 0 && _ntask[0] == 0) {
+            // Nothing to run before the next cascading of the lowest
+            // non-empty level, skip the empty ticks.
+            int level = 1;
+            while (level < NLEVEL && _ntask[level] == 0) {
+                ++level;
+            }
+            if (level == NLEVEL) {
+                _cur = last + 1;
+                break;
+            }
+            const int64_t step = (1L << (level * LEVEL_BITS));
+            _cur = std::min((_cur + step - 1) / step * step, last + 1);
+            continue;
+        }
+        if (index == 0) {
+            for (int level = 1; level < NLEVEL; ++level) {
+                const int64_t i = (_cur >> (level * LEVEL_BITS)) & SLOT_MASK;
+                cascade(level, i);
+                if (i != 0) {
+                    break;
+                }
+            }
+        }
+        Task* p = _slots[0][index];
+        _slots[0][index] = NULL;
+        ++_cur;
+        while (p != NULL) {
+            Task* next_task = p->next;
+            --_ntask[0];
+            if (p->run_and_delete()) {
+                ++ntriggered;
+            }
+            p = next_task;
+        }
+    }
+    return ntriggered;
+}
+
+int64_t TimerThread::Wheel::next_run_time() const {
+    int level = 0;
+    while (level < NLEVEL && _ntask[level] == 0) {
+        ++level;
+    }
+    if (level == NLEVEL) {
+        return std::numeric_limits<int64_t>::max();
+    }
+    if (level == 0) {
+        const int64_t end = (_cur | SLOT_MASK) + 1;
+        for (int64_t t = _cur; t < end; ++t) {
+            if (_slots[0][t & SLOT_MASK] != NULL) {
+                return t * _tick_us;
+            }
+        }
+        // Remaining tasks at level 0 are after the next cascading.
+        return end * _tick_us;
+    }
+    const int64_t step = (1L << (level * LEVEL_BITS));
+    return (_cur + step - 1) / step * step * _tick_us;
+}
+
 template <typename T>
 static T deref_value(void* arg) {
     return *(T*)arg;
@@ -321,7 +477,12 @@ void TimerThread::run() {
 
     // min heap of tasks (ordered by run_time)
     std::vector<Task*> tasks;
-    tasks.reserve(4096);
+    std::unique_ptr<Wheel> wheel;
+    if (_options.use_timing_wheel) {
+        wheel.reset(new Wheel(_options.wheel_tick_us, last_sleep_time));
+    } else {
+        tasks.reserve(4096);
+    }
 
     // vars
     size_t nscheduled = 0;
@@ -357,14 +518,23 @@ void TimerThread::run() {
                 Task* next_task = p->next;
 
                 if (!p->try_delete()) { // remove the task if it's unscheduled
-                    tasks.push_back(p);
-                    std::push_heap(tasks.begin(), tasks.end(), task_greater);
+                    if (wheel) {
+                        wheel->add(p);
+                    } else {
+                        tasks.push_back(p);
+                        std::push_heap(tasks.begin(), tasks.end(), task_greater);
+                    }
                 }
                 p = next_task;
             }
         }
 
         bool pull_again = false;
+        if (wheel) {
+            // Tasks are run tick by tick, new tasks earlier than the ones
+            // being run are at most one tick later, no need to pull again.
+            ntriggered += wheel->run_until(butil::gettimeofday_us());
+        }
         while (!tasks.empty()) {
             Task* task1 = tasks[0];  // the about-to-run task
             if (butil::gettimeofday_us() < task1->run_time) {  // not ready yet.
@@ -401,7 +571,9 @@ void TimerThread::run() {
 
         // The realtime to wait for.
         int64_t next_run_time = std::numeric_limits<int64_t>::max();
-        if (!tasks.empty()) {
+        if (wheel) {
+            next_run_time = wheel->next_run_time();
+        } else if (!tasks.empty()) {
             next_run_time = tasks[0]->run_time;
         }
         // Similarly with the situation before running tasks, we check
@@ -462,6 +634,7 @@ static void init_global_timer_thread() {
     }
     TimerThreadOptions options;
     options.bvar_prefix = "bthread_timer";
+    options.use_timing_wheel = FLAGS_bthread_timer_use_wheel;
     const int rc = g_timer_thread->start(&options);
     if (rc != 0) {
         LOG(FATAL) << "Fail to start timer_thread, " << berror(rc);
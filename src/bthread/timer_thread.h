@@ -43,6 +43,19 @@ struct TimerThreadOptions {
     // Default: ""
     std::string bvar_prefix;
 
+    // Order tasks in the timer thread with a hierarchical timing wheel
+    // instead of a min-heap, which makes adding a task O(1) rather than
+    // O(log N). N includes unscheduled tasks which are not deleted until
+    // their run time, thus the wheel scales better when lots of timers are
+    // scheduled and unscheduled, e.g. timeouts of RPC. Tasks run at the
+    // granularity of `wheel_tick_us', never earlier than requested.
+    // Default: false
+    bool use_timing_wheel;
+
+    // Precision of the timing wheel in microseconds.
+    // Default: 1000
+    int64_t wheel_tick_us;
+
     // Constructed with default options.
     TimerThreadOptions();
 };
@@ -54,6 +67,7 @@ class TimerThread {
 public:
     struct Task;
     class Bucket;
+    class Wheel;
 
     typedef uint64_t TaskId;
     const static TaskId INVALID_TASK_ID;
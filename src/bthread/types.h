@@ -40,6 +40,7 @@ static const bthread_stacktype_t BTHREAD_STACKTYPE_PTHREAD = 1;
 static const bthread_stacktype_t BTHREAD_STACKTYPE_SMALL = 2;
 static const bthread_stacktype_t BTHREAD_STACKTYPE_NORMAL = 3;
 static const bthread_stacktype_t BTHREAD_STACKTYPE_LARGE = 4;
+static const bthread_stacktype_t BTHREAD_STACKTYPE_NONE = 5;
 
 typedef unsigned bthread_attrflags_t;
 static const bthread_attrflags_t BTHREAD_LOG_START_AND_FINISH = 8;
@@ -47,6 +48,18 @@ static const bthread_attrflags_t BTHREAD_LOG_CONTEXT_SWITCH = 16;
 static const bthread_attrflags_t BTHREAD_NOSIGNAL = 32;
 static const bthread_attrflags_t BTHREAD_NEVER_QUIT = 64;
 static const bthread_attrflags_t BTHREAD_INHERIT_SPAN = 128;
+// Run the bthread before normal ones whenever it's ready. Meant for short
+// and latency-sensitive tasks, a flood of high-priority bthreads starves
+// others.
+static const bthread_attrflags_t BTHREAD_HIGH_PRIORITY = 256;
+
+// Workers are divided into pools identified by tags, see bthread_attr_settag
+// and -task_group_ntags. A bthread only runs in workers of its pool.
+typedef int bthread_tag_t;
+// Run in the pool of the creator, or the default pool if the creator is not
+// a worker.
+static const bthread_tag_t BTHREAD_TAG_INVALID = -1;
+static const bthread_tag_t BTHREAD_TAG_DEFAULT = 0;
 
 // Key of thread-local data, created by bthread_key_create.
 typedef struct {
@@ -93,12 +106,17 @@ typedef struct bthread_attr_t {
     bthread_stacktype_t stack_type;
     bthread_attrflags_t flags;
     bthread_keytable_pool_t* keytable_pool;
+    // Tag of the pool plus one, so that zero (e.g. attributes initialized
+    // without this field) means BTHREAD_TAG_INVALID. Use bthread_attr_settag
+    // and bthread_attr_gettag instead of accessing it directly.
+    bthread_tag_t tag_plus_one;
 
 #if defined(__cplusplus)
     void operator=(unsigned stacktype_and_flags) {
         stack_type = (stacktype_and_flags & 7);
         flags = (stacktype_and_flags & ~(unsigned)7u);
         keytable_pool = NULL;
+        tag_plus_one = 0;
     }
     bthread_attr_t operator|(unsigned other_flags) const {
         CHECK(!(other_flags & 7)) << "flags=" << other_flags;
@@ -109,6 +127,15 @@ typedef struct bthread_attr_t {
 #endif  // __cplusplus
 } bthread_attr_t;
 
+static inline void bthread_attr_settag(bthread_attr_t* attr,
+                                       bthread_tag_t tag) {
+    attr->tag_plus_one = tag + 1;
+}
+
+static inline bthread_tag_t bthread_attr_gettag(const bthread_attr_t* attr) {
+    return attr->tag_plus_one - 1;
+}
+
 // bthreads started with this attribute will run on stack of worker pthread and
 // all bthread functions that would block the bthread will block the pthread.
 // The bthread will not allocate its own stack, simply occupying a little meta
@@ -116,23 +143,34 @@ typedef struct bthread_attr_t {
 // obvious drawback is that you need more worker pthreads when you have a lot
 // of such bthreads.
 static const bthread_attr_t BTHREAD_ATTR_PTHREAD =
-{ BTHREAD_STACKTYPE_PTHREAD, 0, NULL };
+{ BTHREAD_STACKTYPE_PTHREAD, 0, NULL, 0 };
+
+// bthreads started with this attribute don't have stacks and run on the
+// stack of the bthread which just finished in the same worker, or the stack
+// of the worker pthread, without context switching. Stacks are neither
+// allocated nor cached for them, which makes running lots of tiny tasks
+// cheaper. The function MUST NOT block: waiting on a butex (bthread_mutex,
+// bthread_cond, bthread_join...) is checked in debug mode, otherwise it
+// may block the worker pthread like BTHREAD_ATTR_PTHREAD does.
+static const bthread_attr_t BTHREAD_ATTR_STACKLESS =
+{ BTHREAD_STACKTYPE_NONE, 0, NULL, 0 };
 
 // bthreads created with following attributes will have different size of
 // stacks. Default is BTHREAD_ATTR_NORMAL.
 static const bthread_attr_t BTHREAD_ATTR_SMALL =
-{ BTHREAD_STACKTYPE_SMALL, 0, NULL };
+{ BTHREAD_STACKTYPE_SMALL, 0, NULL, 0 };
 static const bthread_attr_t BTHREAD_ATTR_NORMAL =
-{ BTHREAD_STACKTYPE_NORMAL, 0, NULL };
+{ BTHREAD_STACKTYPE_NORMAL, 0, NULL, 0 };
 static const bthread_attr_t BTHREAD_ATTR_LARGE =
-{ BTHREAD_STACKTYPE_LARGE, 0, NULL };
+{ BTHREAD_STACKTYPE_LARGE, 0, NULL, 0 };
 
 // bthreads created with this attribute will print log when it's started,
 // context-switched, finished.
 static const bthread_attr_t BTHREAD_ATTR_DEBUG = {
     BTHREAD_STACKTYPE_NORMAL,
     BTHREAD_LOG_START_AND_FINISH | BTHREAD_LOG_CONTEXT_SWITCH,
-    NULL
+    NULL,
+    0
 };
 
 static const size_t BTHREAD_EPOLL_THREAD_NUM = 1;
@@ -142,6 +180,9 @@ static const bthread_t BTHREAD_ATOMIC_INIT = 0;
 static const int BTHREAD_MIN_CONCURRENCY = 3 + BTHREAD_EPOLL_THREAD_NUM;
 static const int BTHREAD_MAX_CONCURRENCY = 1024;
 
+// Max number of worker pools, see -task_group_ntags.
+static const int BTHREAD_MAX_TAG_NUM = 8;
+
 typedef struct {
     void* impl;
     // following fields are part of previous impl. and not used right now.
@@ -175,9 +216,15 @@ typedef struct {
 } bthread_condattr_t;
 
 typedef struct {
+    void* reader_slots;        // counters of readers, see rwlock.cpp
+    unsigned* writer_butex;    // 1 when a writer holds or waits for the lock
+    unsigned* reader_butex;    // bumped by readers leaving before a writer
+    bthread_mutex_t writer_mutex;
+    unsigned write_locked;
 } bthread_rwlock_t;
 
 typedef struct {
+    int kind;
 } bthread_rwlockattr_t;
 
 typedef struct {
@@ -79,6 +79,19 @@ extern int bthread_close(int fd);
 extern int bthread_connect(int sockfd, const struct sockaddr* serv_addr,
                            socklen_t addrlen);
 
+// Create a bthread to run fn(arg) in one of the workers whose index modulo
+// `nset' is `set'. Workers are indexed by the order of being started.
+// If the caller is such a worker, this function behaves like
+// bthread_start_urgent(), otherwise the bthread is queued in a random worker
+// of the set like bthread_start_background() does. Notice that idle workers
+// out of the set may still steal the bthread.
+// Returns 0 on success, errno otherwise.
+extern int bthread_start_in_worker_set(bthread_t* __restrict tid,
+                                       const bthread_attr_t* __restrict attr,
+                                       void * (*fn)(void*),
+                                       void* __restrict arg,
+                                       int set, int nset);
+
 // Add a startup function that each pthread worker will run at the beginning
 // To run code at the end, use butil::thread_atexit()
 // Returns 0 on success, error code otherwise.
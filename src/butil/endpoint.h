@@ -136,6 +136,11 @@ int tcp_connect(EndPoint server, int* self_port);
 // Returns the socket descriptor, -1 otherwise and errno is set.
 int tcp_listen(EndPoint ip_and_port);
 
+// Same as above, but enable SO_REUSEPORT iff `reuse_port' is true rather
+// than checking -reuse_port. Sockets bound to one address with SO_REUSEPORT
+// share incoming connections.
+int tcp_listen(EndPoint ip_and_port, bool reuse_port);
+
 // Get the local end of a socket connection
 int get_local_side(int fd, EndPoint *out);
 
@@ -25,6 +25,9 @@
 #include <mesalink/openssl/err.h>
 #endif
 #include <sys/syscall.h>                   // syscall
+#include <sys/mman.h>                      // mmap, madvise
+#include <pthread.h>
+#include <gflags/gflags.h>
 #include <fcntl.h>                         // O_RDONLY
 #include <errno.h>                         // errno
 #include <limits.h>                        // CHAR_BIT
@@ -35,8 +38,19 @@
 #include "butil/macros.h"                   // BAIDU_CASSERT
 #include "butil/logging.h"                  // CHECK, LOG
 #include "butil/fd_guard.h"                 // butil::fd_guard
+#include "butil/scoped_lock.h"              // BAIDU_SCOPED_LOCK
+#include "butil/simd_find.h"                // find_bytes
 #include "butil/iobuf.h"
 
+DEFINE_bool(iobuf_use_hugepages, false, "Carve IOBuf blocks from 2MB "
+            "hugepage-backed arenas with per-thread free lists instead of "
+            "malloc to reduce TLB misses. Transparent hugepages are used "
+            "when there're no reserved ones. Memory of the arenas is never "
+            "returned to the system");
+DEFINE_bool(iobuf_use_large_blocks, false, "Copy data of at least 64KB "
+            "appended to IOBuf at once into 64KB/1MB blocks instead of 8KB "
+            "ones, so that large attachments are held by fewer blocks");
+
 namespace butil {
 namespace iobuf {
 
@@ -172,8 +186,180 @@ butil::static_atomic<size_t> g_nblock = BUTIL_STATIC_ATOMIC_INIT(0);
 butil::static_atomic<size_t> g_blockmem = BUTIL_STATIC_ATOMIC_INIT(0);
 butil::static_atomic<size_t> g_newbigview = BUTIL_STATIC_ATOMIC_INIT(0);
 
+// === Size classes of blocks ===
+const size_t BLOCK_SIZE_CLASSES[] = {
+    IOBuf::DEFAULT_BLOCK_SIZE, 64 * 1024, 1024 * 1024 };
+const int NUM_BLOCK_SIZE_CLASSES = arraysize(BLOCK_SIZE_CLASSES);
+butil::static_atomic<size_t> g_nblock_of_class[NUM_BLOCK_SIZE_CLASSES] = {
+    BUTIL_STATIC_ATOMIC_INIT(0), BUTIL_STATIC_ATOMIC_INIT(0),
+    BUTIL_STATIC_ATOMIC_INIT(0) };
+
+// Returns index of the class, -1 if `block_size' matches none of them.
+inline int block_size_class(size_t block_size) {
+    for (int i = 0; i < NUM_BLOCK_SIZE_CLASSES; ++i) {
+        if (block_size == BLOCK_SIZE_CLASSES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// === Hugepage-backed arenas ===
+// Memory of blocks in size classes is carved from 2MB arenas aligned to 2MB,
+// free blocks are cached in TLS and exchanged with the global pool in
+// batches. Arenas are never unmapped.
+const size_t HUGEPAGE_ARENA_SIZE = 2 * 1024 * 1024;
+// Max number of free blocks cached in each thread, 1MB for each class.
+const size_t MAX_FREE_BLOCKS_PER_THREAD[NUM_BLOCK_SIZE_CLASSES] = { 128, 16, 1 };
+
+struct FreeChunk {
+    FreeChunk* next;
+};
+
+struct FreeList {
+    FreeChunk* head;
+    size_t size;
+
+    void push(void* mem) {
+        FreeChunk* c = static_cast<FreeChunk*>(mem);
+        c->next = head;
+        head = c;
+        ++size;
+    }
+    void* pop() {
+        FreeChunk* c = head;
+        head = c->next;
+        --size;
+        return c;
+    }
+};
+
+static pthread_mutex_t g_hugepage_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FreeList g_hugepage_pool[NUM_BLOCK_SIZE_CLASSES];
+butil::static_atomic<size_t> g_hugepage_arena_memory = BUTIL_STATIC_ATOMIC_INIT(0);
+
+struct HugePageTLSData {
+    FreeList free_lists[NUM_BLOCK_SIZE_CLASSES];
+    bool registered;
+};
+static __thread HugePageTLSData g_hugepage_tls_data;
+
+static char* new_hugepage_arena() {
+#if defined(OS_LINUX)
+    void* p = mmap(NULL, HUGEPAGE_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        g_hugepage_arena_memory.fetch_add(HUGEPAGE_ARENA_SIZE,
+                                          butil::memory_order_relaxed);
+        return (char*)p;
+    }
+#endif
+    // No reserved hugepages. Map twice the size to get an aligned arena
+    // which can be backed by a transparent hugepage.
+    const size_t len = HUGEPAGE_ARENA_SIZE * 2;
+    char* const q = (char*)mmap(NULL, len, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q == (char*)MAP_FAILED) {
+        PLOG(ERROR) << "Fail to mmap arena of IOBuf blocks";
+        return NULL;
+    }
+    char* const arena = (char*)(((uintptr_t)q + HUGEPAGE_ARENA_SIZE - 1) &
+                                ~(uintptr_t)(HUGEPAGE_ARENA_SIZE - 1));
+    if (arena != q) {
+        munmap(q, arena - q);
+    }
+    if (arena + HUGEPAGE_ARENA_SIZE != q + len) {
+        munmap(arena + HUGEPAGE_ARENA_SIZE, q + len - arena - HUGEPAGE_ARENA_SIZE);
+    }
+#if defined(MADV_HUGEPAGE)
+    madvise(arena, HUGEPAGE_ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+    g_hugepage_arena_memory.fetch_add(HUGEPAGE_ARENA_SIZE,
+                                      butil::memory_order_relaxed);
+    return arena;
+}
+
+// Keep at most `nkeep' blocks in `fl' and return others to the global pool.
+static void trim_free_list(int c, FreeList* fl, size_t nkeep) {
+    if (fl->size <= nkeep) {
+        return;
+    }
+    FreeList moved = { NULL, 0 };
+    while (fl->size > nkeep) {
+        moved.push(fl->pop());
+    }
+    BAIDU_SCOPED_LOCK(g_hugepage_pool_mutex);
+    FreeList& gl = g_hugepage_pool[c];
+    while (moved.head) {
+        gl.push(moved.pop());
+    }
+}
+
+static void return_hugepage_tls_free_lists() {
+    HugePageTLSData& tls_data = g_hugepage_tls_data;
+    for (int c = 0; c < NUM_BLOCK_SIZE_CLASSES; ++c) {
+        trim_free_list(c, &tls_data.free_lists[c], 0);
+    }
+}
+
+// Fill the empty `fl' with blocks from the global pool, or from a new arena
+// if the pool is empty. Returns false on failure.
+static bool refill_free_list(int c, FreeList* fl) {
+    const size_t nwant = std::max(MAX_FREE_BLOCKS_PER_THREAD[c] / 2, (size_t)1);
+    {
+        BAIDU_SCOPED_LOCK(g_hugepage_pool_mutex);
+        FreeList& gl = g_hugepage_pool[c];
+        while (gl.head && fl->size < nwant) {
+            fl->push(gl.pop());
+        }
+    }
+    if (fl->head) {
+        return true;
+    }
+    char* const arena = new_hugepage_arena();
+    if (arena == NULL) {
+        return false;
+    }
+    const size_t block_size = BLOCK_SIZE_CLASSES[c];
+    for (size_t i = HUGEPAGE_ARENA_SIZE / block_size; i > 0; --i) {
+        fl->push(arena + (i - 1) * block_size);
+    }
+    trim_free_list(c, fl, nwant);
+    return true;
+}
+
+// Free lists of the calling thread, which are returned to the global pool
+// when the thread exits. Threads which only free blocks(e.g. the ones
+// destroying IOBufs received from others) need the cleanup as well.
+static HugePageTLSData& get_hugepage_tls_data() {
+    HugePageTLSData& tls_data = g_hugepage_tls_data;
+    if (!tls_data.registered) {
+        tls_data.registered = true;
+        butil::thread_atexit(return_hugepage_tls_free_lists);
+    }
+    return tls_data;
+}
+
+static void* hugepage_block_allocate(int c) {
+    FreeList& fl = get_hugepage_tls_data().free_lists[c];
+    if (fl.head == NULL && !refill_free_list(c, &fl)) {
+        return NULL;
+    }
+    return fl.pop();
+}
+
+static void hugepage_block_deallocate(void* mem, int c) {
+    FreeList& fl = get_hugepage_tls_data().free_lists[c];
+    fl.push(mem);
+    if (fl.size > MAX_FREE_BLOCKS_PER_THREAD[c]) {
+        trim_free_list(c, &fl, MAX_FREE_BLOCKS_PER_THREAD[c] / 2);
+    }
+}
+
 }  // namespace iobuf
 
+const size_t IOBuf::npos;
+
 size_t IOBuf::block_count() {
     return iobuf::g_nblock.load(butil::memory_order_relaxed);
 }
@@ -186,7 +372,21 @@ size_t IOBuf::new_bigview_count() {
     return iobuf::g_newbigview.load(butil::memory_order_relaxed);
 }
 
+size_t IOBuf::block_count_of_size(size_t block_size) {
+    const int c = iobuf::block_size_class(block_size);
+    if (c < 0) {
+        return 0;
+    }
+    return iobuf::g_nblock_of_class[c].load(butil::memory_order_relaxed);
+}
+
+size_t IOBuf::hugepage_arena_memory() {
+    return iobuf::g_hugepage_arena_memory.load(butil::memory_order_relaxed);
+}
+
 const uint16_t IOBUF_BLOCK_FLAGS_USER_DATA = 0x1;
+// Memory of the block is allocated by hugepage_block_allocate()
+const uint16_t IOBUF_BLOCK_FLAGS_HUGEPAGE = 0x2;
 typedef void (*UserDataDeleter)(void*);
 
 struct UserDataExtension {
@@ -216,6 +416,10 @@ struct IOBuf::Block {
         iobuf::g_nblock.fetch_add(1, butil::memory_order_relaxed);
         iobuf::g_blockmem.fetch_add(data_size + sizeof(Block),
                                     butil::memory_order_relaxed);
+        const int c = iobuf::block_size_class(data_size + sizeof(Block));
+        if (c >= 0) {
+            iobuf::g_nblock_of_class[c].fetch_add(1, butil::memory_order_relaxed);
+        }
     }
 
     Block(char* data_in, uint32_t data_size, UserDataDeleter deleter)
@@ -253,12 +457,22 @@ struct IOBuf::Block {
         check_abi();
         if (nshared.fetch_sub(1, butil::memory_order_release) == 1) {
             butil::atomic_thread_fence(butil::memory_order_acquire);
-            if (!flags) {
+            if (!(flags & IOBUF_BLOCK_FLAGS_USER_DATA)) {
                 iobuf::g_nblock.fetch_sub(1, butil::memory_order_relaxed);
                 iobuf::g_blockmem.fetch_sub(cap + sizeof(Block),
                                             butil::memory_order_relaxed);
+                const int c = iobuf::block_size_class(cap + sizeof(Block));
+                if (c >= 0) {
+                    iobuf::g_nblock_of_class[c].fetch_sub(
+                        1, butil::memory_order_relaxed);
+                }
+                const bool from_hugepage = (flags & IOBUF_BLOCK_FLAGS_HUGEPAGE);
                 this->~Block();
-                iobuf::blockmem_deallocate(this);
+                if (from_hugepage) {
+                    iobuf::hugepage_block_deallocate(this, c);
+                } else {
+                    iobuf::blockmem_deallocate(this);
+                }
             } else if (flags & IOBUF_BLOCK_FLAGS_USER_DATA) {
                 get_user_data_extension()->deleter(data);
                 this->~Block();
@@ -297,6 +511,17 @@ inline IOBuf::Block* create_block(const size_t block_size) {
         LOG(FATAL) << "block_size=" << block_size << " is too large";
         return NULL;
     }
+    if (FLAGS_iobuf_use_hugepages) {
+        const int c = block_size_class(block_size);
+        char* mem = (c >= 0 ? (char*)hugepage_block_allocate(c) : NULL);
+        if (mem != NULL) {
+            IOBuf::Block* b = new (mem) IOBuf::Block(
+                mem + sizeof(IOBuf::Block), block_size - sizeof(IOBuf::Block));
+            b->flags = IOBUF_BLOCK_FLAGS_HUGEPAGE;
+            return b;
+        }
+        // Fallback to blockmem_allocate
+    }
     char* mem = (char*)iobuf::blockmem_allocate(block_size);
     if (mem == NULL) {
         return NULL;
@@ -853,61 +1078,95 @@ size_t IOBuf::cutn(std::string* out, size_t n) {
 }
 
 int IOBuf::_cut_by_char(IOBuf* out, char d) {
+    const size_t n = find(d);
+    if (n == npos) {
+        return -1;
+    }
+    // There's no way cutn/pop_front fails
+    cutn(out, n);
+    pop_front(1);
+    return 0;
+}
+
+int IOBuf::_cut_by_delim(IOBuf* out, char const* dbegin, size_t ndelim) {
+    const size_t n = find(butil::StringPiece(dbegin, ndelim));
+    if (n == npos) {
+        return -1;
+    }
+    // There's no way cutn/pop_front fails
+    cutn(out, n);
+    pop_front(ndelim);
+    return 0;
+}
+
+size_t IOBuf::find(char c, size_t pos) const {
     const size_t nref = _ref_num();
-    size_t n = 0;
-    
+    size_t base = 0;  // offset of the i-th ref
     for (size_t i = 0; i < nref; ++i) {
         IOBuf::BlockRef const& r = _ref_at(i);
-        char const* const s = r.block->data + r.offset;
-        for (uint32_t j = 0; j < r.length; ++j, ++n) {
-            if (s[j] == d) {
-                // There's no way cutn/pop_front fails
-                cutn(out, n);
-                pop_front(1);
-                return 0;
+        if (pos < base + r.length) {
+            const size_t skip = (pos > base ? pos - base : 0);
+            char const* const s = r.block->data + r.offset;
+            char const* const p = butil::find_byte(s + skip, r.length - skip, c);
+            if (p != NULL) {
+                return base + (p - s);
             }
         }
+        base += r.length;
     }
-
-    return -1;
+    return npos;
 }
 
-int IOBuf::_cut_by_delim(IOBuf* out, char const* dbegin, size_t ndelim) {
-    typedef unsigned long SigType;
-    const size_t NMAX = sizeof(SigType);
-    
-    if (ndelim > NMAX || ndelim > length()) {
-        return -1;
-    }
-    
-    SigType dsig = 0;
-    for (size_t i = 0; i < ndelim; ++i) {
-        dsig = (dsig << CHAR_BIT) | static_cast<SigType>(dbegin[i]);
+size_t IOBuf::find(const butil::StringPiece& pattern, size_t pos) const {
+    const size_t m = pattern.size();
+    if (m <= 1) {
+        if (m == 1) {
+            return find(pattern[0], pos);
+        }
+        return pos <= length() ? pos : npos;
     }
-    
-    const SigType SIGMASK =
-        (ndelim == NMAX ? (SigType)-1 : (((SigType)1 << (ndelim * CHAR_BIT)) - 1));
-
     const size_t nref = _ref_num();
-    SigType sig = 0;
-    size_t n = 0;
-
+    size_t base = 0;
     for (size_t i = 0; i < nref; ++i) {
         IOBuf::BlockRef const& r = _ref_at(i);
-        char const* const s = r.block->data + r.offset;
-        
-        for (uint32_t j = 0; j < r.length; ++j, ++n) {
-            sig = ((sig << CHAR_BIT) | static_cast<SigType>(s[j])) & SIGMASK;
-            if (sig == dsig) {
-                // There's no way cutn/pop_front fails
-                cutn(out, n + 1 - ndelim);
-                pop_front(ndelim);
-                return 0;
+        if (pos < base + r.length) {
+            const size_t skip = (pos > base ? pos - base : 0);
+            char const* const s = r.block->data + r.offset;
+            char const* const p = butil::find_bytes(
+                s + skip, r.length - skip, pattern.data(), m);
+            if (p != NULL) {
+                return base + (p - s);
+            }
+            // Matches spanning following refs, at most m-1 candidates.
+            size_t j = (r.length >= m ? r.length - m + 1 : 0);
+            for (j = std::max(j, skip); j < r.length; ++j) {
+                if (s[j] == pattern[0] && _equals_from(i, j, pattern)) {
+                    return base + j;
+                }
             }
         }
+        base += r.length;
     }
+    return npos;
+}
 
-    return -1;
+bool IOBuf::_equals_from(size_t i, size_t off,
+                         const butil::StringPiece& s) const {
+    const size_t nref = _ref_num();
+    size_t soff = 0;
+    for (; i < nref && soff < s.size(); ++i, off = 0) {
+        IOBuf::BlockRef const& r = _ref_at(i);
+        const size_t n = std::min((size_t)r.length - off, s.size() - soff);
+        if (memcmp(r.block->data + r.offset + off, s.data() + soff, n) != 0) {
+            return false;
+        }
+        soff += n;
+    }
+    return soff == s.size();
+}
+
+bool IOBuf::starts_with(const butil::StringPiece& prefix) const {
+    return _equals_from(0, 0, prefix);
 }
 
 // Since cut_into_file_descriptor() allocates iovec on stack, IOV_MAX=1024
@@ -1164,6 +1423,25 @@ int IOBuf::append(void const* data, size_t count) {
         return push_back(*((char const*)data));
     }
     size_t total_nc = 0;
+    if (FLAGS_iobuf_use_large_blocks) {
+        // Copy the bulk into dedicated large blocks, the tail smaller than
+        // 64KB goes to TLS blocks as usual.
+        while (count - total_nc >= iobuf::BLOCK_SIZE_CLASSES[1]) {
+            const size_t left = count - total_nc;
+            IOBuf::Block* b = iobuf::create_block(
+                left >= iobuf::BLOCK_SIZE_CLASSES[2] ?
+                iobuf::BLOCK_SIZE_CLASSES[2] : iobuf::BLOCK_SIZE_CLASSES[1]);
+            if (BAIDU_UNLIKELY(!b)) {
+                return -1;
+            }
+            const size_t nc = std::min(left, b->left_space());
+            iobuf::cp(b->data, (char*)data + total_nc, nc);
+            b->size = nc;
+            const IOBuf::BlockRef r = { 0, (uint32_t)nc, b };
+            _move_back_ref(r);
+            total_nc += nc;
+        }
+    }
     while (total_nc < count) {  // excluded count == 0
         IOBuf::Block* b = iobuf::share_tls_block();
         if (BAIDU_UNLIKELY(!b)) {
@@ -1548,7 +1826,7 @@ void IOPortal::clear() {
 const int MAX_APPEND_IOVEC = 64;
 
 ssize_t IOPortal::pappend_from_file_descriptor(
-    int fd, off_t offset, size_t max_count) {
+    int fd, off_t offset, size_t max_count, size_t block_size) {
     iovec vec[MAX_APPEND_IOVEC];
     int nvec = 0;
     size_t space = 0;
@@ -1557,7 +1835,8 @@ ssize_t IOPortal::pappend_from_file_descriptor(
     // Prepare at most MAX_APPEND_IOVEC blocks or space of blocks >= max_count
     do {
         if (p == NULL) {
-            p = iobuf::acquire_tls_block();
+            p = (block_size == DEFAULT_BLOCK_SIZE ? iobuf::acquire_tls_block()
+                 : iobuf::create_block(block_size));
             if (BAIDU_UNLIKELY(!p)) {
                 errno = ENOMEM;
                 return -1;
@@ -1710,7 +1989,25 @@ ssize_t IOPortal::append_from_SSL_channel(
 }
 
 void IOPortal::return_cached_blocks_impl(Block* b) {
-    iobuf::release_tls_block_chain(b);
+    // Blocks larger than default ones are allocated for big reads only,
+    // don't let them occupy TLS which serves small appendings.
+    Block* head = NULL;
+    Block** pnext = &head;
+    do {
+        Block* const saved_next = b->portal_next;
+        if (b->cap > IOBuf::DEFAULT_BLOCK_SIZE - sizeof(Block)) {
+            b->portal_next = NULL;
+            b->dec_ref();
+        } else {
+            *pnext = b;
+            pnext = &b->portal_next;
+        }
+        b = saved_next;
+    } while (b);
+    *pnext = NULL;
+    if (head) {
+        iobuf::release_tls_block_chain(head);
+    }
 }
 
 //////////////// IOBufCutter ////////////////
@@ -1752,6 +2049,27 @@ bool IOBufCutter::load_next_ref() {
     }
 }
 
+size_t IOBufCutter::cut_bytes_in_front_ref() const {
+    if (_block == NULL) {
+        return 0;
+    }
+    // The front ref is updated in dtor or load_next_ref() only.
+    const IOBuf::BlockRef& fr = _buf->_front_ref();
+    return (char*)_data - (_block->data + fr.offset);
+}
+
+size_t IOBufCutter::find(char c) const {
+    const size_t ncut = cut_bytes_in_front_ref();
+    const size_t pos = _buf->find(c, ncut);
+    return pos == IOBuf::npos ? pos : pos - ncut;
+}
+
+size_t IOBufCutter::find(const butil::StringPiece& pattern) const {
+    const size_t ncut = cut_bytes_in_front_ref();
+    const size_t pos = _buf->find(pattern, ncut);
+    return pos == IOBuf::npos ? pos : pos - ncut;
+}
+
 size_t IOBufCutter::slower_copy_to(void* dst, size_t n) {
     size_t size = (char*)_data_end - (char*)_data;
     if (size == 0) {
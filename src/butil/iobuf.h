@@ -66,6 +66,7 @@ friend class IOBufCutter;
 public:
     static const size_t DEFAULT_BLOCK_SIZE = 8192;
     static const size_t INITIAL_CAP = 32; // must be power of 2
+    static const size_t npos = (size_t)-1;
 
     struct Block;
 
@@ -342,11 +343,25 @@ public:
     static size_t block_memory();
     static size_t new_bigview_count();
     static size_t block_count_hit_tls_threshold();
+    // Number of blocks of exactly `block_size' bytes, only sizes of the
+    // classes (8KB/64KB/1MB) are counted.
+    static size_t block_count_of_size(size_t block_size);
+    // Memory mapped for -iobuf_use_hugepages
+    static size_t hugepage_arena_memory();
 
     // Equal with a string/IOBuf or not.
     bool equals(const butil::StringPiece&) const;
     bool equals(const IOBuf& other) const;
 
+    // True iff the first prefix.size() bytes equal `prefix'.
+    bool starts_with(const butil::StringPiece& prefix) const;
+
+    // Returns offset of the first `c' or `pattern' at or after `pos',
+    // npos if not found. Matches may span blocks. Bytes are compared with
+    // SIMD instructions when possible, see butil/simd_find.h
+    size_t find(char c, size_t pos = 0) const;
+    size_t find(const butil::StringPiece& pattern, size_t pos = 0) const;
+
     // Get the number of backing blocks
     size_t backing_block_num() const { return _ref_num(); }
 
@@ -360,6 +375,9 @@ protected:
     int _cut_by_char(IOBuf* out, char);
     int _cut_by_delim(IOBuf* out, char const* dbegin, size_t ndelim);
 
+    // True iff bytes starting from offset `off' of the i-th ref equal `s'.
+    bool _equals_from(size_t i, size_t off, const butil::StringPiece& s) const;
+
     // Returns: true iff this should be viewed as SmallView
     bool _small() const;
 
@@ -446,13 +464,18 @@ public:
     ssize_t append_from_reader(IReader* reader, size_t max_count);
 
     // Read at most `max_count' bytes from file descriptor `fd' and
-    // append to self.
-    ssize_t append_from_file_descriptor(int fd, size_t max_count);
+    // append to self. Blocks allocated for the reading are `block_size'
+    // bytes, use larger ones (e.g. 64KB) for big reads to fill fewer
+    // blocks in one readv and to have less BlockRefs in the result.
+    ssize_t append_from_file_descriptor(
+        int fd, size_t max_count, size_t block_size = DEFAULT_BLOCK_SIZE);
  
     // Read at most `max_count' bytes from file descriptor `fd' at a given
     // offset and append to self. The file offset is not changed.
     // If `offset' is negative, does exactly what append_from_file_descriptor does.
-    ssize_t pappend_from_file_descriptor(int fd, off_t offset, size_t max_count);
+    ssize_t pappend_from_file_descriptor(
+        int fd, off_t offset, size_t max_count,
+        size_t block_size = DEFAULT_BLOCK_SIZE);
 
     // Read as many bytes as possible from SSL channel `ssl', and stop until `max_count'.
     // Returns total bytes read and the ssl error code will be filled into `ssl_error'
@@ -513,8 +536,15 @@ public:
     // Uncut bytes
     size_t remaining_bytes() const;
 
+    // Returns offset of the first `c' or `pattern' in uncut bytes, npos if
+    // not found. Nothing is cut.
+    size_t find(char c) const;
+    size_t find(const butil::StringPiece& pattern) const;
+
 private:
     size_t slower_copy_to(void* data, size_t n);
+    // Bytes cut from the front ref which is not written back yet.
+    size_t cut_bytes_in_front_ref() const;
     bool load_next_ref();
 
 private:
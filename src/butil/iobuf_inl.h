@@ -37,8 +37,9 @@ inline ssize_t IOBuf::cut_multiple_into_file_descriptor(
     return pcut_multiple_into_file_descriptor(fd, -1, pieces, count);
 }
 
-inline ssize_t IOPortal::append_from_file_descriptor(int fd, size_t max_count) {
-    return pappend_from_file_descriptor(fd, -1, max_count);
+inline ssize_t IOPortal::append_from_file_descriptor(
+    int fd, size_t max_count, size_t block_size) {
+    return pappend_from_file_descriptor(fd, -1, max_count, block_size);
 }
 
 inline void IOPortal::return_cached_blocks() {
@@ -0,0 +1,133 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BUTIL_SIMD_FIND_H
+#define BUTIL_SIMD_FIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>                            // memchr, memcmp
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Search bytes in memory 32 (AVX2) or 16 (SSE2) bytes at a time, falling
+// back to plain loops on other platforms. Which one is used is decided at
+// compile time, brpc is compiled with -msse4.2 on x86-64 by default.
+// Candidates of multi-byte patterns are filtered by comparing the first and
+// the last bytes of the pattern in parallel, which skips most positions for
+// text protocols, see http://0x80.pl/articles/simd-strfind.html
+
+namespace butil {
+
+namespace simd_find_internal {
+#if defined(__AVX2__)
+#define BUTIL_SIMD_FIND_VECTORIZED
+typedef __m256i Vec;
+static const size_t VEC_SIZE = 32;
+inline Vec splat(char c) { return _mm256_set1_epi8(c); }
+inline Vec load(const char* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+inline uint32_t eq_mask(Vec a, Vec b) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+}
+#elif defined(__SSE2__)
+#define BUTIL_SIMD_FIND_VECTORIZED
+typedef __m128i Vec;
+static const size_t VEC_SIZE = 16;
+inline Vec splat(char c) { return _mm_set1_epi8(c); }
+inline Vec load(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+inline uint32_t eq_mask(Vec a, Vec b) {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+#endif
+}  // namespace simd_find_internal
+
+// Returns pointer to the first `c' in [s, s + n), NULL if not found.
+// memchr of libc is already vectorized.
+inline const char* find_byte(const char* s, size_t n, char c) {
+    return static_cast<const char*>(memchr(s, c, n));
+}
+
+// Returns pointer to the first byte in [s, s + n) which is `c1' or `c2',
+// NULL if not found.
+inline const char* find_either_byte(const char* s, size_t n, char c1, char c2) {
+    size_t i = 0;
+#ifdef BUTIL_SIMD_FIND_VECTORIZED
+    using namespace simd_find_internal;
+    const Vec v1 = splat(c1);
+    const Vec v2 = splat(c2);
+    for (; i + VEC_SIZE <= n; i += VEC_SIZE) {
+        const Vec d = load(s + i);
+        const uint32_t m = eq_mask(d, v1) | eq_mask(d, v2);
+        if (m) {
+            return s + i + __builtin_ctz(m);
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (s[i] == c1 || s[i] == c2) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+// Returns pointer to the first occurrence of [pat, pat + m) in [s, s + n),
+// NULL if not found. Returns `s' when `m' is 0.
+inline const char* find_bytes(const char* s, size_t n,
+                              const char* pat, size_t m) {
+    if (m <= 1) {
+        return m == 0 ? s : find_byte(s, n, pat[0]);
+    }
+    if (m > n) {
+        return NULL;
+    }
+    const size_t nstart = n - m + 1;  // number of possible starting positions
+    size_t i = 0;
+#ifdef BUTIL_SIMD_FIND_VECTORIZED
+    using namespace simd_find_internal;
+    const Vec first = splat(pat[0]);
+    const Vec last = splat(pat[m - 1]);
+    for (; i + VEC_SIZE <= nstart; i += VEC_SIZE) {
+        uint32_t mask = eq_mask(load(s + i), first) &
+            eq_mask(load(s + i + m - 1), last);
+        while (mask) {
+            const size_t k = i + __builtin_ctz(mask);
+            if (memcmp(s + k + 1, pat + 1, m - 2) == 0) {
+                return s + k;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < nstart; ++i) {
+        if (s[i] == pat[0] && memcmp(s + i + 1, pat + 1, m - 1) == 0) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+}  // namespace butil
+
+#endif  // BUTIL_SIMD_FIND_H
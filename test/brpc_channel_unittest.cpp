@@ -28,6 +28,8 @@
 #include "butil/macros.h"
 #include "butil/logging.h"
 #include "butil/files/temp_file.h"
+#include "butil/fd_guard.h"
+#include "butil/raw_pack.h"
 #include "brpc/socket.h"
 #include "brpc/acceptor.h"
 #include "brpc/server.h"
@@ -46,9 +48,11 @@
 namespace brpc {
 DECLARE_int32(idle_timeout_second);
 DECLARE_int32(max_connection_pool_size);
+DECLARE_int32(multi_connection_count);
 class Server;
 class MethodStatus;
 namespace policy {
+DECLARE_int32(baidu_std_response_batch_window_us);
 void SendRpcResponse(int64_t correlation_id, Controller* cntl, 
                      const google::protobuf::Message* req,
                      const google::protobuf::Message* res,
@@ -171,7 +175,8 @@ protected:
         pthread_once(&register_mock_protocol, register_protocol);
         const brpc::InputMessageHandler pairs[] = {
             { brpc::policy::ParseRpcMessage, 
-              ProcessRpcRequest, VerifyMyRequest, this, "baidu_std" }
+              ProcessRpcRequest, VerifyMyRequest, this, "baidu_std",
+              NULL, NULL }
         };
         EXPECT_EQ(0, _messenger.AddHandler(pairs[0]));
 
@@ -193,7 +198,8 @@ protected:
                                    brpc::policy::PackRpcRequest,
                                    NULL, ProcessRpcRequest,
                                    VerifyMyRequest, NULL, NULL,
-                                   brpc::CONNECTION_TYPE_ALL, "baidu_std" };
+                                   brpc::CONNECTION_TYPE_ALL, "baidu_std",
+                                   NULL, NULL };
         ASSERT_EQ(0,  RegisterProtocol((brpc::ProtocolType)30, dummy_protocol));
     }
 
@@ -2358,6 +2364,185 @@ TEST_F(ChannelTest, timeout_selective) {
     }
 }
 
+static int64_t GetExposedCount(const char* name) {
+    return atoll(bvar::Variable::describe_exposed(name).c_str());
+}
+
+TEST_F(ChannelTest, batch_window) {
+    brpc::ChannelOptions opt;
+    opt.batch_window_us = 10000;
+    opt.protocol = "http";
+    brpc::Channel http_channel;
+    ASSERT_EQ(-1, http_channel.Init(_ep, &opt));
+
+    ASSERT_EQ(0, StartAccept(_ep));
+    const int32_t saved_window =
+        brpc::policy::FLAGS_baidu_std_response_batch_window_us;
+    brpc::policy::FLAGS_baidu_std_response_batch_window_us = 10000;
+    opt.protocol = brpc::PROTOCOL_BAIDU_STD;
+    opt.max_retry = 0;
+    opt.connection_group = "batch";
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init(_ep, &opt));
+
+    const int64_t nbatch0 = GetExposedCount("rpc_batch_count");
+    const int64_t nframe0 = GetExposedCount("rpc_batched_frame_count");
+    const size_t N = 8;
+    brpc::Controller cntl[N];
+    test::EchoRequest req[N];
+    test::EchoResponse res[N];
+    brpc::CallId cids[N];
+    for (size_t i = 0; i < N; ++i) {
+        req[i].set_message(butil::string_printf("batched%d", (int)i));
+        cids[i] = cntl[i].call_id();
+        test::EchoService_Stub(&channel).Echo(
+            &cntl[i], &req[i], &res[i], brpc::DoNothing());
+    }
+    for (size_t i = 0; i < N; ++i) {
+        bthread_id_join(cids[i]);
+        ASSERT_FALSE(cntl[i].Failed()) << cntl[i].ErrorText();
+        ASSERT_EQ("received " + req[i].message(), res[i].message());
+    }
+    // Requests are sent in one batch, responses are batched by the server.
+    ASSERT_GE(GetExposedCount("rpc_batch_count") - nbatch0, 2);
+    ASSERT_GE(GetExposedCount("rpc_batched_frame_count") - nframe0,
+              (int64_t)N + 2);
+    brpc::policy::FLAGS_baidu_std_response_batch_window_us = saved_window;
+    StopAndJoin();
+}
+
+TEST_F(ChannelTest, batch_within_max_body_size) {
+    ASSERT_EQ(0, StartAccept(_ep));
+    const int32_t saved_window =
+        brpc::policy::FLAGS_baidu_std_response_batch_window_us;
+    const uint64_t saved_max_body_size = brpc::FLAGS_max_body_size;
+    brpc::policy::FLAGS_baidu_std_response_batch_window_us = 10000;
+    // Shared by the client and the server, 8 requests together exceed it.
+    brpc::FLAGS_max_body_size = 2048;
+    brpc::ChannelOptions opt;
+    opt.batch_window_us = 10000;
+    opt.max_retry = 0;
+    opt.connection_group = "batch_within_max_body_size";
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init(_ep, &opt));
+
+    const int64_t nbatch0 = GetExposedCount("rpc_batch_count");
+    const size_t N = 8;
+    brpc::Controller cntl[N];
+    test::EchoRequest req[N];
+    test::EchoResponse res[N];
+    brpc::CallId cids[N];
+    for (size_t i = 0; i < N; ++i) {
+        // The last request is too large to be batched.
+        req[i].set_message(std::string(i + 1 == N ? 1500 : 400, 'a' + i));
+        cids[i] = cntl[i].call_id();
+        test::EchoService_Stub(&channel).Echo(
+            &cntl[i], &req[i], &res[i], brpc::DoNothing());
+    }
+    for (size_t i = 0; i < N; ++i) {
+        bthread_id_join(cids[i]);
+        ASSERT_FALSE(cntl[i].Failed()) << cntl[i].ErrorText();
+        ASSERT_EQ("received " + req[i].message(), res[i].message());
+    }
+    ASSERT_GE(GetExposedCount("rpc_batch_count") - nbatch0, 2);
+    brpc::FLAGS_max_body_size = saved_max_body_size;
+    brpc::policy::FLAGS_baidu_std_response_batch_window_us = saved_window;
+    StopAndJoin();
+}
+
+static void AppendRpcHeader(butil::IOBuf* buf, uint32_t body_size,
+                            uint32_t meta_size) {
+    char header[12];
+    memcpy(header, "PRPC", 4);
+    butil::RawPacker(header + 4).pack32(body_size).pack32(meta_size);
+    buf->append(header, sizeof(header));
+}
+
+TEST_F(ChannelTest, reject_malformed_batches) {
+    ASSERT_EQ(0, StartAccept(_ep));
+    for (int i = 0; i < 2; ++i) {
+        butil::IOBuf buf;
+        if (i == 0) {
+            // Batches nested so deeply that parsing them recursively
+            // overflows the stack, ended with an empty frame.
+            const uint32_t N = 100000;
+            for (uint32_t j = 0; j < N; ++j) {
+                AppendRpcHeader(&buf, (N - j) * 12, 0);
+            }
+            AppendRpcHeader(&buf, 0, 0);
+        } else {
+            // The inner frame runs past its batch.
+            AppendRpcHeader(&buf, 24, 0);
+            AppendRpcHeader(&buf, 100, 10);
+            buf.append(std::string(100, 'x'));
+        }
+        butil::fd_guard fd(butil::tcp_connect(_ep, NULL));
+        ASSERT_GE(fd, 0);
+        timeval tv = { 5, 0 };
+        ASSERT_EQ(0, setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)));
+        while (!buf.empty()) {
+            if (buf.cut_into_file_descriptor(fd) < 0) {
+                // Closed by the server before all data is written.
+                ASSERT_TRUE(errno == EPIPE || errno == ECONNRESET) << berror();
+                break;
+            }
+        }
+        // The connection is closed instead of waiting for more data.
+        char c;
+        const ssize_t nr = read(fd, &c, 1);
+        ASSERT_TRUE(nr == 0 || (nr < 0 && errno == ECONNRESET))
+            << "i=" << i << " nr=" << nr << " " << berror();
+    }
+    StopAndJoin();
+}
+
+TEST_F(ChannelTest, multi_connection) {
+    brpc::ChannelOptions opt;
+    opt.connection_type = "multi";
+    opt.protocol = "http";
+    brpc::Channel http_channel;
+    ASSERT_EQ(-1, http_channel.Init(_ep, &opt));
+
+    ASSERT_EQ(0, StartAccept(_ep));
+    const int32_t saved_count = brpc::FLAGS_multi_connection_count;
+    brpc::FLAGS_multi_connection_count = 4;
+    opt.protocol = brpc::PROTOCOL_BAIDU_STD;
+    opt.max_retry = 0;
+    opt.connection_group = "multi";
+    {
+        brpc::Channel channel;
+        ASSERT_EQ(0, channel.Init(_ep, &opt));
+        const size_t N = 64;
+        brpc::Controller cntl[N];
+        test::EchoRequest req[N];
+        test::EchoResponse res[N];
+        brpc::CallId cids[N];
+        for (size_t i = 0; i < N; ++i) {
+            req[i].set_message(__FUNCTION__);
+            cids[i] = cntl[i].call_id();
+            test::EchoService_Stub(&channel).Echo(
+                &cntl[i], &req[i], &res[i], brpc::DoNothing());
+        }
+        std::set<uint64_t> receiving_sockets;
+        for (size_t i = 0; i < N; ++i) {
+            bthread_id_join(cids[i]);
+            ASSERT_FALSE(cntl[i].Failed()) << cntl[i].ErrorText();
+            receiving_sockets.insert(res[i].receiving_socket_id());
+        }
+        // Calls are spread over all connections.
+        ASSERT_EQ(4u, receiving_sockets.size());
+        ASSERT_EQ(4u, _messenger.ConnectionCount());
+    }
+    // Connections are closed along with the main socket.
+    const int64_t start_time = butil::gettimeofday_us();
+    while (_messenger.ConnectionCount() != 0) {
+        ASSERT_LT(butil::gettimeofday_us(), start_time + 1000000L);
+        bthread_usleep(1000);
+    }
+    brpc::FLAGS_multi_connection_count = saved_count;
+    StopAndJoin();
+}
+
 TEST_F(ChannelTest, close_fd) {
     for (int i = 0; i <= 1; ++i) { // Flag SingleServer 
         for (int j = 0; j <= 1; ++j) { // Flag Asynchronous
@@ -2626,6 +2811,10 @@ TEST_F(ChannelTest, adaptive_connection_type) {
     ASSERT_EQ(brpc::CONNECTION_TYPE_POOLED, ctype);
     ASSERT_STREQ("pooled", ctype.name());
 
+    ctype = "Multi";
+    ASSERT_EQ(brpc::CONNECTION_TYPE_MULTI, ctype);
+    ASSERT_STREQ("multi", ctype.name());
+
     ctype = "SINGLE";
     ASSERT_EQ(brpc::CONNECTION_TYPE_SINGLE, ctype);
     ASSERT_FALSE(ctype.has_error());
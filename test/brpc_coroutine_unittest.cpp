@@ -0,0 +1,193 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+// Built with -std=c++20 when the compiler supports it, see test/Makefile.
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include "butil/time.h"
+#include "butil/atomicops.h"
+#include "bthread/bthread.h"
+#include "bthread/butex.h"
+#include "bthread/coroutine.h"
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "echo.pb.h"
+
+#ifdef BTHREAD_HAS_COROUTINE
+
+namespace {
+
+bthread::Awaitable<int64_t> sleep_and_return(int64_t us) {
+    const int64_t start = butil::gettimeofday_us();
+    EXPECT_EQ(0, co_await bthread::co_usleep(us));
+    co_return butil::gettimeofday_us() - start;
+}
+
+TEST(CoroutineTest, usleep) {
+    const int64_t elapsed = bthread::sync_wait(sleep_and_return(20000));
+    ASSERT_GE(elapsed, 20000);
+    ASSERT_LT(elapsed, 200000);
+}
+
+bthread::Awaitable<int> add_after_sleep(int a, int b) {
+    co_await bthread::co_usleep(1000);
+    co_return a + b;
+}
+
+bthread::Awaitable<int> nested() {
+    int sum = 0;
+    for (int i = 0; i < 10; ++i) {
+        sum += co_await add_after_sleep(i, 1);
+    }
+    co_return sum;
+}
+
+bthread::Awaitable<void> throw_after_sleep() {
+    co_await bthread::co_usleep(1000);
+    throw std::runtime_error("oops");
+}
+
+TEST(CoroutineTest, nested_awaitable_and_exception) {
+    ASSERT_EQ(55, bthread::sync_wait(nested()));
+    ASSERT_THROW(bthread::sync_wait(throw_after_sleep()), std::runtime_error);
+}
+
+bthread::Awaitable<int> wait_butex(butil::atomic<int>* butex, int expected,
+                                   int64_t timeout_us) {
+    timespec abstime = butil::microseconds_from_now(timeout_us);
+    if (co_await bthread::co_butex_wait(
+            butex, expected, timeout_us >= 0 ? &abstime : NULL) != 0) {
+        co_return errno;
+    }
+    co_return 0;
+}
+
+void* wake_butex_after_10ms(void* arg) {
+    butil::atomic<int>* butex = static_cast<butil::atomic<int>*>(arg);
+    bthread_usleep(10000);
+    butex->store(1);
+    bthread::butex_wake_all(butex);
+    return NULL;
+}
+
+TEST(CoroutineTest, butex_wait) {
+    butil::atomic<int>* butex = bthread::butex_create_checked<butil::atomic<int> >();
+    butex->store(0);
+    ASSERT_EQ(EWOULDBLOCK, bthread::sync_wait(wait_butex(butex, 1, -1)));
+
+    int64_t start = butil::gettimeofday_us();
+    ASSERT_EQ(ETIMEDOUT, bthread::sync_wait(wait_butex(butex, 0, 20000)));
+    ASSERT_GE(butil::gettimeofday_us() - start, 20000);
+
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(&th, NULL, wake_butex_after_10ms, butex));
+    start = butil::gettimeofday_us();
+    ASSERT_EQ(0, bthread::sync_wait(wait_butex(butex, 0, 1000000)));
+    ASSERT_LT(butil::gettimeofday_us() - start, 500000);
+    ASSERT_EQ(0, bthread_join(th, NULL));
+
+    // Woken up without timeout.
+    butex->store(0);
+    ASSERT_EQ(0, bthread_start_background(&th, NULL, wake_butex_after_10ms, butex));
+    ASSERT_EQ(0, bthread::sync_wait(wait_butex(butex, 0, -1)));
+    ASSERT_EQ(0, bthread_join(th, NULL));
+    bthread::butex_destroy(butex);
+}
+
+bthread::Awaitable<void> sleep_and_count(butil::atomic<int>* nended) {
+    co_await bthread::co_usleep(10000);
+    nended->fetch_add(1);
+}
+
+TEST(CoroutineTest, start_many_coroutines) {
+    const int N = 10000;
+    butil::atomic<int> nended(0);
+    for (int i = 0; i < N; ++i) {
+        bthread::start_coroutine(sleep_and_count(&nended));
+    }
+    for (int i = 0; i < 1000 && nended.load() != N; ++i) {
+        usleep(10000);
+    }
+    ASSERT_EQ(N, nended.load());
+}
+
+class EchoServiceImpl : public test::EchoService {
+public:
+    void Echo(google::protobuf::RpcController*,
+              const test::EchoRequest* request,
+              test::EchoResponse* response,
+              google::protobuf::Closure* done) override {
+        brpc::ClosureGuard done_guard(done);
+        response->set_message(request->message());
+        if (request->sleep_us() > 0) {
+            bthread_usleep(request->sleep_us());
+        }
+    }
+};
+
+bthread::Awaitable<int> call_echo(brpc::Channel* channel, int i) {
+    const google::protobuf::MethodDescriptor* method =
+        test::EchoService::descriptor()->FindMethodByName("Echo");
+    test::EchoRequest req;
+    test::EchoResponse res;
+    brpc::Controller cntl;
+    req.set_message(std::to_string(i));
+    req.set_sleep_us(1000);
+    co_await channel->CallMethodAsync(method, &cntl, &req, &res);
+    if (cntl.Failed()) {
+        co_return -1;
+    }
+    co_return std::stoi(res.message());
+}
+
+bthread::Awaitable<void> fan_out(brpc::Channel* channel, int i,
+                                 butil::atomic<int>* sum,
+                                 bthread::CountdownEvent* ev) {
+    sum->fetch_add(co_await call_echo(channel, i));
+    ev->signal();
+}
+
+TEST(CoroutineTest, call_method_async) {
+    brpc::Server server;
+    EchoServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server.Start(9203, NULL));
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:9203", NULL));
+
+    ASSERT_EQ(7, bthread::sync_wait(call_echo(&channel, 7)));
+
+    const int N = 1000;
+    butil::atomic<int> sum(0);
+    bthread::CountdownEvent ev(N);
+    for (int i = 0; i < N; ++i) {
+        bthread::start_coroutine(fan_out(&channel, i, &sum, &ev));
+    }
+    ASSERT_EQ(0, ev.wait());
+    ASSERT_EQ(N * (N - 1) / 2, sum.load());
+
+    server.Stop(0);
+    server.Join();
+    ASSERT_EQ(-1, bthread::sync_wait(call_echo(&channel, 1)));
+}
+
+} // namespace
+
+#endif  // BTHREAD_HAS_COROUTINE
@@ -20,15 +20,33 @@
 // Date: Sun Jul 13 15:04:18 CST 2014
 
 #include <pthread.h>
+#include <set>
+#include <algorithm>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <gtest/gtest.h>
+#include <gflags/gflags.h>
 #include "butil/gperftools_profiler.h"
 #include "butil/time.h"
 #include "butil/macros.h"
 #include "butil/fd_utility.h"
+#include "butil/string_printf.h"
 #include "brpc/event_dispatcher.h"
 #include "brpc/details/has_epollrdhup.h"
+#include "brpc/acceptor.h"
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "echo.pb.h"
+
+namespace bthread {
+DECLARE_int32(bthread_busy_poll_us);
+}
+
+namespace brpc {
+DECLARE_int32(event_dispatcher_num);
+DECLARE_int32(event_dispatcher_busy_poll_us);
+}
 
 class EventDispatcherTest : public ::testing::Test{
 protected:
@@ -52,6 +70,113 @@ TEST_F(EventDispatcherTest, versioned_ref) {
     ASSERT_EQ(brpc::MakeVRef(1, 1), versioned_ref);
 }
 
+class EchoServiceImpl : public test::EchoService {
+public:
+    void Echo(google::protobuf::RpcController*,
+              const test::EchoRequest* req,
+              test::EchoResponse* res,
+              google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        res->set_message(req->message());
+    }
+};
+
+// Must be the first test creating Sockets in this file since
+// -event_dispatcher_num is read when dispatchers are created.
+TEST_F(EventDispatcherTest, reuse_port_sharding) {
+    const int NDISP = 4;
+    brpc::FLAGS_event_dispatcher_num = NDISP;
+
+    EchoServiceImpl service;
+    brpc::Server server;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    brpc::ServerOptions server_options;
+    server_options.reuse_port_sharding = true;
+    ASSERT_EQ(0, server.Start("127.0.0.1:0", &server_options));
+    ASSERT_EQ((size_t)NDISP, server._am->listened_fd_count());
+    ASSERT_TRUE(brpc::GlobalEventDispatchersBoundToWorkers());
+
+    // Kernel spreads connections over the listened sockets by hashing.
+    const size_t NCONN = 32;
+    // Connections are closed along with the last channel using them.
+    brpc::Channel channels[NCONN];
+    for (size_t i = 0; i < NCONN; ++i) {
+        brpc::ChannelOptions options;
+        options.connection_group = butil::string_printf("group%lu", i);
+        ASSERT_EQ(0, channels[i].Init(server.listen_address(), &options));
+        test::EchoService_Stub stub(&channels[i]);
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("hello");
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ("hello", res.message());
+    }
+    std::vector<brpc::SocketId> conns;
+    server._am->ListConnections(&conns);
+    ASSERT_EQ(NCONN, conns.size());
+    std::set<int> used;
+    for (size_t i = 0; i < conns.size(); ++i) {
+        brpc::SocketUniquePtr s;
+        ASSERT_EQ(0, brpc::Socket::Address(conns[i], &s));
+        ASSERT_GE(s->_dispatcher_index, 0);
+        ASSERT_LT(s->_dispatcher_index, NDISP);
+        used.insert(s->_dispatcher_index);
+    }
+    ASSERT_GT(used.size(), 1u);
+
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+    ASSERT_LT(server._am->listened_fd(), 0);
+}
+
+static void EchoLatencies(const butil::EndPoint& ep, size_t n,
+                          std::vector<int64_t>* latencies) {
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init(ep, NULL));
+    test::EchoService_Stub stub(&channel);
+    latencies->clear();
+    for (size_t i = 0; i < n; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("hello");
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        latencies->push_back(cntl.latency_us());
+    }
+    std::sort(latencies->begin(), latencies->end());
+}
+
+// Not a strict benchmark: the gain depends on whether the spinning threads
+// have dedicated cores, compare the logs on the target machine.
+TEST_F(EventDispatcherTest, busy_poll_latency) {
+    EchoServiceImpl service;
+    brpc::Server server;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server.Start("127.0.0.1:0", NULL));
+
+    const size_t N = 5000;
+    const int busy_poll_us[] = { 0, 50 };
+    for (size_t i = 0; i < ARRAY_SIZE(busy_poll_us); ++i) {
+        brpc::FLAGS_event_dispatcher_busy_poll_us = busy_poll_us[i];
+        bthread::FLAGS_bthread_busy_poll_us = busy_poll_us[i];
+        std::vector<int64_t> latencies;
+        EchoLatencies(server.listen_address(), N, &latencies);
+        ASSERT_EQ(N, latencies.size());
+        LOG(INFO) << "busy_poll_us=" << busy_poll_us[i]
+                  << " p50=" << latencies[N / 2]
+                  << "us p99=" << latencies[N * 99 / 100]
+                  << "us p999=" << latencies[N * 999 / 1000] << "us";
+    }
+    brpc::FLAGS_event_dispatcher_busy_poll_us = 0;
+    bthread::FLAGS_bthread_busy_poll_us = 0;
+
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+
 std::vector<int> err_fd;
 pthread_mutex_t err_fd_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -267,3 +392,33 @@ TEST_F(EventDispatcherTest, dispatch_tasks) {
     ASSERT_EQ(NCLIENT, info.free_item_num - old_info.free_item_num);
 #endif
 }
+
+TEST_F(EventDispatcherTest, fail_socket_when_poll_fails) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    brpc::SocketOptions options;
+    options.fd = fds[1];
+    brpc::SocketId id;
+    ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+    brpc::SocketUniquePtr s;
+    ASSERT_EQ(0, brpc::Socket::Address(id, &s));
+
+    // A closed fd can't be polled. Create the dispatcher first, otherwise
+    // the fd may be reused by it.
+    brpc::EventDispatcher& d = brpc::GetGlobalEventDispatcher(fds[0]);
+    const int bad_fd = dup(fds[0]);
+    ASSERT_GE(bad_fd, 0);
+    close(bad_fd);
+    if (d.AddConsumer(id, bad_fd) == 0) {
+        // io_uring reports the error in the completion of the poll, which
+        // must fail the socket instead of leaving it never polled again.
+        const int64_t start_time = butil::gettimeofday_us();
+        while (!s->Failed()) {
+            ASSERT_LT(butil::gettimeofday_us(), start_time + 1000000L);
+            bthread_usleep(1000);
+        }
+        d.RemoveConsumer(bad_fd);
+    }
+    s->SetFailed();
+    close(fds[0]);
+}
@@ -19,6 +19,7 @@
 #include <iostream>
 
 #include "butil/time.h"
+#include "butil/fast_rand.h"
 #include "butil/logging.h"
 #include "brpc/details/http_parser.h"
 #include "brpc/builtin/common.h"  // AppendFileName
@@ -169,3 +170,87 @@ TEST_F(HttpParserTest, append_filename) {
     brpc::AppendFileName(&dir, "..");
     ASSERT_EQ("/", dir);
 }
+
+struct HeaderCollector {
+    std::string fields;
+    std::string values;
+    bool complete;
+};
+
+int collect_header_field(http_parser* p, const char *at, const size_t length) {
+    HeaderCollector* c = static_cast<HeaderCollector*>(p->data);
+    // May be called multiple times for one field.
+    c->fields.append(at, length);
+    return 0;
+}
+
+int collect_header_value(http_parser* p, const char *at, const size_t length) {
+    static_cast<HeaderCollector*>(p->data)->values.append(at, length);
+    return 0;
+}
+
+int collect_message_complete(http_parser* p) {
+    static_cast<HeaderCollector*>(p->data)->complete = true;
+    return 0;
+}
+
+TEST_F(HttpParserTest, header_values_in_random_pieces) {
+    std::string long_value(1000, 'v');
+    const std::string http_request =
+        "POST /path HTTP/1.1\r\n"
+        "User-Agent: HTTPTool/1.0\r\n"
+        "X-Long: " + long_value + "\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Length: 4\r\n"
+        "\r\n"
+        "body";
+    http_parser_settings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.on_header_field = collect_header_field;
+    settings.on_header_value = collect_header_value;
+    settings.on_message_complete = collect_message_complete;
+    for (int round = 0; round < 100; ++round) {
+        HeaderCollector c;
+        c.complete = false;
+        http_parser parser;
+        http_parser_init(&parser, brpc::HTTP_REQUEST);
+        parser.data = &c;
+        for (size_t i = 0; i < http_request.size(); ) {
+            const size_t n = std::min(http_request.size() - i,
+                                      (size_t)butil::fast_rand_in(1, 64));
+            ASSERT_EQ(n, http_parser_execute(
+                          &parser, &settings, http_request.data() + i, n));
+            i += n;
+        }
+        ASSERT_TRUE(c.complete);
+        ASSERT_EQ("User-AgentX-LongConnectionContent-Length", c.fields);
+        ASSERT_EQ("HTTPTool/1.0" + long_value + "keep-alive4", c.values);
+        ASSERT_TRUE(brpc::http_should_keep_alive(&parser));
+    }
+}
+
+TEST_F(HttpParserTest, parse_headers_perf) {
+    std::string http_request = "GET /path HTTP/1.1\r\n";
+    for (int i = 0; i < 20; ++i) {
+        http_request.append("X-Header-Name: ");
+        http_request.append(std::string(60, 'v'));
+        http_request.append("\r\n");
+    }
+    http_request.append("\r\n");
+    http_parser_settings settings;
+    memset(&settings, 0, sizeof(settings));
+    const size_t loops = 100000;
+    butil::Timer timer;
+    timer.start();
+    for (size_t i = 0; i < loops; ++i) {
+        http_parser parser;
+        http_parser_init(&parser, brpc::HTTP_REQUEST);
+        ASSERT_EQ(http_request.size(), http_parser_execute(
+                      &parser, &settings, http_request.data(),
+                      http_request.size()));
+    }
+    timer.stop();
+    std::cout << "It takes " << timer.n_elapsed() / loops
+              << "ns to parse " << http_request.size()
+              << " bytes of http headers" << std::endl;
+}
@@ -44,7 +44,8 @@ int main(int argc, char* argv[]) {
                                brpc::policy::PackHuluRequest,
                                EmptyProcessHuluRequest, EmptyProcessHuluRequest,
                                NULL, NULL, NULL,
-                               brpc::CONNECTION_TYPE_ALL, "dummy_hulu" };
+                               brpc::CONNECTION_TYPE_ALL, "dummy_hulu",
+                               NULL, NULL };
     EXPECT_EQ(0,  RegisterProtocol((brpc::ProtocolType)30, dummy_protocol));
     return RUN_ALL_TESTS();
 }
@@ -155,7 +156,8 @@ TEST_F(MessengerTest, dispatch_tasks) {
 
     const brpc::InputMessageHandler pairs[] = {
         { brpc::policy::ParseHuluMessage, 
-          EmptyProcessHuluRequest, NULL, NULL, "dummy_hulu" }
+          EmptyProcessHuluRequest, NULL, NULL, "dummy_hulu",
+          NULL, NULL }
     };
 
     for (size_t i = 0; i < NEPOLL; ++i) {        
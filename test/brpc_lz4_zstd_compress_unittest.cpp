@@ -0,0 +1,261 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/macros.h"
+#include "butil/iobuf.h"
+#include "butil/time.h"
+#include "butil/fast_rand.h"
+#include "snappy_message.pb.h"
+#include "brpc/global.h"
+#include "brpc/compress.h"
+#include "brpc/policy/snappy_compress.h"
+#include "brpc/policy/gzip_compress.h"
+#include "brpc/policy/lz4_compress.h"
+#include "brpc/policy/zstd_compress.h"
+#ifdef BRPC_WITH_ZSTD
+#include <zdict.h>
+#endif
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    GFLAGS_NS::ParseCommandLineFlags(&argc, &argv, true);
+    // Register handlers of compress types
+    brpc::GlobalInitializeOrDie();
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+
+typedef bool (*Compress)(const google::protobuf::Message&, butil::IOBuf*);
+typedef bool (*Decompress)(const butil::IOBuf&, google::protobuf::Message*);
+typedef bool (*CompressIOBuf)(const butil::IOBuf&, butil::IOBuf*);
+typedef bool (*DecompressIOBuf)(const butil::IOBuf&, butil::IOBuf*);
+
+// Text looking like logs or json, compressible but not trivially.
+std::string MakeText(size_t len) {
+    static const char* const words[] = {
+        "\"user_id\":", "\"timestamp\":", "\"status\":\"OK\"",
+        "\"region\":\"cn-north\"", "{", "}", ",", "\"items\":[",
+        "]", "\"latency_us\":", "\"retry\":false"
+    };
+    std::string text;
+    text.reserve(len + 32);
+    while (text.size() < len) {
+        const uint64_t r = butil::fast_rand();
+        text.append(words[r % ARRAY_SIZE(words)]);
+        if (r & 1) {
+            char buf[24];
+            text.append(buf, snprintf(buf, sizeof(buf), "%u", (unsigned)(r >> 40)));
+        }
+    }
+    text.resize(len);
+    return text;
+}
+
+// Make an IOBuf of many blocks with different sizes.
+void MakeFragmentedIOBuf(const std::string& text, butil::IOBuf* buf) {
+    size_t i = 0;
+    size_t len = 1;
+    while (i < text.size()) {
+        const size_t n = std::min(len, text.size() - i);
+        butil::IOBuf piece;
+        piece.append(text.data() + i, n);
+        buf->append(piece);
+        i += n;
+        len = len * 3 + 1;
+    }
+}
+
+void TestIOBufRoundTrip(CompressIOBuf compress, DecompressIOBuf decompress) {
+    const size_t lens[] = { 0, 1, 100, 8192, 65537, 1024 * 1024 + 7 };
+    for (size_t i = 0; i < ARRAY_SIZE(lens); ++i) {
+        const std::string text = MakeText(lens[i]);
+        butil::IOBuf in;
+        MakeFragmentedIOBuf(text, &in);
+        ASSERT_EQ(text.size(), in.size());
+        butil::IOBuf compressed;
+        ASSERT_TRUE(compress(in, &compressed)) << lens[i];
+        if (lens[i] > 8192) {
+            ASSERT_LT(compressed.size(), in.size() / 2);
+        }
+        butil::IOBuf out;
+        ASSERT_TRUE(decompress(compressed, &out)) << lens[i];
+        ASSERT_EQ(text, out.to_string()) << lens[i];
+
+        if (compressed.size() > 1) {
+            // Truncated data must be rejected
+            butil::IOBuf truncated = compressed;
+            truncated.pop_back(1);
+            butil::IOBuf out2;
+            ASSERT_FALSE(decompress(truncated, &out2)) << lens[i];
+            // So as trailing garbage
+            butil::IOBuf extended = compressed;
+            extended.append("garbage");
+            butil::IOBuf out3;
+            ASSERT_FALSE(decompress(extended, &out3)) << lens[i];
+        }
+    }
+}
+
+void TestMessageRoundTrip(Compress compress, Decompress decompress) {
+    snappy_message::SnappyMessageProto old_msg;
+    old_msg.set_text(MakeText(12435));
+    old_msg.add_numbers(2);
+    old_msg.add_numbers(7);
+    old_msg.add_numbers(45);
+    butil::IOBuf buf;
+    ASSERT_TRUE(compress(old_msg, &buf));
+    snappy_message::SnappyMessageProto new_msg;
+    ASSERT_TRUE(decompress(buf, &new_msg));
+    ASSERT_EQ(old_msg.text(), new_msg.text());
+    ASSERT_EQ(3, new_msg.numbers_size());
+    ASSERT_EQ(2, new_msg.numbers(0));
+    ASSERT_EQ(7, new_msg.numbers(1));
+    ASSERT_EQ(45, new_msg.numbers(2));
+}
+
+void CompressMessage(const char* method_name, int num,
+                     const snappy_message::SnappyMessageProto& msg,
+                     int len, Compress compress, Decompress decompress) {
+    butil::Timer timer;
+    size_t compression_length = 0;
+    int64_t total_compress_time = 0;
+    int64_t total_decompress_time = 0;
+    snappy_message::SnappyMessageProto new_msg;
+    for (int index = 0; index < num; index++) {
+        butil::IOBuf buf;
+        timer.start();
+        ASSERT_TRUE(compress(msg, &buf));
+        timer.stop();
+        total_compress_time += timer.n_elapsed();
+        compression_length += buf.length();
+        timer.start();
+        ASSERT_TRUE(decompress(buf, &new_msg));
+        timer.stop();
+        total_decompress_time += timer.n_elapsed();
+    }
+    float compression_ratio = compression_length / (((double)num) * len);
+    printf("%20s%20d%20f%20f%30f%30f%29f%%\n", method_name, len,
+            total_compress_time/1000.0/num, total_decompress_time/1000.0/num,
+            1000000000.0/1024/1024*num*len/total_compress_time,
+            1000000000.0/1024/1024*num*len/total_decompress_time,
+            compression_ratio*100.0);
+}
+
+class CompressTest : public testing::Test {};
+
+#ifdef BRPC_WITH_LZ4
+TEST_F(CompressTest, lz4_iobuf) {
+    TestIOBufRoundTrip(brpc::policy::Lz4Compress, brpc::policy::Lz4Decompress);
+}
+
+TEST_F(CompressTest, lz4_message) {
+    TestMessageRoundTrip(brpc::policy::Lz4Compress, brpc::policy::Lz4Decompress);
+    ASSERT_STREQ("lz4", brpc::CompressTypeToCStr(brpc::COMPRESS_TYPE_LZ4));
+}
+#endif  // BRPC_WITH_LZ4
+
+#ifdef BRPC_WITH_ZSTD
+TEST_F(CompressTest, zstd_iobuf) {
+    TestIOBufRoundTrip(brpc::policy::ZstdCompress, brpc::policy::ZstdDecompress);
+}
+
+TEST_F(CompressTest, zstd_message) {
+    TestMessageRoundTrip(brpc::policy::ZstdCompress, brpc::policy::ZstdDecompress);
+    ASSERT_STREQ("zstd", brpc::CompressTypeToCStr(brpc::COMPRESS_TYPE_ZSTD));
+}
+#endif  // BRPC_WITH_ZSTD
+
+TEST_F(CompressTest, throughput_compare) {
+    const int len_subs[] = { 128, 1024, 16 * 1024, 512 * 1024, 4 * 1024 * 1024 };
+    printf("%20s%20s%20s%20s%30s%30s%30s\n", "Compress method", "Compress size(B)",
+           "Compress time(us)", "Decompress time(us)", "Compress throughput(MB/s)",
+           "Decompress throughput(MB/s)", "Compress ratio");
+    for (size_t i = 0; i < ARRAY_SIZE(len_subs); ++i) {
+        const int len = len_subs[i];
+        snappy_message::SnappyMessageProto msg;
+        msg.set_text(MakeText(len));
+        const int k = std::min(32 * 1024 * 1024 / len, 5000);
+        CompressMessage("Snappy", k, msg, len,
+                        brpc::policy::SnappyCompress,
+                        brpc::policy::SnappyDecompress);
+        CompressMessage("Gzip", k, msg, len,
+                        brpc::policy::GzipCompress,
+                        brpc::policy::GzipDecompress);
+#ifdef BRPC_WITH_LZ4
+        CompressMessage("LZ4", k, msg, len,
+                        brpc::policy::Lz4Compress,
+                        brpc::policy::Lz4Decompress);
+#endif
+#ifdef BRPC_WITH_ZSTD
+        CompressMessage("Zstd", k, msg, len,
+                        brpc::policy::ZstdCompress,
+                        brpc::policy::ZstdDecompress);
+#endif
+        printf("\n");
+    }
+}
+
+#ifdef BRPC_WITH_ZSTD
+// Run after others since the dictionary for compression can't be removed.
+TEST_F(CompressTest, zstd_dictionary) {
+    // Train a dictionary from small samples.
+    std::string samples;
+    std::vector<size_t> sample_sizes;
+    for (int i = 0; i < 2000; ++i) {
+        const std::string s = MakeText(200 + butil::fast_rand_less_than(200));
+        samples.append(s);
+        sample_sizes.push_back(s.size());
+    }
+    std::string dict;
+    dict.resize(16 * 1024);
+    const size_t dict_size = ZDICT_trainFromBuffer(
+        &dict[0], dict.size(), samples.data(),
+        &sample_sizes[0], sample_sizes.size());
+    ASSERT_FALSE(ZDICT_isError(dict_size)) << ZDICT_getErrorName(dict_size);
+    dict.resize(dict_size);
+
+    // Not a dictionary
+    ASSERT_EQ(-1, brpc::policy::AddZstdDictionary("not a dict", false));
+
+    butil::IOBuf in;
+    in.append(MakeText(300));
+    butil::IOBuf without_dict;
+    ASSERT_TRUE(brpc::policy::ZstdCompress(in, &without_dict));
+
+    ASSERT_EQ(0, brpc::policy::AddZstdDictionary(dict, true));
+    // Adding again is OK.
+    ASSERT_EQ(0, brpc::policy::AddZstdDictionary(dict, true));
+    butil::IOBuf with_dict;
+    ASSERT_TRUE(brpc::policy::ZstdCompress(in, &with_dict));
+    printf("without_dict=%zu with_dict=%zu\n",
+           without_dict.size(), with_dict.size());
+    ASSERT_LT(with_dict.size(), without_dict.size());
+
+    butil::IOBuf out;
+    ASSERT_TRUE(brpc::policy::ZstdDecompress(with_dict, &out));
+    ASSERT_EQ(in, out);
+    // Frames compressed without dictionary are still readable.
+    out.clear();
+    ASSERT_TRUE(brpc::policy::ZstdDecompress(without_dict, &out));
+    ASSERT_EQ(in, out);
+}
+#endif  // BRPC_WITH_ZSTD
+
+} // namespace
@@ -51,6 +51,9 @@
 #include "brpc/channel.h"
 #include "brpc/socket_map.h"
 #include "brpc/controller.h"
+#include "brpc/details/controller_private_accessor.h"
+#include "brpc/details/method_status.h"
+#include "bthread/task_group.h"
 #include "echo.pb.h"
 #include "v1.pb.h"
 #include "v2.pb.h"
@@ -64,6 +67,15 @@ int main(int argc, char* argv[]) {
 namespace brpc {
 DECLARE_bool(enable_threads_service);
 DECLARE_bool(enable_dir_service);
+DECLARE_int32(max_inline_latency_us);
+DECLARE_bool(shed_expired_requests);
+namespace policy {
+DECLARE_bool(baidu_std_protocol_deliver_timeout_ms);
+}
+}
+
+namespace bthread {
+extern BAIDU_THREAD_LOCAL TaskGroup* tls_task_group;
 }
 
 namespace {
@@ -1463,4 +1475,197 @@ TEST_F(ServerTest, max_concurrency) {
     stub.Echo(&cntl4, &req, NULL, NULL);
     ASSERT_FALSE(cntl4.Failed()) << cntl4.ErrorText();
 }
+
+class PriorityEchoService : public test::EchoService {
+public:
+    PriorityEchoService() : nhigh_priority(0) {}
+    virtual void Echo(google::protobuf::RpcController*,
+                      const test::EchoRequest* request,
+                      test::EchoResponse* response,
+                      google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        bthread::TaskGroup* g = bthread::tls_task_group;
+        if (g != NULL &&
+            (g->current_task()->attr.flags & BTHREAD_HIGH_PRIORITY)) {
+            nhigh_priority.fetch_add(1);
+        }
+        response->set_message(request->message());
+    }
+    butil::atomic<int> nhigh_priority;
+};
+
+TEST_F(ServerTest, high_priority_method) {
+    const int port = 9201;
+    brpc::Server server;
+    PriorityEchoService service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(-1, server.SetMethodHighPriority("test.EchoService.NotExist"));
+    ASSERT_EQ(0, server.SetMethodHighPriority("test.EchoService.Echo"));
+    ASSERT_EQ(0, server.SetMethodHighPriority("test.EchoService", "ComboEcho",
+                                              false));
+    ASSERT_EQ(0, server.Start(port, NULL));
+    ASSERT_EQ(-1, server.SetMethodHighPriority("test.EchoService.Echo", false));
+
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("0.0.0.0", port, NULL));
+    test::EchoService_Stub stub(&channel);
+    for (int i = 0; i < 3; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message(EXP_REQUEST);
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(EXP_REQUEST, res.message());
+    }
+    ASSERT_EQ(3, service.nhigh_priority.load());
+    server.Stop(0);
+    server.Join();
+}
+
+TEST_F(ServerTest, invalid_bthread_tag) {
+    brpc::Server server;
+    EchoServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    brpc::ServerOptions opt;
+    // Only the default pool exists.
+    opt.bthread_tag = 1;
+    ASSERT_EQ(-1, server.Start(9202, &opt));
+    opt.bthread_tag = BTHREAD_TAG_INVALID;
+    ASSERT_EQ(-1, server.Start(9202, &opt));
+    opt.bthread_tag = BTHREAD_TAG_DEFAULT;
+    ASSERT_EQ(0, server.Start(9202, &opt));
+    server.Stop(0);
+    server.Join();
+}
+
+static int64_t SendBatchAndCountInline(brpc::Channel* channel) {
+    const int64_t ninline0 = atoll(bvar::Variable::describe_exposed(
+            "rpc_inline_processed_count").c_str());
+    const size_t N = 8;
+    brpc::Controller cntl[N];
+    test::EchoRequest req[N];
+    test::EchoResponse res[N];
+    brpc::CallId cids[N];
+    test::EchoService_Stub stub(channel);
+    for (size_t i = 0; i < N; ++i) {
+        req[i].set_message(EXP_REQUEST);
+        cids[i] = cntl[i].call_id();
+        stub.Echo(&cntl[i], &req[i], &res[i], brpc::DoNothing());
+    }
+    for (size_t i = 0; i < N; ++i) {
+        brpc::Join(cids[i]);
+        EXPECT_FALSE(cntl[i].Failed()) << cntl[i].ErrorText();
+        EXPECT_EQ(EXP_RESPONSE, res[i].message());
+    }
+    return atoll(bvar::Variable::describe_exposed(
+            "rpc_inline_processed_count").c_str()) - ninline0;
+}
+
+TEST_F(ServerTest, inline_safe_method) {
+    const int port = 9203;
+    brpc::Server server;
+    EchoServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(-1, server.SetMethodInlineSafe("test.EchoService.NotExist"));
+    ASSERT_EQ(0, server.SetMethodInlineSafe("test.EchoService", "Echo"));
+    ASSERT_EQ(0, server.Start(port, NULL));
+    ASSERT_EQ(-1, server.SetMethodInlineSafe("test.EchoService.Echo", false));
+
+    // Batched requests are read at once, all but the last of them would be
+    // processed in new bthreads otherwise.
+    brpc::ChannelOptions opt;
+    opt.batch_window_us = 10000;
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("0.0.0.0", port, &opt));
+    ASSERT_GT(SendBatchAndCountInline(&channel), 0);
+
+    // Not inlined when the method is "slow".
+    const int32_t saved_max_latency = brpc::FLAGS_max_inline_latency_us;
+    brpc::FLAGS_max_inline_latency_us = -1;
+    ASSERT_EQ(0, SendBatchAndCountInline(&channel));
+    brpc::FLAGS_max_inline_latency_us = saved_max_latency;
+    server.Stop(0);
+    server.Join();
+}
+
+int64_t GetShedCount(const char* name) {
+    return atoll(bvar::Variable::describe_exposed(name).c_str());
+}
+
+TEST_F(ServerTest, shed_queued_requests) {
+    const int port = 9204;
+    brpc::Server server;
+    EchoServiceImpl service;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(-1, server.SetMethodMaxQueueTime("test.EchoService.NotExist", 1000));
+    ASSERT_EQ(-1, server.SetMethodMaxQueueTime("test.EchoService.Echo", -1));
+    ASSERT_EQ(0, server.SetMethodMaxQueueTime("test.EchoService", "ComboEcho",
+                                              100000));
+    ASSERT_EQ(0, server.Start(port, NULL));
+    ASSERT_EQ(-1, server.SetMethodMaxQueueTime("test.EchoService.Echo", 0));
+
+    // Requests in time are not affected.
+    const bool saved_deliver = brpc::policy::FLAGS_baidu_std_protocol_deliver_timeout_ms;
+    brpc::policy::FLAGS_baidu_std_protocol_deliver_timeout_ms = true;
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("0.0.0.0", port, NULL));
+    test::EchoService_Stub stub(&channel);
+    {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message(EXP_REQUEST);
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    }
+    brpc::policy::FLAGS_baidu_std_protocol_deliver_timeout_ms = saved_deliver;
+
+    const int64_t nexpired0 = GetShedCount("rpc_server_shed_expired_count");
+    const int64_t nqueued0 = GetShedCount("rpc_server_shed_queue_time_count");
+
+    // Queued longer than max_queue_time_us of the method.
+    brpc::MethodStatus* combo_status = server.FindMethodPropertyByFullName(
+        "test.EchoService", "ComboEcho")->status;
+    {
+        brpc::Controller cntl;
+        brpc::ControllerPrivateAccessor(&cntl).set_begin_time_us(
+            butil::cpuwide_time_us() - 50000);
+        ASSERT_TRUE(combo_status->CheckQueueTime(&cntl));
+        brpc::ControllerPrivateAccessor(&cntl).set_begin_time_us(
+            butil::cpuwide_time_us() - 200000);
+        ASSERT_FALSE(combo_status->CheckQueueTime(&cntl));
+        ASSERT_EQ(brpc::ELIMIT, cntl.ErrorCode());
+    }
+    ASSERT_EQ(nqueued0 + 1, GetShedCount("rpc_server_shed_queue_time_count"));
+
+    // Timeout from the client has expired.
+    brpc::MethodStatus* echo_status = server.FindMethodPropertyByFullName(
+        "test.EchoService", "Echo")->status;
+    {
+        brpc::Controller cntl;
+        cntl.set_timeout_ms(10);
+        brpc::ControllerPrivateAccessor(&cntl).set_begin_time_us(
+            butil::cpuwide_time_us() - 20000);
+        brpc::FLAGS_shed_expired_requests = false;
+        ASSERT_TRUE(echo_status->CheckQueueTime(&cntl));
+        brpc::FLAGS_shed_expired_requests = true;
+        ASSERT_FALSE(echo_status->CheckQueueTime(&cntl));
+        ASSERT_EQ(brpc::ERPCTIMEDOUT, cntl.ErrorCode());
+    }
+    {
+        // gRPC requests carry deadlines instead.
+        brpc::Controller cntl;
+        brpc::ControllerPrivateAccessor accessor(&cntl);
+        accessor.set_begin_time_us(butil::cpuwide_time_us());
+        accessor.set_deadline_us(butil::gettimeofday_us() + 1000000);
+        ASSERT_TRUE(echo_status->CheckQueueTime(&cntl));
+        accessor.set_deadline_us(butil::gettimeofday_us() - 1000);
+        ASSERT_FALSE(echo_status->CheckQueueTime(&cntl));
+        ASSERT_EQ(brpc::ERPCTIMEDOUT, cntl.ErrorCode());
+    }
+    ASSERT_EQ(nexpired0 + 2, GetShedCount("rpc_server_shed_expired_count"));
+    server.Stop(0);
+    server.Join();
+}
 } //namespace
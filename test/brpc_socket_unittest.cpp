@@ -28,6 +28,7 @@
 #include "butil/time.h"
 #include "butil/macros.h"
 #include "butil/fd_utility.h"
+#include "butil/fd_guard.h"
 #include "bthread/unstable.h"
 #include "bthread/task_control.h"
 #include "brpc/socket.h"
@@ -40,6 +41,7 @@
 #include "brpc/server.h"
 #include "brpc/channel.h"
 #include "brpc/controller.h"
+#include "brpc/details/zerocopy.h"
 #include "health_check.pb.h"
 #if defined(OS_MACOSX)
 #include <sys/event.h>
@@ -53,6 +55,8 @@ extern TaskControl* g_task_control;
 
 namespace brpc {
 DECLARE_int32(health_check_interval);
+DECLARE_bool(socket_write_combining);
+extern SocketVarsCollector* g_vars;
 }
 
 void EchoProcessHuluRequest(brpc::InputMessageBase* msg_base);
@@ -66,7 +70,8 @@ int main(int argc, char* argv[]) {
                                brpc::policy::PackHuluRequest,
                                EchoProcessHuluRequest, EchoProcessHuluRequest,
                                NULL, NULL, NULL,
-                               brpc::CONNECTION_TYPE_ALL, "dummy_hulu" };
+                               brpc::CONNECTION_TYPE_ALL, "dummy_hulu",
+                               NULL, NULL };
     EXPECT_EQ(0,  RegisterProtocol((brpc::ProtocolType)30, dummy_protocol));
     return RUN_ALL_TESTS();
 }
@@ -325,7 +330,8 @@ TEST_F(SocketTest, single_threaded_connect_and_write) {
     brpc::Acceptor* messenger = new brpc::Acceptor;
     const brpc::InputMessageHandler pairs[] = {
         { brpc::policy::ParseHuluMessage, 
-          EchoProcessHuluRequest, NULL, NULL, "dummy_hulu" }
+          EchoProcessHuluRequest, NULL, NULL, "dummy_hulu",
+          NULL, NULL }
     };
 
     butil::EndPoint point(butil::IP_ANY, 7878);
@@ -714,7 +720,8 @@ TEST_F(SocketTest, health_check) {
 
     const brpc::InputMessageHandler pairs[] = {
         { brpc::policy::ParseHuluMessage, 
-          EchoProcessHuluRequest, NULL, NULL, "dummy_hulu" }
+          EchoProcessHuluRequest, NULL, NULL, "dummy_hulu",
+          NULL, NULL }
     };
 
     int listening_fd = tcp_listen(point);
@@ -900,6 +907,127 @@ TEST_F(SocketTest, multi_threaded_write) {
     }
 }
 
+TEST_F(SocketTest, multi_threaded_write_with_combining) {
+    const size_t REP = 5000;
+    const size_t NSOCK = 4;
+    brpc::FLAGS_socket_write_combining = true;
+    int fds[NSOCK][2];
+    brpc::SocketId ids[NSOCK];
+    pthread_t th[NSOCK * 2];
+    WriterArg args[ARRAY_SIZE(th)];
+    butil::EndPoint dummy;
+    ASSERT_EQ(0, str2endpoint("192.168.1.26:8080", &dummy));
+    for (size_t i = 0; i < NSOCK; ++i) {
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]));
+        butil::make_non_blocking(fds[i][0]);
+        brpc::SocketOptions options;
+        options.fd = fds[i][1];
+        options.remote_side = dummy;
+        ASSERT_EQ(0, brpc::Socket::Create(options, &ids[i]));
+        brpc::SocketUniquePtr s;
+        ASSERT_EQ(0, brpc::Socket::Address(ids[i], &s));
+        s->_ssl_state = brpc::SSL_OFF;
+    }
+    // Two writers for each socket.
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        args[i].times = REP;
+        args[i].offset = i * REP;
+        args[i].socket_id = ids[i % NSOCK];
+        ASSERT_EQ(0, pthread_create(&th[i], NULL, Writer, &args[i]));
+    }
+    for (size_t i = 0; i < NSOCK; ++i) {
+        std::vector<size_t> result;
+        butil::IOPortal dest;
+        const int64_t start_time = butil::gettimeofday_us();
+        while (result.size() < REP * 2) {
+            ssize_t nr = dest.append_from_file_descriptor(fds[i][0], 32768);
+            if (nr < 0) {
+                ASSERT_TRUE(errno == EINTR || errno == EAGAIN) << berror();
+                bthread_usleep(1000);
+                ASSERT_LT(butil::gettimeofday_us(), start_time + 2000000L)
+                    << "Wait too long!";
+                continue;
+            }
+            while (dest.length() >= NUMBER_WIDTH) {
+                char buf[NUMBER_WIDTH + 1];
+                dest.copy_to(buf, NUMBER_WIDTH);
+                buf[sizeof(buf)-1] = 0;
+                result.push_back(strtol(buf, NULL, 10));
+                dest.pop_front(NUMBER_WIDTH);
+            }
+        }
+        ASSERT_TRUE(dest.empty());
+        // Numbers from each writer must be in order.
+        size_t last[2] = { 0, 0 };
+        size_t count[2] = { 0, 0 };
+        for (size_t j = 0; j < result.size(); ++j) {
+            const size_t w = (result[j] / REP == i ? 0 : 1);
+            ASSERT_EQ(i + w * NSOCK, result[j] / REP);
+            if (count[w]++) {
+                ASSERT_LT(last[w], result[j]);
+            }
+            last[w] = result[j];
+        }
+        ASSERT_EQ(REP, count[0]);
+        ASSERT_EQ(REP, count[1]);
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, pthread_join(th[i], NULL));
+    }
+    brpc::FLAGS_socket_write_combining = false;
+    for (size_t i = 0; i < NSOCK; ++i) {
+        brpc::SocketUniquePtr s;
+        ASSERT_EQ(0, brpc::Socket::Address(ids[i], &s));
+        ASSERT_EQ(0, s->SetFailed());
+        close(fds[i][0]);
+    }
+}
+
+TEST_F(SocketTest, write_in_place_with_combining) {
+    brpc::FLAGS_socket_write_combining = true;
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    butil::make_non_blocking(fds[0]);
+    brpc::SocketOptions options;
+    options.fd = fds[1];
+    brpc::SocketId id;
+    ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+    brpc::SocketUniquePtr s;
+    ASSERT_EQ(0, brpc::Socket::Address(id, &s));
+    s->_ssl_state = brpc::SSL_OFF;
+
+    // Small writes complete in the calling thread.
+    butil::IOBuf src;
+    src.append("hello world");
+    ASSERT_EQ(0, s->Write(&src));
+    char buf[16];
+    ASSERT_EQ(11, read(fds[0], buf, sizeof(buf)));
+    ASSERT_EQ(0, memcmp(buf, "hello world", 11));
+
+    // The part not written in-place is left to the combiner.
+    std::string big(4 * 1024 * 1024, 0);
+    for (size_t i = 0; i < big.size(); ++i) {
+        big[i] = (char)i;
+    }
+    src.append(big);
+    ASSERT_EQ(0, s->Write(&src));
+    butil::IOPortal dest;
+    const int64_t start_time = butil::gettimeofday_us();
+    while (dest.size() < big.size()) {
+        const ssize_t nr = dest.append_from_file_descriptor(fds[0], 65536);
+        if (nr < 0) {
+            ASSERT_TRUE(errno == EINTR || errno == EAGAIN) << berror();
+            bthread_usleep(1000);
+            ASSERT_LT(butil::gettimeofday_us(), start_time + 2000000L)
+                << "Wait too long!";
+        }
+    }
+    ASSERT_EQ(big, dest.to_string());
+    brpc::FLAGS_socket_write_combining = false;
+    ASSERT_EQ(0, s->SetFailed());
+    close(fds[0]);
+}
+
 void* FastWriter(void* void_arg) {
     WriterArg* arg = static_cast<WriterArg*>(void_arg);
     brpc::SocketUniquePtr sock;
@@ -1016,3 +1144,235 @@ TEST_F(SocketTest, multi_threaded_write_perf) {
     ASSERT_EQ((brpc::Socket*)NULL, global_sock);
     close(fds[0]);
 }
+
+struct ZeroCopyReaderArg {
+    int fd;
+    size_t expected;
+    size_t nread;
+    size_t nmismatch;
+};
+
+void* zerocopy_reader(void* void_arg) {
+    ZeroCopyReaderArg* arg = static_cast<ZeroCopyReaderArg*>(void_arg);
+    const size_t LEN = 32768;
+    char* buf = (char*)malloc(LEN);
+    while (arg->nread < arg->expected) {
+        ssize_t nr = read(arg->fd, buf, LEN);
+        if (nr <= 0) {
+            printf("Fail to read, %m\n");
+            break;
+        }
+        for (ssize_t i = 0; i < nr; ++i) {
+            if (buf[i] != (char)((arg->nread + i) % 251)) {
+                ++arg->nmismatch;
+            }
+        }
+        arg->nread += nr;
+    }
+    free(buf);
+    return NULL;
+}
+
+TEST_F(SocketTest, zerocopy_write) {
+    butil::EndPoint point(butil::IP_ANY, 0);
+    butil::fd_guard listening_fd(tcp_listen(point));
+    ASSERT_GT(listening_fd, 0);
+    ASSERT_EQ(0, butil::get_local_side(listening_fd, &point));
+    ASSERT_EQ(0, butil::str2ip("127.0.0.1", &point.ip));
+    butil::fd_guard client_fd(butil::tcp_connect(point, NULL));
+    ASSERT_GT(client_fd, 0);
+    butil::fd_guard server_fd(accept(listening_fd, NULL, NULL));
+    ASSERT_GT(server_fd, 0);
+
+    brpc::SocketId id = 8888;
+    brpc::SocketOptions options;
+    options.fd = client_fd.release();
+    options.use_zerocopy = true;
+    ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+    brpc::SocketUniquePtr s;
+    ASSERT_EQ(0, brpc::Socket::Address(id, &s));
+    ASSERT_TRUE(s->_zerocopy != NULL);
+    if (!s->_zerocopy->enabled()) {
+        printf("MSG_ZEROCOPY is not supported, skip\n");
+        ASSERT_EQ(0, s->SetFailed());
+        return;
+    }
+
+    const size_t N = 16;
+    const size_t PAYLOAD = 256 * 1024;
+    ZeroCopyReaderArg reader_arg = { server_fd, N * PAYLOAD, 0, 0 };
+    pthread_t rth;
+    ASSERT_EQ(0, pthread_create(&rth, NULL, zerocopy_reader, &reader_arg));
+
+    const int64_t old_bytes = brpc::g_vars->nzerocopy_bytes.get_value();
+    size_t offset = 0;
+    for (size_t i = 0; i < N; ++i) {
+        butil::IOBuf src;
+        for (size_t j = 0; j < PAYLOAD; ++j, ++offset) {
+            src.push_back((char)(offset % 251));
+        }
+        ASSERT_EQ(0, s->Write(&src));
+        ASSERT_TRUE(src.empty());
+    }
+    pthread_join(rth, NULL);
+    ASSERT_EQ(N * PAYLOAD, reader_arg.nread);
+    ASSERT_EQ(0u, reader_arg.nmismatch);
+    // The first write large enough must be sent with MSG_ZEROCOPY. Later
+    // writes may fall back to copying after the kernel reports copied
+    // completions, e.g. over loopback.
+    ASSERT_LT(old_bytes, brpc::g_vars->nzerocopy_bytes.get_value());
+
+    // All data is received, the kernel must complete all sends soon.
+    const int64_t start_time = butil::gettimeofday_us();
+    while (true) {
+        s->ReapZeroCopyCompletions();
+        if (s->_zerocopy->pending_count() == 0) {
+            break;
+        }
+        ASSERT_LT(butil::gettimeofday_us(), start_time + 5000000L);
+        bthread_usleep(1000);
+    }
+    ASSERT_EQ(0u, s->_zerocopy->pending_bytes());
+
+    // Small writes are copied.
+    const int64_t old_bytes2 = brpc::g_vars->nzerocopy_bytes.get_value();
+    butil::IOBuf small;
+    small.append("hello");
+    ASSERT_EQ(0, s->Write(&small));
+    char buf[8];
+    ASSERT_EQ(5, read(server_fd, buf, sizeof(buf)));
+    ASSERT_EQ(old_bytes2, brpc::g_vars->nzerocopy_bytes.get_value());
+    ASSERT_EQ(0, s->SetFailed());
+}
+
+struct ZeroCopyReaperArg {
+    brpc::ZeroCopyTracker* tracker;
+    int fd;
+    butil::atomic<bool> stop;
+};
+
+void* zerocopy_reaper(void* void_arg) {
+    ZeroCopyReaperArg* arg = static_cast<ZeroCopyReaperArg*>(void_arg);
+    while (!arg->stop.load(butil::memory_order_relaxed)) {
+        arg->tracker->Reap(arg->fd);
+    }
+    return NULL;
+}
+
+TEST_F(SocketTest, zerocopy_reap_while_sending) {
+    butil::EndPoint point(butil::IP_ANY, 0);
+    butil::fd_guard listening_fd(tcp_listen(point));
+    ASSERT_GT(listening_fd, 0);
+    ASSERT_EQ(0, butil::get_local_side(listening_fd, &point));
+    ASSERT_EQ(0, butil::str2ip("127.0.0.1", &point.ip));
+    butil::fd_guard client_fd(butil::tcp_connect(point, NULL));
+    ASSERT_GT(client_fd, 0);
+    butil::fd_guard server_fd(accept(listening_fd, NULL, NULL));
+    ASSERT_GT(server_fd, 0);
+    if (brpc::ZeroCopyTracker::EnableOnFileDescriptor(client_fd) != 0) {
+        printf("MSG_ZEROCOPY is not supported, skip\n");
+        return;
+    }
+
+    const size_t N = 2000;
+    const size_t PAYLOAD = 16 * 1024;
+    ZeroCopyReaderArg reader_arg = { server_fd, N * PAYLOAD, 0, 0 };
+    pthread_t rth;
+    ASSERT_EQ(0, pthread_create(&rth, NULL, zerocopy_reader, &reader_arg));
+
+    // Completions over loopback arrive almost immediately and are likely
+    // to be reaped before sendmsg returns to the sender.
+    brpc::ZeroCopyTracker tracker;
+    tracker.Reset(true);
+    ZeroCopyReaperArg reaper_arg;
+    reaper_arg.tracker = &tracker;
+    reaper_arg.fd = client_fd;
+    reaper_arg.stop = false;
+    pthread_t reap_th;
+    ASSERT_EQ(0, pthread_create(&reap_th, NULL, zerocopy_reaper, &reaper_arg));
+
+    size_t offset = 0;
+    for (size_t i = 0; i < N; ++i) {
+        butil::IOBuf src;
+        for (size_t j = 0; j < PAYLOAD; ++j, ++offset) {
+            src.push_back((char)(offset % 251));
+        }
+        while (!src.empty()) {
+            butil::IOBuf* pieces[] = { &src };
+            const ssize_t nw = tracker.CutMultipleIntoFileDescriptor(
+                client_fd, pieces, 1);
+            if (nw < 0) {
+                ASSERT_TRUE(errno == EAGAIN || errno == ENOBUFS) << berror();
+                bthread_usleep(100);
+            }
+        }
+    }
+    pthread_join(rth, NULL);
+    ASSERT_EQ(N * PAYLOAD, reader_arg.nread);
+    ASSERT_EQ(0u, reader_arg.nmismatch);
+
+    // Every send must be completed, including the ones whose completions
+    // were reaped before they were queued.
+    const int64_t start_time = butil::gettimeofday_us();
+    while (tracker.pending_count() != 0) {
+        ASSERT_LT(butil::gettimeofday_us(), start_time + 5000000L)
+            << "pending_count=" << tracker.pending_count();
+        bthread_usleep(1000);
+    }
+    ASSERT_EQ(0u, tracker.pending_bytes());
+    reaper_arg.stop = true;
+    pthread_join(reap_th, NULL);
+}
+
+TEST_F(SocketTest, zerocopy_close_with_pending_sends) {
+    butil::EndPoint point(butil::IP_ANY, 0);
+    butil::fd_guard listening_fd(tcp_listen(point));
+    ASSERT_GT(listening_fd, 0);
+    ASSERT_EQ(0, butil::get_local_side(listening_fd, &point));
+    ASSERT_EQ(0, butil::str2ip("127.0.0.1", &point.ip));
+    butil::fd_guard client_fd(butil::tcp_connect(point, NULL));
+    ASSERT_GT(client_fd, 0);
+    butil::fd_guard server_fd(accept(listening_fd, NULL, NULL));
+    ASSERT_GT(server_fd, 0);
+    if (brpc::ZeroCopyTracker::EnableOnFileDescriptor(client_fd) != 0) {
+        printf("MSG_ZEROCOPY is not supported, skip\n");
+        return;
+    }
+
+    const size_t N = 4;
+    const size_t PAYLOAD = 16 * 1024;
+    brpc::ZeroCopyTracker tracker;
+    tracker.Reset(true);
+    size_t offset = 0;
+    for (size_t i = 0; i < N; ++i) {
+        butil::IOBuf src;
+        for (size_t j = 0; j < PAYLOAD; ++j, ++offset) {
+            src.push_back((char)(offset % 251));
+        }
+        butil::IOBuf* pieces[] = { &src };
+        ASSERT_EQ((ssize_t)PAYLOAD, tracker.CutMultipleIntoFileDescriptor(
+                      client_fd, pieces, 1));
+    }
+    // Nothing is reaped yet.
+    ASSERT_EQ(N, tracker.pending_count());
+
+    // Pending sends are moved to the reaper along with the fd.
+    const int closing_fd = client_fd.release();
+    tracker.CloseFileDescriptor(closing_fd);
+    ASSERT_EQ(0u, tracker.pending_count());
+    ASSERT_EQ(0u, tracker.pending_bytes());
+
+    // Queued data is still sent, followed by EOF.
+    ZeroCopyReaderArg reader_arg = { server_fd, N * PAYLOAD, 0, 0 };
+    zerocopy_reader(&reader_arg);
+    ASSERT_EQ(N * PAYLOAD, reader_arg.nread);
+    ASSERT_EQ(0u, reader_arg.nmismatch);
+    char buf[8];
+    ASSERT_EQ(0, read(server_fd, buf, sizeof(buf)));
+    // The fd is closed after the completions are reaped.
+    const int64_t start_time = butil::gettimeofday_us();
+    while (fcntl(closing_fd, F_GETFD) >= 0) {
+        ASSERT_LT(butil::gettimeofday_us(), start_time + 5000000L);
+        bthread_usleep(1000);
+    }
+}
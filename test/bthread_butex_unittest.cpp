@@ -342,6 +342,42 @@ TEST(ButexTest, stop_after_slept) {
     }
 }
 
+butil::atomic<int> g_async_timedout(0);
+
+void on_async_wakeup(void*, int error) {
+    if (error == ETIMEDOUT) {
+        g_async_timedout.fetch_add(1, butil::memory_order_relaxed);
+    }
+}
+
+TEST(ButexTest, wait_async_with_tiny_timeout) {
+    // Deadlines just beyond MIN_SLEEP_US(2us) in butex.cpp make the timer
+    // fire while butex_wait_async() is still queueing the waiter, none of
+    // the timeouts should be lost.
+    int* butex = bthread::butex_create_checked<int>();
+    ASSERT_TRUE(butex);
+    *butex = 0;
+    g_async_timedout.store(0);
+    int nqueued = 0;
+    for (int i = 0; i < 20000; ++i) {
+        const timespec abstime = butil::microseconds_from_now(3 + i % 8);
+        if (bthread::butex_wait_async(butex, 0, &abstime,
+                                      on_async_wakeup, NULL) == 0) {
+            ++nqueued;
+        } else {
+            ASSERT_EQ(ETIMEDOUT, errno);
+        }
+    }
+    const int64_t deadline_us = butil::gettimeofday_us() + 2000000L;
+    while (g_async_timedout.load() != nqueued &&
+           butil::gettimeofday_us() < deadline_us) {
+        usleep(1000);
+    }
+    ASSERT_EQ(nqueued, g_async_timedout.load());
+    ASSERT_EQ(0, bthread::butex_wake_all(butex));
+    bthread::butex_destroy(butex);
+}
+
 TEST(ButexTest, stop_just_when_sleeping) {
     butil::Timer tm;
     const long SLEEP_MSEC = 100;
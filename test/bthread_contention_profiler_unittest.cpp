@@ -0,0 +1,104 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <stdio.h>
+#include <gtest/gtest.h>
+#include "butil/time.h"
+#include "butil/file_util.h"
+#include "butil/files/file_path.h"
+#include "bthread/bthread.h"
+#include "bthread/countdown_event.h"
+#include "bthread/contention_profiler.h"
+
+namespace {
+
+const char* const PROF_FILE = "./contention_profiler_unittest.prof";
+
+// Returns number of sampled contentions in the profile, sum of durations
+// is stored in `total_ns'.
+int read_contentions(const char* filename, int64_t* total_ns) {
+    *total_ns = 0;
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    int n = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        long long duration_ns = 0;
+        size_t count = 0;
+        if (sscanf(line, "%lld %zu @", &duration_ns, &count) == 2) {
+            ++n;
+            *total_ns += duration_ns;
+        }
+    }
+    fclose(fp);
+    return n;
+}
+
+TEST(ContentionProfilerTest, off_by_default) {
+    ASSERT_EQ(0u, bthread::contention_sampling_range());
+    ASSERT_TRUE(bthread::start_async_contention() == NULL);
+}
+
+void* delayed_signal(void* arg) {
+    bthread_usleep(20000);
+    static_cast<bthread::CountdownEvent*>(arg)->signal();
+    return NULL;
+}
+
+struct AsyncArg {
+    bthread::SampledContention* c;
+};
+
+void* delayed_end(void* arg) {
+    bthread_usleep(20000);
+    bthread::end_async_contention(static_cast<AsyncArg*>(arg)->c);
+    return NULL;
+}
+
+TEST(ContentionProfilerTest, sample_waits) {
+    ASSERT_TRUE(bthread::ContentionProfilerStart(PROF_FILE));
+    ASSERT_FALSE(bthread::ContentionProfilerStart(PROF_FILE));
+    for (int i = 0; i < 5; ++i) {
+        bthread::CountdownEvent event(1);
+        bthread_t th;
+        ASSERT_EQ(0, bthread_start_background(&th, NULL, delayed_signal, &event));
+        ASSERT_EQ(0, event.wait());
+        ASSERT_EQ(0, bthread_join(th, NULL));
+
+        AsyncArg arg = { bthread::start_async_contention() };
+        if (arg.c) {
+            ASSERT_EQ(0, bthread_start_background(&th, NULL, delayed_end, &arg));
+            ASSERT_EQ(0, bthread_join(th, NULL));
+        }
+    }
+    // Wait for the collector to dump samples.
+    bthread_usleep(1500000);
+    bthread::ContentionProfilerStop();
+
+    int64_t total_ns = 0;
+    const int n = read_contentions(PROF_FILE, &total_ns);
+    butil::DeleteFile(butil::FilePath(PROF_FILE), false);
+    // Samples with same stacks are combined.
+    ASSERT_GE(n, 1);
+    ASSERT_GE(total_ns, 20000000L);
+    ASSERT_EQ(0u, bthread::contention_sampling_range());
+}
+
+} // namespace
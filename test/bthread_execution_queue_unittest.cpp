@@ -704,4 +704,136 @@ TEST_F(ExecutionQueueTest, cancel_unexecuted_high_priority_task) {
 
     ASSERT_EQ(12345, result);
 }
+
+const int BATCH_SIZE = 16;
+
+void* push_batch_thread_with_id(void* arg) {
+    bthread::ExecutionQueueId<LongIntTask> id = { (uint64_t)arg };
+    int thread_id = num_threads.fetch_add(1, butil::memory_order_relaxed);
+    LongIntTask tasks[BATCH_SIZE];
+    for (int i = 0; i < 100000; i += BATCH_SIZE) {
+        for (int j = 0; j < BATCH_SIZE; ++j) {
+            tasks[j].value = ((long)thread_id << 32) | (i + j);
+        }
+        EXPECT_EQ(0, bthread::execution_queue_execute_batch(
+                      id, tasks, BATCH_SIZE));
+    }
+    return NULL;
+}
+
+long last_batch_task = -1;
+
+int check_batch_order(void* meta, bthread::TaskIterator<LongIntTask>& iter) {
+    for (; iter; ++iter) {
+        const long value = iter->value;
+        // Tasks of a batch are not interleaved with tasks of other batches.
+        if ((value & 0xFFFFFFFFul) % BATCH_SIZE != 0 &&
+            value != last_batch_task + 1) {
+            EXPECT_TRUE(false) << "value=" << value
+                               << " last=" << last_batch_task;
+            ++*(long*)meta;
+        }
+        last_batch_task = value;
+    }
+    return check_order(meta, iter);
+}
+
+TEST_F(ExecutionQueueTest, execute_batch_in_order) {
+    memset(next_task, 0, sizeof(next_task));
+    num_threads.store(0);
+    long disorder_times = 0;
+    bthread::ExecutionQueueId<LongIntTask> queue_id = { 0 };
+    bthread::ExecutionQueueOptions options;
+    ASSERT_EQ(0, bthread::execution_queue_start(&queue_id, &options,
+                                                check_batch_order, &disorder_times));
+    pthread_t threads[12];
+    for (size_t i = 0; i < ARRAY_SIZE(threads); ++i) {
+        pthread_create(&threads[i], NULL, &push_batch_thread_with_id,
+                       (void *)queue_id.value);
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(threads); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    ASSERT_EQ(0, bthread::execution_queue_stop(queue_id));
+    ASSERT_EQ(0, bthread::execution_queue_join(queue_id));
+    ASSERT_EQ(0, disorder_times);
+}
+
+TEST_F(ExecutionQueueTest, execute_batch_in_place) {
+    pthread_t thread_id = pthread_self();
+    bthread::ExecutionQueueId<LongIntTask> queue_id = { 0 };
+    bthread::ExecutionQueueOptions options;
+    ASSERT_EQ(0, bthread::execution_queue_start(&queue_id, &options,
+                                                check_running_thread,
+                                                (void*)thread_id));
+    LongIntTask tasks[10];
+    ASSERT_EQ(0, bthread::execution_queue_execute_batch(
+                  queue_id, tasks, ARRAY_SIZE(tasks), &bthread::TASK_OPTIONS_INPLACE));
+    ASSERT_EQ(0, bthread::execution_queue_execute_batch(
+                  queue_id, tasks, 0, &bthread::TASK_OPTIONS_INPLACE));
+    ASSERT_EQ(0, bthread::execution_queue_stop(queue_id));
+    ASSERT_EQ(0, bthread::execution_queue_join(queue_id));
+    ASSERT_EQ(EINVAL, bthread::execution_queue_execute_batch(
+                  queue_id, tasks, ARRAY_SIZE(tasks)));
+}
+
+TEST_F(ExecutionQueueTest, execute_batch_with_handles_and_stats) {
+    bthread::ExecutionQueueId<LongIntTask> queue_id = { 0 };
+    bthread::ExecutionQueueOptions options;
+    options.bvar_prefix = "execq_batch_test";
+    int64_t result = 0;
+    ASSERT_EQ(0, bthread::execution_queue_start(&queue_id, &options,
+                                                add_with_suspend3, &result));
+    // Push a normal task to make the executor suspend
+    ASSERT_EQ(0, bthread::execution_queue_execute(queue_id, -100));
+    while (!g_suspending) {
+        usleep(10);
+    }
+    LongIntTask tasks[8];
+    bthread::TaskHandle handles[ARRAY_SIZE(tasks)];
+    for (size_t i = 0; i < ARRAY_SIZE(tasks); ++i) {
+        tasks[i].value = 1 << i;
+    }
+    ASSERT_EQ(0, bthread::execution_queue_execute_batch(
+                  queue_id, tasks, ARRAY_SIZE(tasks), NULL, handles));
+    ASSERT_EQ(0, bthread::execution_queue_cancel(handles[1]));
+    ASSERT_EQ(0, bthread::execution_queue_cancel(handles[6]));
+    ASSERT_NE("", bvar::Variable::describe_exposed("execq_batch_test_batch_size"));
+    ASSERT_NE("", bvar::Variable::describe_exposed("execq_batch_test_execute_latency"));
+    g_suspending = false;
+    ASSERT_EQ(0, bthread::execution_queue_stop(queue_id));
+    ASSERT_EQ(0, bthread::execution_queue_join(queue_id));
+    ASSERT_EQ(255 - 2 - 64, result);
+
+    // Removed when the queue is destroyed.
+    ASSERT_EQ("", bvar::Variable::describe_exposed("execq_batch_test_batch_size"));
+}
+
+TEST_F(ExecutionQueueTest, execute_batch_performance) {
+    const int N = 1000000;
+    const int BATCH = 64;
+    std::vector<LongIntTask> tasks(BATCH, LongIntTask(1));
+    for (int batch = 1; batch <= BATCH; batch *= BATCH) {
+        int64_t result = 0;
+        bthread::ExecutionQueueId<LongIntTask> queue_id = { 0 };
+        bthread::ExecutionQueueOptions options;
+        ASSERT_EQ(0, bthread::execution_queue_start(&queue_id, &options,
+                                                    add, &result));
+        butil::Timer tm;
+        tm.start();
+        for (int i = 0; i < N; i += batch) {
+            if (batch == 1) {
+                ASSERT_EQ(0, bthread::execution_queue_execute(queue_id, tasks[0]));
+            } else {
+                ASSERT_EQ(0, bthread::execution_queue_execute_batch(
+                              queue_id, &tasks[0], batch));
+            }
+        }
+        ASSERT_EQ(0, bthread::execution_queue_stop(queue_id));
+        ASSERT_EQ(0, bthread::execution_queue_join(queue_id));
+        tm.stop();
+        ASSERT_EQ(N, result);
+        LOG(INFO) << "batch=" << batch << " " << tm.n_elapsed() / N << "ns/task";
+    }
+}
 } // namespace
@@ -0,0 +1,131 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
+#include "butil/time.h"
+#include "butil/macros.h"
+#include "bthread/bthread.h"
+#include "bthread/numa.h"
+#include "bthread/task_control.h"
+#include "bthread/task_group.h"
+
+DECLARE_bool(bthread_numa_aware);
+
+namespace bthread {
+extern TaskControl* g_task_control;
+extern BAIDU_THREAD_LOCAL TaskGroup* tls_task_group;
+}
+
+namespace {
+
+TEST(NumaTest, parse_cpu_list) {
+    std::vector<int> cpus;
+    ASSERT_EQ(0, bthread::parse_cpu_list("0", &cpus));
+    ASSERT_EQ(1u, cpus.size());
+    ASSERT_EQ(0, cpus[0]);
+
+    ASSERT_EQ(0, bthread::parse_cpu_list("0-3,8,10-11\n", &cpus));
+    const int expected[] = { 0, 1, 2, 3, 8, 10, 11 };
+    ASSERT_EQ(ARRAY_SIZE(expected), cpus.size());
+    for (size_t i = 0; i < ARRAY_SIZE(expected); ++i) {
+        ASSERT_EQ(expected[i], cpus[i]);
+    }
+
+    ASSERT_EQ(0, bthread::parse_cpu_list("\n", &cpus));
+    ASSERT_TRUE(cpus.empty());
+
+    ASSERT_EQ(-1, bthread::parse_cpu_list("3-1", &cpus));
+    ASSERT_EQ(-1, bthread::parse_cpu_list("1,a", &cpus));
+    ASSERT_EQ(-1, bthread::parse_cpu_list("1;2", &cpus));
+}
+
+butil::atomic<int> g_nchecked(0);
+butil::atomic<int> g_nmismatch(0);
+
+void* check_numa_node(void*) {
+    const int node = bthread::tls_numa_node;
+    bthread::ContextualStack* stk =
+        bthread::tls_task_group->current_task()->stack;
+    if (node < 0 || node != bthread::tls_task_group->_numa_node ||
+        (node < bthread::MAX_NUMA_STACK_POOLS && stk->numa_node != node)) {
+        g_nmismatch.fetch_add(1);
+    }
+    g_nchecked.fetch_add(1);
+    return NULL;
+}
+
+void* spawn_and_join(void*) {
+    bthread_t th[16];
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        EXPECT_EQ(0, bthread_start_urgent(&th[i], NULL, check_numa_node, NULL));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        EXPECT_EQ(0, bthread_join(th[i], NULL));
+    }
+    return NULL;
+}
+
+// Must be the first test creating bthreads in this file since the flag is
+// read when TaskControl is initialized.
+TEST(NumaTest, numa_aware_scheduling) {
+    const int nnode = bthread::numa_node_count();
+    ASSERT_GE(nnode, 1);
+    FLAGS_bthread_numa_aware = true;
+
+    bthread_t th[64];
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, bthread_start_background(&th[i], NULL, spawn_and_join, NULL));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], NULL));
+    }
+    ASSERT_EQ((int)(ARRAY_SIZE(th) * 16), g_nchecked.load());
+    ASSERT_EQ(0, g_nmismatch.load());
+
+    bthread::TaskControl* c = bthread::g_task_control;
+    ASSERT_TRUE(c != NULL);
+    ASSERT_EQ(nnode, c->numa_node_count());
+    size_t nworker[8] = { 0 };
+    const size_t ngroup = c->_ngroup.load();
+    for (size_t i = 0; i < ngroup; ++i) {
+        const int node = c->_groups[i]->_numa_node;
+        ASSERT_TRUE(node >= 0 && node < nnode) << node;
+        ++nworker[node % ARRAY_SIZE(nworker)];
+    }
+    // Workers are spread evenly.
+    for (int i = 0; i < nnode && i < (int)ARRAY_SIZE(nworker); ++i) {
+        ASSERT_GE(nworker[i], ngroup / nnode);
+    }
+    size_t nlocal_group = 0;
+    for (int i = 0; i < nnode; ++i) {
+        nlocal_group += c->_node_groups[i].ngroup.load();
+    }
+    ASSERT_EQ(ngroup, nlocal_group);
+
+    // Tasks were pushed into runqueues of a few workers and stolen by others.
+    const int64_t nlocal = c->get_cumulated_local_steal_count();
+    const int64_t nremote = c->get_cumulated_remote_steal_count();
+    LOG(INFO) << "local_steal=" << nlocal << " remote_steal=" << nremote;
+    ASSERT_GT(nlocal + nremote, 0);
+    if (nnode == 1) {
+        ASSERT_EQ(0, nremote);
+    }
+}
+
+} // namespace
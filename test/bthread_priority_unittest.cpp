@@ -0,0 +1,126 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include "butil/atomicops.h"
+#include "butil/macros.h"
+#include "bthread/bthread.h"
+#include "bthread/task_group.h"
+
+DECLARE_int32(task_group_ntags);
+
+namespace bthread {
+DECLARE_int32(bthread_concurrency);
+extern __thread TaskGroup* tls_task_group;
+}
+
+namespace {
+
+butil::atomic<int> g_order(0);
+
+void* record_order(void* arg) {
+    *(int*)arg = g_order.fetch_add(1);
+    return NULL;
+}
+
+void* create_tasks_and_yield(void* hp_order) {
+    int orders[9];
+    bthread_t th[ARRAY_SIZE(orders)];
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL | BTHREAD_NOSIGNAL;
+    // Normal tasks are queued before the high-priority one.
+    for (size_t i = 0; i + 1 < ARRAY_SIZE(th); ++i) {
+        EXPECT_EQ(0, bthread_start_background(&th[i], &attr, record_order,
+                                              &orders[i]));
+    }
+    attr.flags |= BTHREAD_HIGH_PRIORITY;
+    const size_t hp = ARRAY_SIZE(th) - 1;
+    EXPECT_EQ(0, bthread_start_background(&th[hp], &attr, record_order,
+                                          &orders[hp]));
+    bthread_yield();
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        EXPECT_EQ(0, bthread_join(th[i], NULL));
+    }
+    *(int*)hp_order = orders[hp];
+    return NULL;
+}
+
+// Run the test in a pool with a single worker, otherwise other workers may
+// steal and run normal tasks before the high-priority one.
+int start_in_single_worker_pool(void* (*fn)(void*), void* arg) {
+    bthread_t th;
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+    bthread_attr_settag(&attr, 1);
+    const int rc = bthread_start_background(&th, &attr, fn, arg);
+    if (rc != 0) {
+        return rc;
+    }
+    return bthread_join(th, NULL);
+}
+
+TEST(PriorityTest, high_priority_runs_first) {
+    int hp_order = -1;
+    ASSERT_EQ(0, start_in_single_worker_pool(create_tasks_and_yield,
+                                             &hp_order));
+    ASSERT_EQ(0, hp_order);
+}
+
+void* create_tasks_and_wake_remotely(void* hp_order) {
+    int orders[9];
+    bthread_t th[ARRAY_SIZE(orders)];
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL | BTHREAD_NOSIGNAL;
+    attr.flags |= BTHREAD_HIGH_PRIORITY;
+    const size_t hp = ARRAY_SIZE(th) - 1;
+    EXPECT_EQ(0, bthread_start_background(&th[hp], &attr, record_order,
+                                          &orders[hp]));
+    // Move the high-priority task into the remote queue as if it was woken
+    // up by a non-worker pthread.
+    bthread::TaskGroup* g = bthread::tls_task_group;
+    bthread_t tid = 0;
+    EXPECT_TRUE(g->_hp_rq.pop(&tid));
+    EXPECT_EQ(th[hp], tid);
+    g->ready_to_run_remote(tid, true);
+    attr.flags &= ~BTHREAD_HIGH_PRIORITY;
+    for (size_t i = 0; i < hp; ++i) {
+        EXPECT_EQ(0, bthread_start_background(&th[i], &attr, record_order,
+                                              &orders[i]));
+    }
+    bthread_yield();
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        EXPECT_EQ(0, bthread_join(th[i], NULL));
+    }
+    *(int*)hp_order = orders[hp];
+    return NULL;
+}
+
+TEST(PriorityTest, remote_high_priority_runs_before_local_tasks) {
+    g_order.store(0);
+    int hp_order = -1;
+    ASSERT_EQ(0, start_in_single_worker_pool(create_tasks_and_wake_remotely,
+                                             &hp_order));
+    ASSERT_EQ(0, hp_order);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    // One worker per pool. Must be set before the first bthread is created.
+    bthread::FLAGS_bthread_concurrency = BTHREAD_MIN_CONCURRENCY;
+    FLAGS_task_group_ntags = BTHREAD_MIN_CONCURRENCY;
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,199 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <algorithm>                        // std::sort
+#include <vector>
+#include <gtest/gtest.h>
+#include "butil/time.h"
+#include "butil/macros.h"
+#include "butil/containers/bounded_queue.h"
+#include "butil/synchronization/lock.h"
+#include "bthread/remote_task_queue.h"
+
+namespace {
+
+const size_t NPRODUCER = 4;
+const size_t NCONSUMER = 2;
+const size_t N_PER_PRODUCER = 50000;
+const size_t N = NPRODUCER * N_PER_PRODUCER;
+
+// The queue used before, kept to compare contentions.
+class MutexRemoteTaskQueue {
+public:
+    explicit MutexRemoteTaskQueue(size_t cap) {
+        const size_t memsize = sizeof(bthread_t) * cap;
+        butil::BoundedQueue<bthread_t> q(malloc(memsize), memsize,
+                                         butil::OWNS_STORAGE);
+        _tasks.swap(q);
+    }
+    bool pop(bthread_t* task) {
+        if (_tasks.empty()) {
+            return false;
+        }
+        BAIDU_SCOPED_LOCK(_mutex);
+        return _tasks.pop(task);
+    }
+    bool push(bthread_t task) {
+        BAIDU_SCOPED_LOCK(_mutex);
+        return _tasks.push(task);
+    }
+private:
+    butil::BoundedQueue<bthread_t> _tasks;
+    butil::Mutex _mutex;
+};
+
+struct ProducerArg {
+    bthread::RemoteTaskQueue* q;
+    MutexRemoteTaskQueue* mq;
+    bthread::TaskMeta* metas;
+    size_t begin;
+};
+
+volatile bool g_stop = false;
+butil::atomic<size_t> g_nproducing(0);
+
+void* push_thread(void* void_arg) {
+    ProducerArg* arg = (ProducerArg*)void_arg;
+    for (size_t i = arg->begin; i < arg->begin + N_PER_PRODUCER; ++i) {
+        if (arg->q) {
+            arg->q->push(&arg->metas[i]);
+        } else {
+            while (!arg->mq->push(i)) {
+                sched_yield();
+            }
+        }
+    }
+    g_nproducing.fetch_sub(1);
+    return NULL;
+}
+
+void* pop_all_thread(void* arg) {
+    bthread::RemoteTaskQueue* q = (bthread::RemoteTaskQueue*)arg;
+    std::vector<bthread_t>* popped = new std::vector<bthread_t>;
+    popped->reserve(N);
+    while (true) {
+        const bool last_try = (g_nproducing.load() == 0);
+        for (bthread::TaskMeta* m = q->pop_all(); m; m = m->remote_next) {
+            popped->push_back(m->tid);
+        }
+        if (last_try) {
+            break;
+        }
+    }
+    return popped;
+}
+
+void* pop_thread(void* arg) {
+    MutexRemoteTaskQueue* q = (MutexRemoteTaskQueue*)arg;
+    std::vector<bthread_t>* popped = new std::vector<bthread_t>;
+    popped->reserve(N);
+    while (true) {
+        const bool last_try = (g_nproducing.load() == 0);
+        bthread_t tid;
+        while (q->pop(&tid)) {
+            popped->push_back(tid);
+        }
+        if (last_try) {
+            break;
+        }
+    }
+    return popped;
+}
+
+// Run NPRODUCER producers and NCONSUMER consumers over `q' or `mq',
+// returns elapsed nanoseconds and all popped values in `values'.
+int64_t run_producers_and_consumers(bthread::RemoteTaskQueue* q,
+                                    MutexRemoteTaskQueue* mq,
+                                    bthread::TaskMeta* metas,
+                                    std::vector<bthread_t>* values) {
+    pthread_t pth[NPRODUCER];
+    pthread_t cth[NCONSUMER];
+    ProducerArg args[NPRODUCER];
+    g_nproducing.store(NPRODUCER);
+    butil::Timer tm;
+    tm.start();
+    for (size_t i = 0; i < NCONSUMER; ++i) {
+        EXPECT_EQ(0, pthread_create(&cth[i], NULL,
+                                    (q ? pop_all_thread : pop_thread),
+                                    (q ? (void*)q : (void*)mq)));
+    }
+    for (size_t i = 0; i < NPRODUCER; ++i) {
+        args[i].q = q;
+        args[i].mq = mq;
+        args[i].metas = metas;
+        args[i].begin = i * N_PER_PRODUCER;
+        EXPECT_EQ(0, pthread_create(&pth[i], NULL, push_thread, &args[i]));
+    }
+    for (size_t i = 0; i < NPRODUCER; ++i) {
+        pthread_join(pth[i], NULL);
+    }
+    values->clear();
+    for (size_t i = 0; i < NCONSUMER; ++i) {
+        std::vector<bthread_t>* res = NULL;
+        pthread_join(cth[i], (void**)&res);
+        values->insert(values->end(), res->begin(), res->end());
+        delete res;
+    }
+    tm.stop();
+    return tm.n_elapsed();
+}
+
+TEST(RemoteTaskQueueTest, sanity) {
+    bthread::RemoteTaskQueue q;
+    ASSERT_TRUE(q.empty());
+    ASSERT_TRUE(q.pop_all() == NULL);
+    bthread::TaskMeta metas[3];
+    for (size_t i = 0; i < ARRAY_SIZE(metas); ++i) {
+        metas[i].tid = i;
+        q.push(&metas[i]);
+        ASSERT_FALSE(q.empty());
+    }
+    // Popped in pushing order.
+    bthread::TaskMeta* m = q.pop_all();
+    ASSERT_TRUE(q.empty());
+    for (size_t i = 0; i < ARRAY_SIZE(metas); ++i, m = m->remote_next) {
+        ASSERT_EQ(&metas[i], m);
+    }
+    ASSERT_TRUE(m == NULL);
+    ASSERT_TRUE(q.pop_all() == NULL);
+}
+
+TEST(RemoteTaskQueueTest, multiple_producers_and_consumers) {
+    bthread::TaskMeta* metas = new bthread::TaskMeta[N];
+    for (size_t i = 0; i < N; ++i) {
+        metas[i].tid = i;
+    }
+    bthread::RemoteTaskQueue q;
+    std::vector<bthread_t> values;
+    const int64_t lockfree_ns = run_producers_and_consumers(&q, NULL, metas, &values);
+    ASSERT_TRUE(q.empty());
+    std::sort(values.begin(), values.end());
+    ASSERT_EQ(N, values.size());
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_EQ(i, values[i]);
+    }
+    delete [] metas;
+
+    MutexRemoteTaskQueue mq(N);
+    const int64_t mutex_ns = run_producers_and_consumers(NULL, &mq, NULL, &values);
+    ASSERT_EQ(N, values.size());
+    std::cout << NPRODUCER << " producers and " << NCONSUMER
+              << " consumers: lock-free=" << lockfree_ns / N
+              << "ns/task mutex=" << mutex_ns / N << "ns/task" << std::endl;
+}
+
+} // namespace
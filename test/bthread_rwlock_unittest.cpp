@@ -22,6 +22,8 @@
 #include <gtest/gtest.h>
 #include "butil/time.h"
 #include "butil/macros.h"
+#include "butil/atomicops.h"
+#include "bthread/bthread.h"
 
 namespace {
 void* read_thread(void* arg) {
@@ -76,4 +78,209 @@ TEST(RWLockTest, rdlock_performance) {
     pthread_mutex_destroy(&lock1);
 #endif
 }
+
+TEST(RWLockTest, sanity) {
+    bthread_rwlock_t rw;
+    ASSERT_EQ(0, bthread_rwlock_init(&rw, NULL));
+    ASSERT_EQ(0, bthread_rwlock_rdlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_tryrdlock(&rw));
+    ASSERT_EQ(EBUSY, bthread_rwlock_trywrlock(&rw));
+    timespec abstime = butil::milliseconds_from_now(10);
+    ASSERT_EQ(ETIMEDOUT, bthread_rwlock_timedwrlock(&rw, &abstime));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+
+    ASSERT_EQ(0, bthread_rwlock_wrlock(&rw));
+    ASSERT_EQ(EBUSY, bthread_rwlock_tryrdlock(&rw));
+    ASSERT_EQ(EBUSY, bthread_rwlock_trywrlock(&rw));
+    abstime = butil::milliseconds_from_now(10);
+    ASSERT_EQ(ETIMEDOUT, bthread_rwlock_timedrdlock(&rw, &abstime));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+
+    ASSERT_EQ(0, bthread_rwlock_trywrlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_tryrdlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_destroy(&rw));
+
+    bthread_rwlockattr_t attr;
+    ASSERT_EQ(0, bthread_rwlockattr_init(&attr));
+    int kind = -1;
+    ASSERT_EQ(0, bthread_rwlockattr_getkind_np(&attr, &kind));
+    ASSERT_EQ(PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP, kind);
+    ASSERT_EQ(0, bthread_rwlockattr_destroy(&attr));
+}
+
+void* wrlock_and_unlock(void* arg) {
+    bthread_rwlock_t* rw = (bthread_rwlock_t*)arg;
+    EXPECT_EQ(0, bthread_rwlock_wrlock(rw));
+    EXPECT_EQ(0, bthread_rwlock_unlock(rw));
+    return NULL;
+}
+
+TEST(RWLockTest, writer_preference) {
+    bthread_rwlock_t rw;
+    ASSERT_EQ(0, bthread_rwlock_init(&rw, NULL));
+    ASSERT_EQ(0, bthread_rwlock_rdlock(&rw));
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_urgent(&th, NULL, wrlock_and_unlock, &rw));
+    bthread_usleep(10000);
+    // The writer is waiting, new readers are blocked.
+    ASSERT_EQ(EBUSY, bthread_rwlock_tryrdlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+    ASSERT_EQ(0, bthread_join(th, NULL));
+    ASSERT_EQ(0, bthread_rwlock_tryrdlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+
+    // Readers are let in after the writer timed out.
+    ASSERT_EQ(0, bthread_rwlock_rdlock(&rw));
+    const timespec abstime = butil::milliseconds_from_now(10);
+    ASSERT_EQ(ETIMEDOUT, bthread_rwlock_timedwrlock(&rw, &abstime));
+    ASSERT_EQ(0, bthread_rwlock_tryrdlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_unlock(&rw));
+    ASSERT_EQ(0, bthread_rwlock_destroy(&rw));
+}
+
+struct MixedArg {
+    bthread::RWLock* rw;
+    int64_t a;
+    int64_t b;
+    butil::atomic<int64_t> nread;
+    butil::atomic<int64_t> nerror;
+    volatile bool stop;
+};
+
+void* read_and_check(void* void_arg) {
+    MixedArg* arg = (MixedArg*)void_arg;
+    while (!arg->stop) {
+        arg->rw->lock_shared();
+        if (arg->a != arg->b) {
+            arg->nerror.fetch_add(1);
+        }
+        arg->rw->unlock_shared();
+        arg->nread.fetch_add(1, butil::memory_order_relaxed);
+    }
+    return NULL;
+}
+
+void* write_both(void* void_arg) {
+    MixedArg* arg = (MixedArg*)void_arg;
+    for (int i = 0; i < 1000; ++i) {
+        arg->rw->lock();
+        ++arg->a;
+        bthread_yield();
+        ++arg->b;
+        arg->rw->unlock();
+    }
+    return NULL;
+}
+
+TEST(RWLockTest, mixed_readers_and_writers) {
+    bthread::RWLock rw;
+    MixedArg arg;
+    arg.rw = &rw;
+    arg.a = 0;
+    arg.b = 0;
+    arg.nread = 0;
+    arg.nerror = 0;
+    arg.stop = false;
+    // Readers never yield, leave workers for writers.
+    bthread_t rth[4];
+    bthread_t wth[4];
+    for (size_t i = 0; i < ARRAY_SIZE(rth); ++i) {
+        ASSERT_EQ(0, bthread_start_background(&rth[i], NULL, read_and_check, &arg));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(wth); ++i) {
+        ASSERT_EQ(0, bthread_start_background(&wth[i], NULL, write_both, &arg));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(wth); ++i) {
+        ASSERT_EQ(0, bthread_join(wth[i], NULL));
+    }
+    arg.stop = true;
+    for (size_t i = 0; i < ARRAY_SIZE(rth); ++i) {
+        ASSERT_EQ(0, bthread_join(rth[i], NULL));
+    }
+    ASSERT_EQ(0, arg.nerror.load());
+    ASSERT_EQ(4000, arg.a);
+    ASSERT_EQ(4000, arg.b);
+    ASSERT_GT(arg.nread.load(), 0);
+}
+
+enum LockType {
+    BTHREAD_RWLOCK,
+    BTHREAD_MUTEX,
+    PTHREAD_RWLOCK,
+};
+
+struct PerfArg {
+    LockType type;
+    bthread_rwlock_t* brw;
+    bthread_mutex_t* bmu;
+    pthread_rwlock_t* prw;
+    int write_percent;
+};
+
+void* lock_loop(void* void_arg) {
+    const PerfArg* arg = (PerfArg*)void_arg;
+    const int N = 100000;
+    for (int i = 0; i < N; ++i) {
+        const bool write = (i % 100 < arg->write_percent);
+        switch (arg->type) {
+        case BTHREAD_RWLOCK:
+            if (write) {
+                bthread_rwlock_wrlock(arg->brw);
+            } else {
+                bthread_rwlock_rdlock(arg->brw);
+            }
+            bthread_rwlock_unlock(arg->brw);
+            break;
+        case BTHREAD_MUTEX:
+            bthread_mutex_lock(arg->bmu);
+            bthread_mutex_unlock(arg->bmu);
+            break;
+        case PTHREAD_RWLOCK:
+            if (write) {
+                pthread_rwlock_wrlock(arg->prw);
+            } else {
+                pthread_rwlock_rdlock(arg->prw);
+            }
+            pthread_rwlock_unlock(arg->prw);
+            break;
+        }
+    }
+    return NULL;
+}
+
+TEST(RWLockTest, contention_performance) {
+    bthread_rwlock_t brw;
+    bthread_mutex_t bmu;
+    pthread_rwlock_t prw;
+    ASSERT_EQ(0, bthread_rwlock_init(&brw, NULL));
+    ASSERT_EQ(0, bthread_mutex_init(&bmu, NULL));
+    ASSERT_EQ(0, pthread_rwlock_init(&prw, NULL));
+    const char* const names[] = { "bthread_rwlock", "bthread_mutex", "pthread_rwlock" };
+    const int write_percents[] = { 0, 1, 10 };
+    for (size_t w = 0; w < ARRAY_SIZE(write_percents); ++w) {
+        for (int t = BTHREAD_RWLOCK; t <= PTHREAD_RWLOCK; ++t) {
+            PerfArg arg = { (LockType)t, &brw, &bmu, &prw, write_percents[w] };
+            bthread_t th[16];
+            butil::Timer tm;
+            tm.start();
+            for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+                ASSERT_EQ(0, bthread_start_background(&th[i], NULL, lock_loop, &arg));
+            }
+            for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+                ASSERT_EQ(0, bthread_join(th[i], NULL));
+            }
+            tm.stop();
+            printf("%s with %d%% writes: %ldns/op\n", names[t], write_percents[w],
+                   tm.n_elapsed() / (100000L * (long)ARRAY_SIZE(th)));
+        }
+    }
+    ASSERT_EQ(0, bthread_rwlock_destroy(&brw));
+    ASSERT_EQ(0, bthread_mutex_destroy(&bmu));
+    ASSERT_EQ(0, pthread_rwlock_destroy(&prw));
+}
+
 } // namespace
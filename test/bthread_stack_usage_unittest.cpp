@@ -0,0 +1,118 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include <sstream>
+#include "butil/macros.h"
+#include "bthread/bthread.h"
+#include "bthread/stack.h"
+
+DECLARE_bool(bthread_stack_shrink);
+DECLARE_int32(bthread_stack_usage_sample_interval);
+
+namespace {
+
+void touch_stack(size_t size) {
+    char* buf = (char*)alloca(size);
+    memset(buf, 1, size);
+    asm volatile("" : : "r"(buf) : "memory");
+}
+
+void* use_200k_stack(void*) {
+    touch_stack(200 * 1024);
+    return NULL;
+}
+
+void* use_little_stack(void*) {
+    return NULL;
+}
+
+void dummy_entry(intptr_t) {}
+
+TEST(StackUsageTest, shrink_stack) {
+    bthread::ContextualStack* s =
+        bthread::get_stack(bthread::STACK_TYPE_NORMAL, dummy_entry);
+    ASSERT_TRUE(s != NULL);
+    const int64_t size = s->storage.stacksize;
+    ASSERT_GT(size, 300 * 1024);
+    // Touch the lower 300KB.
+    memset((char*)s->storage.bottom - size, 1, 300 * 1024);
+    ASSERT_EQ(size, bthread::get_stack_usage(s));
+    bthread::shrink_stack(s);
+    // The initial context is kept.
+    const int64_t usage = bthread::get_stack_usage(s);
+    ASSERT_GE(usage, 0);
+    ASSERT_LE(usage, 8192);
+    bthread::return_stack(s);
+}
+
+TEST(StackUsageTest, sample_by_function) {
+    FLAGS_bthread_stack_usage_sample_interval = 1;
+    for (int i = 0; i < 10; ++i) {
+        bthread_t th[2];
+        ASSERT_EQ(0, bthread_start_background(&th[0], NULL, use_200k_stack, NULL));
+        ASSERT_EQ(0, bthread_start_background(&th[1], NULL, use_little_stack, NULL));
+        ASSERT_EQ(0, bthread_join(th[0], NULL));
+        ASSERT_EQ(0, bthread_join(th[1], NULL));
+    }
+    FLAGS_bthread_stack_usage_sample_interval = 0;
+
+    std::vector<bthread::StackUsage> usages;
+    bthread::get_stack_usages(&usages);
+    int nfound = 0;
+    for (size_t i = 0; i < usages.size(); ++i) {
+        const bthread::StackUsage& u = usages[i];
+        ASSERT_EQ(bthread::STACK_TYPE_NORMAL, u.stacktype);
+        if (u.fn == use_200k_stack) {
+            ++nfound;
+            ASSERT_EQ(10, u.count);
+            ASSERT_GE(u.max_bytes, 200 * 1024);
+            ASSERT_GE(u.total_bytes, 10 * 200 * 1024);
+        } else if (u.fn == use_little_stack) {
+            ++nfound;
+            ASSERT_EQ(10, u.count);
+            // Pages touched by bthread itself.
+            ASSERT_LT(u.max_bytes, 32 * 1024);
+        }
+    }
+    ASSERT_EQ(2, nfound);
+
+    std::ostringstream os;
+    bthread::print_stack_usages(os);
+    LOG(INFO) << "\n" << os.str();
+    ASSERT_NE(std::string::npos, os.str().find("suggested"));
+}
+
+TEST(StackUsageTest, shrink_on_return) {
+    FLAGS_bthread_stack_shrink = true;
+    bthread::ContextualStack* s =
+        bthread::get_stack(bthread::STACK_TYPE_NORMAL, dummy_entry);
+    ASSERT_TRUE(s != NULL);
+    memset((char*)s->storage.bottom - s->storage.stacksize, 1, 300 * 1024);
+    bthread::return_stack(s);
+    // Got from the local cache of this thread again.
+    bthread::ContextualStack* s2 =
+        bthread::get_stack(bthread::STACK_TYPE_NORMAL, dummy_entry);
+    ASSERT_EQ(s, s2);
+    ASSERT_LE(bthread::get_stack_usage(s2), 8192);
+    bthread::return_stack(s2);
+    FLAGS_bthread_stack_shrink = false;
+}
+
+} // namespace
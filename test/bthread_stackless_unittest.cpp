@@ -0,0 +1,175 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
+#include "butil/macros.h"
+#include "butil/time.h"
+#include "bthread/bthread.h"
+#include "bthread/task_group.h"
+
+namespace bthread {
+extern BAIDU_THREAD_LOCAL TaskGroup* tls_task_group;
+}
+
+namespace logging {
+DECLARE_bool(crash_on_fatal_log);
+}
+
+namespace {
+
+butil::atomic<int> g_nrun(0);
+butil::atomic<int> g_non_stackless(0);
+butil::atomic<int> g_on_worker_stack(0);
+butil::atomic<int> g_on_borrowed_stack(0);
+
+void* check_stack(void*) {
+    bthread::TaskGroup* g = bthread::tls_task_group;
+    const bthread::TaskMeta* m = g->current_task();
+    if (m->attr.stack_type != BTHREAD_STACKTYPE_NONE) {
+        g_non_stackless.fetch_add(1);
+    }
+    if (m->stack == g->_main_stack) {
+        g_on_worker_stack.fetch_add(1);
+    } else if (m->stack != NULL &&
+               m->stack->stacktype == bthread::STACK_TYPE_NORMAL) {
+        g_on_borrowed_stack.fetch_add(1);
+    }
+    g_nrun.fetch_add(1);
+    return NULL;
+}
+
+void reset_counters() {
+    g_nrun.store(0);
+    g_non_stackless.store(0);
+    g_on_worker_stack.store(0);
+    g_on_borrowed_stack.store(0);
+}
+
+TEST(StacklessTest, run_on_worker_stack) {
+    reset_counters();
+    bthread_t th[100];
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, bthread_start_background(
+                      &th[i], &BTHREAD_ATTR_STACKLESS, check_stack, NULL));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], NULL));
+    }
+    ASSERT_EQ((int)ARRAY_SIZE(th), g_nrun.load());
+    ASSERT_EQ(0, g_non_stackless.load());
+    // Started from a pthread, run by main tasks of workers.
+    ASSERT_EQ((int)ARRAY_SIZE(th), g_on_worker_stack.load());
+}
+
+void* start_stackless_tasks_and_quit(void* arg) {
+    bthread_t* th = (bthread_t*)arg;
+    bthread_attr_t attr = BTHREAD_ATTR_STACKLESS | BTHREAD_NOSIGNAL;
+    for (size_t i = 0; i < 100; ++i) {
+        EXPECT_EQ(0, bthread_start_background(&th[i], &attr, check_stack, NULL));
+    }
+    // The worker runs the queued tasks on our stack after we quit.
+    return NULL;
+}
+
+TEST(StacklessTest, borrow_stack_of_ending_bthread) {
+    // Other workers may steal all the tasks and run them on their own
+    // stacks, try more times.
+    for (int i = 0; i < 100 && g_on_borrowed_stack.load() == 0; ++i) {
+        reset_counters();
+        bthread_t th[100];
+        bthread_t parent;
+        ASSERT_EQ(0, bthread_start_background(
+                      &parent, NULL, start_stackless_tasks_and_quit, th));
+        ASSERT_EQ(0, bthread_join(parent, NULL));
+        for (size_t j = 0; j < ARRAY_SIZE(th); ++j) {
+            ASSERT_EQ(0, bthread_join(th[j], NULL));
+        }
+        ASSERT_EQ((int)ARRAY_SIZE(th), g_nrun.load());
+        ASSERT_EQ(0, g_non_stackless.load());
+        ASSERT_EQ((int)ARRAY_SIZE(th),
+                  g_on_borrowed_stack.load() + g_on_worker_stack.load());
+    }
+    ASSERT_GT(g_on_borrowed_stack.load(), 0);
+}
+
+void* noop(void*) {
+    return NULL;
+}
+
+void* start_and_join_tiny_tasks(void* arg) {
+    const bthread_attr_t* attr = (const bthread_attr_t*)arg;
+    bthread_t th[64];
+    for (int round = 0; round < 500; ++round) {
+        for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+            EXPECT_EQ(0, bthread_start_background(&th[i], attr, noop, NULL));
+        }
+        for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+            EXPECT_EQ(0, bthread_join(th[i], NULL));
+        }
+    }
+    return NULL;
+}
+
+TEST(StacklessTest, performance) {
+    const bthread_attr_t* attrs[] = { &BTHREAD_ATTR_SMALL,
+                                      &BTHREAD_ATTR_STACKLESS };
+    const char* names[] = { "small", "stackless" };
+    for (size_t i = 0; i < ARRAY_SIZE(attrs); ++i) {
+        butil::Timer tm;
+        tm.start();
+        bthread_t th;
+        ASSERT_EQ(0, bthread_start_background(
+                      &th, NULL, start_and_join_tiny_tasks, (void*)attrs[i]));
+        ASSERT_EQ(0, bthread_join(th, NULL));
+        tm.stop();
+        LOG(INFO) << names[i] << ": " << tm.n_elapsed() / (500 * 64)
+                  << "ns per bthread";
+    }
+}
+
+#ifndef NDEBUG
+void* sleep_a_while(void*) {
+    bthread_usleep(100000);
+    return NULL;
+}
+
+void* join_bthread(void* arg) {
+    bthread_join(*(bthread_t*)arg, NULL);
+    return NULL;
+}
+
+void block_in_stackless_bthread() {
+    // Failed DCHECK only crashes with -crash_on_fatal_log.
+    ::logging::FLAGS_crash_on_fatal_log = true;
+    bthread_t sleeper;
+    ASSERT_EQ(0, bthread_start_background(&sleeper, NULL, sleep_a_while, NULL));
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(
+                  &th, &BTHREAD_ATTR_STACKLESS, join_bthread, &sleeper));
+    bthread_join(th, NULL);
+}
+
+TEST(StacklessTest, blocking_is_checked_in_debug_mode) {
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    ASSERT_DEATH(block_in_stackless_bthread(), "must not block");
+}
+#endif  // NDEBUG
+
+} // namespace
@@ -0,0 +1,201 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <string.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
+#include "butil/time.h"
+#include "bthread/bthread.h"
+#include "bthread/butex.h"
+#include "bthread/task_control.h"
+#include "bthread/task_group.h"
+
+DECLARE_int32(task_group_ntags);
+
+namespace bthread {
+extern TaskControl* g_task_control;
+extern BAIDU_THREAD_LOCAL TaskGroup* tls_task_group;
+}
+
+namespace {
+
+bthread_tag_t current_tag() {
+    return bthread::tls_task_group->tag();
+}
+
+// bthread_join() does not return values of bthreads, tags are saved in args.
+void* get_tag(void* tag) {
+    *(bthread_tag_t*)tag = current_tag();
+    return NULL;
+}
+
+void* start_in_pools(void* tag) {
+    bthread_t th;
+    bthread_tag_t child_tag = BTHREAD_TAG_INVALID;
+    // Inherit the pool of the creator.
+    EXPECT_EQ(0, bthread_start_background(&th, NULL, get_tag, &child_tag));
+    EXPECT_EQ(0, bthread_join(th, NULL));
+    EXPECT_EQ(current_tag(), child_tag);
+    child_tag = BTHREAD_TAG_INVALID;
+    EXPECT_EQ(0, bthread_start_urgent(&th, NULL, get_tag, &child_tag));
+    EXPECT_EQ(0, bthread_join(th, NULL));
+    EXPECT_EQ(current_tag(), child_tag);
+    // Zero-initialized tag (e.g. aggregates initialized with the first 3
+    // fields only) inherits the pool as well.
+    bthread_attr_t zero_attr;
+    memset(&zero_attr, 0, sizeof(zero_attr));
+    zero_attr.stack_type = BTHREAD_STACKTYPE_NORMAL;
+    child_tag = BTHREAD_TAG_INVALID;
+    EXPECT_EQ(0, bthread_start_background(&th, &zero_attr, get_tag,
+                                          &child_tag));
+    EXPECT_EQ(0, bthread_join(th, NULL));
+    EXPECT_EQ(current_tag(), child_tag);
+
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+    bthread_attr_settag(&attr, 2);
+    EXPECT_EQ(0, bthread_start_background(&th, &attr, get_tag, &child_tag));
+    EXPECT_EQ(0, bthread_join(th, NULL));
+    EXPECT_EQ(2, child_tag);
+    child_tag = BTHREAD_TAG_INVALID;
+    EXPECT_EQ(0, bthread_start_urgent(&th, &attr, get_tag, &child_tag));
+    EXPECT_EQ(0, bthread_join(th, NULL));
+    EXPECT_EQ(2, child_tag);
+    // Still in the original pool after joining bthreads of other pools.
+    *(bthread_tag_t*)tag = current_tag();
+    return NULL;
+}
+
+// Must be the first test creating bthreads in this file since the flag is
+// read when TaskControl is initialized.
+TEST(TagTest, start_in_pools) {
+    FLAGS_task_group_ntags = 3;
+    bthread_t th;
+    bthread_tag_t tag = BTHREAD_TAG_INVALID;
+    ASSERT_EQ(0, bthread_start_background(&th, NULL, get_tag, &tag));
+    ASSERT_EQ(0, bthread_join(th, NULL));
+    ASSERT_EQ(BTHREAD_TAG_DEFAULT, tag);
+
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+    bthread_attr_settag(&attr, 1);
+    ASSERT_EQ(0, bthread_start_background(&th, &attr, start_in_pools, &tag));
+    ASSERT_EQ(0, bthread_join(th, NULL));
+    ASSERT_EQ(1, tag);
+
+    bthread_attr_settag(&attr, 3);
+    ASSERT_EQ(EINVAL, bthread_start_background(&th, &attr, get_tag, &tag));
+
+    bthread::TaskControl* c = bthread::g_task_control;
+    ASSERT_EQ(3, c->tag_count());
+    int nworker = 0;
+    for (int i = 0; i < c->tag_count(); ++i) {
+        ASSERT_GE(c->concurrency(i), 1);
+        nworker += c->concurrency(i);
+    }
+    ASSERT_EQ(c->concurrency(), nworker);
+}
+
+TEST(TagTest, set_concurrency_by_tag) {
+    const int old_total = bthread_getconcurrency();
+    const int old_num = bthread_getconcurrency_by_tag(2);
+    ASSERT_GE(old_num, 1);
+    ASSERT_EQ(0, bthread_setconcurrency_by_tag(old_num + 2, 2));
+    ASSERT_EQ(old_num + 2, bthread_getconcurrency_by_tag(2));
+    ASSERT_EQ(old_total + 2, bthread_getconcurrency());
+    ASSERT_EQ(EPERM, bthread_setconcurrency_by_tag(old_num, 2));
+    ASSERT_EQ(EINVAL, bthread_setconcurrency_by_tag(4, 3));
+    ASSERT_EQ(0, bthread_getconcurrency_by_tag(3));
+}
+
+struct WaitArg {
+    butil::atomic<int>* butex;
+    bthread_tag_t tag_after_wait;
+    bthread_tag_t tag_after_sleep;
+};
+
+void* wait_butex(void* void_arg) {
+    WaitArg* arg = static_cast<WaitArg*>(void_arg);
+    while (arg->butex->load() == 0) {
+        bthread::butex_wait(arg->butex, 0, NULL);
+    }
+    arg->tag_after_wait = current_tag();
+    bthread_usleep(1000);
+    arg->tag_after_sleep = current_tag();
+    return NULL;
+}
+
+void* wake_butex(void* void_arg) {
+    WaitArg* arg = static_cast<WaitArg*>(void_arg);
+    bthread_usleep(10000);
+    arg->butex->store(1);
+    bthread::butex_wake(arg->butex);
+    return NULL;
+}
+
+TEST(TagTest, woken_up_in_own_pool) {
+    WaitArg arg;
+    arg.butex = bthread::butex_create_checked<butil::atomic<int> >();
+    arg.butex->store(0);
+    arg.tag_after_wait = BTHREAD_TAG_INVALID;
+    arg.tag_after_sleep = BTHREAD_TAG_INVALID;
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+    bthread_attr_settag(&attr, 1);
+    bthread_t waiter;
+    ASSERT_EQ(0, bthread_start_background(&waiter, &attr, wait_butex, &arg));
+    bthread_attr_settag(&attr, 2);
+    bthread_t waker;
+    ASSERT_EQ(0, bthread_start_background(&waker, &attr, wake_butex, &arg));
+    ASSERT_EQ(0, bthread_join(waiter, NULL));
+    ASSERT_EQ(0, bthread_join(waker, NULL));
+    ASSERT_EQ(1, arg.tag_after_wait);
+    ASSERT_EQ(1, arg.tag_after_sleep);
+    bthread::butex_destroy(arg.butex);
+}
+
+volatile bool g_stop_spinning = false;
+
+void* spin(void*) {
+    while (!g_stop_spinning) {}
+    return NULL;
+}
+
+TEST(TagTest, busy_pool_does_not_starve_others) {
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+    bthread_attr_settag(&attr, 1);
+    // Occupy all workers of pool 1 with bthreads never yielding.
+    const int nspin = bthread_getconcurrency_by_tag(1);
+    std::vector<bthread_t> spinners(nspin);
+    for (int i = 0; i < nspin; ++i) {
+        ASSERT_EQ(0, bthread_start_background(&spinners[i], &attr, spin, NULL));
+    }
+    bthread_usleep(10000);
+    bthread_attr_settag(&attr, 2);
+    bthread_t th;
+    bthread_tag_t tag = BTHREAD_TAG_INVALID;
+    ASSERT_EQ(0, bthread_start_background(&th, &attr, get_tag, &tag));
+    ASSERT_EQ(0, bthread_join(th, NULL));
+    ASSERT_EQ(2, tag);
+    // Pool 1 is still occupied.
+    ASSERT_FALSE(g_stop_spinning);
+    g_stop_spinning = true;
+    for (int i = 0; i < nspin; ++i) {
+        ASSERT_EQ(0, bthread_join(spinners[i], NULL));
+    }
+}
+
+} // namespace
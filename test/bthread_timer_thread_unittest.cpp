@@ -21,6 +21,7 @@
 #include "bthread/timer_thread.h"
 #include "bthread/bthread.h"
 #include "butil/logging.h"
+#include "butil/macros.h"
 
 namespace {
 
@@ -85,6 +86,12 @@ public:
         EXPECT_LE(labs(diff), 50000);
     }
     
+    // verify the task ran exactly once and not before the expected time.
+    void expect_run_once_not_early() {
+        ASSERT_EQ(1u, _run_times.size());
+        EXPECT_GE(timespec_diff_us(_run_times[0], _expect_run_time), 0);
+    }
+
     void expect_not_run() {
         EXPECT_TRUE(_run_times.empty());
     }
@@ -206,7 +213,7 @@ private:
 };
 
 // Perform schedule and unschedule inside a running task
-TEST(TimerThreadTest, schedule_and_unschedule_in_task) {
+void schedule_and_unschedule_in_task(const bthread::TimerThreadOptions* options) {
     bthread::TimerThread timer_thread;
     timespec past_time = { 0, 0 };
     timespec future_time = { std::numeric_limits<int>::max(), 0 };
@@ -218,7 +225,7 @@ TEST(TimerThreadTest, schedule_and_unschedule_in_task) {
     TimeKeeper keeper4(past_time, "keeper4");
     TimeKeeper keeper5(_500ms_after, "keeper5", 10000/*10s*/);
 
-    ASSERT_EQ(0, timer_thread.start(NULL));
+    ASSERT_EQ(0, timer_thread.start(options));
     keeper1.schedule(&timer_thread);  // start keeper1
     keeper3.schedule(&timer_thread);  // start keeper3
     timespec keeper3_addtime = butil::seconds_from_now(0);
@@ -254,4 +261,126 @@ TEST(TimerThreadTest, schedule_and_unschedule_in_task) {
     keeper5.expect_first_run();
 }
 
+TEST(TimerThreadTest, schedule_and_unschedule_in_task) {
+    schedule_and_unschedule_in_task(NULL);
+}
+
+TEST(TimerThreadTest, schedule_and_unschedule_in_task_with_wheel) {
+    bthread::TimerThreadOptions options;
+    options.use_timing_wheel = true;
+    schedule_and_unschedule_in_task(&options);
+}
+
+TEST(TimerThreadTest, timing_wheel) {
+    bthread::TimerThreadOptions options;
+    options.use_timing_wheel = true;
+    // Small ticks to cascade tasks from upper levels within seconds.
+    options.wheel_tick_us = 10;
+    bthread::TimerThread timer_thread;
+    ASSERT_EQ(0, timer_thread.start(&options));
+
+    const timespec past_time = { 0, 0 };
+    const timespec future_time = { std::numeric_limits<int>::max(), 0 };
+    const int delays_ms[] = { 1, 2, 3, 50, 700, 1200, 1200, 1500 };
+    std::vector<TimeKeeper*> keepers;
+    for (size_t i = 0; i < ARRAY_SIZE(delays_ms); ++i) {
+        keepers.push_back(new TimeKeeper(
+                butil::milliseconds_from_now(delays_ms[i])));
+        keepers.back()->schedule(&timer_thread);
+    }
+    TimeKeeper past_keeper(past_time, "past");
+    past_keeper.schedule(&timer_thread);
+    const timespec past_keeper_addtime = butil::seconds_from_now(0);
+    TimeKeeper future_keeper(future_time, "future");
+    future_keeper.schedule(&timer_thread);
+    TimeKeeper removed_keeper(butil::milliseconds_from_now(800), "removed");
+    removed_keeper.schedule(&timer_thread);
+    usleep(100000);
+    ASSERT_EQ(0, timer_thread.unschedule(removed_keeper._task_id));
+
+    sleep(2);
+    timer_thread.stop_and_join();
+
+    for (size_t i = 0; i < keepers.size(); ++i) {
+        keepers[i]->expect_first_run();
+        keepers[i]->expect_run_once_not_early();
+        delete keepers[i];
+    }
+    past_keeper.expect_first_run(past_keeper_addtime);
+    future_keeper.expect_not_run();
+    removed_keeper.expect_not_run();
+}
+
+struct BenchmarkArg {
+    bthread::TimerThread* timer_thread;
+    size_t nop;
+};
+
+void noop(void*) {}
+
+void set_flag(void* arg) {
+    static_cast<butil::atomic<bool>*>(arg)->store(true);
+}
+
+// Each thread keeps a window of timers in flight and unschedules the oldest
+// one before scheduling a new one, like timeouts of concurrent RPC.
+void* schedule_and_unschedule_timers(void* void_arg) {
+    BenchmarkArg* arg = (BenchmarkArg*)void_arg;
+    std::vector<bthread::TimerThread::TaskId> ids(
+        1024, bthread::TimerThread::INVALID_TASK_ID);
+    for (size_t i = 0; i < arg->nop; ++i) {
+        bthread::TimerThread::TaskId& id = ids[i % ids.size()];
+        if (id != bthread::TimerThread::INVALID_TASK_ID) {
+            arg->timer_thread->unschedule(id);
+        }
+        id = arg->timer_thread->schedule(
+            noop, NULL, butil::milliseconds_from_now(1000 + i % 1000));
+    }
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ids[i] != bthread::TimerThread::INVALID_TASK_ID) {
+            arg->timer_thread->unschedule(ids[i]);
+        }
+    }
+    return NULL;
+}
+
+void benchmark_timer_thread(bool use_timing_wheel) {
+    bthread::TimerThreadOptions options;
+    options.use_timing_wheel = use_timing_wheel;
+    bthread::TimerThread timer_thread;
+    ASSERT_EQ(0, timer_thread.start(&options));
+
+    BenchmarkArg arg = { &timer_thread, 200000 };
+    pthread_t th[4];
+    butil::Timer tm;
+    tm.start();
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, pthread_create(&th[i], NULL,
+                                    schedule_and_unschedule_timers, &arg));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, pthread_join(th[i], NULL));
+    }
+    tm.stop();
+    // Time for the timer thread to catch up with all scheduled tasks.
+    butil::atomic<bool> ran(false);
+    const int64_t catchup_start = butil::gettimeofday_us();
+    ASSERT_NE(bthread::TimerThread::INVALID_TASK_ID,
+              timer_thread.schedule(set_flag, &ran, butil::seconds_from_now(0)));
+    while (!ran.load()) {
+        usleep(100);
+    }
+    LOG(INFO) << (use_timing_wheel ? "wheel" : "heap")
+              << ": schedule+unschedule "
+              << tm.n_elapsed() / (arg.nop * ARRAY_SIZE(th)) << "ns/op, "
+              << "caught up in "
+              << butil::gettimeofday_us() - catchup_start << "us";
+    timer_thread.stop_and_join();
+}
+
+TEST(TimerThreadTest, heap_vs_wheel) {
+    benchmark_timer_thread(false);
+    benchmark_timer_thread(true);
+}
+
 } // end namespace
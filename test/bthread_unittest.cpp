@@ -25,9 +25,13 @@
 #include "bthread/bthread.h"
 #include "bthread/unstable.h"
 #include "bthread/task_meta.h"
+#include "bthread/task_group.h"
+#include "bthread/task_control.h"
 
 namespace bthread {
     extern __thread bthread::LocalStorage tls_bls;
+    extern BAIDU_THREAD_LOCAL TaskGroup* tls_task_group;
+    void print_workers(std::ostream& os);
 }
 
 namespace {
@@ -513,7 +517,7 @@ TEST_F(BthreadTest, bthread_usleep) {
 }
 
 static const bthread_attr_t BTHREAD_ATTR_NORMAL_WITH_SPAN =
-{ BTHREAD_STACKTYPE_NORMAL, BTHREAD_INHERIT_SPAN, NULL };
+{ BTHREAD_STACKTYPE_NORMAL, BTHREAD_INHERIT_SPAN, NULL, 0 };
 
 void* test_parent_span(void* p) {
     uint64_t *q = (uint64_t *)p;
@@ -567,4 +571,86 @@ TEST_F(BthreadTest, yield_single_thread) {
     ASSERT_EQ(0, bthread_join(tid, NULL));
 }
 
+struct WorkerSetArg {
+    int set;
+    int nset;
+    bool in_set;
+};
+
+static void* check_worker_set(void* arg) {
+    WorkerSetArg* a = static_cast<WorkerSetArg*>(arg);
+    bthread::TaskGroup* g = bthread::tls_task_group;
+    a->in_set = g->control()->in_worker_set(g, a->set, a->nset);
+    return NULL;
+}
+
+static void* start_in_worker_set_thread(void*) {
+    const int nset = 2;
+    bthread::TaskGroup* g = bthread::tls_task_group;
+    WorkerSetArg a = { 0, nset, false };
+    if (!g->control()->in_worker_set(g, 0, nset)) {
+        a.set = 1;
+    }
+    // Started in current worker immediately.
+    bthread_t tid;
+    EXPECT_EQ(0, bthread_start_in_worker_set(
+                  &tid, NULL, check_worker_set, &a, a.set, nset));
+    EXPECT_EQ(0, bthread_join(tid, NULL));
+    EXPECT_TRUE(a.in_set);
+
+    // Queued in the other set, may be stolen.
+    WorkerSetArg b = { 1 - a.set, nset, false };
+    EXPECT_EQ(0, bthread_start_in_worker_set(
+                  &tid, NULL, check_worker_set, &b, b.set, nset));
+    EXPECT_EQ(0, bthread_join(tid, NULL));
+    return NULL;
+}
+
+TEST_F(BthreadTest, start_in_worker_set) {
+    bthread_t tid;
+    ASSERT_EQ(EINVAL, bthread_start_in_worker_set(
+                  &tid, NULL, check_worker_set, NULL, 2, 2));
+    ASSERT_EQ(EINVAL, bthread_start_in_worker_set(
+                  &tid, NULL, check_worker_set, NULL, 0, 0));
+    // From non-worker.
+    WorkerSetArg a = { 1, 2, false };
+    ASSERT_EQ(0, bthread_start_in_worker_set(
+                  &tid, NULL, check_worker_set, &a, a.set, a.nset));
+    ASSERT_EQ(0, bthread_join(tid, NULL));
+
+    ASSERT_EQ(0, bthread_start_background(
+                  &tid, NULL, start_in_worker_set_thread, NULL));
+    ASSERT_EQ(0, bthread_join(tid, NULL));
+}
+
+static void* yield_many_times(void*) {
+    for (int i = 0; i < 100; ++i) {
+        bthread_yield();
+    }
+    return NULL;
+}
+
+TEST_F(BthreadTest, runqueue_wait) {
+    bthread::FLAGS_show_bthread_runqueue_wait_in_vars = true;
+    bthread_t th[8];
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, bthread_start_background(&th[i], NULL, yield_many_times, NULL));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], NULL));
+    }
+    bthread::FLAGS_show_bthread_runqueue_wait_in_vars = false;
+
+    std::ostringstream os;
+    bthread::print_workers(os);
+    LOG(INFO) << "\n" << os.str();
+    ASSERT_NE(std::string::npos, os.str().find("runqueue_wait={"));
+    ASSERT_NE(std::string::npos, os.str().find("nwakeup_failure="));
+    ASSERT_EQ(0, bvar::Variable::describe_exposed(
+                  "bthread_runqueue_wait_count", os));
+    ASSERT_EQ(0, bvar::Variable::describe_exposed("bthread_steal_count", os));
+    ASSERT_EQ(0, bvar::Variable::describe_exposed(
+                  "bthread_wakeup_failure_count", os));
+}
+
 } // namespace
@@ -16,9 +16,11 @@
 // under the License.
 
 #include <gtest/gtest.h>
+#include <gflags/gflags.h>
 #include <sys/types.h>
 #include <sys/socket.h>                // socketpair
 #include <errno.h>                     // errno
+#include <limits.h>                    // CHAR_BIT
 #include <fcntl.h>                     // O_RDONLY
 #include <butil/files/temp_file.h>      // TempFile
 #include <butil/containers/flat_map.h>
@@ -36,6 +38,9 @@
 #include "iobuf.pb.h"
 #endif   // BAZEL_TEST
 
+DECLARE_bool(iobuf_use_hugepages);
+DECLARE_bool(iobuf_use_large_blocks);
+
 namespace butil {
 namespace iobuf {
 extern void* (*blockmem_allocate)(size_t);
@@ -872,6 +877,125 @@ TEST_F(IOBufTest, cut_by_delim_perf) {
 }
 
 
+// Split `str' into blocks of random sizes.
+static void append_in_random_blocks(butil::IOBuf* buf, const std::string& str) {
+    for (size_t i = 0; i < str.size(); ) {
+        const size_t n = std::min(str.size() - i,
+                                  (size_t)butil::fast_rand_in(1, 40));
+        char* data = (char*)malloc(n);
+        memcpy(data, str.data() + i, n);
+        ASSERT_EQ(0, buf->append_user_data(data, n, free));
+        i += n;
+    }
+}
+
+TEST_F(IOBufTest, find_and_starts_with) {
+    const char alphabet[] = "ab\r\n";
+    for (int round = 0; round < 200; ++round) {
+        std::string str;
+        const size_t len = butil::fast_rand_less_than(300);
+        for (size_t i = 0; i < len; ++i) {
+            str.push_back(alphabet[butil::fast_rand_less_than(4)]);
+        }
+        butil::IOBuf b;
+        append_in_random_blocks(&b, str);
+        ASSERT_EQ(str, b.to_string());
+        const char* const patterns[] = {
+            "a", "\n", "\r\n", "ab", "\r\n\r\n", "aab\r", "", "b\r\nab\r\nba"
+        };
+        for (size_t i = 0; i < ARRAY_SIZE(patterns); ++i) {
+            const std::string pat = patterns[i];
+            for (size_t pos = 0; pos <= len + 1; pos += 7) {
+                const size_t expected = str.find(pat, pos);
+                ASSERT_EQ(expected == std::string::npos ? butil::IOBuf::npos :
+                          expected, b.find(pat, pos)) << pat << " " << pos;
+                if (pat.size() == 1) {
+                    ASSERT_EQ(expected == std::string::npos ?
+                              butil::IOBuf::npos : expected,
+                              b.find(pat[0], pos));
+                }
+            }
+        }
+        const size_t plen = butil::fast_rand_less_than(len + 2);
+        ASSERT_TRUE(b.starts_with(str.substr(0, plen)));
+        ASSERT_FALSE(b.starts_with(str + "a"));
+        if (len > 0) {
+            std::string other = str;
+            other[len - 1] = (other[len - 1] == 'a' ? 'b' : 'a');
+            ASSERT_FALSE(b.starts_with(other));
+        }
+    }
+}
+
+TEST_F(IOBufTest, cutter_find) {
+    butil::IOBuf b;
+    append_in_random_blocks(&b, "GET / HTTP/1.1\r\nHost: a\r\n\r\nbody");
+    {
+        butil::IOBufCutter cutter(&b);
+        ASSERT_EQ(14UL, cutter.find("\r\n"));
+        char buf[16];
+        ASSERT_EQ(16UL, cutter.cutn(buf, 16));
+        ASSERT_EQ(7UL, cutter.find("\r\n"));
+        ASSERT_EQ(7UL, cutter.find("\r\n\r\n"));
+        ASSERT_EQ(2UL, cutter.find('s'));
+        ASSERT_EQ(butil::IOBuf::npos, cutter.find("GET"));
+        ASSERT_EQ(0UL, cutter.find("Host"));
+    }
+    ASSERT_EQ("Host: a\r\n\r\nbody", b.to_string());
+}
+
+// The byte-by-byte loop used by cut_until before.
+static size_t find_by_signature(const butil::IOBuf& b, const char* delim) {
+    typedef unsigned long SigType;
+    const size_t ndelim = strlen(delim);
+    SigType dsig = 0;
+    for (size_t i = 0; i < ndelim; ++i) {
+        dsig = (dsig << CHAR_BIT) | static_cast<SigType>(delim[i]);
+    }
+    const SigType SIGMASK = (((SigType)1 << (ndelim * CHAR_BIT)) - 1);
+    SigType sig = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < b.backing_block_num(); ++i) {
+        const butil::StringPiece blk = b.backing_block(i);
+        for (size_t j = 0; j < blk.size(); ++j, ++n) {
+            sig = ((sig << CHAR_BIT) | static_cast<SigType>(blk[j])) & SIGMASK;
+            if (sig == dsig) {
+                return n + 1 - ndelim;
+            }
+        }
+    }
+    return butil::IOBuf::npos;
+}
+
+TEST_F(IOBufTest, find_perf) {
+    // Like a long http header or a redis simple string.
+    const size_t lens[] = { 16, 128, 1024, 64 * 1024 };
+    for (size_t k = 0; k < ARRAY_SIZE(lens); ++k) {
+        butil::IOBuf b;
+        b.append(std::string(lens[k], 'x'));
+        b.append("\r\n");
+        const size_t N = std::max((size_t)100, 10000000 / lens[k]);
+        size_t sum1 = 0;
+        size_t sum2 = 0;
+        butil::Timer t1;
+        t1.start();
+        for (size_t i = 0; i < N; ++i) {
+            sum1 += find_by_signature(b, "\r\n");
+        }
+        t1.stop();
+        butil::Timer t2;
+        t2.start();
+        for (size_t i = 0; i < N; ++i) {
+            sum2 += b.find("\r\n");
+        }
+        t2.stop();
+        ASSERT_EQ(sum1, sum2);
+        LOG(INFO) << "Find CRLF after " << lens[k] << " bytes: per-byte loop="
+                  << t1.n_elapsed() / N << "ns find=" << t2.n_elapsed() / N
+                  << "ns";
+    }
+}
+
 TEST_F(IOBufTest, cut_perf) {
     butil::iobuf::reset_blockmem_allocate_and_deallocate();
     
@@ -1706,4 +1830,117 @@ TEST_F(IOBufTest, acquire_tls_block) {
     ASSERT_NE(butil::iobuf::block_cap(b), butil::iobuf::block_size(b));
 }
 
+TEST_F(IOBufTest, append_from_fd_into_large_blocks) {
+    const size_t BLOCK_64K = 64 * 1024;
+    butil::iobuf::remove_tls_block_chain();
+    std::string data(1024 * 1024, '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (char)butil::fast_rand();
+    }
+    butil::TempFile file;
+    ASSERT_EQ(0, file.save_bin(data.data(), data.size()));
+    butil::fd_guard fd(open(file.fname(), O_RDONLY));
+    ASSERT_TRUE(fd >= 0) << file.fname() << ' ' << berror();
+
+    const size_t nblock_64k = butil::IOBuf::block_count_of_size(BLOCK_64K);
+    butil::IOPortal buf;
+    ASSERT_EQ((ssize_t)data.size(),
+              buf.append_from_file_descriptor(fd, data.size(), BLOCK_64K));
+    ASSERT_EQ(data, buf.to_string());
+    // Headers of blocks take some space, the data spans 17 blocks.
+    ASSERT_EQ(17u, buf.backing_block_num());
+    ASSERT_EQ(nblock_64k + 17, butil::IOBuf::block_count_of_size(BLOCK_64K));
+
+    // Large blocks cached in the portal are not returned to TLS.
+    buf.clear();
+    ASSERT_EQ(0, butil::iobuf::get_tls_block_count());
+    ASSERT_EQ(nblock_64k, butil::IOBuf::block_count_of_size(BLOCK_64K));
+}
+
+TEST_F(IOBufTest, hugepage_and_large_blocks) {
+    const size_t BLOCK_1M = 1024 * 1024;
+    butil::iobuf::remove_tls_block_chain();
+    const bool saved_use_hugepages = FLAGS_iobuf_use_hugepages;
+    const bool saved_use_large_blocks = FLAGS_iobuf_use_large_blocks;
+    FLAGS_iobuf_use_hugepages = true;
+    FLAGS_iobuf_use_large_blocks = true;
+    const size_t arena_mem0 = butil::IOBuf::hugepage_arena_memory();
+    const size_t nblock_1m = butil::IOBuf::block_count_of_size(BLOCK_1M);
+    const size_t nblock_64k = butil::IOBuf::block_count_of_size(64 * 1024);
+
+    std::string data(3 * BLOCK_1M + 100, '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (char)butil::fast_rand();
+    }
+    butil::IOBuf buf;
+    ASSERT_EQ(0, buf.append(data));
+    ASSERT_EQ(data, buf.to_string());
+    // 3 blocks of 1MB and the tail in a TLS block.
+    ASSERT_EQ(nblock_1m + 3, butil::IOBuf::block_count_of_size(BLOCK_1M));
+    ASSERT_EQ(nblock_64k, butil::IOBuf::block_count_of_size(64 * 1024));
+    ASSERT_EQ(4u, buf.backing_block_num());
+    // 2 arenas for 1MB blocks, 1 arena for 8KB blocks.
+    const size_t arena_mem1 = butil::IOBuf::hugepage_arena_memory();
+    ASSERT_GE(arena_mem1 - arena_mem0, 6 * BLOCK_1M);
+
+    butil::IOBuf buf2;
+    ASSERT_EQ(0, buf2.append(data.data(), 100 * 1024));
+    ASSERT_EQ(nblock_64k + 1, butil::IOBuf::block_count_of_size(64 * 1024));
+    buf.append(buf2);
+    buf2.clear();
+    buf.pop_front(data.size());
+    ASSERT_EQ(data.substr(0, 100 * 1024), buf.to_string());
+    buf.clear();
+    ASSERT_EQ(nblock_1m, butil::IOBuf::block_count_of_size(BLOCK_1M));
+    ASSERT_EQ(nblock_64k, butil::IOBuf::block_count_of_size(64 * 1024));
+
+    // Freed blocks are reused without mapping more arenas.
+    const size_t arena_mem2 = butil::IOBuf::hugepage_arena_memory();
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(0, buf.append(data));
+        buf.clear();
+    }
+    ASSERT_EQ(arena_mem2, butil::IOBuf::hugepage_arena_memory());
+
+    // Blocks allocated from arenas are still freed correctly after the
+    // flag is turned off.
+    ASSERT_EQ(0, buf.append(data));
+    FLAGS_iobuf_use_hugepages = saved_use_hugepages;
+    FLAGS_iobuf_use_large_blocks = saved_use_large_blocks;
+    buf.clear();
+    butil::iobuf::remove_tls_block_chain();
+    ASSERT_EQ(nblock_1m, butil::IOBuf::block_count_of_size(BLOCK_1M));
+}
+
+static void* clear_iobuf(void* arg) {
+    static_cast<butil::IOBuf*>(arg)->clear();
+    return NULL;
+}
+
+TEST_F(IOBufTest, hugepage_blocks_freed_by_other_threads) {
+    const bool saved_use_hugepages = FLAGS_iobuf_use_hugepages;
+    const bool saved_use_large_blocks = FLAGS_iobuf_use_large_blocks;
+    FLAGS_iobuf_use_hugepages = true;
+    FLAGS_iobuf_use_large_blocks = true;
+    std::string data(3 * 1024 * 1024, 'a');
+    butil::IOBuf buf;
+    ASSERT_EQ(0, buf.append(data));
+    buf.clear();
+
+    // Blocks cached by threads which only free blocks are returned to the
+    // global pool at exit and reused, otherwise each round maps new arenas.
+    const size_t arena_mem0 = butil::IOBuf::hugepage_arena_memory();
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_EQ(0, buf.append(data));
+        pthread_t th;
+        ASSERT_EQ(0, pthread_create(&th, NULL, clear_iobuf, &buf));
+        ASSERT_EQ(0, pthread_join(th, NULL));
+        ASSERT_TRUE(buf.empty());
+    }
+    ASSERT_LE(butil::IOBuf::hugepage_arena_memory(), arena_mem0 + 2 * 2 * 1024 * 1024);
+    FLAGS_iobuf_use_hugepages = saved_use_hugepages;
+    FLAGS_iobuf_use_large_blocks = saved_use_large_blocks;
+    butil::iobuf::remove_tls_block_chain();
+}
+
 } // namespace